@@ -0,0 +1,113 @@
+#ifndef _TABD_BASE_H
+#define _TABD_BASE_H
+
+/* Platform-neutral basics for the processing core (tablet.h, preset.h, output.h). Nothing in here
+may depend on Win32 so the core also builds with gcc/clang on Linux, see bench.c. */
+
+#ifdef _WIN32
+/* tabd.exe is built without CRT headers, declare the few bits we need by hand */
+#pragma comment(lib, "ucrt.lib")
+#pragma comment(lib, "vcruntime.lib")
+
+typedef unsigned short wchar_t;
+typedef unsigned __int64 size_t;
+typedef unsigned char bool;
+typedef signed char int8_t;
+typedef short int16_t;
+typedef int int32_t;
+typedef __int64 int64_t;
+typedef unsigned char uint8_t;
+typedef unsigned short uint16_t;
+typedef unsigned int uint32_t;
+typedef unsigned __int64 uint64_t;
+
+#define true 1
+#define false 0
+#define TRAP() __debugbreak()
+#define CACHE_ALIGNED __declspec(align(64))
+#define INLINE __forceinline
+#define offsetof(_type, _member) ((size_t)&(((_type*)0)->_member))
+
+void _ReadWriteBarrier(void);
+#pragma intrinsic(_ReadWriteBarrier)
+unsigned char _BitScanReverse64(unsigned long *index, unsigned __int64 mask);
+#pragma intrinsic(_BitScanReverse64)
+
+double __cdecl sin(double _X);
+double __cdecl cos(double _X);
+double __cdecl sqrt(double _X);
+double __cdecl pow(double _X, double _Y);
+void *memset(void *dest, int c, size_t count);
+void *memcpy(void *dest, const void *src, size_t count);
+int memcmp(const void *a, const void *b, size_t count);
+
+/* arguments are passed in 8 byte slots, va_arg() only handles types that fit in one */
+typedef char* va_list;
+#define va_start(_list, _arg) ((void)__va_start(&(_list), (_arg)))
+#define va_arg(_list, _type) (*(_type*)(((_list) += 8) - 8))
+#define va_end(_list) ((void)((_list) = (va_list)0))
+void __cdecl __va_start(va_list* , ...);
+#else
+#include <math.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#define TRAP() __builtin_trap()
+#define CACHE_ALIGNED __attribute__((aligned(64)))
+#define INLINE inline __attribute__((always_inline))
+#endif
+
+typedef struct {
+    float x, y;
+} Vec2;
+
+typedef struct {
+    int32_t x, y;
+} IVec2;
+
+/* Acquire loads and release stores for lock-free hand-offs between two threads. Plain x64 loads and
+stores already have these semantics, MSVC only has to be kept from reordering around them. */
+#ifdef _WIN32
+static uint32_t AtomicLoad32(const volatile uint32_t *p) {
+    uint32_t v = *p;
+    _ReadWriteBarrier();
+    return v;
+}
+
+static void AtomicStore32(volatile uint32_t *p, uint32_t v) {
+    _ReadWriteBarrier();
+    *p = v;
+}
+
+/* Orders plain accesses before it against plain accesses after it, for sequence locks. */
+static void AtomicFence(void) {
+    _ReadWriteBarrier();
+}
+#else
+static uint32_t AtomicLoad32(const volatile uint32_t *p) {
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+static void AtomicStore32(volatile uint32_t *p, uint32_t v) {
+    __atomic_store_n(p, v, __ATOMIC_RELEASE);
+}
+
+static void AtomicFence(void) {
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+#endif
+
+#define COUNTOF(_a) (sizeof(_a)/sizeof((_a)[0]))
+#define ASSERT(_e) do { if (!(_e)) TRAP(); } while(0)
+#define CLAMP(_v, _min, _max) ((_v) < (_min) ? (_min) : ((_v) > (_max) ? (_max) : (_v)))
+
+/* File scope only, a typedef of a negative-size array when `_e` is false. cl builds tabd.c as C89
+plus extensions, which has no _Static_assert. */
+#define STATIC_ASSERT(_e) typedef char STATIC_ASSERT_NAME(__LINE__)[(_e) ? 1 : -1]
+#define STATIC_ASSERT_NAME(_line) STATIC_ASSERT_JOIN(static_assert_line_, _line)
+#define STATIC_ASSERT_JOIN(_a, _b) _a##_b
+
+#endif /* _TABD_BASE_H */
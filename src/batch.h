@@ -0,0 +1,328 @@
+#ifndef _TABD_BATCH_H
+#define _TABD_BATCH_H
+
+#include "base.h"
+#include "tablet.h"
+#include "preset.h"
+#include "output.h"
+
+/* Batched counterpart of ParseReport() → TransformPointFixed() → DecideOutput() for reads that return
+several reports at once. Reports are kept as a structure of arrays so the mapping kernel can work on
+a few of them per instruction.
+
+The SIMD kernels evaluate the Q16 matrices in double precision. Coefficients and raw sensor units
+are integers, so while |m0 * x| + |m1 * y| + |m2| stays below 2^53 every product and sum is exact and
+flooring the result gives the same bits as the scalar `>> 16`. MapReportBatch() checks that bound
+(tightened to 2^47 so the result also fits in 32 bits) against the batch's largest raw unit rather
+than the tablet's range, which the predictor may overshoot, and maps the whole batch with the scalar
+kernel when it does not hold. Define TABD_NO_SIMD to force the scalar kernel. */
+#if !defined(TABD_NO_SIMD) && defined(__AVX2__)
+#include <immintrin.h>
+#define REPORT_BATCH_KERNEL "avx2"
+#elif !defined(TABD_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64))
+#include <emmintrin.h>
+#define REPORT_BATCH_KERNEL "sse2"
+#else
+#define REPORT_BATCH_KERNEL "scalar"
+#endif
+
+#define REPORT_BATCH_CAPACITY 1024
+
+typedef struct {
+    uint32_t count;
+    int32_t x[REPORT_BATCH_CAPACITY];
+    int32_t y[REPORT_BATCH_CAPACITY];
+    uint32_t pressure[REPORT_BATCH_CAPACITY];
+    uint32_t flags[REPORT_BATCH_CAPACITY];
+    uint64_t time_ns[REPORT_BATCH_CAPACITY]; /* when the read that carried the report completed */
+    /* filled by MapReportBatch() */
+    int32_t absolute_x[REPORT_BATCH_CAPACITY];
+    int32_t absolute_y[REPORT_BATCH_CAPACITY];
+    int32_t pixel_x[REPORT_BATCH_CAPACITY];
+    int32_t pixel_y[REPORT_BATCH_CAPACITY];
+} ReportBatch;
+
+static void StoreReport(ReportBatch *batch, uint32_t i, const TabletReport *report) {
+    batch->x[i] = report->x;
+    batch->y[i] = report->y;
+    batch->pressure[i] = report->pressure;
+    batch->flags[i] = report->flags;
+}
+
+/* The loops of ParseReportBatch() for aligned plans. They work on copies of just the parts of the
+plan they use: the batch's int32_t stores could otherwise alias the plan and force reloads, and
+copying all of it leaves too few registers for the loop. */
+static INLINE uint32_t ParseWordReports(
+    const ReportPlan *plan, const uint8_t *data, const uint8_t *last, uint32_t packet_size, uint64_t time_ns,
+    ReportBatch *batch
+) {
+    const uint8_t id = (uint8_t)plan->id.value;
+    const uint32_t status_mask = plan->status.mask, flags_mask = plan->flags.mask;
+    uint32_t count = 0;
+    for (const uint8_t *packet = data; packet <= last; packet += packet_size) {
+        uint32_t head = LoadReportWindow(packet, 0);
+        if (!IsWordReportValid(id, status_mask, head))
+            continue;
+        batch->x[count] = (int32_t)ExtractWord(packet, WORD_REPORT_X);
+        batch->y[count] = (int32_t)ExtractWord(packet, WORD_REPORT_Y);
+        batch->pressure[count] = ExtractWord(packet, WORD_REPORT_PRESSURE);
+        batch->flags[count] = head >> 8 & flags_mask;
+        batch->time_ns[count++] = time_ns;
+    }
+    return count;
+}
+
+static INLINE uint32_t ParseAlignedReports(
+    const ReportPlan *plan, const uint8_t *data, const uint8_t *last, uint32_t packet_size, uint64_t time_ns,
+    ReportBatch *batch
+) {
+    const FieldTest id = plan->id;
+    const uint32_t status_mask = plan->status.mask;
+    const FieldExtractor x = plan->x, y = plan->y, pressure = plan->pressure, flags = plan->flags;
+    uint32_t count = 0;
+    for (const uint8_t *packet = data; packet <= last; packet += packet_size) {
+        if (!IsAlignedReportValid(id, status_mask, packet))
+            continue;
+        batch->x[count] = (int32_t)ExtractAlignedField(&x, packet);
+        batch->y[count] = (int32_t)ExtractAlignedField(&y, packet);
+        batch->pressure[count] = ExtractAlignedField(&pressure, packet);
+        batch->flags[count] = ExtractAlignedField(&flags, packet);
+        batch->time_ns[count++] = time_ns;
+    }
+    return count;
+}
+
+/* Splits `data` into tablet->packet_size reports and appends the valid ones to the batch. The kind
+of plan is looked at once per read so each loop runs straight-line extraction only, up to the start
+of the last whole report. */
+uint32_t ParseReportBatch(
+    const TabletInfo *tablet, const uint8_t *data, uint32_t size, uint64_t time_ns, ReportBatch *batch
+) {
+    const ReportPlan *plan = &tablet->plan;
+    uint32_t packet_size = tablet->packet_size;
+    uint32_t limit = REPORT_BATCH_CAPACITY * packet_size;
+    size = (size < limit) ? size : limit;
+    batch->count = 0;
+    if (!packet_size || packet_size != plan->size || size < packet_size)
+        return 0;
+    const uint8_t *last = data + size - packet_size;
+
+    uint32_t count = 0;
+    if (plan->kind == REPORT_PLAN_WORDS) {
+        count = ParseWordReports(plan, data, last, packet_size, time_ns, batch);
+    } else if (plan->kind == REPORT_PLAN_ALIGNED) {
+        count = ParseAlignedReports(plan, data, last, packet_size, time_ns, batch);
+    } else {
+        TabletReport report;
+        for (const uint8_t *packet = data; packet <= last; packet += packet_size) {
+            if (ParseShiftedReport(plan, packet, &report)) {
+                StoreReport(batch, count, &report);
+                batch->time_ns[count++] = time_ns;
+            }
+        }
+    }
+    batch->count = count;
+    return count;
+}
+
+/* The preset's filter stage, in place on raw coordinates before MapReportBatch(). */
+void FilterReportBatch(const CompiledPreset *preset, FilterState *state, ReportBatch *batch) {
+    if (preset->filter.kind == FILTER_NONE)
+        return;
+
+    for (uint32_t i = 0; i < batch->count; i++) {
+        FilterPoint(&preset->filter, state, batch->time_ns[i], &batch->x[i], &batch->y[i]);
+    }
+}
+
+/* The preset's predictor, after FilterReportBatch(). */
+void PredictReportBatch(const CompiledPreset *preset, PredictorState *state, ReportBatch *batch) {
+    if (preset->predictor.kind == PREDICT_NONE)
+        return;
+
+    for (uint32_t i = 0; i < batch->count; i++) {
+        PredictPoint(&preset->predictor, state, batch->time_ns[i], &batch->x[i], &batch->y[i]);
+    }
+}
+
+/* Latest-wins coalescing for when output falls behind the tablet: a run of reports with the same
+flags (moves only) collapses into its last one. A report whose flags differ from the one before it,
+`previous_flags` for the first, is a pen or button transition and always kept, as is the last report
+before it, so every transition is output at its own position. Returns the number of reports dropped.
+Runs after FilterReportBatch() and PredictReportBatch() so their state still sees every report. */
+uint32_t CoalesceReportBatch(ReportBatch *batch, uint32_t previous_flags) {
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < batch->count; i++) {
+        bool is_transition = batch->flags[i] != previous_flags;
+        bool is_last = i + 1 == batch->count || batch->flags[i + 1] != batch->flags[i];
+        previous_flags = batch->flags[i];
+        if (!is_transition && !is_last)
+            continue;
+
+        batch->x[count] = batch->x[i];
+        batch->y[count] = batch->y[i];
+        batch->pressure[count] = batch->pressure[i];
+        batch->flags[count] = batch->flags[i];
+        batch->time_ns[count] = batch->time_ns[i];
+        count++;
+    }
+
+    uint32_t dropped = batch->count - count;
+    batch->count = count;
+    return dropped;
+}
+
+static void MapReportBatchScalar(const CompiledPreset *preset, ReportBatch *batch, uint32_t start) {
+    for (uint32_t i = start; i < batch->count; i++) {
+        IVec2 a = TransformPointFixed(preset->kind, &preset->absolute_q16, batch->x[i], batch->y[i]);
+        IVec2 p = TransformPointFixed(preset->kind, &preset->pixel_q16, batch->x[i], batch->y[i]);
+        batch->absolute_x[i] = a.x;
+        batch->absolute_y[i] = a.y;
+        batch->pixel_x[i] = p.x;
+        batch->pixel_y[i] = p.y;
+    }
+}
+
+#if defined(__AVX2__) && !defined(TABD_NO_SIMD)
+static void MapReportBatchSimd(const CompiledPreset *preset, ReportBatch *batch, uint32_t *done) {
+    const int64_t (*rows[4])[3] = {
+        &preset->absolute_q16.m[0], &preset->absolute_q16.m[1],
+        &preset->pixel_q16.m[0], &preset->pixel_q16.m[1],
+    };
+    int32_t *out[4] = { batch->absolute_x, batch->absolute_y, batch->pixel_x, batch->pixel_y };
+    __m256d c[4][3];
+    for (int r = 0; r < 4; r++) {
+        for (int k = 0; k < 3; k++) {
+            c[r][k] = _mm256_set1_pd((double)(*rows[r])[k]);
+        }
+    }
+    __m256d q16 = _mm256_set1_pd(1.0 / 65536);
+
+    uint32_t i = 0;
+    for (; i + 4 <= batch->count; i += 4) {
+        __m256d x = _mm256_cvtepi32_pd(_mm_loadu_si128((const __m128i*)(batch->x + i)));
+        __m256d y = _mm256_cvtepi32_pd(_mm_loadu_si128((const __m128i*)(batch->y + i)));
+        for (int r = 0; r < 4; r++) {
+            __m256d v = _mm256_add_pd(
+                _mm256_add_pd(_mm256_mul_pd(x, c[r][0]), _mm256_mul_pd(y, c[r][1])), c[r][2]
+            );
+            v = _mm256_floor_pd(_mm256_mul_pd(v, q16));
+            _mm_storeu_si128((__m128i*)(out[r] + i), _mm256_cvttpd_epi32(v));
+        }
+    }
+    *done = i;
+}
+#elif (defined(__SSE2__) || defined(_M_X64)) && !defined(TABD_NO_SIMD)
+/* SSE2 has no floor, truncate and step down where truncation rounded a negative value up */
+static __m128i FloorToInt32Sse2(__m128d v) {
+    __m128i t = _mm_cvttpd_epi32(v);
+    __m128i up = _mm_castpd_si128(_mm_cmpgt_pd(_mm_cvtepi32_pd(t), v));
+    return _mm_add_epi32(t, _mm_shuffle_epi32(up, _MM_SHUFFLE(3, 3, 2, 0)));
+}
+
+static void MapReportBatchSimd(const CompiledPreset *preset, ReportBatch *batch, uint32_t *done) {
+    const int64_t (*rows[4])[3] = {
+        &preset->absolute_q16.m[0], &preset->absolute_q16.m[1],
+        &preset->pixel_q16.m[0], &preset->pixel_q16.m[1],
+    };
+    int32_t *out[4] = { batch->absolute_x, batch->absolute_y, batch->pixel_x, batch->pixel_y };
+    __m128d c[4][3];
+    for (int r = 0; r < 4; r++) {
+        for (int k = 0; k < 3; k++) {
+            c[r][k] = _mm_set1_pd((double)(*rows[r])[k]);
+        }
+    }
+    __m128d q16 = _mm_set1_pd(1.0 / 65536);
+
+    uint32_t i = 0;
+    for (; i + 2 <= batch->count; i += 2) {
+        __m128d x = _mm_cvtepi32_pd(_mm_loadl_epi64((const __m128i*)(batch->x + i)));
+        __m128d y = _mm_cvtepi32_pd(_mm_loadl_epi64((const __m128i*)(batch->y + i)));
+        for (int r = 0; r < 4; r++) {
+            __m128d v = _mm_add_pd(_mm_add_pd(_mm_mul_pd(x, c[r][0]), _mm_mul_pd(y, c[r][1])), c[r][2]);
+            _mm_storel_epi64((__m128i*)(out[r] + i), FloorToInt32Sse2(_mm_mul_pd(v, q16)));
+        }
+    }
+    *done = i;
+}
+#else
+static void MapReportBatchSimd(const CompiledPreset *preset, ReportBatch *batch, uint32_t *done) {
+    (void)preset;
+    (void)batch;
+    *done = 0;
+}
+#endif
+
+/* Whether every row's |m0 * x| + |m1 * y| + |m2| stays below 2^47 for the batch's raw units: the
+sums are then exact in double precision and the result fits in 32 bits, where the SIMD conversion
+and the scalar cast agree. A CTL-672 (raw units below 2^16) on any sane area is far below it. */
+static bool IsBatchExact(const CompiledPreset *preset, const ReportBatch *batch) {
+    int64_t extent = 0;
+    for (uint32_t i = 0; i < batch->count; i++) {
+        int64_t x = batch->x[i], y = batch->y[i];
+        x = (x < 0) ? -x : x;
+        y = (y < 0) ? -y : y;
+        extent = (x > extent) ? x : extent;
+        extent = (y > extent) ? y : extent;
+    }
+
+    const uint64_t limit = 1ull << 47;
+    const FixedAffine *matrices[] = { &preset->absolute_q16, &preset->pixel_q16 };
+    for (unsigned int m = 0; m < COUNTOF(matrices); m++) {
+        for (int r = 0; r < 2; r++) {
+            uint64_t c[3];
+            for (int k = 0; k < 3; k++) {
+                int64_t v = matrices[m]->m[r][k];
+                c[k] = (v < 0) ? 0 - (uint64_t)v : (uint64_t)v;
+                if (c[k] >= limit)
+                    return false;
+            }
+            /* (c0 + c1) * extent + c2 < limit without overflowing */
+            if (extent && c[0] + c[1] > (limit - 1 - c[2]) / (uint64_t)extent)
+                return false;
+        }
+    }
+    return true;
+}
+
+void MapReportBatch(const CompiledPreset *preset, ReportBatch *batch) {
+    uint32_t done = 0;
+    if (IsBatchExact(preset, batch)) {
+        MapReportBatchSimd(preset, batch, &done);
+    }
+    MapReportBatchScalar(preset, batch, done);
+}
+
+/* Runs DecideOutput() over a mapped batch, `previous` is updated to the last report of the batch. */
+uint32_t ComputeOutputFrames(
+    const CompiledPreset *preset,
+    TabletReport *previous,
+    const ReportBatch *batch,
+    OutputFrame *frames
+) {
+    uint32_t previous_flags = previous->flags;
+    for (uint32_t i = 0; i < batch->count; i++) {
+        frames[i] = DecideOutput(
+            preset,
+            previous_flags,
+            batch->flags[i],
+            batch->pressure[i],
+            (IVec2){ batch->absolute_x[i], batch->absolute_y[i] },
+            (IVec2){ batch->pixel_x[i], batch->pixel_y[i] }
+        );
+        previous_flags = batch->flags[i];
+    }
+
+    if (batch->count) {
+        uint32_t last = batch->count - 1;
+        *previous = (TabletReport){
+            .x = batch->x[last],
+            .y = batch->y[last],
+            .pressure = batch->pressure[last],
+            .flags = batch->flags[last],
+        };
+    }
+    return batch->count;
+}
+
+#endif /* _TABD_BATCH_H */
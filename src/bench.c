@@ -0,0 +1,4182 @@
+/* tabd-bench – replays a packet stream through parse → map → output decision without a tablet or
+Windows. Built from the same platform-neutral headers tabd.c uses, see README.md. */
+#define _POSIX_C_SOURCE 200809L
+
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/inotify.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+#include <wchar.h>
+
+#include "base.h"
+#include "tablet.h"
+#include "preset.h"
+#include "output.h"
+#include "batch.h"
+#include "capture.h"
+#include "replay.h"
+#include "ring.h"
+#include "readqueue.h"
+#include "devicedb.h"
+#include "presetfile.h"
+#include "resample.h"
+#include "latency.h"
+#include "log.h"
+#include "hidraw.h"
+#include "uinput.h"
+#include "devicetable.h"
+
+#define BENCH_DEFAULT_PACKET_SIZE 10
+#define BENCH_SYNTHETIC_PACKETS   4096
+#define BENCH_DEFAULT_PACKETS     20000000ull
+#define BENCH_DEFAULT_SWEEP_STEP  5
+#define BENCH_DEFAULT_SCREEN      ((Vec2){ 1920, 1080 })
+#define BENCH_RING_READ_PACKETS   8
+#define BENCH_MOCK_RATE_HZ        8000
+#define BENCH_MOCK_REPORTS        2000000
+#define BENCH_MOCK_INPUT_BUFFERS  32      /* HidD_SetNumInputBuffers() default */
+#define BENCH_MOCK_SERVICE_NS     20000   /* reader time per completion */
+#define BENCH_MOCK_STALL_NS       4500000 /* reader preempted every BENCH_MOCK_STALL_EVERY reads */
+#define BENCH_MOCK_STALL_EVERY    500
+#define BENCH_SINK_RATE_HZ        1000
+#define BENCH_SINK_REPORTS        20000
+#define BENCH_SINK_INJECT_NS      200000    /* per injected report */
+#define BENCH_SINK_STALL_NS       25000000  /* foreground app busy once per BENCH_SINK_STALL_EVERY_NS */
+#define BENCH_SINK_STALL_EVERY_NS 250000000
+#define BENCH_RELOADS             50
+#define BENCH_RELOAD_INTERVAL_US  20000
+#define BENCH_RELOAD_BASELINE_US  500000
+#define BENCH_RELOAD_SLOW_NS      20000   /* batches taking longer than this are counted */
+#define BENCH_PRESSURE_SAMPLES    1000000
+#define BENCH_LOOKUPS             1000000
+#define BENCH_FILTER_SECONDS      60
+#define BENCH_FILTER_NOISE        3       /* raw units, about what a resting CTL-672 pen shows */
+#define BENCH_FILTER_MAX_LAG      0.05    /* s */
+#define BENCH_FILTER_REST         0.05    /* mm */
+#define BENCH_FILTER_MAX_REPORTS  200000  /* per capture, for the filter and predictor benches */
+#define BENCH_RESAMPLE_RATE       144     /* Hz, real-time resampler run */
+#define BENCH_RESAMPLE_SECONDS    2
+#define BENCH_RESAMPLE_MOVING     0.2     /* mm per frame */
+#define BENCH_LATENCY_SAMPLES     1000000
+#define BENCH_LOG_CALLS           1000000
+#define BENCH_HIDRAW_RATE_HZ      1000
+#define BENCH_HIDRAW_PACKETS      1000
+#define BENCH_UINPUT_REPEAT       20 /* passes over the stream when timing the null sink */
+#define BENCH_DEVICES_PACKETS     500 /* per device, at BENCH_HIDRAW_RATE_HZ */
+#define BENCH_MONITOR_STEP        40  /* raw units between points swept on fake monitor layouts */
+#define BENCH_MONITOR_COMPILES    1000
+#define BENCH_IDLE_SECONDS        30
+#define BENCH_IDLE_NOISE          1       /* raw units, a hand resting on the tablet */
+#define BENCH_PRESS_NOISE         8       /* raw pressure units, a nib held down in place */
+#define BENCH_INJECT_PENDING_MAX  64      /* most frames injected at once */
+#define BENCH_INJECT_SWITCHES     64      /* passes over the switch script */
+#define BENCH_CONFORM_PACKETS     4096    /* random packets per layout */
+#define BENCH_CONFORM_LAYOUTS     2000    /* random layouts */
+#define BENCH_FUZZ_INPUTS         20000   /* random inputs through the fuzz harness */
+
+static uint32_t ReadReportBits(const uint8_t *packet, ReportField field) {
+    uint32_t value = 0;
+    for (uint32_t i = 0; i < field.bit_size; i++) {
+        uint32_t bit = field.bit_offset + i;
+        value |= (uint32_t)(packet[bit / 8] >> bit % 8 & 1) << i;
+    }
+    return value;
+}
+
+static int32_t ReadSignedReportBits(const uint8_t *packet, ReportField field) {
+    uint32_t value = ReadReportBits(packet, field);
+    if (field.is_signed && field.bit_size && value >> (field.bit_size - 1) & 1) {
+        value |= ~0u << field.bit_size;
+    }
+    return (int32_t)value;
+}
+
+/* The tablet's layout read a bit at a time straight off the packet, what ParseReport() and
+ParseReportBatch() have to agree with however their plans get at the fields. */
+static bool ReferenceParseReport(const TabletInfo *tablet, const uint8_t *packet, uint32_t size, TabletReport *report) {
+    const ReportLayout *layout = &tablet->layout;
+    if (
+        size != tablet->packet_size
+        || (layout->report_id && packet[0] != layout->report_id)
+        || (layout->status.bit_size && !ReadReportBits(packet, layout->status))
+    ) {
+        return false;
+    }
+
+    *report = (TabletReport){
+        .x = ReadSignedReportBits(packet, layout->x),
+        .y = ReadSignedReportBits(packet, layout->y),
+        .pressure = ReadReportBits(packet, layout->pressure),
+        .flags = ReadReportBits(packet, layout->tip) | ReadReportBits(packet, layout->buttons) << 1,
+    };
+    return true;
+}
+
+static bool IsSameReport(const TabletReport *a, const TabletReport *b) {
+    return a->x == b->x && a->y == b->y && a->pressure == b->pressure && a->flags == b->flags;
+}
+
+/* Parses `size` bytes of back-to-back packets every way there is: each packet on its own with
+ParseReport(), the whole read with ParseReportBatch() and the reference. Returns the number of
+disagreements, a report the reference doesn't have or a different one each count. */
+static uint32_t CheckReportParsers(const TabletInfo *tablet, const uint8_t *data, uint32_t size, ReportBatch *batch) {
+    uint32_t mismatches = 0, valid = 0;
+    uint32_t packets = (tablet->packet_size) ? size / tablet->packet_size : 0;
+    ParseReportBatch(tablet, data, size, 0, batch);
+    for (uint32_t i = 0; i < packets; i++) {
+        const uint8_t *packet = data + i * tablet->packet_size;
+        TabletReport a = {0}, b = {0};
+        bool a_valid = ReferenceParseReport(tablet, packet, tablet->packet_size, &a);
+        bool b_valid = ParseReport(tablet, packet, tablet->packet_size, &b);
+        mismatches += a_valid != b_valid || (a_valid && !IsSameReport(&a, &b));
+        if (!a_valid || i >= REPORT_BATCH_CAPACITY)
+            continue;
+
+        TabletReport c = {0};
+        if (valid < batch->count) {
+            c = (TabletReport){ batch->x[valid], batch->y[valid], batch->pressure[valid], batch->flags[valid] };
+        }
+        mismatches += valid >= batch->count || !IsSameReport(&a, &c);
+        valid++;
+    }
+    return mismatches + (valid < batch->count);
+}
+
+/* A layout made of the bytes at `data`, for conformance and fuzzing: any packet size from 1 to 64
+bytes and fields anywhere, including ones CompileReportLayout() has to turn down. */
+static TabletInfo LayoutFromBytes(const uint8_t *data) {
+    TabletInfo tablet = { .packet_size = 1 + data[0] % 64 };
+    ReportLayout *layout = &tablet.layout;
+    layout->report_id = (data[1] & 1) ? data[2] : 0;
+    ReportField *fields[] = { &layout->status, &layout->x, &layout->y, &layout->pressure, &layout->tip, &layout->buttons };
+    for (unsigned int i = 0; i < COUNTOF(fields); i++) {
+        const uint8_t *f = data + 3 + 3 * i;
+        *fields[i] = (ReportField){
+            .bit_offset = (uint16_t)(f[0] | f[1] << 8) % (tablet.packet_size * 8 + 8),
+            .bit_size = f[2] % 28,
+            .is_signed = f[2] >> 7,
+        };
+    }
+    return tablet;
+}
+#define LAYOUT_BYTES 21
+
+/* One fuzz input: the first byte picks what it is, the rest is
+    < 0x80  packets for a built-in device, as a single packet and as a read
+    < 0xC0  a layout (LAYOUT_BYTES) and packets for it
+    else    a device database in text form
+Parsers have to agree with the reference on whatever they get and nothing may read out of bounds,
+which a build with -fsanitize=address catches. Disagreements trap. */
+static void FuzzParsers(const uint8_t *input, size_t size) {
+    static ReportBatch s_batch;
+    static TabletInfo s_fuzz_devices[8];
+    if (!size)
+        return;
+
+    uint8_t kind = input[0];
+    const uint8_t *data = input + 1;
+    size--;
+    TabletInfo tablet;
+    if (kind < 0x80) {
+        tablet = s_tablet_infos[kind % COUNTOF(s_tablet_infos)];
+        ASSERT(CompileReportLayout(&tablet.layout, tablet.packet_size, &tablet.plan));
+    } else if (kind < 0xC0) {
+        if (size < LAYOUT_BYTES)
+            return;
+        tablet = LayoutFromBytes(data);
+        data += LAYOUT_BYTES;
+        size -= LAYOUT_BYTES;
+        if (!CompileReportLayout(&tablet.layout, tablet.packet_size, &tablet.plan))
+            return;
+    } else {
+        uint32_t count = 0, error_line = 0;
+        if (!ParseDeviceList((const char*)data, size, s_fuzz_devices, COUNTOF(s_fuzz_devices), &count, &error_line))
+            return;
+        for (uint32_t i = 0; i < count; i++) {
+            ASSERT(CompileReportLayout(&s_fuzz_devices[i].layout, s_fuzz_devices[i].packet_size, &s_fuzz_devices[i].plan));
+        }
+        return;
+    }
+
+    /* the packet is copied to its exact size so a read past it is one past the allocation */
+    uint32_t packet_size = (size < UINT32_MAX) ? (uint32_t)size : UINT32_MAX;
+    uint8_t *packet = malloc(packet_size + !packet_size);
+    ASSERT(packet);
+    memcpy(packet, data, packet_size);
+    TabletReport a, b;
+    bool a_valid = ReferenceParseReport(&tablet, packet, packet_size, &a);
+    bool b_valid = ParseReport(&tablet, packet, packet_size, &b);
+    ASSERT(a_valid == b_valid && (!a_valid || IsSameReport(&a, &b)));
+    ASSERT(!CheckReportParsers(&tablet, packet, packet_size, &s_batch));
+    free(packet);
+}
+
+#ifdef TABD_FUZZ
+/* libFuzzer's entry point, built with -DTABD_FUZZ -fsanitize=fuzzer,address in place of main(). */
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+    FuzzParsers(data, size);
+    return 0;
+}
+#else
+
+static DeviceDatabase s_devices;
+static volatile sig_atomic_t s_latency_requested; /* SIGUSR1 */
+static volatile sig_atomic_t s_input_stopping;    /* SIGINT, -i */
+
+typedef struct {
+    uint8_t *data;
+    size_t size;
+    uint32_t packet_size;
+} PacketStream;
+
+static uint64_t NowNs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static struct timespec NsToTimespec(uint64_t ns) {
+    return (struct timespec){ .tv_sec = ns / 1000000000ull, .tv_nsec = ns % 1000000000ull };
+}
+
+static void SleepUs(uint64_t us) {
+    struct timespec ts = { .tv_sec = us / 1000000, .tv_nsec = us % 1000000 * 1000 };
+    while (nanosleep(&ts, &ts)) {}
+}
+
+static int CompareUint64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+    return (x > y) - (x < y);
+}
+
+/* Wacom CTL-672 style strokes: circles over the whole surface with the pen periodically lifted and
+the lower barrel button clicked now and then. */
+static PacketStream GenerateSyntheticStream(void) {
+    PacketStream s = { .packet_size = 10, .size = BENCH_SYNTHETIC_PACKETS * 10 };
+    s.data = calloc(1, s.size);
+    ASSERT(s.data);
+
+    for (int i = 0; i < BENCH_SYNTHETIC_PACKETS; i++) {
+        uint8_t *p = s.data + i * s.packet_size;
+        double t = i / (double)BENCH_SYNTHETIC_PACKETS * 2 * 3.14159265358979;
+        uint16_t x = (uint16_t)((0.5 + 0.45 * cos(t * 7)) * 0x5460);
+        uint16_t y = (uint16_t)((0.5 + 0.45 * sin(t * 5)) * 0x34BC);
+        uint16_t pressure = (uint16_t)((0.5 + 0.5 * sin(t * 31)) * 2047);
+        bool down = (i / 256) % 4 != 3;
+        bool b1 = (i / 64) % 32 == 7;
+
+        p[0] = 0x02;
+        p[1] = 0xE0 | (down ? TABLET_REPORT_POINTER_DOWN : 0) | (b1 ? TABLET_REPORT_BUTTON_DOWN(0) : 0);
+        p[2] = x & 0xFF; p[3] = x >> 8;
+        p[4] = y & 0xFF; p[5] = y >> 8;
+        p[6] = (down ? pressure : 0) & 0xFF; p[7] = (down ? pressure : 0) >> 8;
+    }
+    return s;
+}
+
+static uint8_t *ReadWholeFile(const char *path, size_t *size) {
+    FILE *f = fopen(path, "rb");
+    if (!f)
+        return 0;
+
+    fseek(f, 0, SEEK_END);
+    long length = ftell(f);
+    fseek(f, 0, SEEK_SET);
+
+    uint8_t *data = (length > 0) ? malloc(length) : 0;
+    if (data && fread(data, 1, length, f) != (size_t)length) {
+        free(data);
+        data = 0;
+    }
+    fclose(f);
+    *size = (length > 0) ? length : 0;
+    return data;
+}
+
+/* Either a capture recorded with `tabd.exe --record` (the tablet is picked by the VID/PID of its first
+record) or a raw stream of back-to-back fixed size reports, e.g. `cat /dev/hidrawN > capture.bin`. */
+static bool LoadStream(const char *path, uint32_t packet_size, PacketStream *s, TabletInfo *tablet) {
+    size_t size = 0;
+    uint8_t *data = ReadWholeFile(path, &size);
+    if (!data)
+        return false;
+
+    if (!IsCaptureHeaderValid(data, size)) {
+        FindTabletInfo(&s_devices, s_tablet_infos[0].vid, s_tablet_infos[0].pid, tablet);
+        *s = (PacketStream){ .data = data, .packet_size = packet_size, .size = size - size % packet_size };
+        return s->size != 0;
+    }
+
+    size_t offset = sizeof(CaptureHeader);
+    CaptureRecord record;
+    if (!ReadCaptureRecord(data, size, &offset, &record) || !FindTabletInfo(&s_devices, record.vid, record.pid, tablet)) {
+        free(data);
+        return false;
+    }
+
+    /* payloads are never larger than their records, compacting in place is safe */
+    *s = (PacketStream){ .data = data, .packet_size = tablet->packet_size };
+    offset = sizeof(CaptureHeader);
+    while (ReadCaptureRecord(data, size, &offset, &record)) {
+        if (record.vid != tablet->vid || record.pid != tablet->pid || record.size % s->packet_size)
+            continue;
+        memmove(s->data + s->size, record.packet, record.size);
+        s->size += record.size;
+    }
+    return s->size != 0;
+}
+
+/* A stream as a capture in memory, one record per report at the CTL-672's ~133 Hz report rate. */
+static uint8_t *StreamToCapture(const PacketStream *s, const TabletInfo *tablet, size_t *size) {
+    uint64_t packets = s->size / s->packet_size;
+    *size = sizeof(CaptureHeader) + packets * CAPTURE_RECORD_SIZE(s->packet_size);
+    uint8_t *data = malloc(*size);
+    ASSERT(data);
+
+    CaptureHeader header;
+    InitCaptureHeader(&header);
+    memcpy(data, &header, sizeof(header));
+    size_t offset = sizeof(header);
+    for (uint64_t i = 0; i < packets; i++) {
+        offset += WriteCaptureRecord(
+            data + offset, i * 7500000ull, tablet->vid, tablet->pid, s->data + i * s->packet_size, s->packet_size
+        );
+    }
+    return data;
+}
+
+static bool WriteCapture(const char *path, const PacketStream *s, const TabletInfo *tablet) {
+    size_t size;
+    uint8_t *data = StreamToCapture(s, tablet, &size);
+    FILE *f = fopen(path, "wb");
+    bool ok = f && fwrite(data, 1, size, f) == size;
+    if (f) {
+        ok &= !fclose(f);
+    }
+    free(data);
+    return ok;
+}
+
+static void PrintRate(const char *what, const wchar_t *preset, uint64_t count, uint64_t elapsed) {
+    printf(
+        "%-12s %-10ls %10.2f Mpackets/s %8.2f ns/packet",
+        what, preset, count / (elapsed / 1e9) / 1e6, elapsed / (double)count
+    );
+}
+
+static uint32_t FrameChecksum(const OutputFrame *frame) {
+    return (uint32_t)frame->absolute.x ^ (uint32_t)frame->absolute.y ^ (uint32_t)frame->pixel.x
+        ^ (uint32_t)frame->pixel.y ^ frame->pressure ^ frame->flags;
+}
+
+/* The hand-written parser the CTL-672 layout in tablet.h replaced, kept as the reference. */
+static bool WacomCTL672PacketParser(const uint8_t *packet, uint32_t size, TabletReport *report) {
+    if (size != 10 || packet[0] != 0x02 || (packet[1] == 0x00 || packet[1] == 0x80))
+        return false;
+
+    uint16_t x, y, pressure;
+    memcpy(&x, packet + 2, sizeof(x));
+    memcpy(&y, packet + 4, sizeof(y));
+    memcpy(&pressure, packet + 6, sizeof(pressure));
+    *report = (TabletReport){ .x = x, .y = y, .pressure = pressure, .flags = packet[1] & 0x0F };
+    return true;
+}
+
+static uint32_t ReportChecksum(const TabletReport *report) {
+    return (uint32_t)report->x ^ (uint32_t)report->y << 7 ^ report->pressure << 13 ^ report->flags << 29;
+}
+
+/* ParseReport() with the compiled layout against the hand-written parser: same reports for every
+status byte and the stream, and how long each of them takes per packet. */
+static bool BenchParsers(const PacketStream *s, const TabletInfo *tablet, uint64_t count) {
+    if (tablet->vid != s_tablet_infos[0].vid || tablet->pid != s_tablet_infos[0].pid || s->packet_size != 10)
+        return true;
+
+    uint64_t mismatches = 0;
+    for (uint32_t i = 0; i < 4 * 256; i++) {
+        uint8_t packet[10] = { i >> 8, i & 0xFF, i * 7, i * 13, i * 17, i * 19, i * 23, i * 29, 0xFF, 0xFF };
+        TabletReport a = {0}, b = {0};
+        bool a_valid = WacomCTL672PacketParser(packet, sizeof(packet), &a);
+        bool b_valid = ParseReport(tablet, packet, sizeof(packet), &b);
+        mismatches += a_valid != b_valid || (a_valid && memcmp(&a, &b, sizeof(a)));
+    }
+
+    /* one report at a time, then reads of BENCH_RING_READ_PACKETS reports like tabd.exe gets */
+    uint64_t stream_packets = s->size / s->packet_size;
+    uint32_t checksums[4] = {0};
+    ReportBatch *batch = malloc(sizeof(*batch));
+    ASSERT(batch);
+    for (int run = 0; run < 4; run++) {
+        bool plan = run & 1, batched = run & 2;
+        uint32_t checksum = 0;
+        uint64_t start = NowNs();
+        /* a loop per parser, so that neither runs the other's branch and ParseReport()'s plan can be
+        kept out of the loop like the hand-written parser's constants, the checksum is a local for
+        the same reason */
+        for (uint64_t i = 0; !batched && plan && i < count; i++) {
+            const uint8_t *packet = s->data + (i % stream_packets) * s->packet_size;
+            TabletReport report;
+            bool valid = ParseReport(tablet, packet, s->packet_size, &report);
+            checksum += (valid) ? ReportChecksum(&report) : 1;
+        }
+        for (uint64_t i = 0; !batched && !plan && i < count; i++) {
+            const uint8_t *packet = s->data + (i % stream_packets) * s->packet_size;
+            TabletReport report;
+            bool valid = WacomCTL672PacketParser(packet, s->packet_size, &report);
+            checksum += (valid) ? ReportChecksum(&report) : 1;
+        }
+
+        for (uint64_t done = 0, index = 0; batched && done < count; ) {
+            uint64_t n = BENCH_RING_READ_PACKETS;
+            n = (n < stream_packets - index) ? n : stream_packets - index;
+            n = (n < count - done) ? n : count - done;
+
+            const uint8_t *data = s->data + index * s->packet_size;
+            if (plan) {
+                ParseReportBatch(tablet, data, n * s->packet_size, done, batch);
+            } else {
+                /* fills the same fields as ParseReportBatch() */
+                uint32_t valid = 0;
+                for (uint32_t i = 0; i < n; i++) {
+                    TabletReport report;
+                    if (WacomCTL672PacketParser(data + i * s->packet_size, s->packet_size, &report)) {
+                        StoreReport(batch, valid, &report);
+                        batch->time_ns[valid++] = done;
+                    }
+                }
+                batch->count = valid;
+            }
+            for (uint32_t i = 0; i < batch->count; i++) {
+                TabletReport report = { batch->x[i], batch->y[i], batch->pressure[i], batch->flags[i] };
+                checksum += ReportChecksum(&report);
+            }
+            checksum += n - batch->count;
+
+            done += n;
+            index = (index + n) % stream_packets;
+        }
+
+        static const char *s_names[] = { "parse hand", "parse plan", "parse hand 8", "parse plan 8" };
+        PrintRate(s_names[run], L"", count, NowNs() - start);
+        printf("  (checksum %08x)\n", checksum);
+        checksums[run] = checksum;
+    }
+    free(batch);
+
+    bool ok = !mismatches && checksums[0] == checksums[1] && checksums[0] == checksums[2]
+        && checksums[0] == checksums[3];
+    printf(
+        "parse plan matches hand-written parser: %s (%llu of 1024 status bytes differ)\n",
+        (ok) ? "OK" : "MISMATCH",
+        (unsigned long long)mismatches
+    );
+    return ok;
+}
+
+/* Layouts no built-in device has, so conformance and throughput also cover plans that shift fields
+into place and sign-extend them, and aligned ones with the fields elsewhere than the CTL-672's. */
+static const TabletInfo s_synthetic_tablets[] = {
+    {
+        "aligned 24-bit", 0x7464, 0x0100, { 100, 60 }, 0xFFFFFF, 0xFFFFFF, 4095, 14, {0}, 0,
+        {
+            .report_id = 0x07,
+            .status = { 16, 8 },
+            .x = { 24, 24 },
+            .y = { 48, 24 },
+            .pressure = { 72, 12 },
+            .tip = { 8, 1 },
+            .buttons = { 9, 2 },
+        },
+        {0},
+    },
+    {
+        "packed 12-bit", 0x7464, 0x0101, { 100, 60 }, 4095, 4095, 1023, 8, {0}, 0,
+        {
+            .report_id = 0x05,
+            .status = { 8, 1 },
+            .x = { 12, 12 },
+            .y = { 24, 12 },
+            .pressure = { 36, 10 },
+            .tip = { 8, 1 },
+            .buttons = { 46, 2 },
+        },
+        {0},
+    },
+    {
+        "signed 14-bit", 0x7464, 0x0102, { 100, 60 }, 8191, 8191, 8191, 8, {0}, 0,
+        {
+            .status = { 0, 2 },
+            .x = { 2, 14, true },
+            .y = { 16, 14, true },
+            .pressure = { 32, 13 },
+            .tip = { 45, 1 },
+            .buttons = { 50, 2 },
+        },
+        {0},
+    },
+};
+
+/* Known answers for the CTL-672: byte 1 is the status (0 and 0x80 out of range) with the tip and the
+buttons in its low nibble, then X, Y and pressure as 16-bit little-endian values. */
+static const struct {
+    uint8_t packet[10];
+    uint32_t size;
+    bool valid;
+    TabletReport report;
+} s_golden_ctl672[] = {
+    { { 0x02, 0xE1, 0x34, 0x12, 0x78, 0x56, 0x00, 0x02 }, 10, true, { 0x1234, 0x5678, 0x200, 0x1 } },
+    { { 0x02, 0xE0, 0x60, 0x54, 0xBC, 0x34, 0x00, 0x00 }, 10, true, { 0x5460, 0x34BC, 0, 0 } },
+    { { 0x02, 0xE7, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x07 }, 10, true, { 0xFFFF, 0xFFFF, 0x7FF, 0x7 } },
+    { { 0x02, 0x8F, 0x01, 0x00, 0x02, 0x00, 0x03, 0x00 }, 10, true, { 1, 2, 3, 0xF } },
+    { { 0x02, 0x40, 0x10, 0x00, 0x20, 0x00, 0x30, 0x00 }, 10, true, { 0x10, 0x20, 0x30, 0 } },
+    { { 0x02, 0x00, 0x34, 0x12, 0x78, 0x56, 0x00, 0x02 }, 10, false, {0} },
+    { { 0x02, 0x80, 0x34, 0x12, 0x78, 0x56, 0x00, 0x02 }, 10, false, {0} },
+    { { 0x03, 0xE1, 0x34, 0x12, 0x78, 0x56, 0x00, 0x02 }, 10, false, {0} },
+    { { 0x00, 0xE1, 0x34, 0x12, 0x78, 0x56, 0x00, 0x02 }, 10, false, {0} },
+    { { 0x02, 0xE1, 0x34, 0x12, 0x78, 0x56, 0x00, 0x02 }, 9, false, {0} },
+    { { 0x02, 0xE1, 0x34, 0x12, 0x78, 0x56, 0x00, 0x02 }, 4, false, {0} },
+};
+
+/* A packet the layout takes, or half the time one it may not: random bytes with the report ID and
+a non-zero status, or left as they are. */
+static void RandomReportPacket(const TabletInfo *tablet, uint32_t *seed, bool valid, uint8_t *packet) {
+    for (uint32_t i = 0; i < tablet->packet_size; i++) {
+        *seed = *seed * 1664525u + 1013904223u;
+        packet[i] = *seed >> 24;
+    }
+    const ReportLayout *layout = &tablet->layout;
+    if (valid && layout->report_id) {
+        packet[0] = layout->report_id;
+    }
+    if (valid && layout->status.bit_size) {
+        packet[layout->status.bit_offset / 8] |= 1 << layout->status.bit_offset % 8;
+    }
+}
+
+/* Every device in the database, the synthetic layouts and BENCH_CONFORM_LAYOUTS random ones through
+every parser against the reference, plus the CTL-672's known answers. */
+static bool BenchParserConformance(void) {
+    ReportBatch *batch = malloc(sizeof(*batch));
+    uint8_t *data = malloc(BENCH_CONFORM_PACKETS * 64);
+    ASSERT(batch && data);
+
+    uint32_t golden = 0;
+    for (unsigned int i = 0; i < COUNTOF(s_golden_ctl672); i++) {
+        TabletInfo tablet;
+        TabletReport report = {0};
+        bool valid =
+            FindTabletInfo(&s_devices, s_tablet_infos[0].vid, s_tablet_infos[0].pid, &tablet)
+            && ParseReport(&tablet, s_golden_ctl672[i].packet, s_golden_ctl672[i].size, &report);
+        golden += valid != s_golden_ctl672[i].valid || (valid && !IsSameReport(&report, &s_golden_ctl672[i].report));
+    }
+    printf(
+        "conform %-24s: %u known answers, %u mismatches (%s)\n",
+        s_tablet_infos[0].name,
+        (unsigned int)COUNTOF(s_golden_ctl672),
+        golden,
+        (golden) ? "MISMATCH" : "OK"
+    );
+    bool ok = !golden;
+
+    uint32_t seed = 1234;
+    uint32_t random_layouts = 0, random_mismatches = 0;
+    uint32_t tablet_count = s_devices.count + COUNTOF(s_synthetic_tablets);
+    for (uint32_t t = 0; t < tablet_count + BENCH_CONFORM_LAYOUTS; t++) {
+        TabletInfo tablet;
+        if (t < s_devices.count) {
+            const TabletInfo *d = &s_devices.devices[t];
+            if (!FindTabletInfo(&s_devices, d->vid, d->pid, &tablet))
+                continue;
+        } else if (t < tablet_count) {
+            tablet = s_synthetic_tablets[t - s_devices.count];
+            ASSERT(CompileReportLayout(&tablet.layout, tablet.packet_size, &tablet.plan));
+        } else {
+            uint8_t bytes[LAYOUT_BYTES];
+            RandomReportPacket(&(TabletInfo){ .packet_size = sizeof(bytes) }, &seed, false, bytes);
+            tablet = LayoutFromBytes(bytes);
+            if (!CompileReportLayout(&tablet.layout, tablet.packet_size, &tablet.plan))
+                continue;
+        }
+
+        for (uint32_t i = 0; i < BENCH_CONFORM_PACKETS; i++) {
+            RandomReportPacket(&tablet, &seed, i & 1, data + i * tablet.packet_size);
+        }
+        /* reads of any number of packets, with and without a partial packet at the end */
+        uint32_t mismatches = 0;
+        for (uint32_t offset = 0, n = 1; offset < BENCH_CONFORM_PACKETS; offset += n, n = n % 70 + 1) {
+            uint32_t packets = (n < BENCH_CONFORM_PACKETS - offset) ? n : BENCH_CONFORM_PACKETS - offset;
+            uint32_t size = packets * tablet.packet_size - (n % 3 == 0 && tablet.packet_size > 1);
+            mismatches += CheckReportParsers(&tablet, data + offset * tablet.packet_size, size, batch);
+        }
+        for (uint32_t i = 0; i < 64; i++) {
+            TabletReport report;
+            uint32_t size = tablet.packet_size + 1 + i % 3 - 2 * (i % 2);
+            mismatches += size != tablet.packet_size && ParseReport(&tablet, data, size, &report);
+        }
+        ok &= !mismatches;
+
+        if (t < tablet_count) {
+            static const char *s_plan_kinds[] = { "shifting", "aligned", "16-bit word" };
+            printf(
+                "conform %-24s: %u packets of %u bytes, %s plan, %u mismatches (%s)\n",
+                tablet.name,
+                BENCH_CONFORM_PACKETS,
+                tablet.packet_size,
+                s_plan_kinds[tablet.plan.kind],
+                mismatches,
+                (mismatches) ? "MISMATCH" : "OK"
+            );
+        } else {
+            random_layouts++;
+            random_mismatches += mismatches;
+        }
+    }
+    printf(
+        "conform %-24s: %u of %u compiled, %u mismatches (%s)\n",
+        "random layouts",
+        random_layouts,
+        BENCH_CONFORM_LAYOUTS,
+        random_mismatches,
+        (random_mismatches) ? "MISMATCH" : "OK"
+    );
+
+    free(data);
+    free(batch);
+    return ok;
+}
+
+/* ParseReport() against the hand-written CTL-672 parser packet by packet: random packets, half of
+them with the report ID and some of the wrong size, the known answers and every packet of the
+stream, which are real ones when it comes from a CTL-672 capture. */
+static bool BenchHandParserConformance(const PacketStream *s, const TabletInfo *stream_tablet) {
+    TabletInfo tablet;
+    if (!FindTabletInfo(&s_devices, s_tablet_infos[0].vid, s_tablet_infos[0].pid, &tablet))
+        return true;
+
+    uint32_t mismatches = 0, random = BENCH_CONFORM_PACKETS * 16, seed = 99;
+    for (uint32_t i = 0; i < random; i++) {
+        uint8_t packet[11];
+        RandomReportPacket(&(TabletInfo){ .packet_size = sizeof(packet) }, &seed, false, packet);
+        if (i & 1) {
+            packet[0] = 0x02;
+        }
+        uint32_t size = (i % 16 == 3) ? 9 + i / 16 % 3 : 10;
+        TabletReport a = {0}, b = {0};
+        bool a_valid = WacomCTL672PacketParser(packet, size, &a);
+        bool b_valid = ParseReport(&tablet, packet, size, &b);
+        mismatches += a_valid != b_valid || (a_valid && !IsSameReport(&a, &b));
+    }
+
+    for (unsigned int i = 0; i < COUNTOF(s_golden_ctl672); i++) {
+        TabletReport a = {0}, b = {0};
+        bool a_valid = WacomCTL672PacketParser(s_golden_ctl672[i].packet, s_golden_ctl672[i].size, &a);
+        bool b_valid = ParseReport(&tablet, s_golden_ctl672[i].packet, s_golden_ctl672[i].size, &b);
+        mismatches += a_valid != b_valid || (a_valid && !IsSameReport(&a, &b));
+    }
+
+    uint64_t stream_packets = 0;
+    if (stream_tablet->vid == tablet.vid && stream_tablet->pid == tablet.pid && s->packet_size == tablet.packet_size) {
+        stream_packets = s->size / s->packet_size;
+    }
+    for (uint64_t i = 0; i < stream_packets; i++) {
+        const uint8_t *packet = s->data + i * s->packet_size;
+        TabletReport a = {0}, b = {0};
+        bool a_valid = WacomCTL672PacketParser(packet, s->packet_size, &a);
+        bool b_valid = ParseReport(&tablet, packet, s->packet_size, &b);
+        mismatches += a_valid != b_valid || (a_valid && !IsSameReport(&a, &b));
+    }
+
+    printf(
+        "conform %-24s: %u random, %u known and %llu stream packets against the hand-written parser, "
+        "%u mismatches (%s)\n",
+        tablet.name,
+        random,
+        (unsigned int)COUNTOF(s_golden_ctl672),
+        (unsigned long long)stream_packets,
+        mismatches,
+        (mismatches) ? "MISMATCH" : "OK"
+    );
+    return !mismatches;
+}
+
+/* Parse throughput of every device in the database and the synthetic layouts, on packets the layout
+takes: reads of BENCH_RING_READ_PACKETS with ParseReportBatch(), single packets with ParseReport()
+and the bit by bit reference for scale. */
+static bool BenchParserThroughput(uint64_t count) {
+    ReportBatch *batch = malloc(sizeof(*batch));
+    uint8_t *data = malloc(BENCH_CONFORM_PACKETS * 64);
+    ASSERT(batch && data);
+
+    bool ok = true;
+    uint32_t seed = 4321;
+    uint32_t tablet_count = s_devices.count + COUNTOF(s_synthetic_tablets);
+    for (uint32_t t = 0; t < tablet_count; t++) {
+        TabletInfo tablet;
+        if (t < s_devices.count) {
+            const TabletInfo *d = &s_devices.devices[t];
+            if (!FindTabletInfo(&s_devices, d->vid, d->pid, &tablet))
+                continue;
+        } else {
+            tablet = s_synthetic_tablets[t - s_devices.count];
+            ASSERT(CompileReportLayout(&tablet.layout, tablet.packet_size, &tablet.plan));
+        }
+        for (uint32_t i = 0; i < BENCH_CONFORM_PACKETS; i++) {
+            RandomReportPacket(&tablet, &seed, true, data + i * tablet.packet_size);
+        }
+
+        uint32_t checksums[3] = {0};
+        for (int run = 0; run < 3; run++) {
+            uint64_t start = NowNs();
+            for (uint64_t done = 0; done < count; ) {
+                uint64_t index = done % BENCH_CONFORM_PACKETS;
+                uint64_t n = BENCH_RING_READ_PACKETS;
+                n = (n < BENCH_CONFORM_PACKETS - index) ? n : BENCH_CONFORM_PACKETS - index;
+                n = (n < count - done) ? n : count - done;
+                const uint8_t *read = data + index * tablet.packet_size;
+                if (run == 0) {
+                    ParseReportBatch(&tablet, read, n * tablet.packet_size, 0, batch);
+                    for (uint32_t i = 0; i < batch->count; i++) {
+                        TabletReport report = { batch->x[i], batch->y[i], batch->pressure[i], batch->flags[i] };
+                        checksums[run] += ReportChecksum(&report);
+                    }
+                } else {
+                    for (uint32_t i = 0; i < n; i++) {
+                        TabletReport report;
+                        const uint8_t *packet = read + i * tablet.packet_size;
+                        bool valid = (run == 1)
+                            ? ParseReport(&tablet, packet, tablet.packet_size, &report)
+                            : ReferenceParseReport(&tablet, packet, tablet.packet_size, &report);
+                        checksums[run] += (valid) ? ReportChecksum(&report) : 0;
+                    }
+                }
+                done += n;
+            }
+            uint64_t elapsed = NowNs() - start;
+
+            static const char *s_runs[] = { "batch 8", "single", "reference" };
+            printf(
+                "parse %-24s %-10s %10.2f Mpackets/s %8.2f ns/packet  (checksum %08x)\n",
+                tablet.name,
+                s_runs[run],
+                count / (elapsed / 1e9) / 1e6,
+                elapsed / (double)count,
+                checksums[run]
+            );
+        }
+        ok &= checksums[0] == checksums[1] && checksums[0] == checksums[2];
+    }
+
+    free(data);
+    free(batch);
+    return ok;
+}
+
+/* Random inputs through FuzzParsers(), a smoke test of the harness rather than a fuzzing run. */
+static void BenchFuzzHarness(void) {
+    uint8_t input[256];
+    uint32_t seed = 777;
+    uint64_t start = NowNs();
+    for (uint32_t i = 0; i < BENCH_FUZZ_INPUTS; i++) {
+        seed = seed * 1664525u + 1013904223u;
+        uint32_t size = seed >> 24;
+        RandomReportPacket(&(TabletInfo){ .packet_size = size }, &seed, false, input);
+        if (size > 1 && i % 4 == 0) {
+            input[0] &= 0x7F;
+            input[1] = 0x02;
+        }
+        FuzzParsers(input, size);
+    }
+    printf(
+        "fuzz    %-24s: %u inputs in %.1f ms, none trapped (OK)\n",
+        "random",
+        BENCH_FUZZ_INPUTS,
+        (NowNs() - start) / 1e6
+    );
+}
+
+/* What a capture's reports are, one line per report as the reference parses them, for -G to write
+and -g to compare: `vid:pid x y pressure flags`. Records of devices the database doesn't have are
+left out. `parser` 0 is ParseReportBatch(), 1 ParseReport() and 2 the reference. */
+static char *DescribeCaptureReports(const uint8_t *capture, size_t size, int parser, size_t *length) {
+    ReportBatch *batch = malloc(sizeof(*batch));
+    size_t capacity = size * 16 + 256;
+    char *text = malloc(capacity);
+    ASSERT(batch && text);
+
+    uint64_t packets = 0, reports = 0;
+    size_t n = 0;
+    size_t offset = sizeof(CaptureHeader);
+    CaptureRecord record;
+    TabletInfo tablet = {0};
+    while (IsCaptureHeaderValid(capture, size) && ReadCaptureRecord(capture, size, &offset, &record)) {
+        if ((record.vid != tablet.vid || record.pid != tablet.pid) && !FindTabletInfo(&s_devices, record.vid, record.pid, &tablet))
+            continue;
+
+        uint32_t count = record.size / tablet.packet_size;
+        if (parser == 0) {
+            ParseReportBatch(&tablet, record.packet, record.size, 0, batch);
+        } else {
+            batch->count = 0;
+            for (uint32_t i = 0; i < count && i < REPORT_BATCH_CAPACITY; i++) {
+                TabletReport report;
+                const uint8_t *packet = record.packet + i * tablet.packet_size;
+                bool valid = (parser == 1)
+                    ? ParseReport(&tablet, packet, tablet.packet_size, &report)
+                    : ReferenceParseReport(&tablet, packet, tablet.packet_size, &report);
+                if (valid) {
+                    StoreReport(batch, batch->count++, &report);
+                }
+            }
+        }
+        for (uint32_t i = 0; i < batch->count; i++) {
+            n += snprintf(
+                text + n, capacity - n, "%04x:%04x %d %d %u %u\n",
+                record.vid, record.pid, batch->x[i], batch->y[i], batch->pressure[i], batch->flags[i]
+            );
+        }
+        packets += count;
+        reports += batch->count;
+    }
+    n += snprintf(
+        text + n, capacity - n, "%llu packets, %llu reports\n",
+        (unsigned long long)packets, (unsigned long long)reports
+    );
+
+    free(batch);
+    *length = n;
+    return text;
+}
+
+/* -G writes the reference's view of a capture, -g checks every parser against one written before.
+A difference is reported by line, which is a report. */
+static bool RunGolden(const char *capture_path, const char *golden_path, bool write) {
+    size_t size = 0, golden_size = 0;
+    uint8_t *capture = ReadWholeFile(capture_path, &size);
+    if (!capture || !IsCaptureHeaderValid(capture, size)) {
+        fprintf(stderr, "\"%s\" is not a capture\n", capture_path);
+        free(capture);
+        return false;
+    }
+
+    bool ok = true;
+    size_t lengths[3];
+    char *texts[3];
+    for (int parser = 0; parser < 3; parser++) {
+        texts[parser] = DescribeCaptureReports(capture, size, parser, &lengths[parser]);
+    }
+    char *golden = 0;
+    if (write) {
+        FILE *f = fopen(golden_path, "wb");
+        ok = f && fwrite(texts[2], 1, lengths[2], f) == lengths[2];
+        ok &= f && !fclose(f);
+        if (!ok) {
+            fprintf(stderr, "failed to write \"%s\"\n", golden_path);
+        }
+    } else {
+        golden = (char*)ReadWholeFile(golden_path, &golden_size);
+        if (!golden) {
+            fprintf(stderr, "failed to load \"%s\"\n", golden_path);
+            ok = false;
+        }
+    }
+
+    static const char *s_parsers[] = { "ParseReportBatch()", "ParseReport()", "reference" };
+    const char *expected = (!ok) ? 0 : (golden) ? golden : texts[2];
+    size_t expected_size = (golden) ? golden_size : lengths[2];
+    for (int parser = 0; expected && parser < 3; parser++) {
+        size_t i = 0;
+        uint32_t line = 1;
+        for (; i < lengths[parser] && i < expected_size && texts[parser][i] == expected[i]; i++) {
+            line += expected[i] == '\n';
+        }
+        bool same = i == lengths[parser] && i == expected_size;
+        printf("golden %-18s: %s", s_parsers[parser], (same) ? "OK\n" : "MISMATCH");
+        if (!same) {
+            printf(" from line %u\n", line);
+        }
+        ok &= same;
+    }
+
+    free(golden);
+    for (int parser = 0; parser < 3; parser++) {
+        free(texts[parser]);
+    }
+    free(capture);
+    return ok;
+}
+
+static uint32_t BenchPipeline(const PacketStream *s, const TabletInfo *tablet, const Preset *preset, Vec2 screen, uint64_t count) {
+    uint64_t stream_packets = s->size / s->packet_size;
+    uint64_t parsed = 0, mouse = 0, pen = 0;
+    uint32_t checksum = 0;
+    TabletReport previous = {0};
+    CompiledPreset compiled = CompilePreset(preset, tablet, screen.x, screen.y);
+
+    uint64_t start = NowNs();
+    for (uint64_t i = 0; i < count; i++) {
+        const uint8_t *packet = s->data + (i % stream_packets) * s->packet_size;
+        TabletReport report;
+        if (!ParseReport(tablet, packet, s->packet_size, &report))
+            continue;
+
+        OutputFrame frame = ComputeOutputFrame(&compiled, &previous, &report);
+        previous = report;
+
+        parsed++;
+        mouse += (frame.flags & OUTPUT_MOUSE) != 0;
+        pen += (frame.flags & OUTPUT_PEN) != 0;
+        checksum += FrameChecksum(&frame);
+    }
+
+    PrintRate("pipeline", preset->name, count, NowNs() - start);
+    printf(
+        "  (%llu parsed, %llu mouse, %llu pen, checksum %08x)\n",
+        (unsigned long long)parsed,
+        (unsigned long long)mouse,
+        (unsigned long long)pen,
+        checksum
+    );
+    return checksum;
+}
+
+/* The same pipeline through ParseReportBatch() → MapReportBatch() → ComputeOutputFrames(), as if
+every read returned `batch_size` reports. Output has to match the per-packet pipeline bit for bit. */
+static bool BenchBatches(const PacketStream *s, const TabletInfo *tablet, const Preset *preset, Vec2 screen, uint64_t count, uint32_t expected) {
+    static const uint32_t s_batch_sizes[] = { 1, 8, 64, 1024 };
+    uint64_t stream_packets = s->size / s->packet_size;
+    CompiledPreset compiled = CompilePreset(preset, tablet, screen.x, screen.y);
+    ReportBatch *batch = malloc(sizeof(*batch));
+    OutputFrame *frames = malloc(REPORT_BATCH_CAPACITY * sizeof(*frames));
+    ASSERT(batch && frames);
+
+    bool ok = true;
+    for (unsigned int b = 0; b < COUNTOF(s_batch_sizes); b++) {
+        TabletReport previous = {0};
+        uint32_t checksum = 0;
+        uint64_t index = 0;
+
+        uint64_t start = NowNs();
+        for (uint64_t done = 0; done < count; ) {
+            uint64_t n = s_batch_sizes[b];
+            n = (n < stream_packets - index) ? n : stream_packets - index;
+            n = (n < count - done) ? n : count - done;
+
+            ParseReportBatch(tablet, s->data + index * s->packet_size, n * s->packet_size, 0, batch);
+            MapReportBatch(&compiled, batch);
+            uint32_t frame_count = ComputeOutputFrames(&compiled, &previous, batch, frames);
+            for (uint32_t i = 0; i < frame_count; i++) {
+                checksum += FrameChecksum(&frames[i]);
+            }
+
+            done += n;
+            index = (index + n) % stream_packets;
+        }
+        uint64_t elapsed = NowNs() - start;
+
+        char what[32];
+        snprintf(what, sizeof(what), "batch %u", s_batch_sizes[b]);
+        PrintRate(what, preset->name, count, elapsed);
+        printf("  (%s, checksum %08x %s)\n", REPORT_BATCH_KERNEL, checksum, (checksum == expected) ? "OK" : "MISMATCH");
+        ok &= checksum == expected;
+    }
+
+    /* raw units far outside the tablet's range, as a predictor overshooting might leave them, must map
+    like the scalar path: the SIMD kernels may only take batches they are exact for */
+    static const int32_t s_extremes[] = { 0, -1, 65535, -65536, 1 << 24, -(1 << 24), INT32_MAX, INT32_MIN + 1 };
+    uint32_t extreme_mismatches = 0;
+    for (unsigned int m = 0; m < COUNTOF(s_extremes); m++) {
+        batch->count = 0;
+        for (unsigned int i = 0; i <= m; i++) {
+            for (unsigned int j = 0; j <= m; j++) {
+                batch->x[batch->count] = s_extremes[i];
+                batch->y[batch->count++] = s_extremes[j];
+            }
+        }
+        MapReportBatch(&compiled, batch);
+        for (uint32_t i = 0; i < batch->count; i++) {
+            IVec2 a = TransformPointFixed(compiled.kind, &compiled.absolute_q16, batch->x[i], batch->y[i]);
+            IVec2 p = TransformPointFixed(compiled.kind, &compiled.pixel_q16, batch->x[i], batch->y[i]);
+            extreme_mismatches += a.x != batch->absolute_x[i] || a.y != batch->absolute_y[i];
+            extreme_mismatches += p.x != batch->pixel_x[i] || p.y != batch->pixel_y[i];
+        }
+    }
+    printf("  (extreme raw units, %u mismatches %s)\n", extreme_mismatches, extreme_mismatches ? "MISMATCH" : "OK");
+    ok &= !extreme_mismatches;
+
+    free(frames);
+    free(batch);
+    return ok;
+}
+
+typedef struct {
+    const PacketStream *stream;
+    const TabletInfo *tablet;
+    uint64_t count;
+    ReportRing *ring;
+    volatile uint32_t done;
+    uint64_t full; /* pushes that found the ring full and had to wait */
+} RingProducer;
+
+/* Stands in for tabd.exe's reader thread. Unlike the reader it waits for space instead of dropping
+so the checksum stays comparable, every wait would have been a drop. */
+static void *RingProducerProc(void *arg) {
+    RingProducer *p = arg;
+    const PacketStream *s = p->stream;
+    uint64_t stream_packets = s->size / s->packet_size;
+    ReportBatch *batch = malloc(sizeof(*batch));
+    ASSERT(batch);
+
+    uint64_t index = 0;
+    for (uint64_t done = 0; done < p->count; ) {
+        uint64_t n = BENCH_RING_READ_PACKETS;
+        n = (n < stream_packets - index) ? n : stream_packets - index;
+        n = (n < p->count - done) ? n : p->count - done;
+
+        ParseReportBatch(p->tablet, s->data + index * s->packet_size, n * s->packet_size, 0, batch);
+        for (uint32_t i = 0; i < batch->count; i++) {
+            TabletReport report = {
+                .x = batch->x[i], .y = batch->y[i], .pressure = batch->pressure[i], .flags = batch->flags[i],
+            };
+            if (p->ring->head - AtomicLoad32(&p->ring->tail) == REPORT_RING_CAPACITY) {
+                p->full++;
+                while (p->ring->head - AtomicLoad32(&p->ring->tail) == REPORT_RING_CAPACITY) {
+                    sched_yield();
+                }
+            }
+            PushReport(p->ring, &report, 0, 0);
+        }
+
+        done += n;
+        index = (index + n) % stream_packets;
+    }
+
+    AtomicStore32(&p->done, 1);
+    free(batch);
+    return 0;
+}
+
+/* The batch pipeline split across a producer and a consumer thread through ReportRing, as tabd.exe
+runs it. Output has to match the per-packet pipeline bit for bit. */
+static bool BenchRing(const PacketStream *s, const TabletInfo *tablet, const Preset *preset, Vec2 screen, uint64_t count, uint32_t expected) {
+    CompiledPreset compiled = CompilePreset(preset, tablet, screen.x, screen.y);
+    ReportRing *ring = aligned_alloc(_Alignof(ReportRing), sizeof(*ring));
+    ReportBatch *batch = malloc(sizeof(*batch));
+    OutputFrame *frames = malloc(REPORT_BATCH_CAPACITY * sizeof(*frames));
+    ASSERT(ring && batch && frames);
+    memset(ring, 0, sizeof(*ring));
+
+    RingProducer producer = { .stream = s, .tablet = tablet, .count = count, .ring = ring };
+    TabletReport previous = {0};
+    uint32_t checksum = 0;
+    uint64_t pops = 0;
+
+    uint64_t start = NowNs();
+    pthread_t thread;
+    ASSERT(!pthread_create(&thread, 0, RingProducerProc, &producer));
+    for (;;) {
+        bool done = AtomicLoad32(&producer.done);
+        uint32_t n = PopReportBatch(ring, batch, 0);
+        if (!n) {
+            if (done) break;
+            sched_yield();
+            continue;
+        }
+
+        MapReportBatch(&compiled, batch);
+        n = ComputeOutputFrames(&compiled, &previous, batch, frames);
+        for (uint32_t i = 0; i < n; i++) {
+            checksum += FrameChecksum(&frames[i]);
+        }
+        pops++;
+    }
+    uint64_t elapsed = NowNs() - start;
+    pthread_join(thread, 0);
+
+    PrintRate("ring", preset->name, count, elapsed);
+    printf(
+        "  (high-water %u/%u, %llu full, %.1f reports per pop, checksum %08x %s)\n",
+        ring->high_water,
+        REPORT_RING_CAPACITY,
+        (unsigned long long)producer.full,
+        pops ? (double)count / pops : 0,
+        checksum,
+        (checksum == expected) ? "OK" : "MISMATCH"
+    );
+
+    free(frames);
+    free(batch);
+    free(ring);
+    return checksum == expected;
+}
+
+/* Discrete-event stand-in for a HID device behind the Windows HID class driver, in virtual time. A
+report that arrives while a read is pending completes it right away. Otherwise it waits in the
+driver's input buffers, dropping the oldest one when they are full, and the next read returns as
+many of them as fit. Reports carry their sequence number, which makes losses visible as gaps. */
+typedef struct {
+    uint32_t packet_size;
+    uint64_t period_ns;
+    uint64_t limit;              /* reports to generate */
+    uint64_t now_ns;
+    uint64_t generated;
+    uint32_t queued[BENCH_MOCK_INPUT_BUFFERS];
+    uint32_t queued_head, queued_count;
+    struct {
+        uint32_t slot;
+        uint8_t *buffer;
+        uint32_t capacity;
+    } pending[READ_QUEUE_MAX_DEPTH];
+    uint32_t pending_count;
+    bool done[READ_QUEUE_MAX_DEPTH];
+    uint32_t done_size[READ_QUEUE_MAX_DEPTH];
+} MockHidSource;
+
+static void MockWriteReport(const MockHidSource *m, uint8_t *dst, uint32_t sequence) {
+    memset(dst, 0, m->packet_size);
+    memcpy(dst, &sequence, sizeof(sequence));
+}
+
+/* Generates every report due up to `until_ns`. */
+static void MockAdvance(MockHidSource *m, uint64_t until_ns) {
+    for (; m->generated < m->limit && m->generated * m->period_ns <= until_ns; m->generated++) {
+        uint32_t sequence = (uint32_t)m->generated;
+        if (m->pending_count) {
+            MockWriteReport(m, m->pending[0].buffer, sequence);
+            m->done[m->pending[0].slot] = true;
+            m->done_size[m->pending[0].slot] = m->packet_size;
+            memmove(m->pending, m->pending + 1, --m->pending_count * sizeof(m->pending[0]));
+            continue;
+        }
+
+        if (m->queued_count == BENCH_MOCK_INPUT_BUFFERS) {
+            m->queued_head = (m->queued_head + 1) % BENCH_MOCK_INPUT_BUFFERS;
+            m->queued_count--;
+        }
+        m->queued[(m->queued_head + m->queued_count++) % BENCH_MOCK_INPUT_BUFFERS] = sequence;
+    }
+    m->now_ns = (until_ns > m->now_ns) ? until_ns : m->now_ns;
+}
+
+static bool MockSubmit(void *context, uint32_t slot, uint8_t *buffer, uint32_t capacity) {
+    MockHidSource *m = context;
+    if (!m->queued_count) {
+        m->pending[m->pending_count].slot = slot;
+        m->pending[m->pending_count].buffer = buffer;
+        m->pending[m->pending_count].capacity = capacity;
+        m->pending_count++;
+        return true;
+    }
+
+    uint32_t size = 0;
+    for (; m->queued_count && size + m->packet_size <= capacity; size += m->packet_size) {
+        MockWriteReport(m, buffer + size, m->queued[m->queued_head]);
+        m->queued_head = (m->queued_head + 1) % BENCH_MOCK_INPUT_BUFFERS;
+        m->queued_count--;
+    }
+    m->done[slot] = true;
+    m->done_size[slot] = size;
+    return true;
+}
+
+static bool MockWait(void *context, uint32_t slot, uint32_t *size) {
+    MockHidSource *m = context;
+    while (!m->done[slot]) {
+        if (m->generated == m->limit)
+            return false;
+        MockAdvance(m, m->generated * m->period_ns);
+    }
+    m->done[slot] = false;
+    *size = m->done_size[slot];
+    return true;
+}
+
+/* Drives a ReadQueue of `depth` reads from the simulated device with a reader that needs
+BENCH_MOCK_SERVICE_NS per completion and is preempted for BENCH_MOCK_STALL_NS now and then. */
+static void BenchReadQueue(uint32_t depth, uint32_t packet_size) {
+    MockHidSource *m = calloc(1, sizeof(*m));
+    ReadQueue *queue = malloc(sizeof(*queue));
+    ASSERT(m && queue);
+    m->packet_size = packet_size;
+    m->period_ns = 1000000000ull / BENCH_MOCK_RATE_HZ;
+    m->limit = BENCH_MOCK_REPORTS;
+
+    AsyncReadSource source = { m, MockSubmit, MockWait };
+    ASSERT(StartReadQueue(queue, &source, depth));
+
+    uint64_t received = 0, coalesced = 0, latency_total = 0, latency_max = 0;
+    uint32_t expected = 0;
+    const uint8_t *data;
+    uint32_t size;
+    while (WaitForRead(queue, &data, &size)) {
+        for (uint32_t offset = 0; offset + packet_size <= size; offset += packet_size) {
+            uint32_t sequence;
+            memcpy(&sequence, data + offset, sizeof(sequence));
+            uint64_t latency = m->now_ns - sequence * m->period_ns;
+            latency_total += latency;
+            latency_max = (latency > latency_max) ? latency : latency_max;
+            expected = sequence + 1;
+            received++;
+        }
+        coalesced += size > packet_size;
+
+        uint64_t spent = BENCH_MOCK_SERVICE_NS;
+        if (queue->completions % BENCH_MOCK_STALL_EVERY == 0) {
+            spent += BENCH_MOCK_STALL_NS;
+        }
+        MockAdvance(m, m->now_ns + spent);
+        ASSERT(ResubmitRead(queue));
+    }
+
+    uint64_t lost = expected - received;
+    printf(
+        "reads %-2u     %u Hz: %llu reports, lost %llu (%.3f%%), %.2f%% of reads coalesced, "
+        "latency mean %.1f us, max %.1f us\n",
+        queue->depth,
+        BENCH_MOCK_RATE_HZ,
+        (unsigned long long)expected,
+        (unsigned long long)lost,
+        expected ? 100.0 * lost / expected : 0,
+        queue->completions ? 100.0 * coalesced / queue->completions : 0,
+        received ? latency_total / 1e3 / received : 0,
+        latency_max / 1e3
+    );
+
+    free(queue);
+    free(m);
+}
+
+/* Per-packet MapTabletPointToScreen() against the compiled float and fixed-point transforms, on the
+parsed points of the stream so all of them see the same data. */
+/* A busy foreground app behind SendInput(), in virtual time: reports arrive at BENCH_SINK_RATE_HZ,
+every injection takes BENCH_SINK_INJECT_NS and the first one in each BENCH_SINK_STALL_EVERY_NS window
+blocks for BENCH_SINK_STALL_NS more. Between injections the output loop takes everything that
+arrived, as tabd.exe's output thread does with the ring, and injects it in order or coalesced with
+CoalesceReportBatch(). Latency is from arrival to the end of the injection. Both have to output
+every pen and button transition of the input in order. */
+static bool BenchSlowSink(const PacketStream *s, const TabletInfo *tablet) {
+    uint64_t stream_packets = s->size / s->packet_size;
+    TabletReport *reports = malloc(BENCH_SINK_REPORTS * sizeof(*reports));
+    uint32_t *transitions = malloc(BENCH_SINK_REPORTS * sizeof(uint32_t));
+    uint64_t *latencies = malloc(BENCH_SINK_REPORTS * sizeof(uint64_t));
+    ReportBatch *batch = malloc(sizeof(*batch));
+    ASSERT(reports && transitions && latencies && batch);
+
+    uint32_t count = 0, transition_count = 0, flags = 0;
+    for (uint64_t i = 0; count < BENCH_SINK_REPORTS && i < 2 * stream_packets + BENCH_SINK_REPORTS; i++) {
+        const uint8_t *packet = s->data + (i % stream_packets) * s->packet_size;
+        if (!ParseReportBatch(tablet, packet, s->packet_size, 0, batch))
+            continue;
+        reports[count++] = (TabletReport){ batch->x[0], batch->y[0], batch->pressure[0], batch->flags[0] };
+        if (batch->flags[0] != flags) {
+            transitions[transition_count++] = flags = batch->flags[0];
+        }
+    }
+
+    bool ok = count > 0;
+    uint64_t period = 1000000000ull / BENCH_SINK_RATE_HZ;
+    for (int coalesce = 0; coalesce < 2 && ok; coalesce++) {
+        uint64_t now = 0, stalled_window = UINT64_MAX, coalesced = 0, latency_total = 0;
+        uint32_t next = 0, injected = 0, matched = 0;
+        flags = 0;
+        while (next < count) {
+            now = (now > next * period) ? now : next * period; /* idle until the next report */
+            batch->count = 0;
+            for (; next < count && next * period <= now && batch->count < REPORT_RING_CAPACITY; next++) {
+                StoreReport(batch, batch->count, &reports[next]);
+                batch->time_ns[batch->count++] = next * period;
+            }
+            if (coalesce) {
+                coalesced += CoalesceReportBatch(batch, flags);
+            }
+
+            for (uint32_t i = 0; i < batch->count; i++) {
+                if (now / BENCH_SINK_STALL_EVERY_NS != stalled_window) {
+                    stalled_window = now / BENCH_SINK_STALL_EVERY_NS;
+                    now += BENCH_SINK_STALL_NS;
+                }
+                now += BENCH_SINK_INJECT_NS;
+                latencies[injected++] = now - batch->time_ns[i];
+                latency_total += now - batch->time_ns[i];
+                if (batch->flags[i] != flags) {
+                    ok &= matched < transition_count && transitions[matched] == batch->flags[i];
+                    matched++;
+                    flags = batch->flags[i];
+                }
+            }
+        }
+        ok &= matched == transition_count;
+
+        qsort(latencies, injected, sizeof(uint64_t), CompareUint64);
+        printf(
+            "sink %-9s: %u of %u reports injected, %llu coalesced, latency mean %.2f ms, p99 %.2f ms, "
+            "max %.2f ms, %u transitions %s\n",
+            coalesce ? "coalesced" : "in order", injected, count, (unsigned long long)coalesced,
+            latency_total / 1e6 / injected, latencies[injected * 99 / 100] / 1e6,
+            latencies[injected - 1] / 1e6, matched, ok ? "OK" : "MISMATCH"
+        );
+    }
+
+    free(batch);
+    free(latencies);
+    free(transitions);
+    free(reports);
+    return ok;
+}
+
+static void BenchMapping(const PacketStream *s, const TabletInfo *tablet, const Preset *preset, Vec2 screen, uint64_t count) {
+    uint64_t stream_packets = s->size / s->packet_size;
+    TabletReport *reports = calloc(stream_packets, sizeof(*reports));
+    ASSERT(reports);
+    for (uint64_t i = 0; i < stream_packets; i++) {
+        ParseReport(tablet, s->data + i * s->packet_size, s->packet_size, &reports[i]);
+    }
+
+    volatile float sink;
+    volatile int32_t isink;
+    float acc = 0;
+    uint64_t start = NowNs();
+    for (uint64_t i = 0; i < count; i++) {
+        const TabletReport *r = &reports[i % stream_packets];
+        Vec2 n = { r->x / (float)tablet->max_x, r->y / (float)tablet->max_y };
+        Vec2 p = MapTabletPointToScreen(preset, tablet, n);
+        acc += p.x * 65535 + p.y * screen.y;
+    }
+    PrintRate("map (old)", preset->name, count, NowNs() - start);
+    printf("\n");
+    sink = acc;
+
+    CompiledPreset compiled = CompilePreset(preset, tablet, screen.x, screen.y);
+    acc = 0;
+    start = NowNs();
+    for (uint64_t i = 0; i < count; i++) {
+        const TabletReport *r = &reports[i % stream_packets];
+        Vec2 a = TransformPoint(compiled.kind, &compiled.absolute, (Vec2){ r->x, r->y });
+        Vec2 p = TransformPoint(compiled.kind, &compiled.pixel, (Vec2){ r->x, r->y });
+        acc += a.x + p.y;
+    }
+    PrintRate("map (float)", preset->name, count, NowNs() - start);
+    printf("\n");
+    sink = acc;
+    (void)sink;
+
+    int32_t iacc = 0;
+    start = NowNs();
+    for (uint64_t i = 0; i < count; i++) {
+        const TabletReport *r = &reports[i % stream_packets];
+        IVec2 a = TransformPointFixed(compiled.kind, &compiled.absolute_q16, r->x, r->y);
+        IVec2 p = TransformPointFixed(compiled.kind, &compiled.pixel_q16, r->x, r->y);
+        iacc += a.x + p.y;
+    }
+    PrintRate("map (fixed)", preset->name, count, NowNs() - start);
+    printf("\n");
+    isink = iacc;
+    (void)isink;
+
+    free(reports);
+}
+
+static void AccumulateMismatch(int32_t expected, int32_t actual, uint64_t *mismatches, int *max) {
+    int d = abs(expected - actual);
+    *mismatches += d != 0;
+    *max = (d > *max) ? d : *max;
+}
+
+/* Compares the compiled transforms with MapTabletPointToScreen() over the whole sensor range of the
+tablet (every `step`-th raw unit on both axes). Integer mismatches count how often MOUSEINPUT/pixel
+coordinates differ from truncating the reference, see the error bound in preset.h. */
+static bool SweepEquivalence(const TabletInfo *tablet, const Preset *preset, Vec2 screen, int step) {
+    CompiledPreset compiled = CompilePreset(preset, tablet, screen.x, screen.y);
+    double max_error = 0;
+    uint64_t points = 0, float_mismatches = 0, fixed_mismatches = 0;
+    int max_float_error = 0, max_fixed_error = 0;
+
+    for (int ry = 0; ry <= tablet->max_y; ry += step) {
+        for (int rx = 0; rx <= tablet->max_x; rx += step) {
+            Vec2 n = { rx / (float)tablet->max_x, ry / (float)tablet->max_y };
+            Vec2 r = MapTabletPointToScreen(preset, tablet, n);
+            Vec2 a = TransformPoint(compiled.kind, &compiled.absolute, (Vec2){ rx, ry });
+            Vec2 p = TransformPoint(compiled.kind, &compiled.pixel, (Vec2){ rx, ry });
+            IVec2 fa = TransformPointFixed(compiled.kind, &compiled.absolute_q16, rx, ry);
+            IVec2 fp = TransformPointFixed(compiled.kind, &compiled.pixel_q16, rx, ry);
+
+            double ex = fabs(r.x - a.x / 65535.0), ey = fabs(r.y - a.y / 65535.0);
+            max_error = ex > max_error ? ex : max_error;
+            max_error = ey > max_error ? ey : max_error;
+
+            IVec2 ra = { r.x * 65535, r.y * 65535 };
+            IVec2 rp = { r.x * screen.x, r.y * screen.y };
+            AccumulateMismatch(ra.x, a.x, &float_mismatches, &max_float_error);
+            AccumulateMismatch(ra.y, a.y, &float_mismatches, &max_float_error);
+            AccumulateMismatch(rp.x, p.x, &float_mismatches, &max_float_error);
+            AccumulateMismatch(rp.y, p.y, &float_mismatches, &max_float_error);
+
+            /* the fixed-point path floors, the bound only holds for points on the screen */
+            if (ra.x >= 0 && ra.y >= 0 && ra.x <= 65535 && ra.y <= 65535) {
+                AccumulateMismatch(ra.x, fa.x, &fixed_mismatches, &max_fixed_error);
+                AccumulateMismatch(ra.y, fa.y, &fixed_mismatches, &max_fixed_error);
+                AccumulateMismatch(rp.x, fp.x, &fixed_mismatches, &max_fixed_error);
+                AccumulateMismatch(rp.y, fp.y, &fixed_mismatches, &max_fixed_error);
+            }
+            points++;
+        }
+    }
+
+    /* the reference path loses a few float32 ulps in its millimeter round trip, the compiled one is
+    computed in double, so only values landing right next to an integer may truncate differently */
+    bool ok = max_error < 1e-5 && max_float_error <= 1 && max_fixed_error <= 1;
+    printf(
+        "%-12s %-10ls %llu points, max error %.3g, mismatches: float %llu (max %d), fixed %llu (max %d) %s\n",
+        "equivalence", preset->name, (unsigned long long)points, max_error,
+        (unsigned long long)float_mismatches, max_float_error,
+        (unsigned long long)fixed_mismatches, max_fixed_error,
+        ok ? "OK" : "FAILED"
+    );
+    return ok;
+}
+
+typedef struct {
+    const char *name;
+    uint32_t count;
+    ScreenRect monitors[4]; /* in the order they are added */
+    ScreenRect desktop;
+    uint32_t primary;       /* its number */
+} FakeLayout;
+
+/* Presets onto fake monitor layouts, targeting the primary monitor, the desktop, every monitor by
+number and one past the last (which has to fall back to the primary one). Over every
+BENCH_MONITOR_STEP-th raw unit of the tablet, points the reference puts on the target have to land within a pixel of it, and
+the mouse's virtual desktop units within a pixel of the pen. A single monitor layout has to compile
+exactly like CompilePreset() did with the screen size. */
+static bool BenchMonitors(const TabletInfo *tablet) {
+    static const FakeLayout s_layouts[] = {
+        { "single",       1, { { 0, 0, 1920, 1080 } }, { 0, 0, 1920, 1080 }, 1 },
+        { "side by side", 2, { { 2560, 200, 1920, 1080 }, { 0, 0, 2560, 1440 } }, { 0, 0, 4480, 1440 }, 1 },
+        {
+            "three",
+            3,
+            { { 2560, 0, 1080, 1920 }, { 0, 0, 2560, 1440 }, { -1920, 300, 1920, 1080 } },
+            { -1920, 0, 5560, 1920 },
+            2,
+        },
+        { "stacked",      2, { { 0, -1440, 2560, 1440 }, { 0, 0, 1920, 1080 } }, { 0, -1440, 2560, 2520 }, 2 },
+    };
+
+    bool ok = true;
+    for (unsigned int l = 0; l < COUNTOF(s_layouts); l++) {
+        const FakeLayout *fake = &s_layouts[l];
+        MonitorLayout layout = {0};
+        for (uint32_t i = 0; i < fake->count; i++) {
+            ok &= AddMonitor(&layout, fake->monitors[i]);
+        }
+        bool numbered = layout.count == fake->count && layout.primary + 1 == fake->primary
+            && !memcmp(&layout.desktop, &fake->desktop, sizeof(layout.desktop));
+        for (uint32_t i = 1; i < layout.count; i++) {
+            ScreenRect a = layout.monitors[i - 1], b = layout.monitors[i];
+            numbered &= a.left < b.left || (a.left == b.left && a.top <= b.top);
+        }
+
+        uint64_t points = 0, misses = 0;
+        double max_distance = 0;
+        int max_error = 0;
+        for (int32_t target = MONITOR_DESKTOP; target <= (int32_t)layout.count + 1; target++) {
+            ScreenRect t = GetMonitorTarget(&layout, target), d = layout.desktop;
+            ScreenRect expected = (target == MONITOR_DESKTOP) ? d
+                : (target >= 1 && target <= (int32_t)layout.count) ? layout.monitors[target - 1]
+                : layout.monitors[layout.primary];
+            misses += memcmp(&t, &expected, sizeof(t)) != 0;
+
+            for (unsigned int p = 0; p < COUNTOF(g_presets); p++) {
+                Preset preset = g_presets[p];
+                preset.monitor = target;
+                CompiledPreset compiled = CompilePresetForLayout(&preset, tablet, &layout);
+                for (int ry = 0; ry <= tablet->max_y; ry += BENCH_MONITOR_STEP) {
+                    for (int rx = 0; rx <= tablet->max_x; rx += BENCH_MONITOR_STEP) {
+                        Vec2 r = MapTabletPointToScreen(&preset, tablet, (Vec2){ rx / (float)tablet->max_x, ry / (float)tablet->max_y });
+                        if (r.x < 0 || r.y < 0 || r.x >= 1 || r.y >= 1)
+                            continue;
+
+                        IVec2 fa = TransformPointFixed(compiled.kind, &compiled.absolute_q16, rx, ry);
+                        IVec2 fp = TransformPointFixed(compiled.kind, &compiled.pixel_q16, rx, ry);
+                        double ex = t.left + r.x * t.width, ey = t.top + r.y * t.height;
+                        int error = abs(fp.x - (int)floor(ex));
+                        error = (abs(fp.y - (int)floor(ey)) > error) ? abs(fp.y - (int)floor(ey)) : error;
+                        max_error = (error > max_error) ? error : max_error;
+
+                        /* where Windows puts the mouse for those units */
+                        double mx = d.left + fa.x * (double)d.width / 65535, my = d.top + fa.y * (double)d.height / 65535;
+                        double distance = fabs(mx - ex) > fabs(my - ey) ? fabs(mx - ex) : fabs(my - ey);
+                        max_distance = (distance > max_distance) ? distance : max_distance;
+                        points++;
+                    }
+                }
+            }
+        }
+
+        bool same = true;
+        if (layout.count == 1) {
+            for (unsigned int p = 0; p < COUNTOF(g_presets); p++) {
+                CompiledPreset a = CompilePresetForLayout(&g_presets[p], tablet, &layout);
+                CompiledPreset b = CompilePreset(&g_presets[p], tablet, layout.desktop.width, layout.desktop.height);
+                same &= !memcmp(&a, &b, sizeof(a));
+            }
+        }
+
+        bool layout_ok = numbered && !misses && same && max_error <= 1 && max_distance <= 1;
+        ok &= layout_ok;
+        printf(
+            "monitors %-12s: %u monitors, desktop %dx%d at %d,%d, %llu points, max pixel error %d, "
+            "mouse off the pen by %.2f px%s %s\n",
+            fake->name,
+            layout.count,
+            layout.desktop.width,
+            layout.desktop.height,
+            layout.desktop.left,
+            layout.desktop.top,
+            (unsigned long long)points,
+            max_error,
+            max_distance,
+            (layout.count == 1) ? (same) ? ", same as the screen size" : ", differs from the screen size" : "",
+            layout_ok ? "OK" : "MISMATCH"
+        );
+    }
+
+    /* what a display change costs per preset and tablet */
+    MonitorLayout layout = {0};
+    for (uint32_t i = 0; i < s_layouts[2].count; i++) {
+        AddMonitor(&layout, s_layouts[2].monitors[i]);
+    }
+    volatile int64_t sink = 0;
+    uint64_t start = NowNs();
+    for (int r = 0; r < BENCH_MONITOR_COMPILES; r++) {
+        for (unsigned int p = 0; p < COUNTOF(g_presets); p++) {
+            CompiledPreset compiled = CompilePresetForLayout(&g_presets[p], tablet, &layout);
+            sink += compiled.pixel_q16.m[0][2];
+        }
+    }
+    printf(
+        "monitors: recompiling a preset for a new layout takes %.2f us\n",
+        (NowNs() - start) / 1e3 / (BENCH_MONITOR_COMPILES * COUNTOF(g_presets))
+    );
+    return ok;
+}
+
+static void RequestLatency(int signal) {
+    (void)signal;
+    s_latency_requested = 1;
+}
+
+static void PrintLatency(const LatencyHistogram *latency) {
+    for (int i = 0; i < LATENCY_STAGES; i++) {
+        LatencySummary s = SummarizeLatency(&latency[i]);
+        if (!s.count)
+            continue;
+        printf(
+            "  %-8s p50 %7.1f us, p99 %7.1f us, p99.9 %7.1f us, max %7.1f us (%llu reports)\n",
+            g_latency_stages[i],
+            s.p50 / 1e3,
+            s.p99 / 1e3,
+            s.p999 / 1e3,
+            s.max / 1e3,
+            (unsigned long long)s.count
+        );
+    }
+}
+
+/* Percentiles of a known distribution have to be within a sub-bucket of the truth, and recording
+including the clock read has to stay cheap enough to leave in the packet path. */
+static bool BenchLatency(void) {
+    LatencyHistogram *h = calloc(1, sizeof(*h));
+    ASSERT(h);
+    for (uint64_t v = 1; v <= BENCH_LATENCY_SAMPLES; v++) {
+        RecordLatency(h, v);
+    }
+    const double quantiles[] = { 0.5, 0.99, 0.999 };
+    bool ok = h->max == BENCH_LATENCY_SAMPLES;
+    double worst = 0;
+    for (unsigned int i = 0; i < COUNTOF(quantiles); i++) {
+        double exact = quantiles[i] * BENCH_LATENCY_SAMPLES;
+        double error = ((double)LatencyPercentile(h, quantiles[i]) - exact) / exact;
+        worst = (fabs(error) > worst) ? fabs(error) : worst;
+        ok &= error > -1e-6 && error <= 1.0 / LATENCY_SUB_BUCKETS;
+    }
+
+    *h = (LatencyHistogram){0};
+    uint64_t start = NowNs(), previous = start;
+    for (uint32_t i = 0; i < BENCH_LATENCY_SAMPLES; i++) {
+        uint64_t now = NowNs();
+        RecordLatency(h, now - previous);
+        previous = now;
+    }
+    uint64_t elapsed = NowNs() - start;
+
+    printf(
+        "latency: %.1f ns per recorded sample with its clock read, %zu bytes per stage, "
+        "percentiles within %.2f%% (%s)\n",
+        (double)elapsed / BENCH_LATENCY_SAMPLES,
+        sizeof(*h),
+        worst * 100,
+        ok ? "OK" : "FAILED"
+    );
+    free(h);
+    return ok;
+}
+
+static void BenchLogCall(LogRing *ring, LogSite *site, ...) {
+    va_list args;
+    va_start(args, site);
+    WriteLog(ring, site, 1, NowNs(), args);
+    va_end(args);
+}
+
+static void BenchFormatCall(wchar_t *line, size_t capacity, int fd, const wchar_t *format, ...) {
+    va_list args;
+    va_start(args, format);
+    int length = vswprintf(line, capacity, format, args);
+    va_end(args);
+    if (length > 0 && write(fd, line, length * sizeof(wchar_t)) < 0) {
+        TRAP();
+    }
+}
+
+/* What a Log() call costs the calling thread, against formatting and writing the line right away
+as tabd.exe used to (to /dev/null here, a console is slower still). The ring is drained between runs
+of half its capacity, off the clock, as the log thread would. Every record then goes through the log
+file encoding and back and has to come out as vswprintf() formats it. */
+static bool BenchLog(void) {
+    static LogSite numbers = {
+        __LINE__, L"bench.c", __func__, L"Report ring high-water mark %u/%u, dropped %llu", 0
+    };
+    static LogSite strings = {
+        __LINE__, L"bench.c", __func__, L"Initialized %hs at \"%ls\", %u reads in flight", 0
+    };
+    static LogSite signs = { __LINE__, L"bench.c", __func__, L"%d%% of %x, %lld and %llu", 0 };
+    const wchar_t *path = L"\\\\?\\hid#vid_056a&pid_037a&mi_00#7&1b2c3d4e&0&0000#{4d1e55b2-f16f-11cf-88cb-001111000030}";
+
+    LogRing *ring = calloc(1, sizeof(*ring));
+    LogEncoder *encoder = calloc(1, sizeof(*encoder));
+    LogDecoder *decoder = calloc(1, sizeof(*decoder));
+    uint8_t *encoded = malloc(LOG_RING_CAPACITY * 2 * sizeof(LogRecord));
+    wchar_t *line = malloc(LOG_LINE_CAPACITY * sizeof(wchar_t));
+    wchar_t *decoded = malloc(LOG_LINE_CAPACITY * sizeof(wchar_t));
+    wchar_t *expected = malloc(LOG_LINE_CAPACITY * sizeof(wchar_t));
+    ASSERT(ring && encoder && decoder && encoded && line && decoded && expected);
+
+    bool ok = true;
+    uint64_t elapsed[2] = {0}, mismatches = 0;
+    uint32_t size = StartLogFile(encoder, NowNs(), encoded, LOG_RING_CAPACITY * 2 * sizeof(LogRecord));
+    for (uint32_t i = 0; i < BENCH_LOG_CALLS; ) {
+        uint64_t start = NowNs();
+        for (uint32_t n = 0; n < LOG_RING_CAPACITY / 2; n++, i++) {
+            if (i & 1) {
+                BenchLogCall(ring, &strings, "Wacom CTL-672", path, i & 15);
+            } else {
+                BenchLogCall(ring, &numbers, i & 255, REPORT_RING_CAPACITY, (uint64_t)i << 20);
+            }
+        }
+        elapsed[0] += NowNs() - start;
+
+        /* the log thread's side, and checking it only every so often keeps the run short */
+        bool check = !(i & 0xffff);
+        for (const LogRecord *r; (r = PeekLog(ring)); ReleaseLog(ring)) {
+            if (!check)
+                continue;
+            size += EncodeLogRecord(encoder, r, encoded + size, LOG_RING_CAPACITY * 2 * sizeof(LogRecord) - size);
+            FormatLogRecord(r, line, LOG_LINE_CAPACITY);
+        }
+        for (uint32_t at = 0, length, entry; check && at < size; at += entry) {
+            entry = DecodeLogEntry(decoder, encoded + at, size - at, decoded, LOG_LINE_CAPACITY, &length);
+            ok &= entry != 0;
+            if (!entry)
+                break;
+        }
+        size = 0;
+    }
+    ok &= !ring->dropped;
+
+    /* formatting and the file encoding, against vswprintf() */
+    struct { uint32_t a; uint32_t b; int64_t c; uint64_t d; } cases[] = {
+        { 0, 0, 0, 0 }, { (uint32_t)-1, 0xdeadbeef, -1, ~0ull }, { (uint32_t)INT32_MIN, 1, INT64_MIN, 42 },
+    };
+    for (unsigned int i = 0; i < COUNTOF(cases) + 2; i++) {
+        if (i < COUNTOF(cases)) {
+            BenchLogCall(ring, &signs, cases[i].a, cases[i].b, cases[i].c, cases[i].d);
+            swprintf(expected, LOG_LINE_CAPACITY, signs.format, cases[i].a, cases[i].b, cases[i].c, cases[i].d);
+        } else if (i == COUNTOF(cases)) {
+            BenchLogCall(ring, &strings, "Wacom CTL-672", path, 8);
+            swprintf(expected, LOG_LINE_CAPACITY, strings.format, "Wacom CTL-672", path, 8);
+        } else {
+            BenchLogCall(ring, &numbers, 256, 256, 12345678901ull);
+            swprintf(expected, LOG_LINE_CAPACITY, numbers.format, 256, 256, 12345678901ull);
+        }
+
+        const LogRecord *r = PeekLog(ring);
+        uint32_t at = StartLogFile(encoder, r->time_ns, encoded, LOG_RING_CAPACITY * 2 * sizeof(LogRecord));
+        at += EncodeLogRecord(encoder, r, encoded + at, LOG_RING_CAPACITY * 2 * sizeof(LogRecord) - at);
+        uint32_t length = FormatLogRecord(r, line, LOG_LINE_CAPACITY);
+        ReleaseLog(ring);
+
+        uint32_t decoded_length = 0;
+        for (uint32_t offset = 0, entry; offset < at; offset += entry) {
+            entry = DecodeLogEntry(decoder, encoded + offset, at - offset, decoded, LOG_LINE_CAPACITY, &decoded_length);
+            if (!entry) {
+                decoded_length = 0;
+                break;
+            }
+        }
+        /* `[0.000000] ` and the message after `func() ` */
+        const wchar_t *message = wcsstr(line, L"() ");
+        bool same =
+            decoded_length == length + 11
+            && !wcscmp(decoded + 11, line)
+            && message
+            && !wcsncmp(message + 3, expected, wcslen(expected))
+            && message[3 + wcslen(expected)] == '\n';
+        mismatches += !same;
+    }
+    ok &= !mismatches;
+
+    int fd = open("/dev/null", O_WRONLY);
+    ASSERT(fd >= 0);
+    uint64_t start = NowNs();
+    for (uint32_t i = 0; i < BENCH_LOG_CALLS; i++) {
+        if (i & 1) {
+            BenchFormatCall(line, LOG_LINE_CAPACITY, fd, strings.format, "Wacom CTL-672", path, i & 15);
+        } else {
+            BenchFormatCall(line, LOG_LINE_CAPACITY, fd, numbers.format, i & 255, REPORT_RING_CAPACITY, (uint64_t)i << 20);
+        }
+    }
+    elapsed[1] = NowNs() - start;
+    close(fd);
+
+    printf(
+        "log: %.1f ns per call into the ring, %.1f ns formatting and writing right away, "
+        "%u-byte records, %llu formatting mismatches (%s)\n",
+        (double)elapsed[0] / BENCH_LOG_CALLS,
+        (double)elapsed[1] / BENCH_LOG_CALLS,
+        (unsigned int)sizeof(LogRecord),
+        (unsigned long long)mismatches,
+        ok ? "OK" : "FAILED"
+    );
+
+    free(expected);
+    free(decoded);
+    free(line);
+    free(encoded);
+    free(decoder);
+    free(encoder);
+    free(ring);
+    return ok;
+}
+
+/* Replays a capture straight from an mmap()ed file through the batched pipeline, without ever
+loading it. In real-time mode reports how late packets were processed relative to their original
+spacing, in fast mode the throughput. Either way with per-stage latency, SIGUSR1 prints it so far. */
+static bool BenchReplay(const char *path, ReplayMode mode, const Preset *preset, Vec2 screen) {
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) || !st.st_size) {
+        if (fd >= 0) close(fd);
+        return false;
+    }
+    const uint8_t *data = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+        return false;
+    posix_madvise((void*)data, st.st_size, POSIX_MADV_SEQUENTIAL);
+
+    ReplaySource replay;
+    CaptureRecord record;
+    TabletInfo tablet;
+    if (
+        !InitReplaySource(&replay, data, st.st_size, mode)
+        || !PeekReplayRecord(&replay, &record)
+        || !FindTabletInfo(&s_devices, record.vid, record.pid, &tablet)
+    ) {
+        munmap((void*)data, st.st_size);
+        return false;
+    }
+
+    CompiledPreset compiled = CompilePreset(preset, &tablet, screen.x, screen.y);
+    ReportBatch *batch = malloc(sizeof(*batch));
+    OutputFrame *frames = malloc(REPORT_BATCH_CAPACITY * sizeof(*frames));
+    LatencyHistogram *latency = calloc(LATENCY_STAGES, sizeof(*latency));
+    ASSERT(batch && frames && latency);
+    struct sigaction action = { .sa_handler = RequestLatency };
+    sigaction(SIGUSR1, &action, 0);
+
+    TabletReport previous = {0};
+    FilterState filter = {0};
+    PredictorState predictor = {0};
+    uint64_t frame_count = 0, late_total = 0, late_max = 0, late_over_1ms = 0;
+    uint32_t checksum = 0;
+    uint64_t due, start = NowNs();
+    while (NextReplayRecord(&replay, NowNs(), &record, &due)) {
+        if (record.vid != tablet.vid || record.pid != tablet.pid)
+            continue;
+
+        /* the read would have completed when the packet was due, lateness counts against it */
+        uint64_t completed = NowNs();
+        if (mode == REPLAY_REALTIME) {
+            struct timespec ts = { .tv_sec = due / 1000000000ull, .tv_nsec = due % 1000000000ull };
+            while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, 0)) {}
+
+            uint64_t late = NowNs() - due;
+            late_total += late;
+            late_max = (late > late_max) ? late : late_max;
+            late_over_1ms += late > 1000000;
+            completed = due;
+        }
+
+        ParseReportBatch(&tablet, record.packet, record.size, record.time_ns, batch);
+        RecordLatency(&latency[LATENCY_PARSED], NowNs() - completed);
+        FilterReportBatch(&compiled, &filter, batch);
+        PredictReportBatch(&compiled, &predictor, batch);
+        MapReportBatch(&compiled, batch);
+        RecordLatency(&latency[LATENCY_MAPPED], NowNs() - completed);
+        uint32_t n = ComputeOutputFrames(&compiled, &previous, batch, frames);
+        for (uint32_t i = 0; i < n; i++) {
+            checksum += FrameChecksum(&frames[i]);
+            RecordLatency(&latency[LATENCY_INJECTED], NowNs() - completed);
+        }
+        frame_count += n;
+
+        if (s_latency_requested) {
+            s_latency_requested = 0;
+            PrintLatency(latency);
+        }
+    }
+    uint64_t elapsed = NowNs() - start;
+    action.sa_handler = SIG_DFL;
+    sigaction(SIGUSR1, &action, 0);
+
+    printf(
+        "%ls replay of %s capture: %llu packets (%llu bytes), %llu frames in %.3f s, checksum %08x\n",
+        (mode == REPLAY_REALTIME) ? L"real-time" : L"fast",
+        tablet.name,
+        (unsigned long long)replay.packets,
+        (unsigned long long)replay.bytes,
+        (unsigned long long)frame_count,
+        elapsed / 1e9,
+        checksum
+    );
+    if (mode == REPLAY_REALTIME) {
+        printf(
+            "  lateness: mean %.1f us, max %.1f us, %llu packets over 1 ms\n",
+            replay.packets ? late_total / 1e3 / replay.packets : 0,
+            late_max / 1e3,
+            (unsigned long long)late_over_1ms
+        );
+    } else {
+        PrintRate("replay", preset->name, replay.packets, elapsed);
+        printf("  %.1f MB/s\n", replay.bytes / (elapsed / 1e9) / 1e6);
+    }
+    PrintLatency(latency);
+
+    free(latency);
+    free(frames);
+    free(batch);
+    munmap((void*)data, st.st_size);
+    return true;
+}
+
+typedef struct {
+    ReportBatch *batch;
+    uint64_t packets;
+    uint64_t reports;
+    uint32_t checksum;
+    const uint64_t *due;           /* per packet, when the FIFO writer was to send it */
+    const uint64_t *written;       /* and when it did */
+    LatencyHistogram *read_parsed; /* read completion to parsed */
+    LatencyHistogram *sent_parsed; /* written to parsed */
+    LatencyHistogram *due_parsed;
+    const CompiledPreset *preset;  /* -i, mapped as well */
+    TabletReport previous;
+    OutputFrame *frames;
+    Uinput *sink;
+    LatencyHistogram *stages;
+} HidrawBench;
+
+static void HidrawBenchProc(void *context, const HidrawSource *source, const uint8_t *data, uint32_t size, uint64_t time_ns) {
+    HidrawBench *b = context;
+    uint32_t packets = size / source->info.packet_size;
+    ParseReportBatch(&source->info, data, size, time_ns, b->batch);
+    uint64_t parsed = NowNs();
+    for (uint32_t i = 0; i < b->batch->count; i++) {
+        TabletReport report = { b->batch->x[i], b->batch->y[i], b->batch->pressure[i], b->batch->flags[i] };
+        b->checksum += ReportChecksum(&report);
+    }
+    if (b->read_parsed) {
+        RecordLatency(b->read_parsed, parsed - time_ns);
+    }
+    for (uint32_t i = 0; b->written && i < packets; i++) {
+        RecordLatency(b->sent_parsed, parsed - b->written[b->packets + i]);
+        RecordLatency(b->due_parsed, parsed - b->due[b->packets + i]);
+    }
+    if (b->preset) {
+        RecordLatency(&b->stages[LATENCY_PARSED], parsed - time_ns);
+        MapReportBatch(b->preset, b->batch);
+        RecordLatency(&b->stages[LATENCY_MAPPED], NowNs() - time_ns);
+        uint32_t n = ComputeOutputFrames(b->preset, &b->previous, b->batch, b->frames);
+        for (uint32_t i = 0; i < n; i++) {
+            b->checksum += FrameChecksum(&b->frames[i]);
+        }
+        SynthesizeUinputBatch(b->sink, b->frames, b->batch->time_ns, n);
+        RecordLatency(&b->stages[LATENCY_INJECTED], NowNs() - time_ns);
+    }
+    b->packets += packets;
+    b->reports += b->batch->count;
+}
+
+typedef struct {
+    const char *path;
+    const PacketStream *stream;
+    uint32_t packets;
+    uint64_t period_ns; /* 0 to write them as fast as the FIFO takes them */
+    uint64_t start_ns;  /* when the first one is due, 0 for a millisecond after starting */
+    uint64_t *due;      /* optional */
+    uint64_t *written;  /* optional */
+} HidrawWriter;
+
+/* Plays the device: writes one packet per period into the FIFO, with the time it did. */
+static void *HidrawWriterProc(void *arg) {
+    HidrawWriter *w = arg;
+    int fd = open(w->path, O_WRONLY);
+    ASSERT(fd >= 0);
+    uint64_t stream_packets = w->stream->size / w->stream->packet_size;
+    uint64_t start = (w->start_ns) ? w->start_ns : NowNs() + 1000000;
+    for (uint32_t i = 0; i < w->packets; i++) {
+        uint64_t due = start + i * w->period_ns;
+        if (w->period_ns) {
+            struct timespec ts = NsToTimespec(due);
+            while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, 0)) {}
+        }
+        if (w->due) w->due[i] = due;
+        if (w->written) w->written[i] = NowNs();
+        const uint8_t *packet = w->stream->data + (i % stream_packets) * w->stream->packet_size;
+        ASSERT(write(fd, packet, w->stream->packet_size) == (ssize_t)w->stream->packet_size);
+    }
+    close(fd);
+    return 0;
+}
+
+static void PrintHidrawLatency(const char *what, const LatencyHistogram *h) {
+    LatencySummary s = SummarizeLatency(h);
+    printf(
+        "  %-16s p50 %6.1f us, p99 %6.1f us, max %7.1f us\n",
+        what, s.p50 / 1e3, s.p99 / 1e3, s.max / 1e3
+    );
+}
+
+/* The hidraw backend with stand-ins for a device. A plain file of the stream has to parse to the same
+reports as the stream parsed directly. A FIFO fed one packet per millisecond by another thread gives
+the latency from a packet being written (the device sending it) and from the read completing to it
+being parsed, against the replay harness sleeping until each packet is due and parsing it. */
+static bool BenchHidraw(const PacketStream *s, const TabletInfo *tablet) {
+    HidrawBench b = {0};
+    Hidraw *h = malloc(sizeof(*h));
+    b.batch = malloc(sizeof(*b.batch));
+    b.read_parsed = calloc(4, sizeof(*b.read_parsed));
+    b.sent_parsed = b.read_parsed + 1;
+    b.due_parsed = b.read_parsed + 2;
+    LatencyHistogram *replay_parsed = b.read_parsed + 3;
+    uint64_t *due = calloc(BENCH_HIDRAW_PACKETS, sizeof(*due));
+    uint64_t *written = calloc(BENCH_HIDRAW_PACKETS, sizeof(*written));
+    ASSERT(h && b.batch && b.read_parsed && due && written);
+
+    char dir[64], path[96];
+    snprintf(dir, sizeof(dir), "/tmp/tabd-bench-XXXXXX");
+    if (!mkdtemp(dir)) {
+        fprintf(stderr, "failed to create a directory for the stand-ins\n");
+        return false;
+    }
+
+    uint32_t expected = 0;
+    uint64_t expected_reports = 0, stream_packets = s->size / s->packet_size;
+    for (uint64_t i = 0; i < stream_packets; i += BENCH_RING_READ_PACKETS) {
+        uint64_t n = (stream_packets - i < BENCH_RING_READ_PACKETS) ? stream_packets - i : BENCH_RING_READ_PACKETS;
+        ParseReportBatch(tablet, s->data + i * s->packet_size, n * s->packet_size, 0, b.batch);
+        for (uint32_t j = 0; j < b.batch->count; j++) {
+            TabletReport report = { b.batch->x[j], b.batch->y[j], b.batch->pressure[j], b.batch->flags[j] };
+            expected += ReportChecksum(&report);
+        }
+        expected_reports += b.batch->count;
+    }
+
+    snprintf(path, sizeof(path), "%s/stream.bin", dir);
+    FILE *f = fopen(path, "wb");
+    bool ok = f && fwrite(s->data, 1, s->size, f) == s->size;
+    if (f) fclose(f);
+    ok &= InitHidraw(h) && OpenHidrawStandIn(h, path, tablet);
+    uint64_t reads = 0, start = NowNs();
+    while (ok && PollHidraw(h, -1, HidrawBenchProc, &b) >= 0) {
+        reads++;
+    }
+    uint64_t elapsed = NowNs() - start;
+    ok &= b.checksum == expected && b.reports == expected_reports && b.packets == stream_packets;
+    printf(
+        "hidraw file: %llu packets in %llu reads, %.2f Mpackets/s, checksum %08x %s\n",
+        (unsigned long long)b.packets,
+        (unsigned long long)reads,
+        b.packets / (elapsed / 1e3),
+        b.checksum,
+        ok ? "OK" : "MISMATCH"
+    );
+    unlink(path);
+    CloseHidraw(h);
+
+    snprintf(path, sizeof(path), "%s/device", dir);
+    b = (HidrawBench){
+        .batch = b.batch,
+        .due = due,
+        .written = written,
+        .read_parsed = b.read_parsed,
+        .sent_parsed = b.sent_parsed,
+        .due_parsed = b.due_parsed,
+    };
+    bool fifo = !mkfifo(path, 0600) && InitHidraw(h) && OpenHidrawStandIn(h, path, tablet);
+    ok &= fifo;
+    if (fifo) {
+        HidrawWriter writer = {
+            .path = path,
+            .stream = s,
+            .packets = BENCH_HIDRAW_PACKETS,
+            .period_ns = 1000000000ull / BENCH_HIDRAW_RATE_HZ,
+            .due = due,
+            .written = written,
+        };
+        pthread_t thread;
+        ASSERT(!pthread_create(&thread, 0, HidrawWriterProc, &writer));
+        reads = 0;
+        while (PollHidraw(h, -1, HidrawBenchProc, &b) >= 0) {
+            reads++;
+        }
+        pthread_join(thread, 0);
+        CloseHidraw(h);
+        ok &= b.packets == BENCH_HIDRAW_PACKETS;
+
+        printf(
+            "hidraw fifo: %llu packets at %d Hz in %llu reads\n",
+            (unsigned long long)b.packets,
+            BENCH_HIDRAW_RATE_HZ,
+            (unsigned long long)reads
+        );
+        PrintHidrawLatency("read to parsed", b.read_parsed);
+        PrintHidrawLatency("sent to parsed", b.sent_parsed);
+        PrintHidrawLatency("due to parsed", b.due_parsed);
+    }
+    unlink(path);
+    rmdir(dir);
+
+    /* the replay harness on the same packets and timing */
+    uint64_t period = 1000000000ull / BENCH_HIDRAW_RATE_HZ;
+    start = NowNs() + 1000000;
+    for (uint32_t i = 0; i < BENCH_HIDRAW_PACKETS; i++) {
+        due[i] = start + i * period;
+        struct timespec ts = NsToTimespec(due[i]);
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, 0)) {}
+        ParseReportBatch(tablet, s->data + (i % stream_packets) * s->packet_size, s->packet_size, due[i], b.batch);
+        RecordLatency(replay_parsed, NowNs() - due[i]);
+    }
+    printf("replay: %d packets at %d Hz\n", BENCH_HIDRAW_PACKETS, BENCH_HIDRAW_RATE_HZ);
+    PrintHidrawLatency("due to parsed", replay_parsed);
+
+    free(written);
+    free(due);
+    free(b.read_parsed);
+    free(b.batch);
+    free(h);
+    return ok;
+}
+
+static void StopInput(int signal) {
+    (void)signal;
+    s_input_stopping = 1;
+}
+
+/* -i: real tablets (`auto`: every hidraw device in the device database) or a stand-in taken as the
+first built-in device, through the first preset until they're gone or SIGINT. SIGUSR1 prints the
+latency from read completion so far. */
+static bool RunHidrawInput(const char *path, const TabletInfo *tablet, const Preset *preset, Vec2 screen, bool inject) {
+    Hidraw *h = malloc(sizeof(*h));
+    Uinput sink;
+    HidrawBench b = {
+        .sink = &sink,
+        .batch = malloc(sizeof(ReportBatch)),
+        .frames = malloc(REPORT_BATCH_CAPACITY * sizeof(OutputFrame)),
+        .stages = calloc(LATENCY_STAGES, sizeof(LatencyHistogram)),
+    };
+    ASSERT(h && b.batch && b.frames && b.stages);
+    bool opened = InitHidraw(h) && (
+        (!strcmp(path, "auto")) ? OpenHidrawDevices(h, &s_devices, "/dev") : OpenHidrawStandIn(h, path, tablet)
+    );
+    if (!opened) {
+        free(h);
+        return false;
+    }
+    if (!inject) {
+        InitUinputNull(&sink);
+    } else if (!OpenUinput(&sink, (IVec2){ (int32_t)screen.x, (int32_t)screen.y })) {
+        fprintf(stderr, "failed to create uinput devices: %s\n", strerror(errno));
+        CloseHidraw(h);
+        free(h);
+        return false;
+    }
+
+    /* every device gets the preset compiled for the first one, good enough for timing */
+    const TabletInfo *info = &tablet[0];
+    for (int i = 0; i < HIDRAW_MAX_SOURCES; i++) {
+        if (h->sources[i].fd >= 0) {
+            info = &h->sources[i].info;
+            printf("reading %s\n", info->name);
+            break;
+        }
+    }
+    CompiledPreset compiled = CompilePreset(preset, info, screen.x, screen.y);
+    b.preset = &compiled;
+
+    struct sigaction action = { .sa_handler = RequestLatency };
+    sigaction(SIGUSR1, &action, 0);
+    action.sa_handler = StopInput;
+    sigaction(SIGINT, &action, 0);
+    uint64_t start = NowNs();
+    while (!s_input_stopping && PollHidraw(h, 100, HidrawBenchProc, &b) >= 0) {
+        if (s_latency_requested) {
+            s_latency_requested = 0;
+            PrintLatency(b.stages);
+        }
+    }
+    uint64_t elapsed = NowNs() - start;
+
+    printf(
+        "%llu packets, %llu reports in %.3f s, checksum %08x\n",
+        (unsigned long long)b.packets,
+        (unsigned long long)b.reports,
+        elapsed / 1e9,
+        b.checksum
+    );
+    printf(
+        "%llu frames, %llu writes, %llu events, %llu failed writes\n",
+        (unsigned long long)sink.frames,
+        (unsigned long long)sink.writes,
+        (unsigned long long)sink.events,
+        (unsigned long long)sink.failed
+    );
+    PrintLatency(b.stages);
+    CloseUinput(&sink);
+    CloseHidraw(h);
+    free(b.stages);
+    free(b.frames);
+    free(b.batch);
+    free(h);
+    return true;
+}
+
+/* What the uinput devices look like after the events recorded so far. */
+typedef struct {
+    int32_t abs[UINPUT_DEVICES][ABS_CNT];
+    int32_t key[UINPUT_DEVICES][KEY_CNT];
+} UinputState;
+
+/* Applies the events `u` recorded for one frame, false if they aren't whole writes. */
+static bool ApplyUinputEvents(UinputState *state, Uinput *u, uint64_t writes) {
+    uint32_t reports = 0;
+    for (uint32_t i = 0; i < u->recorded_count; i++) {
+        UinputEvent e = u->recorded[i];
+        if (e.type == EV_ABS && e.code < ABS_CNT) state->abs[e.device][e.code] = e.value;
+        if (e.type == EV_KEY && e.code < KEY_CNT) state->key[e.device][e.code] = e.value;
+        reports += e.type == EV_SYN && e.code == SYN_REPORT;
+    }
+    bool whole = u->recorded_count < u->recorded_capacity
+        && reports == u->writes - writes
+        && (!reports || u->recorded[u->recorded_count - 1].type == EV_SYN);
+    u->recorded_count = 0;
+    return whole;
+}
+
+/* Whether the devices now show what `frame` asked for. */
+static bool MatchUinputFrame(const UinputState *state, const OutputFrame *frame) {
+    const int32_t *pen = state->abs[UINPUT_PEN], *mouse = state->abs[UINPUT_MOUSE];
+    bool ok = true;
+    if (frame->flags & OUTPUT_PEN) {
+        ok &= pen[ABS_X] == frame->pixel.x && pen[ABS_Y] == frame->pixel.y;
+        ok &= pen[ABS_PRESSURE] == (int32_t)((frame->pointer_down) ? frame->pressure : 0);
+        ok &= state->key[UINPUT_PEN][BTN_TOOL_PEN] == 1;
+        ok &= state->key[UINPUT_PEN][BTN_TOUCH] == frame->pointer_down;
+        if (frame->flags & OUTPUT_RIGHT_DOWN) ok &= state->key[UINPUT_PEN][BTN_STYLUS] == 1;
+        if (frame->flags & OUTPUT_RIGHT_UP)   ok &= state->key[UINPUT_PEN][BTN_STYLUS] == 0;
+        return ok;
+    }
+    if (!(frame->flags & OUTPUT_MOUSE))
+        return ok;
+
+    ok &= state->key[UINPUT_PEN][BTN_TOOL_PEN] == 0;
+    if (frame->flags & OUTPUT_MOUSE_MOVE) {
+        ok &= mouse[ABS_X] == frame->absolute.x && mouse[ABS_Y] == frame->absolute.y;
+    }
+    if (frame->flags & OUTPUT_LEFT_DOWN)  ok &= state->key[UINPUT_MOUSE][BTN_LEFT] == 1;
+    if (frame->flags & OUTPUT_LEFT_UP)    ok &= state->key[UINPUT_MOUSE][BTN_LEFT] == 0;
+    if (frame->flags & OUTPUT_RIGHT_DOWN) ok &= state->key[UINPUT_MOUSE][BTN_RIGHT] == 1;
+    if (frame->flags & OUTPUT_RIGHT_UP)   ok &= state->key[UINPUT_MOUSE][BTN_RIGHT] == 0;
+    return ok;
+}
+
+/* A mouse preset stroke that switches to the pen with the second barrel button, clicks the first one
+and switches back. */
+static const uint32_t s_switch_script[] = {
+    0,
+    TABLET_REPORT_POINTER_DOWN,
+    TABLET_REPORT_POINTER_DOWN | TABLET_REPORT_BUTTON_DOWN(1),
+    TABLET_REPORT_POINTER_DOWN | TABLET_REPORT_BUTTON_DOWN(1) | TABLET_REPORT_BUTTON_DOWN(0),
+    TABLET_REPORT_BUTTON_DOWN(1),
+    0,
+    TABLET_REPORT_BUTTON_DOWN(0),
+    0,
+};
+
+/* Every preset's frames into the recording uinput sink, followed by the switch script. Each
+frame with output has to be a single write ending in SYN_REPORT, apart from taking the pen out of
+range, and the devices rebuilt from the recorded events have to show what the frames asked for.
+Then what a frame costs through the null sink, which is the encoding without the syscall. */
+static bool BenchUinput(const PacketStream *s, const TabletInfo *tablet, Vec2 screen) {
+    const uint32_t *script = s_switch_script;
+    uint64_t stream_packets = s->size / s->packet_size;
+    UinputEvent *events = malloc(2 * UINPUT_FRAME_EVENTS * sizeof(*events));
+    UinputState *state = malloc(sizeof(*state));
+    OutputFrame *frames = malloc((stream_packets + COUNTOF(s_switch_script)) * sizeof(*frames));
+    ASSERT(events && state && frames);
+
+    bool ok = true;
+    for (unsigned int p = 0; p <= COUNTOF(g_presets); p++) {
+        bool scripted = p == COUNTOF(g_presets);
+        const Preset *preset = &g_presets[(scripted) ? 1 : p];
+        CompiledPreset compiled = CompilePreset(preset, tablet, screen.x, screen.y);
+        uint32_t count = 0;
+        if (!scripted) {
+            TabletReport previous = {0};
+            for (uint64_t i = 0; i < stream_packets; i++) {
+                TabletReport report;
+                if (!ParseReport(tablet, s->data + i * s->packet_size, s->packet_size, &report))
+                    continue;
+                frames[count++] = ComputeOutputFrame(&compiled, &previous, &report);
+                previous = report;
+            }
+        } else {
+            for (uint32_t previous = 0; count < COUNTOF(s_switch_script); previous = script[count++]) {
+                IVec2 point = { 1000 * count, 500 * count };
+                frames[count] = DecideOutput(&compiled, previous, script[count], 100 * count, point, point);
+            }
+        }
+
+        Uinput u;
+        InitUinputRecording(&u, events, 2 * UINPUT_FRAME_EVENTS);
+        memset(state, 0, sizeof(*state));
+        uint32_t mismatches = 0, outputs = 0;
+        for (uint32_t i = 0; i < count; i++) {
+            uint64_t writes = u.writes;
+            SynthesizeUinput(&u, &frames[i]);
+            bool to_mouse = (frames[i].flags & OUTPUT_MOUSE) && !(frames[i].flags & OUTPUT_PEN);
+            bool single = u.writes - writes <= 1 || (u.writes - writes == 2 && to_mouse);
+            mismatches += !ApplyUinputEvents(state, &u, writes) || !single || !MatchUinputFrame(state, &frames[i]);
+            outputs += (frames[i].flags & (OUTPUT_PEN | OUTPUT_MOUSE)) != 0;
+        }
+        ok &= !mismatches;
+        printf(
+            "uinput %-8ls: %u frames, %u with output, %llu writes, %.2f events per write, %u mismatches (%s)\n",
+            (scripted) ? L"switch" : preset->name,
+            count,
+            outputs,
+            (unsigned long long)u.writes,
+            u.writes ? (double)u.events / u.writes : 0,
+            mismatches,
+            (mismatches) ? "MISMATCH" : "OK"
+        );
+        if (scripted)
+            continue;
+
+        InitUinputNull(&u);
+        uint64_t start = NowNs();
+        for (int r = 0; r < BENCH_UINPUT_REPEAT; r++) {
+            for (uint32_t i = 0; i < count; i++) {
+                SynthesizeUinput(&u, &frames[i]);
+            }
+        }
+        uint64_t elapsed = NowNs() - start;
+        printf("  null sink: %.1f ns per frame\n", count ? (double)elapsed / ((uint64_t)count * BENCH_UINPUT_REPEAT) : 0);
+    }
+
+    free(frames);
+    free(state);
+    free(events);
+    return ok;
+}
+
+typedef struct {
+    DeviceTable *table;
+    Hidraw *hidraw;
+    uint64_t full; /* pushes that found a ring full and had to wait */
+} DevicesReader;
+
+/* The reader loop's side of a device slot, like tabd.exe's ServiceTablet(): parse into the slot's
+batch and queue it on the slot's ring. Waits for space instead of dropping, as RingProducerProc()
+does, so checksums stay comparable. */
+static void DevicesReaderProc(void *context, const HidrawSource *source, const uint8_t *data, uint32_t size, uint64_t time_ns) {
+    DevicesReader *r = context;
+    DeviceSlot *slot = &r->table->slots[source - r->hidraw->sources];
+    ParseReportBatch(&slot->info, data, size, time_ns, &slot->batch);
+    for (uint32_t i = 0; i < slot->batch.count; i++) {
+        TabletReport report = {
+            slot->batch.x[i], slot->batch.y[i], slot->batch.pressure[i], slot->batch.flags[i],
+        };
+        if (slot->ring.head - AtomicLoad32(&slot->ring.tail) == REPORT_RING_CAPACITY) {
+            r->full++;
+            while (slot->ring.head - AtomicLoad32(&slot->ring.tail) == REPORT_RING_CAPACITY) {
+                sched_yield();
+            }
+        }
+        PushReport(&slot->ring, &report, slot->batch.time_ns[i], slot->generation);
+    }
+}
+
+typedef struct {
+    DeviceTable *table;
+    uint32_t devices;
+    volatile uint32_t reading;  /* cleared once every source has ended */
+    uint64_t **written;         /* per device and packet, 0 when not timing */
+    LatencyHistogram *latency;  /* per device, written to output frame */
+    uint64_t reports[DEVICE_TABLE_CAPACITY];
+    uint32_t checksums[DEVICE_TABLE_CAPACITY];
+} DevicesOutput;
+
+/* tabd.exe's output thread: a batch off every device's ring in turn, through the device's own
+preset and state. */
+static void *DevicesOutputProc(void *arg) {
+    DevicesOutput *o = arg;
+    ReportBatch *batch = malloc(sizeof(*batch));
+    OutputFrame *frames = malloc(REPORT_BATCH_CAPACITY * sizeof(*frames));
+    ASSERT(batch && frames);
+
+    for (;;) {
+        bool reading = AtomicLoad32(&o->reading);
+        uint32_t popped = 0;
+        for (uint32_t d = 0; d < o->devices; d++) {
+            DeviceSlot *slot = &o->table->slots[d];
+            if (!PopDeviceBatch(slot, batch))
+                continue;
+
+            const CompiledPreset *preset = PrepareDeviceBatch(slot, batch);
+            MapReportBatch(preset, batch);
+            uint32_t n = ComputeOutputFrames(preset, &slot->previous, batch, frames);
+            uint64_t now = NowNs();
+            for (uint32_t i = 0; i < n; i++) {
+                o->checksums[d] += FrameChecksum(&frames[i]);
+            }
+            for (uint32_t i = 0; o->written && i < batch->count; i++) {
+                RecordLatency(&o->latency[d], now - o->written[d][o->reports[d] + i]);
+            }
+            o->reports[d] += batch->count;
+            popped += batch->count;
+        }
+        if (!popped && !reading)
+            break;
+        if (!popped) {
+            sched_yield();
+        }
+    }
+
+    free(frames);
+    free(batch);
+    return 0;
+}
+
+/* Runs `devices` FIFO stand-ins, each fed `packets` of `s` by a writer thread of its own, through one
+reader loop and one output thread. */
+static bool RunDevices(
+    const char *dir, const PacketStream *s, const TabletInfo *tablet, const CompiledPreset *compiled,
+    uint32_t devices, uint32_t packets, uint64_t period_ns, DeviceTable *table, DevicesOutput *o, uint64_t *elapsed
+) {
+    Hidraw *h = malloc(sizeof(*h));
+    HidrawWriter writers[DEVICE_TABLE_CAPACITY];
+    pthread_t threads[DEVICE_TABLE_CAPACITY], output;
+    char paths[DEVICE_TABLE_CAPACITY][96];
+    ASSERT(h);
+
+    memset(table, 0, sizeof(*table));
+    InitDeviceTable(table, 0, 0);
+    o->table = table;
+    o->devices = devices;
+    o->reading = 1;
+    memset(o->reports, 0, sizeof(o->reports));
+    memset(o->checksums, 0, sizeof(o->checksums));
+    bool ok = InitHidraw(h);
+    for (uint32_t d = 0; d < devices; d++) {
+        snprintf(paths[d], sizeof(paths[d]), "%s/device%u", dir, d);
+        DeviceSlot *slot = (ok) ? ClaimDeviceSlot(table, tablet) : 0;
+        ok = slot && GetDeviceIndex(table, slot) == d;
+        for (uint32_t p = 0; ok && p < COUNTOF(g_presets); p++) {
+            PublishPreset(&slot->presets[p], &compiled[p]);
+        }
+        if (ok) {
+            slot->preset_idx = d % COUNTOF(g_presets);
+        }
+        /* sources are taken in order as well, so source d feeds slot d */
+        ok = ok && !mkfifo(paths[d], 0600) && OpenHidrawStandIn(h, paths[d], tablet) && h->sources[d].fd >= 0;
+    }
+    if (!ok) {
+        for (uint32_t d = 0; d < devices; d++) {
+            unlink(paths[d]);
+        }
+        CloseHidraw(h);
+        free(h);
+        return false;
+    }
+
+    DevicesReader r = { table, h, 0 };
+    uint64_t begin = NowNs(), start = begin + 2000000;
+    ASSERT(!pthread_create(&output, 0, DevicesOutputProc, o));
+    for (uint32_t d = 0; d < devices; d++) {
+        writers[d] = (HidrawWriter){
+            .path = paths[d],
+            .stream = s,
+            .packets = packets,
+            .period_ns = period_ns,
+            .start_ns = start,
+            .written = (o->written) ? o->written[d] : 0,
+        };
+        ASSERT(!pthread_create(&threads[d], 0, HidrawWriterProc, &writers[d]));
+    }
+    while (PollHidraw(h, -1, DevicesReaderProc, &r) >= 0) {}
+    AtomicStore32(&o->reading, 0);
+    pthread_join(output, 0);
+    *elapsed = NowNs() - begin;
+    for (uint32_t d = 0; d < devices; d++) {
+        pthread_join(threads[d], 0);
+        unlink(paths[d]);
+    }
+
+    CloseHidraw(h);
+    free(h);
+    return true;
+}
+
+/* Several tablets at once, each a FIFO stand-in with a writer thread playing the device, read by a
+single epoll loop into per-device slots and drained by one output thread as tabd.exe does. Device
+i uses preset i % COUNTOF(g_presets), without filter and predictor since those depend on read times.
+Every device's checksum has to match that preset's run of the stream on its own, any report or state
+ending up at the wrong device would show. First every device sends the whole stream as fast as the
+pipeline takes it, then BENCH_DEVICES_PACKETS at BENCH_HIDRAW_RATE_HZ each, all due at the same time,
+for the latency from a packet being written to its output frame. */
+static bool BenchDevices(const PacketStream *s, const TabletInfo *tablet, Vec2 screen) {
+    static const uint32_t s_device_counts[] = { 1, 2, 4, 8, 16 };
+
+    /* only packets that parse, so the k-th report of a device came from its k-th packet */
+    uint64_t stream_packets = s->size / s->packet_size;
+    PacketStream valid = { malloc(s->size), 0, s->packet_size };
+    uint64_t valid_packets = 0;
+    DeviceTable *table = aligned_alloc(_Alignof(DeviceTable), sizeof(*table)); /* holds rings */
+    DevicesOutput *o = malloc(sizeof(*o));
+    LatencyHistogram *latency = malloc(DEVICE_TABLE_CAPACITY * sizeof(*latency));
+    uint64_t *written[DEVICE_TABLE_CAPACITY];
+    ASSERT(valid.data && table && o && latency);
+    for (uint32_t d = 0; d < DEVICE_TABLE_CAPACITY; d++) {
+        written[d] = malloc(BENCH_DEVICES_PACKETS * sizeof(*written[d]));
+        ASSERT(written[d]);
+    }
+    for (uint64_t i = 0; i < stream_packets; i++) {
+        TabletReport report;
+        if (!ParseReport(tablet, s->data + i * s->packet_size, s->packet_size, &report))
+            continue;
+        memcpy(valid.data + valid.size, s->data + i * s->packet_size, s->packet_size);
+        valid.size += s->packet_size;
+        valid_packets++;
+    }
+
+    CompiledPreset compiled[COUNTOF(g_presets)];
+    uint32_t expected[COUNTOF(g_presets)], expected_latency[COUNTOF(g_presets)];
+    for (uint32_t p = 0; p < COUNTOF(g_presets); p++) {
+        Preset preset = g_presets[p];
+        preset.filter = (FilterSettings){ FILTER_NONE };
+        preset.predict = (PredictorSettings){ PREDICT_NONE };
+        compiled[p] = CompilePreset(&preset, tablet, screen.x, screen.y);
+        TabletReport previous = {0};
+        expected[p] = expected_latency[p] = 0;
+        for (uint64_t i = 0; valid_packets && (i < valid_packets || i < BENCH_DEVICES_PACKETS); i++) {
+            TabletReport report;
+            ParseReport(tablet, valid.data + (i % valid_packets) * valid.packet_size, valid.packet_size, &report);
+            OutputFrame frame = ComputeOutputFrame(&compiled[p], &previous, &report);
+            previous = report;
+            if (i < valid_packets) expected[p] += FrameChecksum(&frame);
+            if (i < BENCH_DEVICES_PACKETS) expected_latency[p] += FrameChecksum(&frame);
+        }
+    }
+
+    char dir[64];
+    snprintf(dir, sizeof(dir), "/tmp/tabd-bench-XXXXXX");
+    if (!valid_packets || !mkdtemp(dir)) {
+        fprintf(stderr, "failed to set up the device stand-ins\n");
+        return false;
+    }
+
+    bool ok = true;
+    for (unsigned int c = 0; c < COUNTOF(s_device_counts); c++) {
+        uint32_t devices = s_device_counts[c];
+        uint64_t elapsed = 0, reports = 0;
+        uint32_t mismatches = 0;
+        o->written = 0;
+        o->latency = 0;
+        bool ran = RunDevices(dir, &valid, tablet, compiled, devices, (uint32_t)valid_packets, 0, table, o, &elapsed);
+        for (uint32_t d = 0; ran && d < devices; d++) {
+            mismatches += o->reports[d] != valid_packets || o->checksums[d] != expected[d % COUNTOF(g_presets)];
+            reports += o->reports[d];
+        }
+        ok &= ran && !mismatches;
+        printf(
+            "devices %2u: %llu reports in %.1f ms, %.2f Mreports/s, %u mismatches (%s)\n",
+            devices,
+            (unsigned long long)reports,
+            elapsed / 1e6,
+            (elapsed) ? reports / (elapsed / 1e3) : 0,
+            mismatches,
+            (ran && !mismatches) ? "OK" : "MISMATCH"
+        );
+        if (!ran)
+            continue;
+
+        memset(latency, 0, DEVICE_TABLE_CAPACITY * sizeof(*latency));
+        o->written = written;
+        o->latency = latency;
+        ran = RunDevices(
+            dir, &valid, tablet, compiled, devices, BENCH_DEVICES_PACKETS,
+            1000000000ull / BENCH_HIDRAW_RATE_HZ, table, o, &elapsed
+        );
+        LatencySummary low = {0}, high = {0};
+        for (uint32_t d = 0; ran && d < devices; d++) {
+            LatencySummary l = SummarizeLatency(&latency[d]);
+            mismatches += o->reports[d] != BENCH_DEVICES_PACKETS
+                || o->checksums[d] != expected_latency[d % COUNTOF(g_presets)];
+            low.p50 = (!d || l.p50 < low.p50) ? l.p50 : low.p50;
+            low.p99 = (!d || l.p99 < low.p99) ? l.p99 : low.p99;
+            high.p50 = (!d || l.p50 > high.p50) ? l.p50 : high.p50;
+            high.p99 = (!d || l.p99 > high.p99) ? l.p99 : high.p99;
+        }
+        ok &= ran && !mismatches;
+        printf(
+            "  %d Hz each: sent to output p50 %.1f..%.1f us, p99 %.1f..%.1f us across devices%s\n",
+            BENCH_HIDRAW_RATE_HZ,
+            low.p50 / 1e3,
+            high.p50 / 1e3,
+            low.p99 / 1e3,
+            high.p99 / 1e3,
+            (ran && !mismatches) ? "" : " (MISMATCH)"
+        );
+    }
+    rmdir(dir);
+
+    for (uint32_t d = 0; d < DEVICE_TABLE_CAPACITY; d++) {
+        free(written[d]);
+    }
+    free(latency);
+    free(o);
+    free(table);
+    free(valid.data);
+    return ok;
+}
+
+/* Pushes `count` reports onto the slot's ring as its reader does, x numbering them from `first`. */
+static void PushSlotReports(DeviceSlot *slot, int32_t first, uint32_t count) {
+    for (uint32_t i = 0; i < count; i++) {
+        TabletReport report = { first + (int32_t)i, 1, 1, TABLET_REPORT_POINTER_DOWN };
+        PushReport(&slot->ring, &report, 0, slot->generation);
+    }
+}
+
+/* A slot released with reports still on its ring and claimed for the next tablet: none of them may
+be mapped for that tablet, whose output side state starts over, and an output thread that read the
+generation from before the claim has to leave the next tablet's reports queued, not drop them. */
+static bool BenchSlotReuse(const TabletInfo *tablet) {
+    DeviceTable *table = aligned_alloc(_Alignof(DeviceTable), sizeof(*table)); /* holds rings */
+    ReportBatch *batch = malloc(sizeof(*batch));
+    ASSERT(table && batch);
+    memset(table, 0, sizeof(*table));
+    InitDeviceTable(table, 0, 0);
+
+    DeviceSlot *slot = ClaimDeviceSlot(table, tablet);
+    PushSlotReports(slot, 0, 3);
+    bool ok = PopDeviceBatch(slot, batch) == 3;
+    slot->previous = (TabletReport){ batch->x[2], 1, 1, TABLET_REPORT_POINTER_DOWN };
+
+    /* the tablet goes away with reports queued */
+    PushSlotReports(slot, 100, 5);
+    ReleaseDeviceSlot(table, slot);
+    ok &= ClaimDeviceSlot(table, tablet) == slot;
+    PushSlotReports(slot, 200, 2);
+    ok &= PopDeviceBatch(slot, batch) == 2 && batch->x[0] == 200 && batch->x[1] == 201;
+    ok &= !slot->previous.x && !slot->previous.flags;
+
+    /* the output thread is a claim behind */
+    uint32_t behind = slot->generation;
+    PushSlotReports(slot, 300, 2);
+    ReleaseDeviceSlot(table, slot);
+    ok &= ClaimDeviceSlot(table, tablet) == slot;
+    PushSlotReports(slot, 400, 4);
+    ok &= PopReportBatch(&slot->ring, batch, behind) == 2 && batch->x[0] == 300;
+    ok &= PopDeviceBatch(slot, batch) == 4 && batch->x[0] == 400 && batch->x[3] == 403;
+    ok &= !PopDeviceBatch(slot, batch) && slot->ring.tail == slot->ring.head;
+
+    printf("slot reuse: reports left by a released tablet dropped %s\n", ok ? "OK" : "MISMATCH");
+    free(batch);
+    free(table);
+    return ok;
+}
+
+/* Pen movement for the filter bench, as a CTL-672 capture at its ~133 Hz report rate: the pen rests
+for half a second, flicks to another spot in 150 ms, rests again and then circles slowly. Every
+report gets up to ±BENCH_FILTER_NOISE raw units of triangular sensor noise. */
+static uint8_t *GenerateFilterCapture(size_t *size) {
+    uint32_t reports = BENCH_FILTER_SECONDS * 133;
+    *size = sizeof(CaptureHeader) + reports * CAPTURE_RECORD_SIZE(10);
+    uint8_t *data = malloc(*size);
+    ASSERT(data);
+
+    CaptureHeader header;
+    InitCaptureHeader(&header);
+    memcpy(data, &header, sizeof(header));
+    size_t offset = sizeof(header);
+
+    uint32_t seed = 12345, cycle = ~0u;
+    double from_x = 10000, from_y = 6000, to_x = from_x, to_y = from_y;
+    for (uint32_t i = 0; i < reports; i++) {
+        double t = i * 0.0075, phase = fmod(t, 2.0);
+        if (cycle != (uint32_t)(t / 2.0)) {
+            cycle = (uint32_t)(t / 2.0);
+            from_x = to_x;
+            from_y = to_y;
+            seed = seed * 1664525u + 1013904223u;
+            to_x = 3000 + (seed >> 8) % 15000;
+            to_y = 3000 + (seed >> 12) % 7000;
+        }
+
+        double x = to_x, y = to_y;
+        if (phase < 0.5) {
+            x = from_x;
+            y = from_y;
+        } else if (phase < 0.65) {
+            /* minimum-jerk profile, like a hand's point-to-point movement */
+            double u = (phase - 0.5) / 0.15, k = u * u * u * (10 - 15 * u + 6 * u * u);
+            x = from_x + (to_x - from_x) * k;
+            y = from_y + (to_y - from_y) * k;
+        } else if (phase >= 1.2) {
+            double a = (phase - 1.2) / 0.8 * 2 * 3.14159265358979;
+            x = to_x + 1000 * (cos(a) - 1);
+            y = to_y + 1000 * sin(a);
+        }
+
+        int noise[2];
+        for (int k = 0; k < 2; k++) {
+            seed = seed * 1664525u + 1013904223u;
+            int a = (seed >> 8) % (BENCH_FILTER_NOISE + 1), b = (seed >> 20) % (BENCH_FILTER_NOISE + 1);
+            noise[k] = a - b;
+        }
+        uint16_t px = (uint16_t)(x + noise[0]), py = (uint16_t)(y + noise[1]);
+        uint8_t packet[10] = { 0x02, 0xE1, px & 0xFF, px >> 8, py & 0xFF, py >> 8, 0x00, 0x04 };
+        offset += WriteCaptureRecord(
+            data + offset, 1000000000ull + i * 7500000ull, s_tablet_infos[0].vid, s_tablet_infos[0].pid,
+            packet, sizeof(packet)
+        );
+    }
+    return data;
+}
+
+typedef struct {
+    double *t;    /* s */
+    double *x, *y; /* mm */
+    uint32_t count;
+} Trace;
+
+/* Jitter is the RMS second difference between consecutive reports while the pen rests, i.e. while
+the raw average of the 5 reports before and the 5 after are less than BENCH_FILTER_REST apart. Only
+sensor noise moves a resting pen so the strokes themselves don't count as jitter. */
+static double TraceJitter(const Trace *raw, const Trace *trace) {
+    double sum = 0;
+    uint32_t n = 0;
+    for (uint32_t i = 5; i + 5 < trace->count; i++) {
+        double dx = 0, dy = 0;
+        for (int k = 1; k <= 5; k++) {
+            dx += raw->x[i + k] - raw->x[i - k];
+            dy += raw->y[i + k] - raw->y[i - k];
+        }
+        if (dx * dx + dy * dy >= 25 * BENCH_FILTER_REST * BENCH_FILTER_REST)
+            continue;
+
+        dx = trace->x[i + 1] - 2 * trace->x[i] + trace->x[i - 1];
+        dy = trace->y[i + 1] - 2 * trace->y[i] + trace->y[i - 1];
+        sum += dx * dx + dy * dy;
+        n++;
+    }
+    return n ? sqrt(sum / n) : 0;
+}
+
+/* Lag is the delay that best lines the filtered trace up with the raw one: the d minimizing the RMS
+distance between filtered(t) and raw(t - d), raw linearly interpolated, d in 0.1 ms steps. */
+static double TraceLag(const Trace *raw, const Trace *trace, double *error) {
+    double best_lag = 0, best = 1e300;
+    for (double d = 0; d <= BENCH_FILTER_MAX_LAG; d += 0.0001) {
+        double sum = 0;
+        uint32_t n = 0;
+        for (uint32_t i = 0, j = 0; i < trace->count; i++) {
+            double t = trace->t[i] - d;
+            while (j + 1 < raw->count && raw->t[j + 1] <= t) {
+                j++;
+            }
+            if (t < raw->t[0] || j + 1 >= raw->count || raw->t[j + 1] == raw->t[j])
+                continue;
+            double u = (t - raw->t[j]) / (raw->t[j + 1] - raw->t[j]);
+            double dx = trace->x[i] - (raw->x[j] + (raw->x[j + 1] - raw->x[j]) * u);
+            double dy = trace->y[i] - (raw->y[j] + (raw->y[j + 1] - raw->y[j]) * u);
+            sum += dx * dx + dy * dy;
+            n++;
+        }
+        if (n && sum / n < best) {
+            best = sum / n;
+            best_lag = d;
+        }
+    }
+    *error = sqrt(best);
+    return best_lag;
+}
+
+static void FreeTrace(Trace *trace) {
+    free(trace->t);
+    free(trace->x);
+    free(trace->y);
+}
+
+/* Idle-heavy capture at ~133 Hz: the pen hovers over one spot with ±BENCH_IDLE_NOISE raw units of
+noise and touches down for 200 ms every 4 s, like someone reading a page between strokes. `pressing`
+holds the tip down in place instead, still but for ±BENCH_PRESS_NOISE units of pressure. */
+static uint8_t *GenerateIdleCapture(bool pressing, size_t *size) {
+    uint32_t reports = BENCH_IDLE_SECONDS * 133;
+    *size = sizeof(CaptureHeader) + reports * CAPTURE_RECORD_SIZE(10);
+    uint8_t *data = malloc(*size);
+    ASSERT(data);
+
+    CaptureHeader header;
+    InitCaptureHeader(&header);
+    memcpy(data, &header, sizeof(header));
+    size_t offset = sizeof(header);
+
+    uint32_t seed = 54321;
+    for (uint32_t i = 0; i < reports; i++) {
+        bool down = pressing || fmod(i * 0.0075, 4.0) >= 3.8;
+        int noise[3];
+        for (int k = 0; k < 3; k++) {
+            seed = seed * 1664525u + 1013904223u;
+            int range = (k == 2) ? BENCH_PRESS_NOISE : (pressing) ? 0 : BENCH_IDLE_NOISE;
+            noise[k] = (int)((seed >> 8) % (2 * range + 1)) - range;
+        }
+        uint16_t px = (uint16_t)(9000 + noise[0]), py = (uint16_t)(5000 + noise[1]);
+        uint16_t pressure = (down) ? 600 + ((pressing) ? noise[2] : 0) : 0;
+        uint8_t packet[10] = {
+            0x02, 0xE0 | (down ? TABLET_REPORT_POINTER_DOWN : 0), px & 0xFF, px >> 8, py & 0xFF, py >> 8,
+            pressure & 0xFF, pressure >> 8,
+        };
+        offset += WriteCaptureRecord(
+            data + offset, 1000000000ull + i * 7500000ull, s_tablet_infos[0].vid, s_tablet_infos[0].pid,
+            packet, sizeof(packet)
+        );
+    }
+    return data;
+}
+
+/* Every report of a capture through `preset` as tabd.exe runs it, filter and predictor included, into
+frames stamped with their reports' times. Returns the number of frames, 0 if the capture's tablet is
+unknown. */
+static uint32_t CaptureOutputFrames(
+    const uint8_t *capture, size_t size, const Preset *preset, Vec2 screen, OutputFrame **frames, uint64_t **times
+) {
+    ReplaySource replay;
+    CaptureRecord record;
+    TabletInfo tablet;
+    if (
+        !InitReplaySource(&replay, capture, size, REPLAY_FAST)
+        || !PeekReplayRecord(&replay, &record)
+        || !FindTabletInfo(&s_devices, record.vid, record.pid, &tablet)
+    ) {
+        return 0;
+    }
+
+    uint32_t capacity = size / tablet.packet_size + 1;
+    *frames = malloc(capacity * sizeof(**frames));
+    *times = malloc(capacity * sizeof(**times));
+    ReportBatch *batch = malloc(sizeof(*batch));
+    ASSERT(*frames && *times && batch);
+
+    CompiledPreset compiled = CompilePreset(preset, &tablet, screen.x, screen.y);
+    FilterState filter = {0};
+    PredictorState predictor = {0};
+    TabletReport previous = {0};
+    uint32_t count = 0;
+    uint64_t due;
+    while (NextReplayRecord(&replay, 0, &record, &due)) {
+        if (record.vid != tablet.vid || record.pid != tablet.pid)
+            continue;
+        ParseReportBatch(&tablet, record.packet, record.size, record.time_ns, batch);
+        FilterReportBatch(&compiled, &filter, batch);
+        PredictReportBatch(&compiled, &predictor, batch);
+        MapReportBatch(&compiled, batch);
+        ComputeOutputFrames(&compiled, &previous, batch, *frames + count);
+        memcpy(*times + count, batch->time_ns, batch->count * sizeof(**times));
+        count += batch->count;
+    }
+    free(batch);
+    return count;
+}
+
+/* Whether `frame` injects anything the one before it didn't, going by what the platform receives:
+pixels, pressure and contact for the pen, absolute units for the mouse, and any button transition. */
+static bool IsOutputChange(const OutputFrame *last, const OutputFrame *frame) {
+    uint32_t kind = OUTPUT_PEN | OUTPUT_MOUSE | OUTPUT_MOUSE_MOVE;
+    bool pen = frame->flags & OUTPUT_PEN, mouse = frame->flags & OUTPUT_MOUSE;
+    return (frame->flags & OUTPUT_TRANSITIONS) || (frame->flags & kind) != (last->flags & kind)
+        || (pen && (frame->pixel.x != last->pixel.x || frame->pixel.y != last->pixel.y))
+        || (pen && (frame->pressure != last->pressure || frame->pointer_down != last->pointer_down))
+        || (mouse && (frame->absolute.x != last->absolute.x || frame->absolute.y != last->absolute.y));
+}
+
+/* Delta suppression on a drawing capture (the stream), a resting one (the filter capture), an
+idle-heavy one and one pressing in place: how many injection calls and uinput writes every frame
+takes, and how many are left at a few keep-alive intervals. Every frame, skipped or not, has to leave
+the recording sink's devices in the state it asked for, so nothing observable was skipped, and no
+more frames may be emitted than there are changes plus a keep-alive per interval, so nothing that
+changes nothing is kept either. Osu runs a second time with pressure sensitivity, which mouse
+output has no use for. */
+static bool BenchSuppression(const char *const *names, uint8_t *const *captures, const size_t *sizes, uint32_t count, Vec2 screen) {
+    static const uint32_t s_keep_alive_ms[] = { OUTPUT_KEEP_ALIVE_MS, 1000 };
+    UinputEvent *events = malloc(2 * UINPUT_FRAME_EVENTS * sizeof(*events));
+    UinputState *state = malloc(sizeof(*state));
+    ASSERT(events && state);
+    Preset presets[COUNTOF(g_presets) + 1];
+    memcpy(presets, g_presets, sizeof(g_presets));
+    presets[COUNTOF(g_presets)] = g_presets[1];
+    presets[COUNTOF(g_presets)].name = L"Osu+pres";
+    presets[COUNTOF(g_presets)].pressure_sensitivity = 1;
+
+    bool ok = true;
+    for (uint32_t c = 0; c < count; c++) {
+        for (unsigned int p = 0; p < COUNTOF(presets); p++) {
+            OutputFrame *frames = 0;
+            uint64_t *times = 0;
+            uint32_t n = CaptureOutputFrames(captures[c], sizes[c], &presets[p], screen, &frames, &times);
+            if (!n) {
+                free(frames);
+                free(times);
+                continue;
+            }
+
+            uint64_t calls = 0;
+            uint32_t changes = 0;
+            const OutputFrame *last = 0;
+            Uinput all;
+            InitUinputNull(&all);
+            for (uint32_t i = 0; i < n; i++) {
+                calls += CountOutputCalls(&frames[i]);
+                SynthesizeUinput(&all, &frames[i]);
+                if (!(frames[i].flags & (OUTPUT_PEN | OUTPUT_MOUSE)))
+                    continue;
+                changes += !last || IsOutputChange(last, &frames[i]);
+                last = &frames[i];
+            }
+            printf(
+                "suppress %-8s %-8ls: %u frames, %llu calls, %llu uinput writes without\n",
+                names[c],
+                presets[p].name,
+                n,
+                (unsigned long long)calls,
+                (unsigned long long)all.writes
+            );
+
+            for (unsigned int k = 0; k < COUNTOF(s_keep_alive_ms); k++) {
+                OutputSuppressor suppressor = { .keep_alive_ns = s_keep_alive_ms[k] * 1000000ull };
+                Uinput u;
+                InitUinputRecording(&u, events, 2 * UINPUT_FRAME_EVENTS);
+                memset(state, 0, sizeof(*state));
+                uint32_t mismatches = 0, emitted = 0;
+                uint64_t start = NowNs();
+                for (uint32_t i = 0; i < n; i++) {
+                    uint64_t writes = u.writes;
+                    if (ShouldEmitFrame(&suppressor, &frames[i], times[i])) {
+                        SynthesizeUinput(&u, &frames[i]);
+                        emitted++;
+                    }
+                    mismatches += !ApplyUinputEvents(state, &u, writes) || !MatchUinputFrame(state, &frames[i]);
+                }
+                uint64_t elapsed = NowNs() - start;
+                uint32_t needed = changes + (uint32_t)((times[n - 1] - times[0]) / suppressor.keep_alive_ns) + 1;
+                mismatches += emitted > needed;
+                ok &= !mismatches && suppressor.calls_saved <= calls;
+                printf(
+                    "  keep-alive %4u ms: %llu calls (%.1f%% saved), %llu uinput writes, %.1f ns per frame, "
+                    "%u mismatches (%s)\n",
+                    s_keep_alive_ms[k],
+                    (unsigned long long)(calls - suppressor.calls_saved),
+                    (calls) ? 100.0 * suppressor.calls_saved / calls : 0,
+                    (unsigned long long)u.writes,
+                    (double)elapsed / n,
+                    mismatches,
+                    (mismatches) ? "MISMATCH" : "OK"
+                );
+            }
+            free(frames);
+            free(times);
+        }
+    }
+
+    free(state);
+    free(events);
+    return ok;
+}
+
+/* Whether the calls planned for `count` frames, expanded back into frames in the order they'd be made,
+are every frame's pen call followed by its mouse event as when injecting them one by one. */
+static bool CheckOutputCalls(const OutputFrame *frames, uint32_t count, const OutputCall *calls, uint32_t n) {
+    static const uint32_t s_kinds[] = { OUTPUT_PEN, OUTPUT_MOUSE };
+    uint32_t c = 0, i = 0; /* frame i of call c is next */
+    for (uint32_t f = 0; f < count; f++) {
+        for (int k = 0; k < 2; k++) {
+            if (!(frames[f].flags & s_kinds[k]))
+                continue;
+            if (c == n || calls[c].kind != s_kinds[k] || calls[c].first + i != f)
+                return false;
+            if (s_kinds[k] == OUTPUT_PEN && calls[c].count != 1)
+                return false;
+            if (++i == calls[c].count) {
+                c++;
+                i = 0;
+            }
+        }
+    }
+    return c == n;
+}
+
+/* Applies what a batch of frames recorded, false unless every frame with output shows up in order in
+a SYN_REPORT of its own on its device, stamped with its time and leaving the devices as it asked.
+Unstamped reports are the pen being taken out of range. */
+static bool MatchUinputBatch(UinputState *state, Uinput *u, const OutputFrame *frames, const uint64_t *times, uint32_t count) {
+    bool ok = u->recorded_count < u->recorded_capacity;
+    bool stamped = false;
+    int32_t stamp = 0;
+    uint32_t f = 0;
+    for (uint32_t i = 0; i < u->recorded_count; i++) {
+        UinputEvent e = u->recorded[i];
+        if (e.type == EV_ABS && e.code < ABS_CNT) state->abs[e.device][e.code] = e.value;
+        if (e.type == EV_KEY && e.code < KEY_CNT) state->key[e.device][e.code] = e.value;
+        if (e.type == EV_MSC && e.code == MSC_TIMESTAMP) {
+            stamped = true;
+            stamp = e.value;
+        }
+        if (e.type != EV_SYN || e.code != SYN_REPORT)
+            continue;
+
+        for (; f < count && !(frames[f].flags & (OUTPUT_PEN | OUTPUT_MOUSE)); f++) {}
+        if (stamped) {
+            uint16_t device = (f < count && frames[f].flags & OUTPUT_PEN) ? UINPUT_PEN : UINPUT_MOUSE;
+            ok &= f < count && e.device == device && stamp == (int32_t)(uint32_t)(times[f] / 1000);
+            ok &= f < count && MatchUinputFrame(state, &frames[f]);
+            f++;
+        }
+        stamped = false;
+    }
+    for (; f < count && !(frames[f].flags & (OUTPUT_PEN | OUTPUT_MOUSE)); f++) {}
+    ok &= f == count && (!u->recorded_count || u->recorded[u->recorded_count - 1].type == EV_SYN);
+    u->recorded_count = 0;
+    return ok;
+}
+
+/* Batched injection: a capture's frames through every mouse preset, and the switch script that has
+pen and mouse frames take turns, injected BENCH_INJECT_PENDING_MAX or fewer at a time as if that
+many reports were pending whenever the output thread got to them. Prints the injection calls
+tabd.exe makes (one per pen frame, one SendInput() per run of mouse frames) and the uinput writes
+per second of the capture, one by one and batched, and checks that batching kept every frame, in
+order, with its own time. Ink presets are left out, their frames are injected one by one either way. */
+static bool BenchBatchedInjection(const uint8_t *capture, size_t size, Vec2 screen) {
+    static const uint32_t s_pending[] = { 1, 4, 16, BENCH_INJECT_PENDING_MAX };
+    uint32_t script_frames = BENCH_INJECT_SWITCHES * COUNTOF(s_switch_script);
+    OutputCall *calls = malloc(2 * BENCH_INJECT_PENDING_MAX * sizeof(*calls));
+    uint32_t event_capacity = 2 * BENCH_INJECT_PENDING_MAX * UINPUT_FRAME_EVENTS;
+    UinputEvent *events = malloc(event_capacity * sizeof(*events));
+    UinputState *state = malloc(sizeof(*state));
+    Uinput *u = malloc(sizeof(*u));
+    ASSERT(calls && events && state && u);
+
+    bool ok = true;
+    for (unsigned int p = 0; p <= COUNTOF(g_presets); p++) {
+        bool scripted = p == COUNTOF(g_presets);
+        if (!scripted && g_presets[p].mode == MODE_INK)
+            continue;
+
+        OutputFrame *frames = 0;
+        uint64_t *times = 0;
+        uint32_t count;
+        if (!scripted) {
+            count = CaptureOutputFrames(capture, size, &g_presets[p], screen, &frames, &times);
+        } else {
+            frames = malloc(script_frames * sizeof(*frames));
+            times = malloc(script_frames * sizeof(*times));
+            ASSERT(frames && times);
+            CompiledPreset compiled = CompilePreset(&g_presets[1], &s_tablet_infos[0], screen.x, screen.y);
+            for (count = 0; count < script_frames; count++) {
+                uint32_t step = count % COUNTOF(s_switch_script);
+                uint32_t previous = (count) ? s_switch_script[(count - 1) % COUNTOF(s_switch_script)] : 0;
+                IVec2 point = { 1000 * step, 500 * step };
+                frames[count] = DecideOutput(&compiled, previous, s_switch_script[step], 100 * step, point, point);
+                times[count] = 1000000000ull + count * 1000000ull;
+            }
+        }
+        if (count < 2) {
+            free(frames);
+            free(times);
+            continue;
+        }
+
+        double seconds = (times[count - 1] - times[0]) / 1e9;
+        uint64_t single_calls = 0;
+        InitUinputNull(u);
+        for (uint32_t i = 0; i < count; i++) {
+            single_calls += CountOutputCalls(&frames[i]);
+            SynthesizeUinput(u, &frames[i]);
+        }
+        uint64_t single_writes = u->writes;
+
+        for (unsigned int k = 0; k < COUNTOF(s_pending); k++) {
+            InitUinputRecording(u, events, event_capacity);
+            memset(state, 0, sizeof(*state));
+            uint64_t batched_calls = 0;
+            uint32_t mismatches = 0;
+            for (uint32_t first = 0; first < count; first += s_pending[k]) {
+                uint32_t n = (count - first < s_pending[k]) ? count - first : s_pending[k];
+                uint32_t planned = PlanOutputCalls(&frames[first], n, calls);
+                batched_calls += planned;
+                mismatches += !CheckOutputCalls(&frames[first], n, calls, planned);
+                SynthesizeUinputBatch(u, &frames[first], &times[first], n);
+                mismatches += !MatchUinputBatch(state, u, &frames[first], &times[first], n);
+            }
+            ok &= !mismatches;
+            printf(
+                "inject %-8ls %2u pending: %7.0f -> %7.0f calls/s, %7.0f -> %7.0f uinput writes/s, "
+                "%u mismatches (%s)\n",
+                (scripted) ? L"switch" : g_presets[p].name,
+                s_pending[k],
+                single_calls / seconds,
+                batched_calls / seconds,
+                single_writes / seconds,
+                u->writes / seconds,
+                mismatches,
+                (mismatches) ? "MISMATCH" : "OK"
+            );
+        }
+        free(frames);
+        free(times);
+    }
+
+    free(u);
+    free(state);
+    free(events);
+    free(calls);
+    return ok;
+}
+
+typedef struct {
+    TabletInfo tablet;
+    double units_per_mm;
+    int32_t *x, *y;
+    uint64_t *time_ns;
+    uint32_t count;
+} CapturedReports;
+
+/* Parses up to BENCH_FILTER_MAX_REPORTS reports of the capture's first tablet with their timestamps. */
+static bool LoadCapturedReports(const uint8_t *capture, size_t size, CapturedReports *reports) {
+    ReplaySource replay;
+    CaptureRecord record;
+    TabletInfo *tablet = &reports->tablet;
+    if (
+        !InitReplaySource(&replay, capture, size, REPLAY_FAST)
+        || !PeekReplayRecord(&replay, &record)
+        || !FindTabletInfo(&s_devices, record.vid, record.pid, tablet)
+        || tablet->measurements.x <= 0
+    ) {
+        return false;
+    }
+
+    uint32_t capacity = size / CAPTURE_RECORD_SIZE(tablet->packet_size) + 1;
+    capacity = (capacity < BENCH_FILTER_MAX_REPORTS) ? capacity : BENCH_FILTER_MAX_REPORTS;
+    reports->units_per_mm = tablet->max_x / tablet->measurements.x;
+    reports->x = malloc(capacity * sizeof(int32_t));
+    reports->y = malloc(capacity * sizeof(int32_t));
+    reports->time_ns = malloc(capacity * sizeof(uint64_t));
+    reports->count = 0;
+    ReportBatch *batch = malloc(sizeof(*batch));
+    ASSERT(reports->x && reports->y && reports->time_ns && batch);
+
+    uint64_t due;
+    while (reports->count < capacity && NextReplayRecord(&replay, 0, &record, &due)) {
+        if (record.vid != tablet->vid || record.pid != tablet->pid)
+            continue;
+        ParseReportBatch(tablet, record.packet, record.size, record.time_ns, batch);
+        for (uint32_t i = 0; i < batch->count && reports->count < capacity; i++, reports->count++) {
+            reports->x[reports->count] = batch->x[i];
+            reports->y[reports->count] = batch->y[i];
+            reports->time_ns[reports->count] = batch->time_ns[i];
+        }
+    }
+    free(batch);
+    return reports->count > 0;
+}
+
+static void FreeCapturedReports(CapturedReports *reports) {
+    free(reports->x);
+    free(reports->y);
+    free(reports->time_ns);
+}
+
+static Trace AllocTrace(uint32_t count) {
+    Trace trace = {
+        malloc(count * sizeof(double)), malloc(count * sizeof(double)), malloc(count * sizeof(double)), count
+    };
+    ASSERT(trace.t && trace.x && trace.y);
+    return trace;
+}
+
+static void StoreTrace(const CapturedReports *reports, const int32_t *x, const int32_t *y, Trace *trace) {
+    for (uint32_t i = 0; i < reports->count; i++) {
+        trace->t[i] = (reports->time_ns[i] - reports->time_ns[0]) / 1e9;
+        trace->x[i] = x[i] / reports->units_per_mm;
+        trace->y[i] = y[i] / reports->units_per_mm;
+    }
+}
+
+/* Runs the reports through each filter: the jitter left while the pen rests, the lag it costs and
+how long FilterPoint() takes per report. */
+static void BenchFilters(const CapturedReports *reports) {
+    FilterSettings settings[COUNTOF(g_presets) + 4] = {
+        { FILTER_NONE, 0, 0, 0 },
+        { FILTER_EMA, 10, 0, 0 },
+        { FILTER_EMA, 30, 0, 0 },
+        { FILTER_ONE_EURO, 1, 0.05f, 1 },
+    };
+    uint32_t filters = 4;
+    for (unsigned int i = 0; i < COUNTOF(g_presets); i++) {
+        if (g_presets[i].filter.kind != FILTER_NONE) {
+            settings[filters++] = g_presets[i].filter;
+        }
+    }
+
+    uint32_t count = reports->count;
+    Trace raw = AllocTrace(count), trace = AllocTrace(count);
+    StoreTrace(reports, reports->x, reports->y, &raw);
+    int32_t *x = malloc(count * sizeof(int32_t)), *y = malloc(count * sizeof(int32_t));
+    ASSERT(x && y);
+
+    double raw_jitter = TraceJitter(&raw, &raw);
+    for (uint32_t f = 0; f < filters; f++) {
+        CompiledFilter filter = CompileFilter(&settings[f], reports->units_per_mm);
+        FilterState state = {0};
+        memcpy(x, reports->x, count * sizeof(int32_t));
+        memcpy(y, reports->y, count * sizeof(int32_t));
+        uint64_t start = NowNs();
+        if (filter.kind != FILTER_NONE) {
+            for (uint32_t i = 0; i < count; i++) {
+                FilterPoint(&filter, &state, reports->time_ns[i], &x[i], &y[i]);
+            }
+        }
+        uint64_t elapsed = NowNs() - start;
+
+        StoreTrace(reports, x, y, &trace);
+        double error, lag = TraceLag(&raw, &trace, &error);
+        double jitter = TraceJitter(&raw, &trace);
+
+        static const char *s_kinds[] = { "none", "ema", "one-euro" };
+        printf(
+            "filter %-8s %4.1f Hz %5.3f %4.1f Hz: jitter %6.4f mm (%3.0f%%), lag %5.2f ms, error %6.4f mm, %5.1f ns/report\n",
+            s_kinds[settings[f].kind], settings[f].min_cutoff, settings[f].beta, settings[f].derivative_cutoff,
+            jitter, raw_jitter ? jitter / raw_jitter * 100 : 0, lag * 1e3, error, elapsed / (double)count
+        );
+    }
+
+    free(x);
+    free(y);
+    FreeTrace(&raw);
+    FreeTrace(&trace);
+}
+
+/* Offline evaluation of the predictors: for every report, the distance between the position
+predicted `horizon` ahead and where the pen actually was by then (raw reports, linearly
+interpolated), RMS and worst case. Horizon 0 and PREDICT_NONE at any horizon is what not predicting
+costs. Jitter is measured as in BenchFilters(), prediction amplifies it. */
+static void BenchPredictors(const CapturedReports *reports) {
+    static const float s_horizons[] = { 0, 4, 8, 12, 16, 24 };
+    static const char *s_kinds[] = { "none", "linear", "quadratic", "kalman" };
+
+    uint32_t count = reports->count;
+    Trace raw = AllocTrace(count), trace = AllocTrace(count);
+    StoreTrace(reports, reports->x, reports->y, &raw);
+    int32_t *x = malloc(count * sizeof(int32_t)), *y = malloc(count * sizeof(int32_t));
+    ASSERT(x && y);
+
+    for (unsigned int h = 0; h < COUNTOF(s_horizons); h++) {
+        printf("predict %4.1f ms ahead, rms/max/jitter mm:", s_horizons[h]);
+        for (PredictorKind kind = PREDICT_NONE; kind <= PREDICT_KALMAN; kind++) {
+            PredictorSettings settings = { kind, s_horizons[h] };
+            CompiledPredictor predictor = CompilePredictor(&settings, reports->units_per_mm);
+            PredictorState state = {0};
+            memcpy(x, reports->x, count * sizeof(int32_t));
+            memcpy(y, reports->y, count * sizeof(int32_t));
+            if (kind != PREDICT_NONE) {
+                for (uint32_t i = 0; i < count; i++) {
+                    PredictPoint(&predictor, &state, reports->time_ns[i], &x[i], &y[i]);
+                }
+            }
+            StoreTrace(reports, x, y, &trace);
+
+            double sum = 0, max = 0;
+            uint32_t n = 0;
+            double horizon = s_horizons[h] / 1000;
+            for (uint32_t i = 0, j = 0; i < count; i++) {
+                double t = trace.t[i] + horizon;
+                while (j + 1 < count && raw.t[j + 1] <= t) {
+                    j++;
+                }
+                if (j + 1 >= count || raw.t[j + 1] == raw.t[j])
+                    continue;
+                double u = (t - raw.t[j]) / (raw.t[j + 1] - raw.t[j]);
+                double dx = trace.x[i] - (raw.x[j] + (raw.x[j + 1] - raw.x[j]) * u);
+                double dy = trace.y[i] - (raw.y[j] + (raw.y[j + 1] - raw.y[j]) * u);
+                double e = dx * dx + dy * dy;
+                sum += e;
+                max = (e > max) ? e : max;
+                n++;
+            }
+            printf(
+                "  %s %.3f/%.2f/%.3f", s_kinds[kind], n ? sqrt(sum / n) : 0, sqrt(max),
+                TraceJitter(&raw, &trace)
+            );
+        }
+        printf("\n");
+    }
+
+    free(x);
+    free(y);
+    FreeTrace(&raw);
+    FreeTrace(&trace);
+}
+
+/* Position of the raw trace at `t`, linearly interpolated; `j` carries the search over between calls
+with increasing `t`. */
+static bool InterpolateTrace(const Trace *raw, double t, uint32_t *j, double *x, double *y) {
+    while (*j + 1 < raw->count && raw->t[*j + 1] <= t) {
+        (*j)++;
+    }
+    if (t < raw->t[0] || *j + 1 >= raw->count || raw->t[*j + 1] == raw->t[*j])
+        return false;
+    double u = (t - raw->t[*j]) / (raw->t[*j + 1] - raw->t[*j]);
+    *x = raw->x[*j] + (raw->x[*j + 1] - raw->x[*j]) * u;
+    *y = raw->y[*j] + (raw->y[*j + 1] - raw->y[*j]) * u;
+    return true;
+}
+
+/* Judder is the RMS difference between how far the shown position and the pen (raw, interpolated
+`lag` earlier) advanced from one frame to the next, over frames where the pen moved at least
+BENCH_RESAMPLE_MOVING: a steady stroke that goes 0, 1, 1, 2 reports per frame judders, changes in
+speed don't count. */
+static double TraceJudder(const Trace *raw, const Trace *shown, double lag) {
+    double sum = 0, px = 0, py = 0;
+    uint32_t n = 0, j = 0;
+    bool primed = false;
+    for (uint32_t f = 0; f < shown->count; f++) {
+        double x, y;
+        if (!InterpolateTrace(raw, shown->t[f] - lag, &j, &x, &y)) {
+            primed = false;
+            continue;
+        }
+        double ix = x - px, iy = y - py;
+        px = x;
+        py = y;
+        if (!primed) {
+            primed = true;
+            continue;
+        }
+        if (ix * ix + iy * iy < BENCH_RESAMPLE_MOVING * BENCH_RESAMPLE_MOVING)
+            continue;
+        double dx = shown->x[f] - shown->x[f - 1] - ix;
+        double dy = shown->y[f] - shown->y[f - 1] - iy;
+        sum += dx * dx + dy * dy;
+        n++;
+    }
+    return n ? sqrt(sum / n) : 0;
+}
+
+/* What a display refreshing at each rate shows: at every vsync the latest output, once per report or
+resampled at the refresh rate. Lag is measured as in BenchFilters(), judder as in TraceJudder(). */
+static void BenchResampleDisplay(const CapturedReports *reports) {
+    static const int s_rates[] = { 60, 144, 240 };
+    static const char *s_outputs[] = { "per report", "resampled" };
+
+    uint32_t count = reports->count;
+    Trace raw = AllocTrace(count);
+    StoreTrace(reports, reports->x, reports->y, &raw);
+    Resampler *resampler = malloc(sizeof(*resampler));
+    ReportBatch *out = malloc(sizeof(*out));
+    ASSERT(resampler && out);
+
+    for (unsigned int k = 0; k < COUNTOF(s_rates); k++) {
+        uint64_t period = 1000000000ull / s_rates[k], start = reports->time_ns[0];
+        uint32_t frames = (reports->time_ns[count - 1] - start) / period + 1;
+        Trace shown[2] = { AllocTrace(frames), AllocTrace(frames) };
+        InitResampler(resampler, period);
+
+        /* vsync half a period off the start, so it doesn't line up with the first reports */
+        int32_t latest[2][2] = { { reports->x[0], reports->y[0] }, { reports->x[0], reports->y[0] } };
+        uint32_t next = 0;
+        for (uint32_t f = 0; f < frames; f++) {
+            uint64_t vsync = start + f * period + period / 2;
+            for (; next < count && reports->time_ns[next] <= vsync; next++) {
+                TabletReport report = { reports->x[next], reports->y[next], 0, 0 };
+                PushResampler(resampler, &report, reports->time_ns[next]);
+                latest[0][0] = reports->x[next];
+                latest[0][1] = reports->y[next];
+            }
+            out->count = 0;
+            if (ResampleReports(resampler, vsync, out)) {
+                latest[1][0] = out->x[out->count - 1];
+                latest[1][1] = out->y[out->count - 1];
+            }
+
+            double t = (vsync - start) / 1e9;
+            for (int o = 0; o < 2; o++) {
+                shown[o].t[f] = t;
+                shown[o].x[f] = latest[o][0] / reports->units_per_mm;
+                shown[o].y[f] = latest[o][1] / reports->units_per_mm;
+            }
+        }
+
+        for (int o = 0; o < 2; o++) {
+            double error, lag = TraceLag(&raw, &shown[o], &error);
+            printf(
+                "resample %3d Hz display, %-10s: judder %6.4f mm, lag %5.2f ms, error %6.4f mm\n",
+                s_rates[k], s_outputs[o], TraceJudder(&raw, &shown[o], lag), lag * 1e3, error
+            );
+        }
+        if (resampler->held) {
+            printf("  %llu of %llu samples held\n",
+                (unsigned long long)resampler->held, (unsigned long long)resampler->samples);
+        }
+
+        FreeTrace(&shown[0]);
+        FreeTrace(&shown[1]);
+    }
+
+    free(out);
+    free(resampler);
+    FreeTrace(&raw);
+}
+
+/* The resampler against the clock for up to BENCH_RESAMPLE_SECONDS, as tabd.exe --output-rate runs
+it with a waitable timer: reports arrive at their captured spacing from one timerfd and are stamped
+on arrival like the reader does, ticks come from a periodic timerfd at `rate`. Lateness is how long
+after its due time a tick got to run, a tick that expired while the one before ran is missed. */
+static void BenchResampleRealtime(const CapturedReports *reports, int rate) {
+    int ticks = timerfd_create(CLOCK_MONOTONIC, 0), arrivals = timerfd_create(CLOCK_MONOTONIC, 0);
+    ASSERT(ticks >= 0 && arrivals >= 0);
+
+    uint64_t period = 1000000000ull / rate;
+    uint64_t start = NowNs() + 1000000, offset = start - reports->time_ns[0];
+    uint64_t end = start + BENCH_RESAMPLE_SECONDS * 1000000000ull;
+    uint64_t last = reports->time_ns[reports->count - 1] + offset;
+    end = (last < end) ? last : end;
+
+    uint32_t capacity = (end - start) / period + 1;
+    uint64_t *lateness = malloc(capacity * sizeof(uint64_t));
+    Resampler *resampler = malloc(sizeof(*resampler));
+    ReportBatch *out = malloc(sizeof(*out));
+    ASSERT(lateness && resampler && out);
+    InitResampler(resampler, period);
+
+    struct itimerspec tick_spec = { NsToTimespec(period), NsToTimespec(start) };
+    struct itimerspec arrival_spec = { { 0, 0 }, NsToTimespec(start) };
+    timerfd_settime(ticks, TFD_TIMER_ABSTIME, &tick_spec, 0);
+    timerfd_settime(arrivals, TFD_TIMER_ABSTIME, &arrival_spec, 0);
+
+    uint64_t due = start, previous = 0, missed = 0, late_total = 0;
+    double interval_sum = 0, interval_squares = 0;
+    uint32_t tick_count = 0, next = 0;
+    while (due < end && tick_count < capacity) {
+        struct pollfd fds[2] = { { ticks, POLLIN, 0 }, { arrivals, POLLIN, 0 } };
+        if (poll(fds, 2, -1) <= 0)
+            continue;
+
+        uint64_t now = NowNs(), expirations;
+        if ((fds[1].revents & POLLIN) && read(arrivals, &expirations, sizeof(expirations)) > 0) {
+            for (; next < reports->count && reports->time_ns[next] + offset <= now; next++) {
+                TabletReport report = { reports->x[next], reports->y[next], 0, 0 };
+                PushResampler(resampler, &report, now);
+            }
+            if (next < reports->count) {
+                arrival_spec.it_value = NsToTimespec(reports->time_ns[next] + offset);
+                timerfd_settime(arrivals, TFD_TIMER_ABSTIME, &arrival_spec, 0);
+            }
+        }
+        if ((fds[0].revents & POLLIN) && read(ticks, &expirations, sizeof(expirations)) > 0) {
+            missed += expirations - 1;
+            due += (expirations - 1) * period;
+            lateness[tick_count++] = now - due;
+            late_total += now - due;
+            due += period;
+
+            out->count = 0;
+            ResampleReports(resampler, now, out);
+            if (previous) {
+                double interval = (now - previous) / 1e3;
+                interval_sum += interval;
+                interval_squares += interval * interval;
+            }
+            previous = now;
+        }
+    }
+
+    if (tick_count > 1) {
+        qsort(lateness, tick_count, sizeof(uint64_t), CompareUint64);
+        double mean = interval_sum / (tick_count - 1);
+        double variance = interval_squares / (tick_count - 1) - mean * mean;
+        printf(
+            "resample %d Hz real-time, %u ticks: lateness mean %.1f us, p99 %.1f us, max %.1f us, "
+            "%llu missed, interval %.1f us sd %.1f us\n",
+            rate, tick_count, late_total / 1e3 / tick_count, lateness[tick_count * 99 / 100] / 1e3,
+            lateness[tick_count - 1] / 1e3, (unsigned long long)missed, mean,
+            sqrt((variance > 0) ? variance : 0)
+        );
+        printf(
+            "  %llu samples, %llu edges, %llu held, %llu dropped\n",
+            (unsigned long long)resampler->samples, (unsigned long long)resampler->edges,
+            (unsigned long long)resampler->held, (unsigned long long)resampler->dropped
+        );
+    }
+
+    free(out);
+    free(resampler);
+    free(lateness);
+    close(arrivals);
+    close(ticks);
+}
+
+/* The built-in devices, or a device database like tabd.exe --devices takes: a prebuilt one is
+mapped and used in place, a text one is parsed and built. `*data` is the prebuilt form. */
+static bool LoadDevices(const char *path, const uint8_t **data, size_t *size) {
+    TabletInfo *devices = (TabletInfo*)s_tablet_infos;
+    uint32_t count = COUNTOF(s_tablet_infos);
+    uint8_t *text = 0;
+    if (path) {
+        int fd = open(path, O_RDONLY);
+        struct stat st;
+        if (fd < 0 || fstat(fd, &st) || !st.st_size) {
+            if (fd >= 0) close(fd);
+            return false;
+        }
+        text = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (text == MAP_FAILED)
+            return false;
+        if (OpenDeviceDatabase(text, st.st_size, &s_devices)) {
+            *data = text;
+            *size = st.st_size;
+            return true;
+        }
+
+        /* every device line is longer than 16 characters */
+        uint32_t capacity = st.st_size / 16 + 1, error_line = 0;
+        devices = malloc(capacity * sizeof(*devices));
+        ASSERT(devices);
+        if (!ParseDeviceList((const char*)text, st.st_size, devices, capacity, &count, &error_line)) {
+            fprintf(stderr, "%s:%u: invalid device\n", path, error_line);
+            free(devices);
+            munmap(text, st.st_size);
+            return false;
+        }
+        munmap(text, st.st_size);
+    }
+
+    size_t capacity = DeviceDatabaseSize(count);
+    uint8_t *built = malloc(capacity);
+    ASSERT(built);
+    *size = BuildDeviceDatabase(devices, count, built, capacity);
+    *data = built;
+    if (devices != s_tablet_infos) {
+        free(devices);
+    }
+    return *size && OpenDeviceDatabase(built, *size, &s_devices);
+}
+
+static bool WriteDevices(const char *path, const uint8_t *data, size_t size) {
+    FILE *f = fopen(path, "wb");
+    if (!f)
+        return false;
+    bool written = fwrite(data, 1, size, f) == size;
+    return !fclose(f) && written;
+}
+
+/* The thresholds as pressure.h documents them, independent of how CompilePressureTable() gets
+there: 0 stands for 1 and there is at least a raw step between `min` and `max`. */
+static void GetPressureThresholds(const PressureCurve *curve, int32_t max_pressure, double *min, double *max) {
+    double step = 1.0 / max_pressure;
+    *min = (curve->min < 0) ? 0 : (curve->min > 1 - step) ? 1 - step : curve->min;
+    *max = (curve->max <= 0 || curve->max > 1) ? 1 : curve->max;
+    *max = (*max < *min + step) ? *min + step : *max;
+}
+
+/* The compiled pressure tables against evaluating their curves per report. Every table has to
+match its curve and thresholds within 1 for every raw value, and the linear one the formula it
+replaces, CLAMP(raw * sensitivity / max_pressure, 0, 1) * 1024, at several sensitivities. */
+static bool BenchPressure(const TabletInfo *tablet) {
+    static const PressureCurve s_curves[] = {
+        { PRESSURE_LINEAR, 0, { 0, 0 }, { 0, 0 }, 0, 0 },
+        { PRESSURE_GAMMA, 1.8f, { 0, 0 }, { 0, 0 }, 0.02f, 0.9f },
+        { PRESSURE_BEZIER, 0, { 0.4f, 0 }, { 0.6f, 1 }, 0.02f, 0 },
+        { PRESSURE_LINEAR, 0, { 0, 0 }, { 0, 0 }, 0.5f, 0.5f },
+        { PRESSURE_GAMMA, 0.6f, { 0, 0 }, { 0, 0 }, 1, 0 },
+    };
+    static const char *s_kinds[] = { "linear", "gamma", "bezier", "min=max", "min=1" };
+    static const float s_sensitivities[] = { 0.5f, 1, 1.15f, 2 };
+
+    bool ok = true;
+    int max_diff = 0;
+    for (unsigned int k = 0; k < COUNTOF(s_sensitivities); k++) {
+        PressureTable table;
+        CompilePressureTable(&s_curves[0], s_sensitivities[k], tablet->max_pressure, &table);
+        for (int32_t raw = 0; raw <= tablet->max_pressure; raw++) {
+            double expected = CLAMP(raw * (double)s_sensitivities[k] / tablet->max_pressure, 0, 1) * 1024;
+            int diff = abs((int)LookUpPressure(&table, raw) - (int)expected);
+            max_diff = (diff > max_diff) ? diff : max_diff;
+        }
+    }
+    ok &= max_diff <= 1;
+
+    uint32_t *raw = malloc(BENCH_PRESSURE_SAMPLES * sizeof(uint32_t));
+    ASSERT(raw);
+    uint32_t seed = 1;
+    for (uint32_t i = 0; i < BENCH_PRESSURE_SAMPLES; i++) {
+        seed = seed * 1664525 + 1013904223;
+        raw[i] = (seed >> 8) % (tablet->max_pressure + 1);
+    }
+
+    for (unsigned int c = 0; c < COUNTOF(s_curves); c++) {
+        PressureTable table;
+        uint64_t start = NowNs();
+        CompilePressureTable(&s_curves[c], 1, tablet->max_pressure, &table);
+        uint64_t compile = NowNs() - start;
+
+        uint32_t table_sum = 0;
+        start = NowNs();
+        for (uint32_t i = 0; i < BENCH_PRESSURE_SAMPLES; i++) {
+            table_sum += LookUpPressure(&table, raw[i]);
+        }
+        uint64_t table_elapsed = NowNs() - start;
+
+        /* every raw value against the curve: 0 up to `min`, full from `max` on */
+        double min, max;
+        GetPressureThresholds(&s_curves[c], tablet->max_pressure, &min, &max);
+        int curve_diff = 0;
+        for (int32_t r = 0; r <= tablet->max_pressure; r++) {
+            double v = (double)r / tablet->max_pressure;
+            double expected = (v <= min) ? 0
+                : (v >= max) ? 1024
+                : EvaluatePressureCurve(&s_curves[c], (v - min) / (max - min)) * 1024;
+            int diff = abs((int)LookUpPressure(&table, r) - (int)expected);
+            curve_diff = (diff > curve_diff) ? diff : curve_diff;
+        }
+        ok &= curve_diff <= 1;
+
+        /* what each report would cost without the table */
+        double direct_sum = 0;
+        start = NowNs();
+        for (uint32_t i = 0; i < BENCH_PRESSURE_SAMPLES; i++) {
+            double u = ((double)raw[i] / tablet->max_pressure - min) / (max - min);
+            direct_sum += EvaluatePressureCurve(&s_curves[c], CLAMP(u, 0, 1)) * 1024;
+        }
+        uint64_t direct_elapsed = NowNs() - start;
+
+        printf(
+            "pressure %-7s: table %5.2f ns/report, curve %6.2f ns/report, compiled in %.1f us "
+            "(sums %u/%.0f), max difference %d %s\n",
+            s_kinds[c], table_elapsed / (double)BENCH_PRESSURE_SAMPLES,
+            direct_elapsed / (double)BENCH_PRESSURE_SAMPLES, compile / 1e3, table_sum, direct_sum,
+            curve_diff, (curve_diff <= 1) ? "OK" : "MISMATCH"
+        );
+    }
+    printf("  linear table vs reference: max difference %d %s\n", max_diff, (max_diff <= 1) ? "OK" : "MISMATCH");
+
+    free(raw);
+    return ok;
+}
+
+/* A preset in the file format of presetfile.h, with a single fprintf as the format doc has it. */
+static bool WritePresetFile(const char *path, const Preset *preset) {
+    FILE *f = fopen(path, "w");
+    if (!f)
+        return false;
+    char monitor[16];
+    snprintf(monitor, sizeof(monitor), "%d", preset->monitor);
+    fprintf(f,
+        "center-x %.9f\ncenter-y %.9f\nwidth %.9f\nheight %.9f\nrotation %.9f\nmode %s\n"
+        "pressure-sensitivity %.9f\nfilter %s\nfilter-min-cutoff %.9f\nfilter-beta %.9f\n"
+        "filter-derivative-cutoff %.9f\npredict %s\npredict-horizon %.9f\npressure-curve %s\n"
+        "pressure-gamma %.9f\npressure-p1-x %.9f\npressure-p1-y %.9f\npressure-p2-x %.9f\n"
+        "pressure-p2-y %.9f\npressure-min %.9f\npressure-max %.9f\nmonitor %s\n",
+        preset->area.center.x, preset->area.center.y, preset->area.size.x, preset->area.size.y,
+        preset->area.rotation, s_preset_modes[preset->mode], preset->pressure_sensitivity,
+        s_preset_filters[preset->filter.kind], preset->filter.min_cutoff, preset->filter.beta,
+        preset->filter.derivative_cutoff, s_preset_predictors[preset->predict.kind],
+        preset->predict.horizon_ms, s_preset_curves[preset->pressure.kind], preset->pressure.gamma,
+        preset->pressure.p1.x, preset->pressure.p1.y, preset->pressure.p2.x, preset->pressure.p2.y,
+        preset->pressure.min, preset->pressure.max,
+        (preset->monitor == MONITOR_PRIMARY) ? "primary" : (preset->monitor == MONITOR_DESKTOP) ? "desktop" : monitor
+    );
+    return !fclose(f);
+}
+
+static bool LoadPresetFromFile(const char *path, Preset *preset) {
+    size_t size;
+    uint8_t *text = ReadWholeFile(path, &size);
+    uint32_t error_line = 0;
+    *preset = g_presets[0];
+    bool valid = text && ParsePresetFile((const char*)text, size, preset, &error_line);
+    free(text);
+    return valid;
+}
+
+typedef struct {
+    const TabletInfo *tablet;
+    const ReportBatch *batch;
+    Vec2 screen;
+    char dir[64];
+    PresetSlot slot;
+    uint32_t expected[2];    /* checksums of the batch under either preset */
+    volatile uint32_t stop;
+    volatile uint32_t phase; /* 0 before the reloads start, 1 during */
+    uint64_t written_ns;     /* when the last preset file was written */
+    uint64_t batches[2], slow[2], max_ns[2];
+    uint64_t torn, pickups, latency_total, latency_max;
+    uint64_t reloads, reload_total, reload_max;
+} PresetReloadBench;
+
+static uint32_t PresetBatchChecksum(const CompiledPreset *preset, ReportBatch *batch, OutputFrame *frames) {
+    TabletReport previous = {0};
+    MapReportBatch(preset, batch);
+    uint32_t n = ComputeOutputFrames(preset, &previous, batch, frames), checksum = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        checksum = checksum * 31 + FrameChecksum(&frames[i]);
+    }
+    return checksum;
+}
+
+/* The output thread's side: a batch per iteration through whatever ReadPreset() returns. Every batch
+has to come out as under one of the two presets, anything else would be a torn copy. */
+static void *PresetPacketProc(void *arg) {
+    PresetReloadBench *b = arg;
+    PresetReader *reader = calloc(1, sizeof(*reader));
+    ReportBatch *batch = malloc(sizeof(*batch));
+    OutputFrame *frames = malloc(REPORT_BATCH_CAPACITY * sizeof(*frames));
+    ASSERT(reader && batch && frames);
+
+    while (!AtomicLoad32(&b->stop)) {
+        uint32_t phase = AtomicLoad32(&b->phase), sequence = reader->sequence;
+        memcpy(batch, b->batch, sizeof(*batch));
+        uint64_t start = NowNs();
+        const CompiledPreset *preset = ReadPreset(&b->slot, reader);
+        uint32_t checksum = PresetBatchChecksum(preset, batch, frames);
+        uint64_t now = NowNs(), elapsed = now - start;
+
+        b->batches[phase]++;
+        b->slow[phase] += elapsed > BENCH_RELOAD_SLOW_NS;
+        b->max_ns[phase] = (elapsed > b->max_ns[phase]) ? elapsed : b->max_ns[phase];
+        b->torn += checksum != b->expected[0] && checksum != b->expected[1];
+        if (reader->sequence != sequence && phase) {
+            uint64_t latency = now - __atomic_load_n(&b->written_ns, __ATOMIC_ACQUIRE);
+            b->pickups++;
+            b->latency_total += latency;
+            b->latency_max = (latency > b->latency_max) ? latency : b->latency_max;
+        }
+    }
+
+    free(frames);
+    free(batch);
+    free(reader);
+    return 0;
+}
+
+/* The watcher's side, as tabd.exe's preset thread with inotify instead of ReadDirectoryChangesW():
+reparse the file that changed, compile and publish. */
+static void *PresetWatchProc(void *arg) {
+    PresetReloadBench *b = arg;
+    int fd = inotify_init1(IN_NONBLOCK);
+    ASSERT(fd >= 0 && inotify_add_watch(fd, b->dir, IN_CLOSE_WRITE | IN_MOVED_TO) >= 0);
+
+    char events[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    while (!AtomicLoad32(&b->stop)) {
+        struct pollfd pfd = { fd, POLLIN, 0 };
+        if (poll(&pfd, 1, 50) <= 0)
+            continue;
+        ssize_t size = read(fd, events, sizeof(events));
+        for (char *p = events; size > 0 && p < events + size; ) {
+            const struct inotify_event *event = (const struct inotify_event*)p;
+            p += sizeof(*event) + event->len;
+            size_t length = (event->len) ? strlen(event->name) : 0;
+            if (length <= 4 || strcmp(event->name + length - 4, ".txt"))
+                continue;
+
+            uint64_t start = NowNs();
+            char path[128];
+            Preset preset;
+            snprintf(path, sizeof(path), "%s/%s", b->dir, event->name);
+            if (!LoadPresetFromFile(path, &preset))
+                continue;
+            CompiledPreset compiled = CompilePreset(&preset, b->tablet, b->screen.x, b->screen.y);
+            PublishPreset(&b->slot, &compiled);
+            uint64_t elapsed = NowNs() - start;
+            b->reloads++;
+            b->reload_total += elapsed;
+            b->reload_max = (elapsed > b->reload_max) ? elapsed : b->reload_max;
+        }
+    }
+    close(fd);
+    return 0;
+}
+
+/* Preset files: every built-in preset has to survive being written and parsed back. Then a packet
+thread runs batches through a PresetSlot while a watcher reloads the preset file every
+BENCH_RELOAD_INTERVAL_US, alternating between two presets: how long a reload takes (parse, compile,
+publish), how long after the file was written the packet thread used it, and whether batches got any
+slower than before the reloads started. */
+static bool BenchPresetReload(const PacketStream *s, const TabletInfo *tablet, Vec2 screen) {
+    bool ok = true;
+    PresetReloadBench *b = calloc(1, sizeof(*b));
+    ReportBatch *batch = malloc(sizeof(*batch));
+    OutputFrame *frames = malloc(REPORT_BATCH_CAPACITY * sizeof(*frames));
+    ASSERT(b && batch && frames);
+    snprintf(b->dir, sizeof(b->dir), "/tmp/tabd-bench-XXXXXX");
+    if (!mkdtemp(b->dir)) {
+        fprintf(stderr, "failed to create a preset directory\n");
+        return false;
+    }
+
+    char path[128];
+    snprintf(path, sizeof(path), "%s/Bench.txt", b->dir);
+    Preset written[COUNTOF(g_presets) + 2];
+    for (unsigned int i = 0; i < COUNTOF(written); i++) {
+        written[i] = g_presets[i % COUNTOF(g_presets)];
+    }
+    written[COUNTOF(g_presets)].monitor = MONITOR_DESKTOP;
+    written[COUNTOF(g_presets) + 1].monitor = 3;
+    for (unsigned int i = 0; i < COUNTOF(written); i++) {
+        Preset parsed;
+        ok &= WritePresetFile(path, &written[i]) && LoadPresetFromFile(path, &parsed);
+        parsed.name = written[i].name;
+        ok &= !memcmp(&parsed, &written[i], sizeof(parsed));
+    }
+    printf("preset files: built-in presets and monitor targets written and parsed back %s\n", ok ? "OK" : "MISMATCH");
+
+    Preset variants[2] = { g_presets[0], g_presets[0] };
+    variants[1].area.rotation = 180;
+    variants[1].pressure = (PressureCurve){ PRESSURE_GAMMA, 1.5f, { 0, 0 }, { 0, 0 }, 0, 0 };
+    uint32_t packets = (uint32_t)(s->size / s->packet_size);
+    ParseReportBatch(tablet, s->data, ((packets < 8) ? packets : 8) * s->packet_size, 0, batch);
+    for (int v = 0; v < 2; v++) {
+        ReportBatch copy = *batch;
+        CompiledPreset compiled = CompilePreset(&variants[v], tablet, screen.x, screen.y);
+        b->expected[v] = PresetBatchChecksum(&compiled, &copy, frames);
+    }
+    b->tablet = tablet;
+    b->batch = batch;
+    b->screen = screen;
+    CompiledPreset compiled = CompilePreset(&variants[0], tablet, screen.x, screen.y);
+    PublishPreset(&b->slot, &compiled);
+
+    pthread_t packet_thread, watch_thread;
+    ASSERT(!pthread_create(&packet_thread, 0, PresetPacketProc, b));
+    ASSERT(!pthread_create(&watch_thread, 0, PresetWatchProc, b));
+    SleepUs(BENCH_RELOAD_BASELINE_US);
+    AtomicStore32(&b->phase, 1);
+    for (int i = 1; i <= BENCH_RELOADS; i++) {
+        __atomic_store_n(&b->written_ns, NowNs(), __ATOMIC_RELEASE);
+        ok &= WritePresetFile(path, &variants[i & 1]);
+        SleepUs(BENCH_RELOAD_INTERVAL_US);
+    }
+    AtomicStore32(&b->stop, 1);
+    pthread_join(packet_thread, 0);
+    pthread_join(watch_thread, 0);
+
+    ok &= !b->torn && b->reloads > 0;
+    printf(
+        "preset reload: %llu reloads, %.1f us mean, %.1f us max; picked up %.1f us after the write "
+        "(mean, max %.1f us), %llu torn batches %s\n",
+        (unsigned long long)b->reloads, b->reloads ? b->reload_total / 1e3 / b->reloads : 0,
+        b->reload_max / 1e3, b->pickups ? b->latency_total / 1e3 / b->pickups : 0,
+        b->latency_max / 1e3, (unsigned long long)b->torn, ok ? "OK" : "MISMATCH"
+    );
+    for (int phase = 0; phase < 2; phase++) {
+        printf(
+            "  %-15s %9llu batches, %llu over %d us, max %.1f us\n",
+            phase ? "during reloads:" : "before reloads:", (unsigned long long)b->batches[phase],
+            (unsigned long long)b->slow[phase], BENCH_RELOAD_SLOW_NS / 1000, b->max_ns[phase] / 1e3
+        );
+    }
+
+    unlink(path);
+    rmdir(b->dir);
+    free(frames);
+    free(batch);
+    free(b);
+    return ok;
+}
+
+/* A zero maximum would divide by zero when a preset is compiled for the device, so a text line
+with one is rejected, as is a prebuilt record with one. */
+static bool BenchDeviceLimits(void) {
+    static const char *const s_lines[] = {
+        "\"ok\" vid=1 pid=1 max=21600x13500x2047 packet=10 x=16:16 y=32:16\n",
+        "\"x\" vid=1 pid=1 max=0x13500x2047 packet=10 x=16:16 y=32:16\n",
+        "\"y\" vid=1 pid=1 max=21600x0x2047 packet=10 x=16:16 y=32:16\n",
+        "\"pressure\" vid=1 pid=1 max=21600x13500x0 packet=10 x=16:16 y=32:16\n",
+    };
+    bool ok = true;
+    for (unsigned int i = 0; i < COUNTOF(s_lines); i++) {
+        TabletInfo device;
+        uint32_t count = 0, error_line = 0;
+        bool parsed = ParseDeviceList(s_lines[i], strlen(s_lines[i]), &device, 1, &count, &error_line);
+        ok &= parsed == (i == 0) && (parsed || error_line == 1);
+    }
+
+    TabletInfo devices[3] = { s_tablet_infos[0], s_tablet_infos[0], s_tablet_infos[0] };
+    devices[1].pid ^= 1;
+    devices[1].max_y = 0;
+    devices[2].pid ^= 2;
+    devices[2].max_pressure = -1;
+    uint64_t data[DEVICE_DATABASE_MAX_SIZE(3) / 8 + 1];
+    size_t size = BuildDeviceDatabase(devices, 3, (uint8_t*)data, sizeof(data));
+    DeviceDatabase db;
+    ASSERT(OpenDeviceDatabase((uint8_t*)data, size, &db));
+    for (int i = 0; i < 3; i++) {
+        TabletInfo info;
+        ok &= FindTabletInfo(&db, devices[i].vid, devices[i].pid, &info) == (i == 0);
+    }
+
+    printf("device limits: zero maximums rejected %s\n", ok ? "OK" : "MISMATCH");
+    return ok;
+}
+
+/* FindTabletInfo() against scanning a device table, on databases of growing size. Half of the
+lookups are for devices that aren't there, as with most HID interfaces enumerated at startup. */
+static void BenchDeviceLookup(void) {
+    static const uint32_t s_sizes[] = { 1, 100, 10000, 100000 };
+    for (unsigned int i = 0; i < COUNTOF(s_sizes); i++) {
+        uint32_t count = s_sizes[i];
+        TabletInfo *devices = malloc(count * sizeof(*devices));
+        size_t capacity = DeviceDatabaseSize(count);
+        uint8_t *data = malloc(capacity);
+        ASSERT(devices && data);
+        for (uint32_t d = 0; d < count; d++) {
+            devices[d] = s_tablet_infos[0];
+            devices[d].vid = (uint16_t)(0x1000 + d / 0x10000 * 7);
+            devices[d].pid = (uint16_t)(d * 40503u);
+        }
+
+        DeviceDatabase db;
+        ASSERT(OpenDeviceDatabase(data, BuildDeviceDatabase(devices, count, data, capacity), &db));
+
+        /* the scan gets fewer lookups, it would take minutes on the largest table */
+        uint32_t lookups[2] = { BENCH_LOOKUPS, CLAMP(BENCH_LOOKUPS * 10 / count, 100, BENCH_LOOKUPS) };
+        uint32_t found[2] = {0}, seed = 1;
+        uint64_t elapsed[2];
+        for (int scan = 0; scan < 2; scan++) {
+            uint64_t start = NowNs();
+            for (uint32_t n = 0; n < lookups[scan]; n++) {
+                seed = seed * 1664525u + 1013904223u;
+                uint32_t d = (seed >> 8) % count;
+                uint16_t vid = devices[d].vid ^ (seed >> 31);
+                uint16_t pid = devices[d].pid;
+
+                TabletInfo info;
+                if (!scan) {
+                    found[0] += FindTabletInfo(&db, vid, pid, &info);
+                    continue;
+                }
+                for (uint32_t k = 0; k < count; k++) {
+                    if (devices[k].vid == vid && devices[k].pid == pid) {
+                        info = devices[k];
+                        found[1] += CompileReportLayout(&info.layout, info.packet_size, &info.plan);
+                        break;
+                    }
+                }
+            }
+            elapsed[scan] = NowNs() - start;
+        }
+
+        printf(
+            "lookup %6u devices: hash %7.1f ns, scan %9.1f ns (%.1f%%/%.1f%% found)\n",
+            count, elapsed[0] / (double)lookups[0], elapsed[1] / (double)lookups[1],
+            found[0] * 100.0 / lookups[0], found[1] * 100.0 / lookups[1]
+        );
+        free(data);
+        free(devices);
+    }
+}
+
+static void PrintUsage(void) {
+    fprintf(stderr,
+        "usage: tabd-bench [-n packets] [-s packet-size] [-r WxH] [-e step] [-q reads] [-w file] [-p mode]\n"
+        "                  [-d devices] [-D file] [-o rate] [-i input [-u]] [-g|-G golden] [-z input]\n"
+        "                  [capture]\n"
+        "  capture      tabd.exe --record capture or back-to-back raw reports,\n"
+        "               synthetic CTL-672 strokes if omitted\n"
+        "  -n packets   number of packets to process per preset (default %llu)\n"
+        "  -s size      size of a single report in a raw capture (default %d)\n"
+        "  -r WxH       screen resolution (default %dx%d)\n"
+        "  -e step      raw unit step of the mapping equivalence sweep, 1 is exhaustive (default %d)\n"
+        "  -q reads     reads in flight compared against a single one on a simulated %d Hz device\n"
+        "               (default %d)\n"
+        "  -w file      write the stream as a capture and exit\n"
+        "  -p mode      replay the capture through the first preset, `fast` or `realtime`\n"
+        "  -d devices   device database, text or prebuilt (default: built-in devices)\n"
+        "  -D file      write the device database in prebuilt form and exit\n"
+        "  -o rate      output rate of the real-time resampler run in Hz (default %d)\n"
+        "  -i input     read tablets through hidraw until Ctrl+C, `auto` for every known one in /dev,\n"
+        "               or a hidraw node, FIFO or file of raw reports taken as the first built-in device\n"
+        "  -u           with -i, inject through /dev/uinput instead of the null sink\n"
+        "  -g golden    check every parser's reports of the capture against a golden file and exit\n"
+        "  -G golden    write the reference parser's reports of the capture as a golden file and exit\n"
+        "  -z input     run a single input through the parser fuzz harness and exit, e.g. for afl-fuzz\n",
+        BENCH_DEFAULT_PACKETS, BENCH_DEFAULT_PACKET_SIZE,
+        (int)BENCH_DEFAULT_SCREEN.x, (int)BENCH_DEFAULT_SCREEN.y, BENCH_DEFAULT_SWEEP_STEP,
+        BENCH_MOCK_RATE_HZ, READ_QUEUE_DEFAULT_DEPTH, BENCH_RESAMPLE_RATE
+    );
+}
+
+int main(int argc, char **argv) {
+    uint64_t count = BENCH_DEFAULT_PACKETS;
+    uint32_t packet_size = BENCH_DEFAULT_PACKET_SIZE;
+    const char *path = 0;
+    const char *output = 0;
+    const char *replay = 0;
+    const char *devices = 0;
+    const char *prebuilt = 0;
+    const char *input = 0;
+    const char *golden = 0;
+    const char *fuzz = 0;
+    bool inject = false;
+    bool write_golden = false;
+    Vec2 screen = BENCH_DEFAULT_SCREEN;
+    int step = BENCH_DEFAULT_SWEEP_STEP;
+    uint32_t depth = READ_QUEUE_DEFAULT_DEPTH;
+    int rate = BENCH_RESAMPLE_RATE;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-n") && i + 1 < argc) {
+            count = strtoull(argv[++i], 0, 10);
+        } else if (!strcmp(argv[i], "-s") && i + 1 < argc) {
+            packet_size = strtoul(argv[++i], 0, 10);
+        } else if (!strcmp(argv[i], "-r") && i + 1 < argc) {
+            int w = 0, h = 0;
+            sscanf(argv[++i], "%dx%d", &w, &h);
+            screen = (Vec2){ w, h };
+        } else if (!strcmp(argv[i], "-e") && i + 1 < argc) {
+            step = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "-q") && i + 1 < argc) {
+            depth = strtoul(argv[++i], 0, 10);
+        } else if (!strcmp(argv[i], "-w") && i + 1 < argc) {
+            output = argv[++i];
+        } else if (!strcmp(argv[i], "-p") && i + 1 < argc) {
+            replay = argv[++i];
+        } else if (!strcmp(argv[i], "-d") && i + 1 < argc) {
+            devices = argv[++i];
+        } else if (!strcmp(argv[i], "-D") && i + 1 < argc) {
+            prebuilt = argv[++i];
+        } else if (!strcmp(argv[i], "-o") && i + 1 < argc) {
+            rate = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "-i") && i + 1 < argc) {
+            input = argv[++i];
+        } else if (!strcmp(argv[i], "-u")) {
+            inject = true;
+        } else if ((!strcmp(argv[i], "-g") || !strcmp(argv[i], "-G")) && i + 1 < argc) {
+            write_golden = argv[i][1] == 'G';
+            golden = argv[++i];
+        } else if (!strcmp(argv[i], "-z") && i + 1 < argc) {
+            fuzz = argv[++i];
+        } else if (argv[i][0] != '-' && !path) {
+            path = argv[i];
+        } else {
+            PrintUsage();
+            return 1;
+        }
+    }
+
+    if (!count || !packet_size || screen.x <= 0 || screen.y <= 0 || step <= 0 || !depth || depth > READ_QUEUE_MAX_DEPTH || rate <= 0 || rate > 1000) {
+        PrintUsage();
+        return 1;
+    }
+
+    const uint8_t *device_data;
+    size_t device_data_size;
+    if (!LoadDevices(devices, &device_data, &device_data_size)) {
+        fprintf(stderr, "failed to load devices from \"%s\"\n", devices);
+        return 1;
+    }
+    if (prebuilt) {
+        bool written = WriteDevices(prebuilt, device_data, device_data_size);
+        if (!written) {
+            fprintf(stderr, "failed to write \"%s\"\n", prebuilt);
+        }
+        return written ? 0 : 1;
+    }
+
+    if (fuzz) {
+        size_t size = 0;
+        uint8_t *data = ReadWholeFile(fuzz, &size);
+        if (!data) {
+            fprintf(stderr, "failed to load \"%s\"\n", fuzz);
+            return 1;
+        }
+        FuzzParsers(data, size);
+        free(data);
+        return 0;
+    }
+
+    if (golden) {
+        if (!path) {
+            PrintUsage();
+            return 1;
+        }
+        return RunGolden(path, golden, write_golden) ? 0 : 2;
+    }
+
+    if (input) {
+        if (!RunHidrawInput(input, &s_tablet_infos[0], &g_presets[0], screen, inject)) {
+            fprintf(stderr, "failed to open \"%s\"\n", input);
+            return 1;
+        }
+        return 0;
+    }
+
+    if (replay) {
+        bool fast = !strcmp(replay, "fast");
+        if ((!fast && strcmp(replay, "realtime")) || !path) {
+            PrintUsage();
+            return 1;
+        }
+        if (!BenchReplay(path, fast ? REPLAY_FAST : REPLAY_REALTIME, &g_presets[0], screen)) {
+            fprintf(stderr, "failed to replay \"%s\"\n", path);
+            return 1;
+        }
+        return 0;
+    }
+
+    PacketStream stream;
+    TabletInfo info;
+    const TabletInfo *tablet = &info;
+    if (!FindTabletInfo(&s_devices, s_tablet_infos[0].vid, s_tablet_infos[0].pid, &info)) {
+        fprintf(stderr, "no usable %s in the device database\n", s_tablet_infos[0].name);
+        return 1;
+    }
+    if (path) {
+        if (!LoadStream(path, packet_size, &stream, &info)) {
+            fprintf(stderr, "failed to load \"%s\"\n", path);
+            return 1;
+        }
+    } else {
+        stream = GenerateSyntheticStream();
+    }
+
+    if (output) {
+        bool written = WriteCapture(output, &stream, tablet);
+        if (!written) {
+            fprintf(stderr, "failed to write \"%s\"\n", output);
+        }
+        free(stream.data);
+        return written ? 0 : 1;
+    }
+
+    printf(
+        "%s, %llu packets of %u bytes in stream, %llu per preset\n",
+        tablet->name,
+        (unsigned long long)(stream.size / stream.packet_size),
+        stream.packet_size,
+        (unsigned long long)count
+    );
+    BenchReadQueue(1, stream.packet_size);
+    BenchReadQueue(depth, stream.packet_size);
+    BenchDeviceLookup();
+    bool ok = BenchDeviceLimits();
+    ok &= BenchSlowSink(&stream, tablet);
+    ok &= BenchPressure(tablet);
+    ok &= BenchPresetReload(&stream, tablet, screen);
+    ok &= BenchMonitors(tablet);
+    ok &= BenchLatency();
+    ok &= BenchLog();
+    ok &= BenchHidraw(&stream, tablet);
+    ok &= BenchUinput(&stream, tablet, screen);
+    ok &= BenchDevices(&stream, tablet, screen);
+    ok &= BenchSlotReuse(tablet);
+
+    size_t filter_capture_size = 0;
+    uint8_t *filter_capture = (path) ? ReadWholeFile(path, &filter_capture_size) : 0;
+    if (!filter_capture || !IsCaptureHeaderValid(filter_capture, filter_capture_size)) {
+        free(filter_capture);
+        filter_capture = GenerateFilterCapture(&filter_capture_size);
+    }
+
+    size_t stream_capture_size, idle_capture_size, pressing_capture_size;
+    uint8_t *stream_capture = StreamToCapture(&stream, tablet, &stream_capture_size);
+    uint8_t *idle_capture = GenerateIdleCapture(false, &idle_capture_size);
+    uint8_t *pressing_capture = GenerateIdleCapture(true, &pressing_capture_size);
+    const char *const suppress_names[] = { "drawing", "resting", "idle", "pressing" };
+    uint8_t *const suppress_captures[] = { stream_capture, filter_capture, idle_capture, pressing_capture };
+    const size_t suppress_sizes[] = {
+        stream_capture_size, filter_capture_size, idle_capture_size, pressing_capture_size
+    };
+    ok &= BenchSuppression(suppress_names, suppress_captures, suppress_sizes, COUNTOF(suppress_captures), screen);
+    ok &= BenchBatchedInjection(stream_capture, stream_capture_size, screen);
+    free(pressing_capture);
+    free(idle_capture);
+    free(stream_capture);
+
+    CapturedReports reports;
+    if (LoadCapturedReports(filter_capture, filter_capture_size, &reports)) {
+        BenchFilters(&reports);
+        BenchPredictors(&reports);
+        BenchResampleDisplay(&reports);
+        BenchResampleRealtime(&reports, rate);
+        FreeCapturedReports(&reports);
+    }
+    free(filter_capture);
+
+    ok &= BenchParsers(&stream, tablet, count);
+    ok &= BenchParserConformance();
+    ok &= BenchHandParserConformance(&stream, tablet);
+    BenchFuzzHarness();
+    ok &= BenchParserThroughput(count);
+    for (unsigned int i = 0; i < COUNTOF(g_presets); i++) {
+        uint32_t checksum = BenchPipeline(&stream, tablet, &g_presets[i], screen, count);
+        ok &= BenchBatches(&stream, tablet, &g_presets[i], screen, count, checksum);
+        ok &= BenchRing(&stream, tablet, &g_presets[i], screen, count, checksum);
+        BenchMapping(&stream, tablet, &g_presets[i], screen, count);
+        ok &= SweepEquivalence(tablet, &g_presets[i], screen, step);
+    }
+
+    free(stream.data);
+    return ok ? 0 : 2;
+}
+#endif /* TABD_FUZZ */
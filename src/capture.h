@@ -0,0 +1,92 @@
+#ifndef _TABD_CAPTURE_H
+#define _TABD_CAPTURE_H
+
+#include "base.h"
+
+/* Packet capture format written by `tabd.exe --record <file>` and read by tabd-bench.
+
+    CaptureHeader, then any number of records:
+        CaptureRecordHeader (16 bytes)
+        packet bytes        (CaptureRecordHeader.size bytes)
+
+All integers are little-endian. Records are not aligned, read their headers with
+ReadCaptureRecord() rather than casting. A capture may be appended to, so every record carries the
+VID/PID of the device it came from. Timestamps are monotonic nanoseconds of an unspecified epoch,
+only differences between them are meaningful. */
+#define CAPTURE_MAGIC   "TABDCAP"
+#define CAPTURE_VERSION 1
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t record_header_size;
+} CaptureHeader;
+
+typedef struct {
+    uint64_t time_ns;
+    uint16_t vid, pid;
+    uint16_t size;
+    uint16_t reserved;
+} CaptureRecordHeader;
+
+typedef struct {
+    uint64_t time_ns;
+    uint16_t vid, pid;
+    uint16_t size;
+    const uint8_t *packet; /* points into the capture, nothing is copied */
+} CaptureRecord;
+
+#define CAPTURE_RECORD_SIZE(_packet_size) (sizeof(CaptureRecordHeader) + (_packet_size))
+
+void InitCaptureHeader(CaptureHeader *header) {
+    *header = (CaptureHeader){
+        .magic = CAPTURE_MAGIC,
+        .version = CAPTURE_VERSION,
+        .record_header_size = sizeof(CaptureRecordHeader),
+    };
+}
+
+bool IsCaptureHeaderValid(const uint8_t *data, size_t size) {
+    CaptureHeader header;
+    if (size < sizeof(header))
+        return false;
+
+    memcpy(&header, data, sizeof(header));
+    return !memcmp(header.magic, CAPTURE_MAGIC, sizeof(header.magic))
+        && header.version == CAPTURE_VERSION
+        && header.record_header_size == sizeof(CaptureRecordHeader);
+}
+
+/* Writes a record to `dst` which must have CAPTURE_RECORD_SIZE(size) bytes available. */
+uint32_t WriteCaptureRecord(
+    uint8_t *dst, uint64_t time_ns, uint16_t vid, uint16_t pid, const uint8_t *packet, uint16_t size
+) {
+    CaptureRecordHeader header = { .time_ns = time_ns, .vid = vid, .pid = pid, .size = size };
+    memcpy(dst, &header, sizeof(header));
+    memcpy(dst + sizeof(header), packet, size);
+    return CAPTURE_RECORD_SIZE(size);
+}
+
+/* Reads the record at `*offset` and advances it. Returns false at the end of the capture or if the
+last record is truncated. */
+bool ReadCaptureRecord(const uint8_t *data, size_t size, size_t *offset, CaptureRecord *record) {
+    CaptureRecordHeader header;
+    if (*offset + sizeof(header) > size)
+        return false;
+
+    memcpy(&header, data + *offset, sizeof(header));
+    if (*offset + CAPTURE_RECORD_SIZE(header.size) > size)
+        return false;
+
+    *record = (CaptureRecord){
+        .time_ns = header.time_ns,
+        .vid = header.vid,
+        .pid = header.pid,
+        .size = header.size,
+        .packet = data + *offset + sizeof(header),
+    };
+    *offset += CAPTURE_RECORD_SIZE(header.size);
+    return true;
+}
+
+#endif /* _TABD_CAPTURE_H */
@@ -0,0 +1,363 @@
+#ifndef _TABD_DEVICEDB_H
+#define _TABD_DEVICEDB_H
+
+#include "base.h"
+#include "tablet.h"
+
+/* Tablets tabd knows about, looked up by VID/PID when a HID interface shows up.
+
+The prebuilt form is what lookups run on: a header, an open-addressing hash table and the
+TabletInfo records. There are no pointers in it, so tabd.exe and tabd-bench map the file and use it
+in place, and a lookup costs a probe or two however many devices the database has. Records are
+stored as laid out in memory by the build that wrote them, `record_size` catches the obvious
+mismatches. Report plans are not stored, they are compiled for the one device that gets opened.
+
+    DeviceDatabaseHeader
+    DeviceBucket[bucket_count]  a power of two, at least twice `count`
+    TabletInfo[count]
+
+The text form is what people edit, one device per line, `#` starts a comment:
+
+    "Wacom CTL-672" vid=0x056A pid=0x037B size=216x135 max=21600x13500x2047 packet=10 features=02:02 report_id=2 status=8:7 x=16:16 y=32:16 pressure=48:16 tip=8:1 buttons=9:3
+
+Fields are `bit_offset:bit_size` (see ReportLayout), an `s` suffix makes a coordinate signed.
+`vid`, `pid`, `max`, `packet`, `x` and `y` are required, the maximums can't be 0. A later line for the same VID/PID replaces
+an earlier one. `tabd-bench -D` converts text to the prebuilt form, tabd.exe takes either. */
+#define DEVICE_DATABASE_MAGIC   "TABDDEV"
+#define DEVICE_DATABASE_VERSION 1
+#define DEVICE_KEY(_vid, _pid)  ((uint32_t)(_vid) << 16 | (_pid))
+
+/* Upper bound of BuildDeviceDatabase()'s output for `_count` devices, for static buffers. */
+#define DEVICE_DATABASE_MAX_SIZE(_count) \
+    (sizeof(DeviceDatabaseHeader) + 4 * ((_count) + 1) * sizeof(DeviceBucket) + (_count) * sizeof(TabletInfo))
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t record_size;
+    uint32_t count;
+    uint32_t bucket_count;
+} DeviceDatabaseHeader;
+
+typedef struct {
+    uint32_t key;
+    uint32_t index; /* record index + 1, 0 for an empty bucket */
+} DeviceBucket;
+
+typedef struct {
+    const DeviceBucket *buckets;
+    const TabletInfo *devices;
+    uint32_t count;
+    uint32_t bucket_mask;
+} DeviceDatabase;
+
+static uint32_t DeviceBucketCount(uint32_t count) {
+    uint32_t n = 2;
+    while (n < count * 2) {
+        n *= 2;
+    }
+    return n;
+}
+
+static uint32_t HashDeviceKey(uint32_t key, uint32_t mask) {
+    return (uint32_t)(key * 0x9E3779B97F4A7C15ull >> 32) & mask;
+}
+
+size_t DeviceDatabaseSize(uint32_t count) {
+    return sizeof(DeviceDatabaseHeader)
+        + DeviceBucketCount(count) * sizeof(DeviceBucket)
+        + count * sizeof(TabletInfo);
+}
+
+/* Writes the prebuilt form of `devices` to `dst` (8-byte aligned). Returns its size, 0 if it doesn't
+fit or a layout doesn't compile. */
+size_t BuildDeviceDatabase(const TabletInfo *devices, uint32_t count, uint8_t *dst, size_t capacity) {
+    size_t size = DeviceDatabaseSize(count);
+    uint32_t bucket_count = DeviceBucketCount(count);
+    if (size > capacity)
+        return 0;
+
+    DeviceDatabaseHeader header = {
+        .magic = DEVICE_DATABASE_MAGIC,
+        .version = DEVICE_DATABASE_VERSION,
+        .record_size = sizeof(TabletInfo),
+        .count = count,
+        .bucket_count = bucket_count,
+    };
+    memcpy(dst, &header, sizeof(header));
+    DeviceBucket *buckets = (DeviceBucket*)(dst + sizeof(header));
+    TabletInfo *records = (TabletInfo*)(buckets + bucket_count);
+    memset(buckets, 0, bucket_count * sizeof(*buckets));
+
+    for (uint32_t i = 0; i < count; i++) {
+        ReportPlan plan;
+        if (!CompileReportLayout(&devices[i].layout, devices[i].packet_size, &plan))
+            return 0;
+
+        records[i] = devices[i];
+        records[i].plan = (ReportPlan){0};
+        uint32_t key = DEVICE_KEY(devices[i].vid, devices[i].pid);
+        uint32_t b = HashDeviceKey(key, bucket_count - 1);
+        while (buckets[b].index && buckets[b].key != key) {
+            b = (b + 1) & (bucket_count - 1);
+        }
+        buckets[b] = (DeviceBucket){ key, i + 1 };
+    }
+    return size;
+}
+
+/* Points `db` into a prebuilt database, nothing is copied. */
+bool OpenDeviceDatabase(const uint8_t *data, size_t size, DeviceDatabase *db) {
+    DeviceDatabaseHeader header;
+    if (size < sizeof(header))
+        return false;
+
+    memcpy(&header, data, sizeof(header));
+    bool valid = !memcmp(header.magic, DEVICE_DATABASE_MAGIC, sizeof(header.magic))
+        && header.version == DEVICE_DATABASE_VERSION
+        && header.record_size == sizeof(TabletInfo)
+        && header.bucket_count > header.count
+        && !(header.bucket_count & (header.bucket_count - 1))
+        && size >= sizeof(header)
+            + (size_t)header.bucket_count * sizeof(DeviceBucket)
+            + (size_t)header.count * sizeof(TabletInfo);
+    if (!valid)
+        return false;
+
+    db->buckets = (const DeviceBucket*)(data + sizeof(header));
+    db->devices = (const TabletInfo*)(db->buckets + header.bucket_count);
+    db->count = header.count;
+    db->bucket_mask = header.bucket_count - 1;
+    return true;
+}
+
+/* Copies the device out of the database and compiles its report plan, false if it isn't there or
+its record is unusable. */
+bool FindTabletInfo(const DeviceDatabase *db, uint16_t vid, uint16_t pid, TabletInfo *info) {
+    uint32_t key = DEVICE_KEY(vid, pid);
+    uint32_t b = HashDeviceKey(key, db->bucket_mask);
+    for (uint32_t probes = 0; probes <= db->bucket_mask; probes++, b = (b + 1) & db->bucket_mask) {
+        const DeviceBucket *bucket = &db->buckets[b];
+        if (!bucket->index || bucket->index > db->count)
+            return false;
+        if (bucket->key != key)
+            continue;
+
+        *info = db->devices[bucket->index - 1];
+        info->name[sizeof(info->name) - 1] = 0;
+        return info->features_size <= sizeof(info->features)
+            && info->max_x > 0 && info->max_y > 0 && info->max_pressure > 0
+            && CompileReportLayout(&info->layout, info->packet_size, &info->plan);
+    }
+    return false;
+}
+
+static void SkipDeviceSpaces(const char **p, const char *end) {
+    while (*p < end && (**p == ' ' || **p == '\t' || **p == '\r')) {
+        (*p)++;
+    }
+}
+
+static bool ExpectDeviceChar(const char **p, const char *end, char c) {
+    if (*p == end || **p != c)
+        return false;
+    (*p)++;
+    return true;
+}
+
+static bool MatchDeviceKey(const char **p, const char *end, const char *key) {
+    const char *s = *p;
+    for (; *key; key++, s++) {
+        if (s == end || *s != *key)
+            return false;
+    }
+    if (s == end || *s != '=')
+        return false;
+    *p = s + 1;
+    return true;
+}
+
+static int HexDigitValue(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if ((c | 0x20) >= 'a' && (c | 0x20) <= 'f') return (c | 0x20) - 'a' + 10;
+    return -1;
+}
+
+/* Decimal, or hexadecimal with a 0x prefix. */
+static bool ParseDeviceNumber(const char **p, const char *end, uint32_t max, uint32_t *value) {
+    const char *s = *p;
+    uint32_t base = 10;
+    if (end - s > 2 && s[0] == '0' && (s[1] | 0x20) == 'x') {
+        base = 16;
+        s += 2;
+    }
+
+    uint64_t v = 0;
+    const char *digits = s;
+    for (int d; s < end && (d = HexDigitValue(*s)) >= 0 && (uint32_t)d < base; s++) {
+        v = v * base + d;
+        if (v > max)
+            return false;
+    }
+    if (s == digits)
+        return false;
+
+    *p = s;
+    *value = (uint32_t)v;
+    return true;
+}
+
+static bool ParseDeviceDecimal(const char **p, const char *end, float *value) {
+    uint32_t whole, fraction = 0;
+    float scale = 1;
+    if (!ParseDeviceNumber(p, end, 0xFFFFFF, &whole))
+        return false;
+    if (ExpectDeviceChar(p, end, '.')) {
+        for (; *p < end && **p >= '0' && **p <= '9' && scale < 1e6f; (*p)++) {
+            fraction = fraction * 10 + (**p - '0');
+            scale *= 10;
+        }
+    }
+    *value = whole + fraction / scale;
+    return true;
+}
+
+static bool ParseDeviceField(const char **p, const char *end, ReportField *field) {
+    uint32_t offset, size;
+    if (
+        !ParseDeviceNumber(p, end, 0xFFFF, &offset)
+        || !ExpectDeviceChar(p, end, ':')
+        || !ParseDeviceNumber(p, end, 25, &size)
+    ) {
+        return false;
+    }
+    *field = (ReportField){ (uint16_t)offset, (uint8_t)size, ExpectDeviceChar(p, end, 's') };
+    return true;
+}
+
+static bool ParseDeviceFeatures(const char **p, const char *end, TabletInfo *info) {
+    info->features_size = 0;
+    do {
+        if (end - *p < 2 || info->features_size == sizeof(info->features))
+            return false;
+        int hi = HexDigitValue((*p)[0]), lo = HexDigitValue((*p)[1]);
+        if (hi < 0 || lo < 0)
+            return false;
+        info->features[info->features_size++] = (uint8_t)(hi << 4 | lo);
+        *p += 2;
+    } while (ExpectDeviceChar(p, end, ':'));
+    return true;
+}
+
+#define DEVICE_HAS_VID    0x01
+#define DEVICE_HAS_PID    0x02
+#define DEVICE_HAS_MAX    0x04
+#define DEVICE_HAS_PACKET 0x08
+#define DEVICE_HAS_X      0x10
+#define DEVICE_HAS_Y      0x20
+#define DEVICE_REQUIRED   0x3F
+
+static bool ParseDeviceLine(const char **p, const char *end, TabletInfo *info) {
+    *info = (TabletInfo){0};
+    if (!ExpectDeviceChar(p, end, '"'))
+        return false;
+    for (uint32_t length = 0; *p < end && **p != '"' && **p != '\n'; (*p)++) {
+        if (length + 1 < sizeof(info->name)) {
+            info->name[length++] = **p;
+        }
+    }
+    if (!ExpectDeviceChar(p, end, '"'))
+        return false;
+
+    uint32_t seen = 0, a, b, c;
+    for (;;) {
+        SkipDeviceSpaces(p, end);
+        if (*p == end || **p == '\n' || **p == '#')
+            break;
+
+        bool valid;
+        if (MatchDeviceKey(p, end, "vid")) {
+            valid = ParseDeviceNumber(p, end, 0xFFFF, &a);
+            info->vid = (uint16_t)a;
+            seen |= DEVICE_HAS_VID;
+        } else if (MatchDeviceKey(p, end, "pid")) {
+            valid = ParseDeviceNumber(p, end, 0xFFFF, &a);
+            info->pid = (uint16_t)a;
+            seen |= DEVICE_HAS_PID;
+        } else if (MatchDeviceKey(p, end, "size")) {
+            valid = ParseDeviceDecimal(p, end, &info->measurements.x)
+                && ExpectDeviceChar(p, end, 'x')
+                && ParseDeviceDecimal(p, end, &info->measurements.y);
+        } else if (MatchDeviceKey(p, end, "max")) {
+            valid = ParseDeviceNumber(p, end, 0x1FFFFFF, &a)
+                && ExpectDeviceChar(p, end, 'x')
+                && ParseDeviceNumber(p, end, 0x1FFFFFF, &b)
+                && ExpectDeviceChar(p, end, 'x')
+                && ParseDeviceNumber(p, end, 0x1FFFFFF, &c)
+                && a && b && c;
+            info->max_x = a;
+            info->max_y = b;
+            info->max_pressure = c;
+            seen |= DEVICE_HAS_MAX;
+        } else if (MatchDeviceKey(p, end, "packet")) {
+            valid = ParseDeviceNumber(p, end, 0xFFFF, &info->packet_size);
+            seen |= DEVICE_HAS_PACKET;
+        } else if (MatchDeviceKey(p, end, "features")) {
+            valid = ParseDeviceFeatures(p, end, info);
+        } else if (MatchDeviceKey(p, end, "report_id")) {
+            valid = ParseDeviceNumber(p, end, 0xFF, &a);
+            info->layout.report_id = (uint8_t)a;
+        } else if (MatchDeviceKey(p, end, "status")) {
+            valid = ParseDeviceField(p, end, &info->layout.status);
+        } else if (MatchDeviceKey(p, end, "x")) {
+            valid = ParseDeviceField(p, end, &info->layout.x);
+            seen |= DEVICE_HAS_X;
+        } else if (MatchDeviceKey(p, end, "y")) {
+            valid = ParseDeviceField(p, end, &info->layout.y);
+            seen |= DEVICE_HAS_Y;
+        } else if (MatchDeviceKey(p, end, "pressure")) {
+            valid = ParseDeviceField(p, end, &info->layout.pressure);
+        } else if (MatchDeviceKey(p, end, "tip")) {
+            valid = ParseDeviceField(p, end, &info->layout.tip);
+        } else if (MatchDeviceKey(p, end, "buttons")) {
+            valid = ParseDeviceField(p, end, &info->layout.buttons);
+        } else {
+            valid = false;
+        }
+
+        bool separated = *p == end || **p == ' ' || **p == '\t' || **p == '\r' || **p == '\n';
+        if (!valid || !separated)
+            return false;
+    }
+
+    ReportPlan plan;
+    return (seen & DEVICE_REQUIRED) == DEVICE_REQUIRED
+        && CompileReportLayout(&info->layout, info->packet_size, &plan);
+}
+
+/* Parses the text form into `devices`. On failure `*error_line` is the 1-based line at fault. */
+bool ParseDeviceList(
+    const char *text,
+    size_t size,
+    TabletInfo *devices,
+    uint32_t capacity,
+    uint32_t *count,
+    uint32_t *error_line
+) {
+    const char *p = text, *end = text + size;
+    *count = 0;
+    for (uint32_t line = 1; p < end; line++) {
+        SkipDeviceSpaces(&p, end);
+        if (p < end && *p != '\n' && *p != '#') {
+            if (*count == capacity || !ParseDeviceLine(&p, end, &devices[*count])) {
+                *error_line = line;
+                return false;
+            }
+            (*count)++;
+        }
+        while (p < end && *p++ != '\n') {}
+    }
+    return true;
+}
+
+#endif /* _TABD_DEVICEDB_H */
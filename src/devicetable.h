@@ -0,0 +1,139 @@
+#ifndef _TABD_DEVICETABLE_H
+#define _TABD_DEVICETABLE_H
+
+#include "base.h"
+#include "tablet.h"
+#include "batch.h"
+#include "ring.h"
+#include "readqueue.h"
+#include "resample.h"
+#include "presetfile.h"
+#include "output.h"
+
+/* Every open tablet gets a slot of its own, so several can be used at once without sharing anything
+but the threads. The reader side of a slot (reads in flight, parsed batch, report ring) is serviced by
+a single loop waiting on all of them, an I/O completion port in tabd.c and epoll in tabd-bench. The
+output side (previous report, filter, predictor, resampler, active preset) belongs to the one output
+thread, which takes a batch off every ring in turn.
+
+Slots are claimed and released under the platform layer's lock. A released slot keeps its ring and
+counters. Reports go onto the ring tagged with the slot's generation and the output thread pops
+them by the generation it reads, so whatever the previous tablet left queued is dropped rather than
+mapped for the next one, and the output side state is reset before the next tablet's first batch. */
+#define DEVICE_TABLE_CAPACITY 16
+
+typedef enum {
+    DEVICE_FREE,
+    DEVICE_OPEN,
+    DEVICE_CLOSING, /* reads are being cancelled */
+} DeviceState;
+
+typedef struct {
+    volatile uint32_t state;      /* DeviceState */
+    volatile uint32_t generation; /* bumped per claim, older completions and reports are stale */
+    TabletInfo info;
+
+    /* reader side */
+    ReadQueue queue;
+    ReportBatch batch;
+    ReportRing ring;
+
+    /* output side, PresetSlots written by whoever (re)compiles presets */
+    volatile uint32_t preset_idx; /* active preset */
+    PresetSlot presets[PRESET_CAPACITY];
+    uint32_t output_preset_idx;
+    uint32_t output_generation; /* whose state the output side has */
+    PresetReader preset;
+    TabletReport previous;
+    FilterState filter;
+    PredictorState predictor;
+    Resampler resampler;
+    OutputSuppressor suppressor;
+    uint64_t coalesced;         /* reports dropped by coalescing */
+    uint64_t coalesced_batches; /* batches that had any */
+} DeviceSlot;
+
+typedef struct {
+    uint32_t count;               /* slots not DEVICE_FREE */
+    volatile uint32_t preset_idx; /* what new tablets start with */
+    DeviceSlot slots[DEVICE_TABLE_CAPACITY];
+} DeviceTable;
+
+/* Sets up every slot's resampler and suppressor, `period_ns` 0 when output isn't resampled and
+`keep_alive_ns` 0 when repeated frames aren't suppressed. */
+void InitDeviceTable(DeviceTable *table, uint64_t period_ns, uint64_t keep_alive_ns) {
+    for (uint32_t i = 0; i < DEVICE_TABLE_CAPACITY; i++) {
+        InitResampler(&table->slots[i].resampler, period_ns);
+        table->slots[i].suppressor = (OutputSuppressor){ .keep_alive_ns = keep_alive_ns };
+    }
+}
+
+/* A free slot for `info`, 0 if all of them are taken. */
+DeviceSlot *ClaimDeviceSlot(DeviceTable *table, const TabletInfo *info) {
+    for (uint32_t i = 0; i < DEVICE_TABLE_CAPACITY; i++) {
+        DeviceSlot *slot = &table->slots[i];
+        if (slot->state != DEVICE_FREE)
+            continue;
+
+        AtomicStore32(&slot->generation, slot->generation + 1);
+        slot->info = *info;
+        slot->preset_idx = AtomicLoad32(&table->preset_idx);
+        AtomicStore32(&slot->state, DEVICE_OPEN);
+        table->count++;
+        return slot;
+    }
+    return 0;
+}
+
+void ReleaseDeviceSlot(DeviceTable *table, DeviceSlot *slot) {
+    if (slot->state == DEVICE_FREE)
+        return;
+    AtomicStore32(&slot->state, DEVICE_FREE);
+    slot->info = (TabletInfo){0};
+    table->count--;
+}
+
+uint32_t GetDeviceIndex(const DeviceTable *table, const DeviceSlot *slot) {
+    return (uint32_t)(slot - table->slots);
+}
+
+/* Output side: a batch of the slot's current tablet off its ring, resetting the output side state
+on the first one. */
+uint32_t PopDeviceBatch(DeviceSlot *slot, ReportBatch *batch) {
+    uint32_t generation = AtomicLoad32(&slot->generation);
+    if (!PopReportBatch(&slot->ring, batch, generation))
+        return 0;
+
+    if (generation != slot->output_generation) {
+        slot->output_generation = generation;
+        slot->previous = (TabletReport){0};
+        slot->filter = (FilterState){0};
+        slot->predictor = (PredictorState){0};
+        ResetResampler(&slot->resampler);
+        slot->suppressor.has_last = false;
+    }
+    return batch->count;
+}
+
+/* Output side: runs the slot's active preset's filter and predictor over a batch from
+PopDeviceBatch(). */
+const CompiledPreset *PrepareDeviceBatch(DeviceSlot *slot, ReportBatch *batch) {
+    /* filter and predictor state don't carry over between presets, nor over a reload */
+    uint32_t preset_idx = AtomicLoad32(&slot->preset_idx);
+    if (preset_idx != slot->output_preset_idx) {
+        slot->output_preset_idx = preset_idx;
+        slot->preset.sequence = 0;
+    }
+    uint32_t sequence = slot->preset.sequence;
+    const CompiledPreset *preset = ReadPreset(&slot->presets[preset_idx], &slot->preset);
+    if (slot->preset.sequence != sequence) {
+        slot->filter = (FilterState){0};
+        slot->predictor = (PredictorState){0};
+    }
+
+    FilterReportBatch(preset, &slot->filter, batch);
+    PredictReportBatch(preset, &slot->predictor, batch);
+    return preset;
+}
+
+#endif /* _TABD_DEVICETABLE_H */
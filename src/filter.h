@@ -0,0 +1,109 @@
+#ifndef _TABD_FILTER_H
+#define _TABD_FILTER_H
+
+#include "base.h"
+
+/* Smoothing of raw sensor coordinates between parsing and mapping, picked per preset.
+
+FILTER_EMA is a first-order low-pass. Every report moves the output towards the input by
+alpha = 1 / (1 + 1 / (2π · cutoff · dt)), so the cutoff frequency stays put whatever the report rate
+or the gaps between reports.
+
+FILTER_ONE_EURO (Casiez et al., "1€ Filter", CHI 2012) is the same low-pass with a cutoff that rises
+with pen speed, cutoff = min_cutoff + beta · speed: a resting pen loses its jitter and a moving one
+gets little lag. Speed is the magnitude of the velocity, itself low-passed at `derivative_cutoff`, so
+both axes share one cutoff and diagonal strokes aren't smoothed differently from straight ones.
+
+Settings are in millimeters so they carry over between tablets, CompileFilter() converts them to raw
+units. A gap longer than FILTER_RESET_NS (the pen left proximity) restarts the filter at the new
+position rather than dragging the cursor over from where the pen was lifted. */
+#define FILTER_RESET_NS          100000000ull
+#define FILTER_DEFAULT_INTERVAL  0.0075f /* s, until two reports with distinct timestamps arrive */
+
+typedef enum {
+    FILTER_NONE,
+    FILTER_EMA,
+    FILTER_ONE_EURO,
+} FilterKind;
+
+typedef struct {
+    FilterKind kind;
+    float min_cutoff;        /* Hz */
+    float beta;              /* Hz per mm/s, One-Euro only */
+    float derivative_cutoff; /* Hz, One-Euro only */
+} FilterSettings;
+
+/* Cutoffs as angular frequencies, beta per raw unit/s. */
+typedef struct {
+    FilterKind kind;
+    float min_cutoff;
+    float beta;
+    float derivative_cutoff;
+} CompiledFilter;
+
+typedef struct {
+    bool primed;
+    uint64_t time_ns;
+    float interval; /* s, between the last two distinct timestamps */
+    float x, y;
+    float dx, dy;   /* raw units/s */
+} FilterState;
+
+CompiledFilter CompileFilter(const FilterSettings *settings, float units_per_mm) {
+    float w = 2 * 3.1415927f;
+    return (CompiledFilter){
+        .kind = settings->kind,
+        .min_cutoff = w * settings->min_cutoff,
+        .beta = (units_per_mm > 0) ? w * settings->beta / units_per_mm : 0,
+        .derivative_cutoff = w * settings->derivative_cutoff,
+    };
+}
+
+static float FilterAlpha(float w, float dt) {
+    float r = w * dt;
+    return r / (r + 1);
+}
+
+static int32_t RoundToInt32(float v) {
+    return (int32_t)(v + ((v < 0) ? -0.5f : 0.5f));
+}
+
+/* Filters one report in place. Reports of a single read share its timestamp, they are spaced by
+the last interval seen instead. */
+void FilterPoint(
+    const CompiledFilter *filter, FilterState *state, uint64_t time_ns, int32_t *x, int32_t *y
+) {
+    if (!state->primed || time_ns - state->time_ns > FILTER_RESET_NS) {
+        *state = (FilterState){
+            .primed = true,
+            .time_ns = time_ns,
+            .interval = FILTER_DEFAULT_INTERVAL,
+            .x = (float)*x,
+            .y = (float)*y,
+        };
+        return;
+    }
+
+    float dt = state->interval;
+    if (time_ns != state->time_ns) {
+        dt = (time_ns - state->time_ns) / 1e9f;
+        state->interval = dt;
+        state->time_ns = time_ns;
+    }
+
+    float cutoff = filter->min_cutoff;
+    if (filter->kind == FILTER_ONE_EURO) {
+        float a = FilterAlpha(filter->derivative_cutoff, dt);
+        state->dx += a * ((*x - state->x) / dt - state->dx);
+        state->dy += a * ((*y - state->y) / dt - state->dy);
+        cutoff += filter->beta * (float)sqrt(state->dx * state->dx + state->dy * state->dy);
+    }
+
+    float a = FilterAlpha(cutoff, dt);
+    state->x += a * (*x - state->x);
+    state->y += a * (*y - state->y);
+    *x = RoundToInt32(state->x);
+    *y = RoundToInt32(state->y);
+}
+
+#endif /* _TABD_FILTER_H */
@@ -0,0 +1,238 @@
+#ifndef _TABD_HIDRAW_H
+#define _TABD_HIDRAW_H
+
+/* Linux input backend, the counterpart of tabd.c's HID reads: tablets are found among /dev/hidraw*
+by the VID/PID HIDIOCGRAWINFO reports, get TabletInfo.features sent as a feature report like
+HidD_SetFeature() does and are read without blocking, every ready device drained from one epoll set.
+Each read is one report, handed on with the time it completed.
+
+A FIFO or a plain file of back-to-back reports can stand in for a device, taking the TabletInfo it
+is opened with. Their reads return any number of bytes, packets split across two are put back
+together before they are handed on. epoll doesn't take plain files, they count as always ready and are
+read a chunk per poll until they end; a FIFO ends when its last writer closes it. */
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/hidraw.h>
+#include <stdio.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "base.h"
+#include "tablet.h"
+#include "devicedb.h"
+
+#define HIDRAW_MAX_SOURCES 16
+#define HIDRAW_READ_SIZE 4096
+
+typedef enum {
+    HIDRAW_DEVICE,
+    HIDRAW_FIFO,
+    HIDRAW_FILE,
+} HidrawSourceKind;
+
+typedef struct {
+    int fd; /* -1 while the slot is free */
+    HidrawSourceKind kind;
+    TabletInfo info;
+    uint32_t pending; /* bytes of a split packet at the start of buffer */
+    uint64_t reads;
+    uint64_t bytes;
+    uint8_t buffer[HIDRAW_READ_SIZE];
+} HidrawSource;
+
+typedef struct {
+    int epoll;
+    uint32_t count;
+    uint32_t files;
+    HidrawSource sources[HIDRAW_MAX_SOURCES];
+} Hidraw;
+
+/* `size` is a whole number of packets. */
+typedef void (*HidrawPacketsProc)(
+    void *context, const HidrawSource *source, const uint8_t *data, uint32_t size, uint64_t time_ns
+);
+
+static uint64_t GetHidrawTime(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+bool InitHidraw(Hidraw *h) {
+    *h = (Hidraw){ .epoll = epoll_create1(EPOLL_CLOEXEC) };
+    for (int i = 0; i < HIDRAW_MAX_SOURCES; i++) {
+        h->sources[i].fd = -1;
+    }
+    return h->epoll >= 0;
+}
+
+static HidrawSource *AddHidrawSource(Hidraw *h, int fd, HidrawSourceKind kind, const TabletInfo *info) {
+    HidrawSource *s = 0;
+    for (int i = 0; i < HIDRAW_MAX_SOURCES && !s; i++) {
+        s = (h->sources[i].fd < 0) ? &h->sources[i] : 0;
+    }
+    if (!s || !info->packet_size || info->packet_size > HIDRAW_READ_SIZE)
+        return 0;
+
+    struct epoll_event event = { .events = EPOLLIN, .data.ptr = s };
+    if (kind != HIDRAW_FILE && epoll_ctl(h->epoll, EPOLL_CTL_ADD, fd, &event))
+        return 0;
+
+    s->fd = fd;
+    s->kind = kind;
+    s->info = *info;
+    s->pending = 0;
+    s->reads = 0;
+    s->bytes = 0;
+    h->count++;
+    h->files += kind == HIDRAW_FILE;
+    return s;
+}
+
+void CloseHidrawSource(Hidraw *h, HidrawSource *s) {
+    if (s->fd < 0)
+        return;
+    if (s->kind != HIDRAW_FILE) {
+        epoll_ctl(h->epoll, EPOLL_CTL_DEL, s->fd, 0);
+    }
+    close(s->fd);
+    s->fd = -1;
+    h->count--;
+    h->files -= s->kind == HIDRAW_FILE;
+}
+
+void CloseHidraw(Hidraw *h) {
+    for (int i = 0; i < HIDRAW_MAX_SOURCES; i++) {
+        CloseHidrawSource(h, &h->sources[i]);
+    }
+    if (h->epoll >= 0) {
+        close(h->epoll);
+    }
+    h->epoll = -1;
+}
+
+/* Opens `path` if it is a hidraw node of a device in `db`, false otherwise or if it didn't take the
+feature report. */
+bool OpenHidrawDevice(Hidraw *h, const DeviceDatabase *db, const char *path) {
+    int fd = open(path, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+
+    struct hidraw_devinfo devinfo;
+    TabletInfo info;
+    uint8_t features[sizeof(info.features)];
+    bool valid =
+        !ioctl(fd, HIDIOCGRAWINFO, &devinfo)
+        && FindTabletInfo(db, (uint16_t)devinfo.vendor, (uint16_t)devinfo.product, &info)
+        && info.features_size <= sizeof(features);
+    if (valid && info.features_size) {
+        memcpy(features, info.features, info.features_size);
+        valid = ioctl(fd, HIDIOCSFEATURE(info.features_size), features) >= 0;
+    }
+    if (!valid || !AddHidrawSource(h, fd, HIDRAW_DEVICE, &info)) {
+        close(fd);
+        return false;
+    }
+    return true;
+}
+
+/* Tries every hidrawN in `dir` (/dev), returns how many were opened. */
+uint32_t OpenHidrawDevices(Hidraw *h, const DeviceDatabase *db, const char *dir) {
+    DIR *d = opendir(dir);
+    if (!d)
+        return 0;
+
+    uint32_t opened = 0;
+    for (struct dirent *entry; (entry = readdir(d)); ) {
+        if (strncmp(entry->d_name, "hidraw", 6))
+            continue;
+
+        char path[512];
+        snprintf(path, sizeof(path), "%s/%s", dir, entry->d_name);
+        opened += OpenHidrawDevice(h, db, path);
+    }
+    closedir(d);
+    return opened;
+}
+
+/* A FIFO or plain file of `info`'s reports, or a hidraw node taken as `info` without asking it. */
+bool OpenHidrawStandIn(Hidraw *h, const char *path, const TabletInfo *info) {
+    int fd = open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st)) {
+        if (fd >= 0) close(fd);
+        return false;
+    }
+
+    HidrawSourceKind kind =
+        S_ISFIFO(st.st_mode) ? HIDRAW_FIFO : S_ISREG(st.st_mode) ? HIDRAW_FILE : HIDRAW_DEVICE;
+    if (!AddHidrawSource(h, fd, kind, info)) {
+        close(fd);
+        return false;
+    }
+    return true;
+}
+
+/* Reads what `s` has, false once it has ended or failed and was closed. */
+static bool ReadHidrawSource(Hidraw *h, HidrawSource *s, HidrawPacketsProc proc, void *context) {
+    uint32_t packet_size = s->info.packet_size;
+    uint32_t capacity = HIDRAW_READ_SIZE - HIDRAW_READ_SIZE % packet_size;
+    do {
+        ssize_t n = read(s->fd, s->buffer + s->pending, capacity - s->pending);
+        uint64_t now = GetHidrawTime();
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && errno == EAGAIN)
+            return true;
+        if (n <= 0) {
+            CloseHidrawSource(h, s);
+            return false;
+        }
+
+        s->reads++;
+        s->bytes += n;
+        uint32_t size = s->pending + (uint32_t)n;
+        uint32_t whole = size - size % packet_size;
+        if (whole) {
+            proc(context, s, s->buffer, whole, now);
+        }
+        s->pending = size - whole;
+        memmove(s->buffer, s->buffer + whole, s->pending);
+    } while (s->kind != HIDRAW_FILE);
+    return true;
+}
+
+/* Waits up to `timeout_ms` (-1 for ever) for any source to be ready and passes on everything that is,
+plain files right away. Returns the number of sources read, -1 once none is left. */
+int PollHidraw(Hidraw *h, int timeout_ms, HidrawPacketsProc proc, void *context) {
+    if (!h->count)
+        return -1;
+
+    struct epoll_event events[HIDRAW_MAX_SOURCES];
+    int ready = epoll_wait(h->epoll, events, HIDRAW_MAX_SOURCES, (h->files) ? 0 : timeout_ms);
+    if (ready < 0)
+        return (errno == EINTR) ? 0 : -1;
+
+    int polled = 0;
+    for (int i = 0; i < ready; i++) {
+        HidrawSource *s = events[i].data.ptr;
+        if (s->fd >= 0) {
+            ReadHidrawSource(h, s, proc, context);
+            polled++;
+        }
+    }
+    for (int i = 0; i < HIDRAW_MAX_SOURCES && h->files; i++) {
+        HidrawSource *s = &h->sources[i];
+        if (s->fd >= 0 && s->kind == HIDRAW_FILE) {
+            ReadHidrawSource(h, s, proc, context);
+            polled++;
+        }
+    }
+    return polled;
+}
+
+#endif /* _TABD_HIDRAW_H */
@@ -0,0 +1,107 @@
+#ifndef _TABD_LATENCY_H
+#define _TABD_LATENCY_H
+
+#include "base.h"
+
+/* Where the time goes between a read completing and its input being injected. Every report is
+stamped with its read's completion time (ReportBatch.time_ns), each stage records how long after
+that the report got there:
+
+    LATENCY_PARSED    parsed, on the reader thread
+    LATENCY_POPPED    taken off the ring by the output thread
+    LATENCY_MAPPED    filtered, predicted and mapped to the screen
+    LATENCY_INJECTED  SendInput() / InjectSyntheticPointerInput() returned
+
+Histograms are log-linear with a fixed size: values below 2 * LATENCY_SUB_BUCKETS ns get a bucket
+each, above that every power of two is split into LATENCY_SUB_BUCKETS buckets, so any percentile is
+within 1/16 of the true value. Recording is an index computation and three adds. Every histogram has
+a single writer, readers may see it mid-update which is fine for statistics.
+
+tabd.exe only records with TABD_LATENCY defined, otherwise the LATENCY_* macros there compile to
+nothing. */
+#define LATENCY_SUB_BITS    4
+#define LATENCY_SUB_BUCKETS (1 << LATENCY_SUB_BITS)
+#define LATENCY_MAX_BITS    40 /* ~18 minutes, longer is counted as that */
+#define LATENCY_BUCKETS     ((LATENCY_MAX_BITS - LATENCY_SUB_BITS + 1) * LATENCY_SUB_BUCKETS)
+
+typedef enum {
+    LATENCY_PARSED,
+    LATENCY_POPPED,
+    LATENCY_MAPPED,
+    LATENCY_INJECTED,
+    LATENCY_STAGES,
+} LatencyStage;
+
+static const char *const g_latency_stages[] = { "parsed", "popped", "mapped", "injected" };
+
+typedef struct {
+    uint64_t count;
+    uint64_t sum;
+    uint64_t max;
+    uint64_t buckets[LATENCY_BUCKETS];
+} LatencyHistogram;
+
+typedef struct {
+    uint64_t count;
+    uint64_t mean, p50, p99, p999, max; /* ns */
+} LatencySummary;
+
+static uint32_t HighestBit64(uint64_t v) {
+#ifdef _WIN32
+    unsigned long index;
+    _BitScanReverse64(&index, v);
+    return index;
+#else
+    return 63 - __builtin_clzll(v);
+#endif
+}
+
+static uint32_t LatencyBucket(uint64_t ns) {
+    if (ns < 2 * LATENCY_SUB_BUCKETS)
+        return (uint32_t)ns;
+    uint32_t shift = HighestBit64(ns) - LATENCY_SUB_BITS;
+    uint32_t bucket = (shift + 1) * LATENCY_SUB_BUCKETS + ((ns >> shift) & (LATENCY_SUB_BUCKETS - 1));
+    return (bucket < LATENCY_BUCKETS) ? bucket : LATENCY_BUCKETS - 1;
+}
+
+/* The highest value that lands in `bucket`. */
+static uint64_t LatencyBucketLimit(uint32_t bucket) {
+    if (bucket < 2 * LATENCY_SUB_BUCKETS)
+        return bucket;
+    uint32_t shift = bucket / LATENCY_SUB_BUCKETS - 1;
+    uint64_t base = LATENCY_SUB_BUCKETS + bucket % LATENCY_SUB_BUCKETS;
+    return (base << shift) + ((1ull << shift) - 1);
+}
+
+void RecordLatency(LatencyHistogram *h, uint64_t ns) {
+    h->buckets[LatencyBucket(ns)]++;
+    h->count++;
+    h->sum += ns;
+    h->max = (ns > h->max) ? ns : h->max;
+}
+
+/* The value at quantile `q` (0..1), never above the maximum seen. */
+uint64_t LatencyPercentile(const LatencyHistogram *h, double q) {
+    uint64_t rank = (uint64_t)(q * h->count), seen = 0;
+    for (uint32_t i = 0; i < LATENCY_BUCKETS; i++) {
+        seen += h->buckets[i];
+        if (seen > rank) {
+            uint64_t limit = LatencyBucketLimit(i);
+            return (limit < h->max) ? limit : h->max;
+        }
+    }
+    return h->max;
+}
+
+LatencySummary SummarizeLatency(const LatencyHistogram *h) {
+    return (LatencySummary){
+        .count = h->count,
+        .mean = (h->count) ? h->sum / h->count : 0,
+        .p50 = LatencyPercentile(h, 0.5),
+        .p99 = LatencyPercentile(h, 0.99),
+        .p999 = LatencyPercentile(h, 0.999),
+        .max = h->max,
+    };
+}
+
+#endif /* _TABD_LATENCY_H */
@@ -0,0 +1,535 @@
+#ifndef _TABD_LOG_H
+#define _TABD_LOG_H
+
+#include "base.h"
+
+/* Logging that costs the calling thread a copy and nothing else. Log() stores a timestamp, its call
+site and its raw arguments as a fixed-size LogRecord in the calling thread's own LogRing and returns.
+Formatting and writing happen later on a log thread, or never: with a log file the records are written
+as compact binary entries and only formatted by the decoder (tabd.exe --decode-log). A full ring drops
+the record and counts it, the caller never waits.
+
+Each call site is a static LogSite holding the format, the kinds of its arguments are worked out from
+the format on the first call. Only the conversions tabd uses are understood: %lld, %llu and %llx take
+64 bits, %d, %u and %x 32 (%lu too, long is 32 bits on Windows), %ls and %hs copy the string into the
+record's text, truncated to what's left of it. Widths and precisions are ignored. */
+#define LOG_MAX_ARGS         8
+#define LOG_TEXT_CAPACITY    212 /* UTF-16 units, a record is 512 bytes */
+#define LOG_RING_CAPACITY    128 /* records, power of two */
+#define LOG_SITE_CAPACITY    256 /* per log file */
+#define LOG_DECODER_CAPACITY (64 * 1024) /* characters of site strings */
+#define LOG_LINE_CAPACITY    1024 /* characters of a formatted line */
+#define LOG_FILE_MAGIC       0x474f4c54 /* "TLOG" */
+
+typedef enum {
+    LOG_ARG_NONE,
+    LOG_ARG_INT32,
+    LOG_ARG_INT64,
+    LOG_ARG_WSTRING,
+    LOG_ARG_STRING,
+} LogArgKind;
+
+typedef struct {
+    int line;
+    const wchar_t *file;
+    const char *func;
+    const wchar_t *format;
+    volatile uint32_t kinds; /* 3 bits per argument, LOG_KINDS_PARSED once set */
+} LogSite;
+
+#define LOG_KINDS_PARSED 0x80000000u
+
+typedef struct {
+    uint64_t time_ns;
+    const LogSite *site;
+    uint32_t thread;
+    uint16_t arg_count;
+    uint16_t text_units;
+    uint64_t args[LOG_MAX_ARGS]; /* strings as their offset into text */
+    uint16_t text[LOG_TEXT_CAPACITY];
+} LogRecord;
+
+/* Single producer, the thread it belongs to, and single consumer, the log thread. */
+typedef struct {
+    volatile uint32_t head;
+    volatile uint32_t dropped;
+    uint8_t _pad0[64 - sizeof(uint32_t) * 2];
+    volatile uint32_t tail;
+    uint8_t _pad1[64 - sizeof(uint32_t)];
+    LogRecord records[LOG_RING_CAPACITY];
+} LogRing;
+
+/* Log files are a sequence of entries, every run appended starts with LOG_ENTRY_START (its `site` is
+LOG_FILE_MAGIC). A LOG_ENTRY_SITE defines the site index it carries for the rest of the run: `thread`
+is the line and its text the file, function and format, each 0-terminated. A LOG_ENTRY_RECORD is a
+record with its arguments and text. */
+typedef enum {
+    LOG_ENTRY_START = 1,
+    LOG_ENTRY_SITE,
+    LOG_ENTRY_RECORD,
+} LogEntryKind;
+
+typedef struct {
+    uint32_t size; /* header, args and text */
+    uint16_t kind;
+    uint16_t arg_count;
+    uint32_t site;
+    uint32_t thread;
+    uint64_t time_ns;
+} LogEntry;
+
+typedef struct {
+    const LogSite *sites[LOG_SITE_CAPACITY];
+    uint32_t site_count;
+} LogEncoder;
+
+typedef struct {
+    struct {
+        uint32_t line;
+        uint32_t file, func, format; /* offsets into strings */
+    } sites[LOG_SITE_CAPACITY];
+    uint32_t site_count;
+    uint64_t start_ns;
+    uint32_t strings_size;
+    wchar_t strings[LOG_DECODER_CAPACITY];
+} LogDecoder;
+
+typedef struct {
+    LogArgKind kind;
+    wchar_t conversion;   /* d, u, x, s or 0 for a literal % */
+    const wchar_t *start; /* the % */
+    const wchar_t *end;   /* past the conversion */
+} LogConversion;
+
+/* Finds the next conversion from `p`, false at the end of the format. */
+static bool NextLogConversion(const wchar_t *p, LogConversion *c) {
+    while (*p && *p != '%') {
+        p++;
+    }
+    if (!*p)
+        return false;
+
+    c->start = p++;
+    while (*p == '-' || *p == '+' || *p == ' ' || *p == '#' || *p == '.' || (*p >= '0' && *p <= '9')) {
+        p++;
+    }
+    int longs = 0, shorts = 0;
+    for (; *p == 'l' || *p == 'h'; p++) {
+        longs += *p == 'l';
+        shorts += *p == 'h';
+    }
+
+    c->conversion = *p;
+    switch (*p) {
+    case 'd': case 'i': case 'u': case 'x':
+        c->kind = (longs >= 2) ? LOG_ARG_INT64 : LOG_ARG_INT32;
+        break;
+    case 's':
+        /* wide printf semantics: plain %s is a wide string */
+        c->kind = (shorts) ? LOG_ARG_STRING : LOG_ARG_WSTRING;
+        break;
+    default:
+        c->kind = LOG_ARG_NONE;
+        c->conversion = 0;
+        break;
+    }
+    c->end = (*p) ? p + 1 : p;
+    return true;
+}
+
+static uint32_t GetLogArgKinds(LogSite *site) {
+    uint32_t kinds = site->kinds;
+    if (kinds & LOG_KINDS_PARSED)
+        return kinds;
+
+    /* racing first calls all come up with the same value */
+    kinds = LOG_KINDS_PARSED;
+    LogConversion c = { .end = site->format };
+    for (uint32_t n = 0; n < LOG_MAX_ARGS && NextLogConversion(c.end, &c); ) {
+        if (c.kind != LOG_ARG_NONE) {
+            kinds |= c.kind << (3 * n++);
+        }
+    }
+    site->kinds = kinds;
+    return kinds;
+}
+
+static uint32_t CopyLogWideText(LogRecord *r, uint32_t at, const wchar_t *s) {
+    for (; s && *s && at < LOG_TEXT_CAPACITY - 1; s++) {
+        r->text[at++] = (uint16_t)*s;
+    }
+    r->text[at++] = 0;
+    return at;
+}
+
+static uint32_t CopyLogText(LogRecord *r, uint32_t at, const char *s) {
+    for (; s && *s && at < LOG_TEXT_CAPACITY - 1; s++) {
+        r->text[at++] = (uint8_t)*s;
+    }
+    r->text[at++] = 0;
+    return at;
+}
+
+/* Called by the ring's own thread only. False if the ring is full. */
+bool WriteLog(LogRing *ring, LogSite *site, uint32_t thread, uint64_t time_ns, va_list args) {
+    uint32_t head = ring->head;
+    if (head - AtomicLoad32(&ring->tail) == LOG_RING_CAPACITY) {
+        AtomicStore32(&ring->dropped, ring->dropped + 1);
+        return false;
+    }
+
+    LogRecord *r = &ring->records[head & (LOG_RING_CAPACITY - 1)];
+    uint32_t kinds = GetLogArgKinds(site), n = 0, text = 0;
+    for (; n < LOG_MAX_ARGS; n++) {
+        LogArgKind kind = (kinds >> (3 * n)) & 7;
+        if (kind == LOG_ARG_NONE)
+            break;
+
+        if (kind == LOG_ARG_INT32) {
+            r->args[n] = va_arg(args, uint32_t);
+        } else if (kind == LOG_ARG_INT64) {
+            r->args[n] = va_arg(args, uint64_t);
+        } else if (text >= LOG_TEXT_CAPACITY) {
+            (void)va_arg(args, const void*);
+            r->args[n] = LOG_TEXT_CAPACITY; /* formatted as an empty string */
+        } else if (kind == LOG_ARG_WSTRING) {
+            r->args[n] = text;
+            text = CopyLogWideText(r, text, va_arg(args, const wchar_t*));
+        } else {
+            r->args[n] = text;
+            text = CopyLogText(r, text, va_arg(args, const char*));
+        }
+    }
+    r->time_ns = time_ns;
+    r->site = site;
+    r->thread = thread;
+    r->arg_count = (uint16_t)n;
+    r->text_units = (uint16_t)text;
+    AtomicStore32(&ring->head, head + 1);
+    return true;
+}
+
+/* The oldest record, 0 if there's none. ReleaseLog() when done with it. */
+const LogRecord *PeekLog(LogRing *ring) {
+    uint32_t tail = ring->tail;
+    if (AtomicLoad32(&ring->head) == tail)
+        return 0;
+    return &ring->records[tail & (LOG_RING_CAPACITY - 1)];
+}
+
+void ReleaseLog(LogRing *ring) {
+    AtomicStore32(&ring->tail, ring->tail + 1);
+}
+
+/* Records not taken yet, for the ring's own thread to decide when to wake the log thread. */
+uint32_t GetLogBacklog(LogRing *ring) {
+    return ring->head - AtomicLoad32(&ring->tail);
+}
+
+static uint32_t AppendLogChar(wchar_t *out, uint32_t at, uint32_t capacity, wchar_t c) {
+    if (at < capacity - 1) {
+        out[at++] = c;
+    }
+    return at;
+}
+
+static uint32_t AppendLogWideString(wchar_t *out, uint32_t at, uint32_t capacity, const wchar_t *s) {
+    for (; *s; s++) {
+        at = AppendLogChar(out, at, capacity, *s);
+    }
+    return at;
+}
+
+static uint32_t AppendLogNumber(wchar_t *out, uint32_t at, uint32_t capacity, uint64_t v, uint32_t base, uint32_t min_digits) {
+    wchar_t digits[24];
+    uint32_t n = 0;
+    do {
+        digits[n++] = L"0123456789abcdef"[v % base];
+        v /= base;
+    } while (v || n < min_digits);
+    while (n) {
+        at = AppendLogChar(out, at, capacity, digits[--n]);
+    }
+    return at;
+}
+
+/* Formats `format` with a record's arguments into `out`, from `at` on and always 0-terminated.
+Returns the new length. */
+uint32_t FormatLogMessage(
+    const wchar_t *format,
+    const uint64_t *args,
+    uint32_t arg_count,
+    const uint16_t *text,
+    uint32_t text_units,
+    wchar_t *out,
+    uint32_t at,
+    uint32_t capacity
+) {
+    const wchar_t *p = format;
+    uint32_t n = 0;
+    for (LogConversion c; NextLogConversion(p, &c); p = c.end) {
+        for (; p < c.start; p++) {
+            at = AppendLogChar(out, at, capacity, *p);
+        }
+        if (c.kind == LOG_ARG_NONE) {
+            /* %% or something unsupported, which is left as it is */
+            if (c.end == c.start + 2 && c.start[1] == '%') {
+                at = AppendLogChar(out, at, capacity, '%');
+            } else {
+                for (const wchar_t *q = c.start; q < c.end; q++) {
+                    at = AppendLogChar(out, at, capacity, *q);
+                }
+            }
+            continue;
+        }
+        if (n == arg_count)
+            break;
+
+        uint64_t v = args[n++];
+        if (c.kind == LOG_ARG_WSTRING || c.kind == LOG_ARG_STRING) {
+            for (uint64_t i = v; i < text_units && text[i]; i++) {
+                at = AppendLogChar(out, at, capacity, text[i]);
+            }
+        } else if (c.conversion == 'x') {
+            at = AppendLogNumber(out, at, capacity, v, 16, 1);
+        } else if (c.conversion == 'u') {
+            at = AppendLogNumber(out, at, capacity, v, 10, 1);
+        } else {
+            int64_t s = (c.kind == LOG_ARG_INT32) ? (int32_t)v : (int64_t)v;
+            if (s < 0) {
+                at = AppendLogChar(out, at, capacity, '-');
+            }
+            at = AppendLogNumber(out, at, capacity, (s < 0) ? 0 - (uint64_t)s : (uint64_t)s, 10, 1);
+        }
+    }
+    for (; *p; p++) {
+        at = AppendLogChar(out, at, capacity, *p);
+    }
+    out[at] = 0;
+    return at;
+}
+
+/* `thread file:line:func() message`, newline-terminated, the file name without its directory. */
+static uint32_t FormatLogLine(
+    const wchar_t *file,
+    int line,
+    const wchar_t *func,
+    const wchar_t *format,
+    uint32_t thread,
+    const uint64_t *args,
+    uint32_t arg_count,
+    const uint16_t *text,
+    uint32_t text_units,
+    wchar_t *out,
+    uint32_t at,
+    uint32_t capacity
+) {
+    const wchar_t *name = file;
+    for (const wchar_t *p = file; *p; p++) {
+        name = (*p == '\\' || *p == '/') ? p + 1 : name;
+    }
+    at = AppendLogNumber(out, at, capacity, thread, 10, 1);
+    at = AppendLogChar(out, at, capacity, ' ');
+    at = AppendLogWideString(out, at, capacity, name);
+    at = AppendLogChar(out, at, capacity, ':');
+    at = AppendLogNumber(out, at, capacity, (uint32_t)line, 10, 1);
+    at = AppendLogChar(out, at, capacity, ':');
+    at = AppendLogWideString(out, at, capacity, func);
+    at = AppendLogWideString(out, at, capacity, L"() ");
+    at = FormatLogMessage(format, args, arg_count, text, text_units, out, at, capacity);
+    at = AppendLogChar(out, at, capacity, '\n');
+    out[at] = 0;
+    return at;
+}
+
+uint32_t FormatLogRecord(const LogRecord *r, wchar_t *out, uint32_t capacity) {
+    wchar_t func[64];
+    uint32_t length = 0;
+    for (const char *p = r->site->func; *p && length < COUNTOF(func) - 1; p++) {
+        func[length++] = (uint8_t)*p;
+    }
+    func[length] = 0;
+
+    const LogSite *site = r->site;
+    return FormatLogLine(
+        site->file, site->line, func, site->format,
+        r->thread, r->args, r->arg_count, r->text, r->text_units, out, 0, capacity
+    );
+}
+
+static uint32_t WriteLogEntryText(uint8_t *out, uint32_t at, const wchar_t *s) {
+    for (;; s++) {
+        uint16_t unit = (uint16_t)*s;
+        memcpy(out + at, &unit, sizeof(unit));
+        at += sizeof(unit);
+        if (!*s)
+            return at;
+    }
+}
+
+static uint32_t GetLogWideLength(const wchar_t *s) {
+    uint32_t length = 0;
+    while (s[length]) {
+        length++;
+    }
+    return length;
+}
+
+/* The LOG_ENTRY_START entry a log file, or every run appended to one, begins with. Returns its
+size, 0 if it doesn't fit. */
+uint32_t StartLogFile(LogEncoder *e, uint64_t time_ns, uint8_t *out, uint32_t capacity) {
+    if (capacity < sizeof(LogEntry))
+        return 0;
+
+    e->site_count = 0;
+    LogEntry entry = {
+        .size = sizeof(LogEntry), .kind = LOG_ENTRY_START, .site = LOG_FILE_MAGIC, .time_ns = time_ns,
+    };
+    memcpy(out, &entry, sizeof(entry));
+    return sizeof(entry);
+}
+
+/* Writes `r` as file entries, preceded by the definition of its site the first time. Returns the
+bytes written, 0 if they don't fit in `capacity`. */
+uint32_t EncodeLogRecord(LogEncoder *e, const LogRecord *r, uint8_t *out, uint32_t capacity) {
+    const LogSite *site = r->site;
+    uint32_t index = 0, at = 0;
+    while (index < e->site_count && e->sites[index] != site) {
+        index++;
+    }
+
+    uint32_t size = sizeof(LogEntry) + r->arg_count * sizeof(uint64_t) + r->text_units * sizeof(uint16_t);
+    if (index == e->site_count && index < LOG_SITE_CAPACITY) {
+        uint32_t units = GetLogWideLength(site->file) + GetLogWideLength(site->format) + 3;
+        for (const char *p = site->func; *p; p++) {
+            units++;
+        }
+        uint32_t site_size = sizeof(LogEntry) + units * sizeof(uint16_t);
+        if (site_size + size > capacity)
+            return 0;
+
+        LogEntry entry = {
+            .size = site_size, .kind = LOG_ENTRY_SITE, .site = index, .thread = (uint32_t)site->line,
+        };
+        memcpy(out, &entry, sizeof(entry));
+        at = WriteLogEntryText(out, sizeof(entry), site->file);
+        for (const char *p = site->func; ; p++) {
+            uint16_t unit = (uint8_t)*p;
+            memcpy(out + at, &unit, sizeof(unit));
+            at += sizeof(unit);
+            if (!*p)
+                break;
+        }
+        at = WriteLogEntryText(out, at, site->format);
+        e->sites[e->site_count++] = site;
+    }
+
+    if (at + size > capacity)
+        return 0;
+
+    LogEntry entry = {
+        .size = size,
+        .kind = LOG_ENTRY_RECORD,
+        .arg_count = r->arg_count,
+        .site = index, /* LOG_SITE_CAPACITY and up once they ran out */
+        .thread = r->thread,
+        .time_ns = r->time_ns,
+    };
+    memcpy(out + at, &entry, sizeof(entry));
+    memcpy(out + at + sizeof(entry), r->args, r->arg_count * sizeof(uint64_t));
+    memcpy(out + at + sizeof(entry) + r->arg_count * sizeof(uint64_t), r->text, r->text_units * sizeof(uint16_t));
+    return at + size;
+}
+
+static bool DecodeLogString(LogDecoder *d, const uint8_t **p, const uint8_t *end, uint32_t *offset) {
+    *offset = d->strings_size;
+    for (;;) {
+        uint16_t unit;
+        if (*p + sizeof(unit) > end || d->strings_size == LOG_DECODER_CAPACITY)
+            return false;
+
+        memcpy(&unit, *p, sizeof(unit));
+        *p += sizeof(unit);
+        d->strings[d->strings_size++] = unit;
+        if (!unit)
+            return true;
+    }
+}
+
+/* Decodes the entry at the start of `data` and formats it into `out` as `[seconds] ` and the line
+tabd.exe would have written to the console, `*length` is 0 for entries that aren't a record. Returns
+the entry's size, 0 if it is malformed or truncated. */
+uint32_t DecodeLogEntry(
+    LogDecoder *d, const uint8_t *data, size_t size, wchar_t *out, uint32_t capacity, uint32_t *length
+) {
+    LogEntry entry;
+    if (size < sizeof(entry))
+        return 0;
+    memcpy(&entry, data, sizeof(entry));
+    if (entry.size < sizeof(entry) || entry.size > size)
+        return 0;
+
+    const uint8_t *p = data + sizeof(entry), *end = data + entry.size;
+    *length = 0;
+    out[0] = 0;
+    if (entry.kind == LOG_ENTRY_START) {
+        if (entry.site != LOG_FILE_MAGIC)
+            return 0;
+        d->site_count = 0;
+        d->strings_size = 0;
+        d->start_ns = entry.time_ns;
+        return entry.size;
+    }
+
+    if (entry.kind == LOG_ENTRY_SITE) {
+        if (entry.site != d->site_count || d->site_count == LOG_SITE_CAPACITY)
+            return 0;
+        uint32_t i = d->site_count;
+        d->sites[i].line = entry.thread;
+        if (
+            !DecodeLogString(d, &p, end, &d->sites[i].file)
+            || !DecodeLogString(d, &p, end, &d->sites[i].func)
+            || !DecodeLogString(d, &p, end, &d->sites[i].format)
+        ) {
+            return 0;
+        }
+        d->site_count++;
+        return entry.size;
+    }
+
+    uint64_t args[LOG_MAX_ARGS];
+    uint16_t text[LOG_TEXT_CAPACITY];
+    size_t text_size = end - p - entry.arg_count * sizeof(uint64_t);
+    if (
+        entry.kind != LOG_ENTRY_RECORD
+        || entry.arg_count > LOG_MAX_ARGS
+        || (size_t)(end - p) < entry.arg_count * sizeof(uint64_t)
+        || text_size > sizeof(text)
+    ) {
+        return 0;
+    }
+    memcpy(args, p, entry.arg_count * sizeof(uint64_t));
+    memcpy(text, p + entry.arg_count * sizeof(uint64_t), text_size);
+
+    uint64_t elapsed = (entry.time_ns > d->start_ns) ? (entry.time_ns - d->start_ns) / 1000 : 0;
+    uint32_t at = AppendLogChar(out, 0, capacity, '[');
+    at = AppendLogNumber(out, at, capacity, elapsed / 1000000, 10, 1);
+    at = AppendLogChar(out, at, capacity, '.');
+    at = AppendLogNumber(out, at, capacity, elapsed % 1000000, 10, 6);
+    at = AppendLogWideString(out, at, capacity, L"] ");
+    if (entry.site < d->site_count) {
+        const wchar_t *s = d->strings;
+        at = FormatLogLine(
+            s + d->sites[entry.site].file, (int)d->sites[entry.site].line, s + d->sites[entry.site].func,
+            s + d->sites[entry.site].format, entry.thread, args, entry.arg_count, text,
+            (uint32_t)(text_size / sizeof(uint16_t)), out, at, capacity
+        );
+    } else {
+        at = AppendLogWideString(out, at, capacity, L"(unknown call site)\n");
+        out[at] = 0;
+    }
+    *length = at;
+    return entry.size;
+}
+
+#endif /* _TABD_LOG_H */
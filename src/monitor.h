@@ -0,0 +1,77 @@
+#ifndef _TABD_MONITOR_H
+#define _TABD_MONITOR_H
+
+#include "base.h"
+
+/* The desktop a preset's area is mapped onto. Monitors are rectangles in virtual screen pixels: the
+primary one has its top-left corner at 0, 0 and the others may lie at negative coordinates. The
+virtual desktop is the bounding box of all of them, SM_XVIRTUALSCREEN and friends on Windows.
+
+A preset targets the primary monitor, the whole virtual desktop or a monitor by number, counting from
+1 left to right and then top to bottom as display settings usually do. A number that has no monitor
+(the laptop got undocked) falls back to the primary monitor.
+
+Layouts change rarely, so presets are compiled for the current one and compiled again when it
+changes, see CompilePresetForLayout() in preset.h. */
+#define MONITOR_CAPACITY 16
+#define MONITOR_PRIMARY  0
+#define MONITOR_DESKTOP  (-1)
+
+typedef struct {
+    int32_t left, top, width, height;
+} ScreenRect;
+
+typedef struct {
+    uint32_t count;
+    uint32_t primary;   /* index into monitors, the one at 0, 0 or else the first */
+    ScreenRect desktop; /* bounding box of all monitors */
+    ScreenRect monitors[MONITOR_CAPACITY]; /* in numbering order */
+} MonitorLayout;
+
+/* Adds a monitor in its place in the numbering, false if it is empty or the layout is full. */
+bool AddMonitor(MonitorLayout *layout, ScreenRect rect) {
+    if (rect.width <= 0 || rect.height <= 0 || layout->count == MONITOR_CAPACITY)
+        return false;
+
+    uint32_t i = layout->count;
+    for (; i > 0; i--) {
+        ScreenRect *m = &layout->monitors[i - 1];
+        if (m->left < rect.left || (m->left == rect.left && m->top <= rect.top))
+            break;
+        layout->monitors[i] = *m;
+    }
+    layout->monitors[i] = rect;
+
+    if (!layout->count) {
+        layout->desktop = rect;
+    } else {
+        ScreenRect *d = &layout->desktop;
+        int32_t right = d->left + d->width, bottom = d->top + d->height;
+        right = (rect.left + rect.width > right) ? rect.left + rect.width : right;
+        bottom = (rect.top + rect.height > bottom) ? rect.top + rect.height : bottom;
+        d->left = (rect.left < d->left) ? rect.left : d->left;
+        d->top = (rect.top < d->top) ? rect.top : d->top;
+        d->width = right - d->left;
+        d->height = bottom - d->top;
+    }
+    layout->count++;
+
+    layout->primary = 0;
+    for (uint32_t j = 0; j < layout->count; j++) {
+        if (!layout->monitors[j].left && !layout->monitors[j].top) {
+            layout->primary = j;
+        }
+    }
+    return true;
+}
+
+/* The rectangle `monitor` (MONITOR_PRIMARY, MONITOR_DESKTOP or a 1-based number) stands for. */
+ScreenRect GetMonitorTarget(const MonitorLayout *layout, int32_t monitor) {
+    if (monitor == MONITOR_DESKTOP)
+        return layout->desktop;
+    if (monitor >= 1 && (uint32_t)monitor <= layout->count)
+        return layout->monitors[monitor - 1];
+    return layout->monitors[layout->primary];
+}
+
+#endif /* _TABD_MONITOR_H */
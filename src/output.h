@@ -0,0 +1,172 @@
+#ifndef _TABD_OUTPUT_H
+#define _TABD_OUTPUT_H
+
+#include "base.h"
+#include "tablet.h"
+#include "preset.h"
+
+/* What should be emitted for a single report. Sinks (SynthesizeInput() on Windows, tabd-bench) only
+translate an OutputFrame into their own calls, all of the decision making happens here. */
+#define OUTPUT_PEN        0x0001 /* inject a synthetic pen frame */
+#define OUTPUT_MOUSE      0x0002 /* send a mouse event */
+#define OUTPUT_MOUSE_MOVE 0x0004 /* mouse event carries an absolute move */
+#define OUTPUT_LEFT_DOWN  0x0010
+#define OUTPUT_LEFT_UP    0x0020
+#define OUTPUT_RIGHT_DOWN 0x0040
+#define OUTPUT_RIGHT_UP   0x0080
+
+#define OUTPUT_TRANSITIONS (OUTPUT_LEFT_DOWN | OUTPUT_LEFT_UP | OUTPUT_RIGHT_DOWN | OUTPUT_RIGHT_UP)
+
+typedef struct {
+    IVec2 absolute;    /* MOUSEINPUT absolute units, 0..65535 */
+    IVec2 pixel;       /* screen pixels */
+    uint32_t pressure; /* 0..1024 */
+    uint32_t flags;    /* OUTPUT_* */
+    bool pointer_down;
+} OutputFrame;
+
+OutputFrame DecideOutput(
+    const CompiledPreset *preset,
+    uint32_t previous_flags,
+    uint32_t flags,
+    uint32_t pressure,
+    IVec2 absolute,
+    IVec2 pixel
+) {
+    bool b1_down = flags & TABLET_REPORT_BUTTON_DOWN(0);
+    bool was_b1_down = previous_flags & TABLET_REPORT_BUTTON_DOWN(0);
+    bool b2_down = flags & TABLET_REPORT_BUTTON_DOWN(1);
+    bool pointer_down = flags & TABLET_REPORT_POINTER_DOWN;
+    bool was_pointer_down = previous_flags & TABLET_REPORT_POINTER_DOWN;
+
+    OutputFrame frame = {
+        .absolute = absolute,
+        .pixel = pixel,
+        .pressure = ScalePressure(preset, pressure),
+        .pointer_down = pointer_down,
+    };
+
+    if      (pointer_down && !was_pointer_down) frame.flags |= OUTPUT_LEFT_DOWN;
+    else if (!pointer_down && was_pointer_down) frame.flags |= OUTPUT_LEFT_UP;
+
+    if      (b1_down && !was_b1_down) frame.flags |= OUTPUT_RIGHT_DOWN;
+    else if (!b1_down && was_b1_down) frame.flags |= OUTPUT_RIGHT_UP;
+
+    /* the second barrel button temporarily switches mouse presets to pen input */
+    if (preset->mode == MODE_INK || b2_down) {
+        frame.flags |= OUTPUT_PEN;
+        if (b1_down != was_b1_down) {
+            frame.flags |= OUTPUT_MOUSE;
+        }
+    } else {
+        frame.flags |= OUTPUT_MOUSE | OUTPUT_MOUSE_MOVE;
+    }
+
+    return frame;
+}
+
+OutputFrame ComputeOutputFrame(
+    const CompiledPreset *preset,
+    const TabletReport *previous,
+    const TabletReport *report
+) {
+    return DecideOutput(
+        preset,
+        previous->flags,
+        report->flags,
+        report->pressure,
+        TransformPointFixed(preset->kind, &preset->absolute_q16, report->x, report->y),
+        TransformPointFixed(preset->kind, &preset->pixel_q16, report->x, report->y)
+    );
+}
+
+/* Delta suppression: a resting pen keeps sending reports that map to the same pixel with the same
+pressure, and every one of them would cost an injection call that changes nothing. A frame is a repeat
+when it has no button transition and outputs the same kind of input at the same position (pixels for
+the pen, absolute units for the mouse) with the same tip state as the last frame emitted, and for
+the pen the same pressure, which mouse input doesn't carry. Repeats are skipped, though never for longer than the keep-alive interval so whatever is
+listening still hears from the pointer now and then. */
+#define OUTPUT_KEEP_ALIVE_MS 100 /* default */
+
+typedef struct {
+    uint64_t keep_alive_ns; /* 0 emits every frame */
+    bool has_last;
+    OutputFrame last;
+    uint64_t last_ns;
+    uint64_t suppressed;    /* frames skipped */
+    uint64_t calls_saved;   /* injection calls they would have taken */
+} OutputSuppressor;
+
+/* SendInput() and InjectSyntheticPointerInput() calls SynthesizeInput() makes for a frame. */
+uint32_t CountOutputCalls(const OutputFrame *frame) {
+    return ((frame->flags & OUTPUT_PEN) != 0) + ((frame->flags & OUTPUT_MOUSE) != 0);
+}
+
+bool IsOutputRepeat(const OutputFrame *last, const OutputFrame *frame) {
+    uint32_t kind = OUTPUT_PEN | OUTPUT_MOUSE | OUTPUT_MOUSE_MOVE;
+    IVec2 a = (frame->flags & OUTPUT_PEN) ? last->pixel : last->absolute;
+    IVec2 b = (frame->flags & OUTPUT_PEN) ? frame->pixel : frame->absolute;
+    return !(frame->flags & OUTPUT_TRANSITIONS)
+        && (frame->flags & kind) == (last->flags & kind)
+        && a.x == b.x
+        && a.y == b.y
+        && (!(frame->flags & OUTPUT_PEN) || frame->pressure == last->pressure)
+        && frame->pointer_down == last->pointer_down;
+}
+
+/* Whether `frame`, due at `time_ns`, has to be emitted. */
+bool ShouldEmitFrame(OutputSuppressor *s, const OutputFrame *frame, uint64_t time_ns) {
+    if (!(frame->flags & (OUTPUT_PEN | OUTPUT_MOUSE)))
+        return false;
+
+    /* a timestamp older than the last one makes the frame due as well */
+    bool repeat =
+        s->keep_alive_ns
+        && s->has_last
+        && IsOutputRepeat(&s->last, frame)
+        && time_ns - s->last_ns < s->keep_alive_ns;
+    if (repeat) {
+        s->suppressed++;
+        s->calls_saved += CountOutputCalls(frame);
+        return false;
+    }
+
+    s->has_last = true;
+    s->last = *frame;
+    s->last_ns = time_ns;
+    return true;
+}
+
+/* Batched injection: the frames pending at once (a read returned several reports, or they piled up
+while the last batch was being injected) are injected in as few calls as the platform takes, in order.
+SendInput() takes any number of mouse events, so a run of mouse frames is a single call.
+InjectSyntheticPointerInput() takes a single pen contact per call and fills in pointer history itself,
+so every pen frame stays a call of its own, stamped with its report's time so the history apps read
+keeps the reports' spacing however close together they were injected. */
+typedef struct {
+    uint32_t kind;  /* OUTPUT_PEN or OUTPUT_MOUSE */
+    uint32_t first; /* index of the first frame */
+    uint32_t count; /* always 1 for OUTPUT_PEN */
+} OutputCall;
+
+/* The calls for `count` frames, at most 2 * count of them. A frame's pen call comes before its mouse
+event, as when frames are injected one by one. */
+uint32_t PlanOutputCalls(const OutputFrame *frames, uint32_t count, OutputCall *calls) {
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        if (frames[i].flags & OUTPUT_PEN) {
+            calls[n++] = (OutputCall){ OUTPUT_PEN, i, 1 };
+        }
+        if (!(frames[i].flags & OUTPUT_MOUSE))
+            continue;
+        OutputCall *last = (n) ? &calls[n - 1] : 0;
+        if (last && last->kind == OUTPUT_MOUSE && last->first + last->count == i) {
+            last->count++;
+        } else {
+            calls[n++] = (OutputCall){ OUTPUT_MOUSE, i, 1 };
+        }
+    }
+    return n;
+}
+
+#endif /* _TABD_OUTPUT_H */
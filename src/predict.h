@@ -0,0 +1,142 @@
+#ifndef _TABD_PREDICT_H
+#define _TABD_PREDICT_H
+
+#include "base.h"
+#include "filter.h"
+
+/* Extrapolates where the pen will be `horizon_ms` after a report and outputs that instead, trading
+some overshoot when the pen stops or turns for that much less perceived latency. Runs on raw
+coordinates after the preset's filter.
+
+PREDICT_LINEAR extrapolates the velocity between the last two reports, PREDICT_QUADRATIC adds their
+change in velocity. Both amplify sensor noise by roughly the horizon over the report interval.
+PREDICT_KALMAN tracks position and velocity with a constant-velocity Kalman filter instead, the
+velocity it extrapolates is smoothed by how well the model has been predicting so far. Both axes go
+through the same model with the same timing and share one covariance matrix.
+
+Reports of a single read and gaps longer than FILTER_RESET_NS are handled as in filter.h. */
+#define PREDICT_ACCELERATION_SD  1000.0f /* mm/s², Kalman process noise */
+#define PREDICT_MEASUREMENT_SD   0.02f   /* mm, Kalman sensor noise */
+#define PREDICT_INITIAL_SPEED_SD 500.0f  /* mm/s, uncertainty of the first velocity estimate */
+
+typedef enum {
+    PREDICT_NONE,
+    PREDICT_LINEAR,
+    PREDICT_QUADRATIC,
+    PREDICT_KALMAN,
+} PredictorKind;
+
+typedef struct {
+    PredictorKind kind;
+    float horizon_ms;
+} PredictorSettings;
+
+/* Noise terms as variances in raw units. */
+typedef struct {
+    PredictorKind kind;
+    float horizon; /* s */
+    float acceleration_var;
+    float measurement_var;
+    float initial_velocity_var;
+} CompiledPredictor;
+
+typedef struct {
+    bool primed;
+    uint32_t samples;
+    uint64_t time_ns;
+    float interval; /* s */
+    float x, y;     /* last report, or the Kalman estimate */
+    float vx, vy;   /* raw units/s */
+    float ax, ay;   /* raw units/s², quadratic only */
+    float p00, p01, p11; /* Kalman covariance of position and velocity */
+} PredictorState;
+
+CompiledPredictor CompilePredictor(const PredictorSettings *settings, float units_per_mm) {
+    float a = PREDICT_ACCELERATION_SD * units_per_mm;
+    float m = PREDICT_MEASUREMENT_SD * units_per_mm;
+    float v = PREDICT_INITIAL_SPEED_SD * units_per_mm;
+    return (CompiledPredictor){
+        .kind = (units_per_mm > 0) ? settings->kind : PREDICT_NONE,
+        .horizon = settings->horizon_ms / 1000,
+        .acceleration_var = a * a,
+        .measurement_var = m * m,
+        .initial_velocity_var = v * v,
+    };
+}
+
+static void StepKalman(const CompiledPredictor *predictor, PredictorState *state, float dt, float x, float y) {
+    /* predict with constant velocity, white noise acceleration */
+    float q = predictor->acceleration_var, dt2 = dt * dt;
+    state->x += state->vx * dt;
+    state->y += state->vy * dt;
+    state->p00 += dt * (2 * state->p01 + dt * state->p11) + q * dt2 * dt2 / 4;
+    state->p01 += dt * state->p11 + q * dt2 * dt / 2;
+    state->p11 += q * dt2;
+
+    /* update with the measured position */
+    float s = state->p00 + predictor->measurement_var;
+    float k0 = state->p00 / s, k1 = state->p01 / s;
+    float ex = x - state->x, ey = y - state->y;
+    state->x += k0 * ex;
+    state->y += k0 * ey;
+    state->vx += k1 * ex;
+    state->vy += k1 * ey;
+    state->p11 -= k1 * state->p01;
+    state->p00 *= 1 - k0;
+    state->p01 *= 1 - k0;
+}
+
+/* Replaces the report's position with the predicted one. */
+void PredictPoint(
+    const CompiledPredictor *predictor, PredictorState *state, uint64_t time_ns, int32_t *x, int32_t *y
+) {
+    if (!state->primed || time_ns - state->time_ns > FILTER_RESET_NS) {
+        *state = (PredictorState){
+            .primed = true,
+            .samples = 1,
+            .time_ns = time_ns,
+            .interval = FILTER_DEFAULT_INTERVAL,
+            .x = (float)*x,
+            .y = (float)*y,
+            .p00 = predictor->measurement_var,
+            .p11 = predictor->initial_velocity_var,
+        };
+        return;
+    }
+
+    float dt = state->interval;
+    if (time_ns != state->time_ns) {
+        dt = (time_ns - state->time_ns) / 1e9f;
+        state->interval = dt;
+        state->time_ns = time_ns;
+    }
+
+    float h = predictor->horizon;
+    if (predictor->kind == PREDICT_KALMAN) {
+        StepKalman(predictor, state, dt, (float)*x, (float)*y);
+        *x = RoundToInt32(state->x + state->vx * h);
+        *y = RoundToInt32(state->y + state->vy * h);
+        return;
+    }
+
+    float vx = (*x - state->x) / dt, vy = (*y - state->y) / dt;
+    if (state->samples >= 2) {
+        state->ax = (vx - state->vx) / dt;
+        state->ay = (vy - state->vy) / dt;
+    }
+    state->samples += state->samples < 3;
+    state->x = (float)*x;
+    state->y = (float)*y;
+    state->vx = vx;
+    state->vy = vy;
+
+    float px = state->x + vx * h, py = state->y + vy * h;
+    if (predictor->kind == PREDICT_QUADRATIC && state->samples >= 3) {
+        px += state->ax * h * h / 2;
+        py += state->ay * h * h / 2;
+    }
+    *x = RoundToInt32(px);
+    *y = RoundToInt32(py);
+}
+
+#endif /* _TABD_PREDICT_H */
@@ -1,8 +1,12 @@
 #ifndef _TABD_PRESET_H
 #define _TABD_PRESET_H
 
-#include "util.h"
+#include "base.h"
 #include "tablet.h"
+#include "filter.h"
+#include "predict.h"
+#include "pressure.h"
+#include "monitor.h"
 
 typedef struct {
     Vec2 center;
@@ -16,15 +20,19 @@ typedef enum {
 } OutputMode;
 
 typedef struct {
-    PCWSTR name;
+    const wchar_t *name;
     ActiveArea area;
     OutputMode mode;
     float pressure_sensitivity;
+    FilterSettings filter;     /* see filter.h */
+    PredictorSettings predict; /* see predict.h */
+    PressureCurve pressure;    /* see pressure.h */
+    int32_t monitor;           /* MONITOR_PRIMARY, MONITOR_DESKTOP or a number, see monitor.h */
 } Preset;
 
 const Preset g_presets[] = {
-    { L"Drawing", { {108, 67.5},      {216, 135},       0 }, MODE_INK,   1.15 },
-    { L"Osu",     { {80.41049, 85.5}, {99, 55.66032}, -90 }, MODE_MOUSE, 0    },
+    { L"Drawing", { {108, 67.5},      {216, 135},       0 }, MODE_INK,   1.15, { FILTER_NONE },                  { PREDICT_NONE }, { PRESSURE_LINEAR }, MONITOR_PRIMARY },
+    { L"Osu",     { {80.41049, 85.5}, {99, 55.66032}, -90 }, MODE_MOUSE, 0,    { FILTER_ONE_EURO, 1, 0.3f, 3 }, { PREDICT_NONE }, { PRESSURE_LINEAR }, MONITOR_PRIMARY },
 };
 
 /* Illustrations are available in docs/preset-transforms.excalidraw */
@@ -59,4 +67,158 @@ Vec2 MapTabletPointToScreen(const Preset *preset, const TabletInfo *tablet, Vec2
     return p;
 }
 
+/* MapTabletPointToScreen() above is the reference implementation. Since preset, tablet and screen
+only change on preset activation, all of its steps (including normalization of raw sensor units) are
+folded into 2x3 matrices once instead:
+
+    n.x = ( cos*T.x*x/X - sin*T.y*y/Y - cos*C.x + sin*C.y) / S.x + 0.5
+    n.y = ( sin*T.x*x/X + cos*T.y*y/Y - sin*C.x - cos*C.y) / S.y + 0.5
+
+where x, y are raw sensor units, X and Y their logical maximums, T is tablet measurements, C and S
+are area center and size and the angle is the inverted area rotation. Multiples of 90° get exact
+sin/cos and skip the zero terms of the matrix.
+
+The packet path uses the Q16 fixed-point copy of the matrices. Every coefficient is rounded to the
+nearest 1/65536 so the result is off by at most (X + Y + 1) / 2^17 before flooring, about 0.27 units
+for a CTL-672. For on-screen points the integer output thus never differs from truncating the float
+path by more than 1 unit and only does so when the exact value lies that close to an integer. */
+typedef enum {
+    TRANSFORM_GENERAL,
+    TRANSFORM_AXIS_ALIGNED, /* 0° or 180°, x only depends on x */
+    TRANSFORM_AXIS_SWAPPED, /* 90° or 270°, x only depends on y */
+} TransformKind;
+
+typedef struct {
+    float m[2][3];
+} Affine;
+
+typedef struct {
+    int64_t m[2][3]; /* Q16 */
+} FixedAffine;
+
+typedef struct {
+    OutputMode mode;
+    TransformKind kind;
+    Affine absolute;         /* raw sensor units to MOUSEEVENTF_VIRTUALDESK units (0..65535) */
+    Affine pixel;            /* raw sensor units to virtual screen pixels */
+    FixedAffine absolute_q16;
+    FixedAffine pixel_q16;
+    CompiledFilter filter;
+    CompiledPredictor predictor;
+    PressureTable pressure;  /* raw pressure to 0..1024 */
+} CompiledPreset;
+
+static int64_t ToQ16(double v) {
+    return (int64_t)(v * 65536 + ((v < 0) ? -0.5 : 0.5));
+}
+
+/* The area lands on `target`, a rectangle of the virtual `desktop`. Absolute units span the desktop,
+so the mouse and the pen end up on the same pixel. */
+CompiledPreset CompilePresetOnto(
+    const Preset *preset, const TabletInfo *tablet, ScreenRect target, ScreenRect desktop
+) {
+    float units_per_mm = (tablet->measurements.x > 0) ? tablet->max_x / tablet->measurements.x : 0;
+    CompiledPreset c = {
+        .mode = preset->mode,
+        .kind = TRANSFORM_GENERAL,
+        .filter = CompileFilter(&preset->filter, units_per_mm),
+        .predictor = CompilePredictor(&preset->predict, units_per_mm),
+    };
+
+    CompilePressureTable(
+        &preset->pressure, preset->pressure_sensitivity, tablet->max_pressure, &c.pressure
+    );
+
+    double cos_a, sin_a;
+    double quarters = preset->area.rotation / 90.0;
+    if (quarters == (int)quarters) {
+        static const int s_cos[] = { 1, 0, -1, 0 };
+        int q = ((int)quarters % 4 + 4) % 4;
+        cos_a = s_cos[q];
+        sin_a = -s_cos[(q + 3) % 4];
+        c.kind = (q % 2) ? TRANSFORM_AXIS_SWAPPED : TRANSFORM_AXIS_ALIGNED;
+    } else {
+        double a = -preset->area.rotation / 180.0 * 3.14159265358979;
+        cos_a = cos(a);
+        sin_a = sin(a);
+    }
+
+    double tx = tablet->measurements.x / tablet->max_x, ty = tablet->measurements.y / tablet->max_y;
+    double cx = preset->area.center.x, cy = preset->area.center.y;
+    double sx = preset->area.size.x, sy = preset->area.size.y;
+    double n[2][3] = {
+        { cos_a * tx / sx, -sin_a * ty / sx, (-cos_a * cx + sin_a * cy) / sx + 0.5 },
+        { sin_a * tx / sy,  cos_a * ty / sy, (-sin_a * cx - cos_a * cy) / sy + 0.5 },
+    };
+
+    /* n spans the target, which is offset into the desktop; with a single monitor both are 0, 0 */
+    double pixel_scale[2] = { target.width, target.height };
+    double pixel_offset[2] = { target.left, target.top };
+    double absolute_scale[2] = {
+        65535.0 * target.width / desktop.width, 65535.0 * target.height / desktop.height,
+    };
+    double absolute_offset[2] = {
+        65535.0 * (target.left - desktop.left) / desktop.width,
+        65535.0 * (target.top - desktop.top) / desktop.height,
+    };
+    for (int r = 0; r < 2; r++) {
+        for (int i = 0; i < 3; i++) {
+            double absolute = n[r][i] * absolute_scale[r] + ((i == 2) ? absolute_offset[r] : 0);
+            double pixel = n[r][i] * pixel_scale[r] + ((i == 2) ? pixel_offset[r] : 0);
+            c.absolute.m[r][i] = absolute;
+            c.pixel.m[r][i] = pixel;
+            c.absolute_q16.m[r][i] = ToQ16(absolute);
+            c.pixel_q16.m[r][i] = ToQ16(pixel);
+        }
+    }
+    return c;
+}
+
+/* A desktop of a single `screen_width` x `screen_height` monitor. */
+CompiledPreset CompilePreset(
+    const Preset *preset, const TabletInfo *tablet, int32_t screen_width, int32_t screen_height
+) {
+    ScreenRect screen = { 0, 0, screen_width, screen_height };
+    return CompilePresetOnto(preset, tablet, screen, screen);
+}
+
+/* Onto the monitor the preset targets, compiled again whenever the layout changes. */
+CompiledPreset CompilePresetForLayout(
+    const Preset *preset, const TabletInfo *tablet, const MonitorLayout *layout
+) {
+    return CompilePresetOnto(preset, tablet, GetMonitorTarget(layout, preset->monitor), layout->desktop);
+}
+
+Vec2 TransformPoint(TransformKind kind, const Affine *t, Vec2 p) {
+    switch (kind) {
+    case TRANSFORM_AXIS_ALIGNED:
+        return (Vec2){ t->m[0][0]*p.x + t->m[0][2], t->m[1][1]*p.y + t->m[1][2] };
+    case TRANSFORM_AXIS_SWAPPED:
+        return (Vec2){ t->m[0][1]*p.y + t->m[0][2], t->m[1][0]*p.x + t->m[1][2] };
+    default:
+        return (Vec2){
+            t->m[0][0]*p.x + t->m[0][1]*p.y + t->m[0][2],
+            t->m[1][0]*p.x + t->m[1][1]*p.y + t->m[1][2],
+        };
+    }
+}
+
+IVec2 TransformPointFixed(TransformKind kind, const FixedAffine *t, int32_t x, int32_t y) {
+    switch (kind) {
+    case TRANSFORM_AXIS_ALIGNED:
+        return (IVec2){ (t->m[0][0]*x + t->m[0][2]) >> 16, (t->m[1][1]*y + t->m[1][2]) >> 16 };
+    case TRANSFORM_AXIS_SWAPPED:
+        return (IVec2){ (t->m[0][1]*y + t->m[0][2]) >> 16, (t->m[1][0]*x + t->m[1][2]) >> 16 };
+    default:
+        return (IVec2){
+            (t->m[0][0]*x + t->m[0][1]*y + t->m[0][2]) >> 16,
+            (t->m[1][0]*x + t->m[1][1]*y + t->m[1][2]) >> 16,
+        };
+    }
+}
+
+uint32_t ScalePressure(const CompiledPreset *preset, uint32_t raw) {
+    return LookUpPressure(&preset->pressure, raw);
+}
+
 #endif /* _TABD_PRESET_H */
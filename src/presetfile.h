@@ -0,0 +1,213 @@
+#ifndef _TABD_PRESETFILE_H
+#define _TABD_PRESETFILE_H
+
+#include "base.h"
+#include "preset.h"
+
+/* Presets loaded from files at runtime, one preset per file named after it (`Drawing.txt`), see
+docs/Preset and Settings file formats.md. Every line is a key and a value, keys are bound to Preset
+fields by offset and missing ones keep the value the caller initialized the preset with:
+
+    center-x 108
+    center-y 67.5
+    width    216
+    height   135
+    rotation 0
+    mode     ink
+    monitor  primary
+
+`monitor` is `primary`, `desktop` or a monitor's number. Lines starting with `#` are comments. An
+unknown key or a value that doesn't parse rejects the whole file so a half-saved preset never gets
+activated. */
+#define PRESET_CAPACITY      32
+#define PRESET_NAME_CAPACITY 64
+#define PRESET_FILE_MAX_SIZE 4096
+
+typedef enum {
+    PRESET_VALUE_FLOAT,
+    PRESET_VALUE_ENUM,
+    PRESET_VALUE_MONITOR, /* int32_t, one of the names or 1..MONITOR_CAPACITY */
+} PresetValueKind;
+
+typedef struct {
+    const char *key;
+    PresetValueKind kind;
+    size_t offset;
+    const char *const *names; /* PRESET_VALUE_ENUM, index is the value */
+} PresetKey;
+
+static const char *const s_preset_modes[] = { "mouse", "ink", 0 };
+static const char *const s_preset_filters[] = { "none", "ema", "one-euro", 0 };
+static const char *const s_preset_predictors[] = { "none", "linear", "quadratic", "kalman", 0 };
+static const char *const s_preset_curves[] = { "linear", "gamma", "bezier", 0 };
+static const char *const s_preset_monitors[] = { "primary", "desktop", 0 };
+static const int32_t s_preset_monitor_values[] = { MONITOR_PRIMARY, MONITOR_DESKTOP };
+
+static const PresetKey s_preset_keys[] = {
+    { "center-x",                 PRESET_VALUE_FLOAT, offsetof(Preset, area.center.x), 0 },
+    { "center-y",                 PRESET_VALUE_FLOAT, offsetof(Preset, area.center.y), 0 },
+    { "width",                    PRESET_VALUE_FLOAT, offsetof(Preset, area.size.x), 0 },
+    { "height",                   PRESET_VALUE_FLOAT, offsetof(Preset, area.size.y), 0 },
+    { "rotation",                 PRESET_VALUE_FLOAT, offsetof(Preset, area.rotation), 0 },
+    { "mode",                     PRESET_VALUE_ENUM,  offsetof(Preset, mode), s_preset_modes },
+    { "pressure-sensitivity",     PRESET_VALUE_FLOAT, offsetof(Preset, pressure_sensitivity), 0 },
+    { "filter",                   PRESET_VALUE_ENUM,  offsetof(Preset, filter.kind), s_preset_filters },
+    { "filter-min-cutoff",        PRESET_VALUE_FLOAT, offsetof(Preset, filter.min_cutoff), 0 },
+    { "filter-beta",              PRESET_VALUE_FLOAT, offsetof(Preset, filter.beta), 0 },
+    { "filter-derivative-cutoff", PRESET_VALUE_FLOAT, offsetof(Preset, filter.derivative_cutoff), 0 },
+    { "predict",                  PRESET_VALUE_ENUM,  offsetof(Preset, predict.kind), s_preset_predictors },
+    { "predict-horizon",          PRESET_VALUE_FLOAT, offsetof(Preset, predict.horizon_ms), 0 },
+    { "pressure-curve",           PRESET_VALUE_ENUM,  offsetof(Preset, pressure.kind), s_preset_curves },
+    { "pressure-gamma",           PRESET_VALUE_FLOAT, offsetof(Preset, pressure.gamma), 0 },
+    { "pressure-p1-x",            PRESET_VALUE_FLOAT, offsetof(Preset, pressure.p1.x), 0 },
+    { "pressure-p1-y",            PRESET_VALUE_FLOAT, offsetof(Preset, pressure.p1.y), 0 },
+    { "pressure-p2-x",            PRESET_VALUE_FLOAT, offsetof(Preset, pressure.p2.x), 0 },
+    { "pressure-p2-y",            PRESET_VALUE_FLOAT, offsetof(Preset, pressure.p2.y), 0 },
+    { "pressure-min",             PRESET_VALUE_FLOAT, offsetof(Preset, pressure.min), 0 },
+    { "pressure-max",             PRESET_VALUE_FLOAT, offsetof(Preset, pressure.max), 0 },
+    { "monitor",                  PRESET_VALUE_MONITOR, offsetof(Preset, monitor), s_preset_monitors },
+};
+
+static bool IsPresetSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+static bool IsPresetTokenEqual(const char *token, size_t length, const char *s) {
+    for (size_t i = 0; i < length; i++) {
+        if (token[i] != s[i])
+            return false;
+    }
+    return !s[length];
+}
+
+static bool ParsePresetFloat(const char *p, const char *end, float *value) {
+    bool negative = p < end && *p == '-';
+    p += negative || (p < end && *p == '+');
+
+    double v = 0, scale = 1;
+    const char *digits = p;
+    for (; p < end && *p >= '0' && *p <= '9'; p++) {
+        v = v * 10 + (*p - '0');
+    }
+    if (p < end && *p == '.') {
+        for (p++; p < end && *p >= '0' && *p <= '9'; p++) {
+            v = v * 10 + (*p - '0');
+            scale *= 10;
+        }
+    }
+    if (p != end || p == digits || (p == digits + 1 && *digits == '.'))
+        return false;
+
+    *value = (float)((negative) ? -v / scale : v / scale);
+    return true;
+}
+
+static bool ParsePresetLine(const char *key, size_t key_length, const char *value, const char *end, Preset *preset) {
+    for (unsigned int i = 0; i < COUNTOF(s_preset_keys); i++) {
+        const PresetKey *k = &s_preset_keys[i];
+        if (!IsPresetTokenEqual(key, key_length, k->key))
+            continue;
+
+        uint8_t *field = (uint8_t*)preset + k->offset;
+        if (k->kind == PRESET_VALUE_FLOAT)
+            return ParsePresetFloat(value, end, (float*)field);
+
+        for (int n = 0; k->names[n]; n++) {
+            if (IsPresetTokenEqual(value, end - value, k->names[n])) {
+                if (k->kind == PRESET_VALUE_MONITOR) {
+                    *(int32_t*)field = s_preset_monitor_values[n];
+                } else {
+                    *(int*)field = n;
+                }
+                return true;
+            }
+        }
+
+        float number;
+        if (k->kind != PRESET_VALUE_MONITOR || !ParsePresetFloat(value, end, &number))
+            return false;
+        if (number < 1 || number > MONITOR_CAPACITY || number != (int32_t)number)
+            return false;
+        *(int32_t*)field = (int32_t)number;
+        return true;
+    }
+    return false;
+}
+
+/* Parses a preset file over `preset`, which holds the defaults. On failure `*error_line` is the
+1-based line at fault and `preset` may have been partially overwritten. */
+bool ParsePresetFile(const char *text, size_t size, Preset *preset, uint32_t *error_line) {
+    const char *p = text, *end = text + size;
+    for (uint32_t line = 1; p < end; line++) {
+        const char *line_end = p;
+        while (line_end < end && *line_end != '\n') {
+            line_end++;
+        }
+
+        while (p < line_end && IsPresetSpace(*p)) {
+            p++;
+        }
+        if (p < line_end && *p != '#') {
+            const char *key = p;
+            while (p < line_end && !IsPresetSpace(*p)) {
+                p++;
+            }
+            size_t key_length = p - key;
+            while (p < line_end && IsPresetSpace(*p)) {
+                p++;
+            }
+            const char *value_end = line_end;
+            while (value_end > p && IsPresetSpace(value_end[-1])) {
+                value_end--;
+            }
+            if (p == value_end || !ParsePresetLine(key, key_length, p, value_end, preset)) {
+                *error_line = line;
+                return false;
+            }
+        }
+        p = line_end + (line_end < end);
+    }
+    return true;
+}
+
+/* A compiled preset shared between the thread that (re)compiles it and the output thread, as a
+sequence lock. The writer never waits: it makes the sequence odd, copies and makes it even again.
+The reader never waits either. It keeps two copies of its own and only copies into the spare one when
+the sequence moved; if that overlapped a write it keeps using the current copy and tries again on the
+next batch. The packet path thus costs one load per batch and a reload one extra copy. */
+typedef struct {
+    volatile uint32_t sequence; /* odd while a write is in progress, 0 until the first one */
+    CompiledPreset preset;
+} PresetSlot;
+
+typedef struct {
+    uint32_t sequence; /* of the slot the current copy came from, 0 to pick up any */
+    uint32_t current;
+    CompiledPreset copies[2];
+} PresetReader;
+
+void PublishPreset(PresetSlot *slot, const CompiledPreset *preset) {
+    uint32_t sequence = slot->sequence;
+    AtomicStore32(&slot->sequence, sequence + 1);
+    AtomicFence();
+    slot->preset = *preset;
+    AtomicStore32(&slot->sequence, sequence + 2);
+}
+
+/* The reader's current copy, refreshed first if `slot` changed since it was taken. Set
+`reader->sequence` to 0 when switching to another slot. */
+const CompiledPreset *ReadPreset(const PresetSlot *slot, PresetReader *reader) {
+    uint32_t before = AtomicLoad32(&slot->sequence);
+    if (before != reader->sequence && before && !(before & 1)) {
+        CompiledPreset *spare = &reader->copies[reader->current ^ 1];
+        *spare = slot->preset;
+        AtomicFence();
+        if (AtomicLoad32(&slot->sequence) == before) {
+            reader->sequence = before;
+            reader->current ^= 1;
+        }
+    }
+    return &reader->copies[reader->current];
+}
+
+#endif /* _TABD_PRESETFILE_H */
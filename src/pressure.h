@@ -0,0 +1,99 @@
+#ifndef _TABD_PRESSURE_H
+#define _TABD_PRESSURE_H
+
+#include "base.h"
+
+/* Pressure curves, on raw pressure normalized to 0..1 by the tablet's logical maximum:
+
+    u = (raw / max_pressure - min) / (max - min), clamped to 0..1
+    pressure = CLAMP(curve(u) * sensitivity, 0, 1) * 1024
+
+PRESSURE_LINEAR is curve(u) = u, PRESSURE_GAMMA is u^gamma (above 1 softer, below 1 firmer) and
+PRESSURE_BEZIER the cubic Bézier from (0, 0) to (1, 1) with control points p1 and p2 like drawing
+apps have. `min` keeps a resting or worn nib from registering, `max` reaches full pressure before
+the sensor does, 0 stands for 1. There is at least a raw step between them: `min` stops a step
+short of the logical maximum and `max` is moved up to a step above `min`, so `min` equal to `max`
+is a switch from 0 to full pressure there.
+
+The curve is evaluated for every raw value once when the preset is compiled, per report it is a
+single table load. Sensors with more than PRESSURE_LUT_SIZE levels index the table with their top
+bits, which still leaves two raw steps per output level. */
+#define PRESSURE_LUT_SIZE 2048 /* 11 bits */
+
+typedef enum {
+    PRESSURE_LINEAR,
+    PRESSURE_GAMMA,
+    PRESSURE_BEZIER,
+} PressureCurveKind;
+
+typedef struct {
+    PressureCurveKind kind;
+    float gamma;    /* PRESSURE_GAMMA */
+    Vec2 p1, p2;    /* PRESSURE_BEZIER, x within 0..1 */
+    float min, max; /* activation thresholds, fractions of the logical maximum */
+} PressureCurve;
+
+typedef struct {
+    uint32_t shift; /* raw pressure to table index */
+    uint16_t table[PRESSURE_LUT_SIZE];
+} PressureTable;
+
+static double CubicBezier(double a, double b, double t) {
+    double s = 1 - t;
+    return 3 * s * s * t * a + 3 * s * t * t * b + t * t * t;
+}
+
+/* Bisection on x(t), monotonic while both control points are within 0..1. */
+static double EvaluateBezier(Vec2 p1, Vec2 p2, double u) {
+    double x1 = CLAMP(p1.x, 0, 1), x2 = CLAMP(p2.x, 0, 1);
+    double lo = 0, hi = 1;
+    for (int i = 0; i < 32; i++) {
+        double t = (lo + hi) / 2;
+        if (CubicBezier(x1, x2, t) < u) {
+            lo = t;
+        } else {
+            hi = t;
+        }
+    }
+    return CubicBezier(p1.y, p2.y, (lo + hi) / 2);
+}
+
+double EvaluatePressureCurve(const PressureCurve *curve, double u) {
+    switch (curve->kind) {
+    case PRESSURE_GAMMA:
+        return (curve->gamma > 0) ? pow(u, curve->gamma) : u;
+    case PRESSURE_BEZIER:
+        return EvaluateBezier(curve->p1, curve->p2, u);
+    default:
+        return u;
+    }
+}
+
+void CompilePressureTable(
+    const PressureCurve *curve, float sensitivity, int32_t max_pressure, PressureTable *table
+) {
+    table->shift = 0;
+    while (max_pressure > 0 && (max_pressure >> table->shift) >= PRESSURE_LUT_SIZE) {
+        table->shift++;
+    }
+
+    double step = (max_pressure > 0) ? 1.0 / max_pressure : 1;
+    double min = CLAMP(curve->min, 0, 1 - step);
+    double max = (curve->max > 0 && curve->max < 1) ? curve->max : 1;
+    max = CLAMP(max, min + step, 1);
+    double gain = CLAMP(sensitivity, 0, 64);
+    for (uint32_t i = 0; i < PRESSURE_LUT_SIZE; i++) {
+        /* the middle of the raw values sharing the entry */
+        double raw = (i << table->shift) + ((1u << table->shift) - 1) / 2.0;
+        double u = (max_pressure > 0) ? (raw / max_pressure - min) / (max - min) : 0;
+        double p = EvaluatePressureCurve(curve, CLAMP(u, 0, 1)) * gain;
+        table->table[i] = (uint16_t)(CLAMP(p, 0, 1) * 1024);
+    }
+}
+
+uint32_t LookUpPressure(const PressureTable *table, uint32_t raw) {
+    uint32_t i = raw >> table->shift;
+    return table->table[(i < PRESSURE_LUT_SIZE) ? i : PRESSURE_LUT_SIZE - 1];
+}
+
+#endif /* _TABD_PRESSURE_H */
@@ -0,0 +1,71 @@
+#ifndef _TABD_READQUEUE_H
+#define _TABD_READQUEUE_H
+
+#include "base.h"
+
+/* Keeps `depth` asynchronous reads permanently in flight so there is never a moment without a
+pending read for the HID stack to complete. With a single read, reports arriving between a
+completion and the next ReadFile() pile up in the driver's input buffers (or are lost once those are
+full) and come back coalesced into one late read.
+
+The source only has to start a read and wait for one, tabd.c drives it with OVERLAPPED reads and
+bench.c with a simulated device. Reads of a source must complete in the order they were submitted,
+as HID reads do. */
+#define READ_QUEUE_MAX_DEPTH     16
+#define READ_QUEUE_DEFAULT_DEPTH 8
+#define READ_QUEUE_BUFFER_SIZE   1024
+
+typedef struct {
+    void *context;
+    /* starts a read into `buffer`, false if it could not be started */
+    bool (*Submit)(void *context, uint32_t slot, uint8_t *buffer, uint32_t capacity);
+    /* blocks until the read started in `slot` is done, false if it failed or waiting was cancelled */
+    bool (*Wait)(void *context, uint32_t slot, uint32_t *size);
+} AsyncReadSource;
+
+typedef struct {
+    AsyncReadSource source;
+    uint32_t depth;
+    uint32_t next; /* slot of the oldest read in flight */
+    uint64_t completions;
+    uint64_t bytes;
+    uint8_t buffers[READ_QUEUE_MAX_DEPTH][READ_QUEUE_BUFFER_SIZE];
+} ReadQueue;
+
+bool StartReadQueue(ReadQueue *queue, const AsyncReadSource *source, uint32_t depth) {
+    queue->source = *source;
+    queue->depth = CLAMP(depth, 1, READ_QUEUE_MAX_DEPTH);
+    queue->next = 0;
+    queue->completions = 0;
+    queue->bytes = 0;
+
+    for (uint32_t slot = 0; slot < queue->depth; slot++) {
+        if (!queue->source.Submit(
+            queue->source.context, slot, queue->buffers[slot], READ_QUEUE_BUFFER_SIZE
+        )) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Waits for the oldest read. `*data` stays valid until ResubmitRead() hands its buffer back. */
+bool WaitForRead(ReadQueue *queue, const uint8_t **data, uint32_t *size) {
+    if (!queue->source.Wait(queue->source.context, queue->next, size))
+        return false;
+
+    *data = queue->buffers[queue->next];
+    queue->completions++;
+    queue->bytes += *size;
+    return true;
+}
+
+bool ResubmitRead(ReadQueue *queue) {
+    uint32_t slot = queue->next;
+    queue->next = (queue->next + 1) % queue->depth;
+    return queue->source.Submit(
+        queue->source.context, slot, queue->buffers[slot], READ_QUEUE_BUFFER_SIZE
+    );
+}
+
+#endif /* _TABD_READQUEUE_H */
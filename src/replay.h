@@ -0,0 +1,76 @@
+#ifndef _TABD_REPLAY_H
+#define _TABD_REPLAY_H
+
+#include "base.h"
+#include "capture.h"
+
+/* Replays a capture that the platform layer has mapped into memory (MapViewOfFile() in tabd.c,
+mmap() in bench.c). Records are handed out as pointers into the mapping so they can go straight into
+ParseReport(), a capture never has to fit into memory.
+
+In real-time mode each record comes with the clock time it is due at, keeping the original spacing
+between packets. The caller does the waiting so the source works with any clock. */
+typedef enum {
+    REPLAY_REALTIME,
+    REPLAY_FAST,
+} ReplayMode;
+
+typedef struct {
+    const uint8_t *data;
+    size_t size;
+    size_t offset;
+    ReplayMode mode;
+    bool started;
+    uint64_t first_time_ns; /* capture timestamp of the first record */
+    uint64_t start_ns;      /* clock time the first record was handed out at */
+    uint64_t packets;
+    uint64_t bytes;
+} ReplaySource;
+
+bool InitReplaySource(ReplaySource *replay, const uint8_t *data, size_t size, ReplayMode mode) {
+    if (!IsCaptureHeaderValid(data, size))
+        return false;
+
+    *replay = (ReplaySource){
+        .data = data,
+        .size = size,
+        .offset = sizeof(CaptureHeader),
+        .mode = mode,
+    };
+    return true;
+}
+
+/* Returns the first record without consuming it, e.g. to look up the tablet by its VID/PID. */
+bool PeekReplayRecord(const ReplaySource *replay, CaptureRecord *record) {
+    size_t offset = replay->offset;
+    return ReadCaptureRecord(replay->data, replay->size, &offset, record);
+}
+
+/* The record's capture timestamp moved onto the clock the replay started on, in either mode. */
+uint64_t ReplayClockTime(const ReplaySource *replay, const CaptureRecord *record) {
+    /* appended captures may go back in time, treat that as no delay */
+    uint64_t elapsed = (record->time_ns > replay->first_time_ns)
+        ? record->time_ns - replay->first_time_ns
+        : 0;
+    return replay->start_ns + elapsed;
+}
+
+/* `*due_ns` is the clock time the record should be processed at, `now_ns` in fast mode. */
+bool NextReplayRecord(ReplaySource *replay, uint64_t now_ns, CaptureRecord *record, uint64_t *due_ns) {
+    if (!ReadCaptureRecord(replay->data, replay->size, &replay->offset, record))
+        return false;
+
+    if (!replay->started) {
+        replay->started = true;
+        replay->first_time_ns = record->time_ns;
+        replay->start_ns = now_ns;
+    }
+
+    *due_ns = (replay->mode == REPLAY_REALTIME) ? ReplayClockTime(replay, record) : now_ns;
+
+    replay->packets++;
+    replay->bytes += record->size;
+    return true;
+}
+
+#endif /* _TABD_REPLAY_H */
@@ -0,0 +1,136 @@
+#ifndef _TABD_RESAMPLE_H
+#define _TABD_RESAMPLE_H
+
+#include "base.h"
+#include "tablet.h"
+#include "batch.h"
+#include "filter.h"
+
+/* Output at a fixed rate instead of once per report, so a ~133 Hz tablet doesn't beat against a
+144 or 240 Hz display.
+
+Reports are queued with their timestamps and played back one report interval (a running average)
+behind: every tick outputs the position interpolated at tick - interval between the two reports
+around that time, so there always is a report on either side while reports arrive on time. If one is
+late the last position is held. Reports whose flags differ from the one before (tip, buttons) are
+output as they are when playback passes them, before the tick's own sample, so no click is lost
+however short. A predictor horizon of about one report interval wins the delay back.
+
+The platform layer only supplies the ticks and the clock reports are stamped with: a high resolution
+waitable timer in tabd.c, timerfd in bench.c. Once the pen has been gone for FILTER_RESET_NS the
+resampler is idle and the ticks can stop until the next report. */
+#define RESAMPLE_QUEUE_CAPACITY 64 /* power of two */
+
+typedef struct {
+    uint64_t period_ns;
+    uint64_t interval_ns; /* running average of the report interval, the playback delay */
+    uint64_t newest_ns;
+    uint32_t head, tail;
+    TabletReport reports[RESAMPLE_QUEUE_CAPACITY];
+    uint64_t times[RESAMPLE_QUEUE_CAPACITY];
+    bool playing;
+    TabletReport current; /* last report played back */
+    uint64_t current_ns;
+    uint64_t samples;
+    uint64_t edges;
+    uint64_t held;    /* ticks without a newer report to interpolate towards */
+    uint64_t dropped; /* reports that found the queue full */
+} Resampler;
+
+void InitResampler(Resampler *r, uint64_t period_ns) {
+    *r = (Resampler){ .period_ns = period_ns };
+}
+
+/* Forgets queued reports, e.g. when the tablet goes away, counters are kept. */
+void ResetResampler(Resampler *r) {
+    r->tail = r->head;
+    r->playing = false;
+    r->interval_ns = 0;
+    r->newest_ns = 0;
+}
+
+bool PushResampler(Resampler *r, const TabletReport *report, uint64_t time_ns) {
+    if (r->head - r->tail == RESAMPLE_QUEUE_CAPACITY) {
+        r->dropped++;
+        return false;
+    }
+
+    /* reports of a single read share a timestamp and don't count as an interval */
+    if (r->newest_ns && time_ns > r->newest_ns && time_ns - r->newest_ns < FILTER_RESET_NS) {
+        uint64_t interval = time_ns - r->newest_ns;
+        r->interval_ns = (r->interval_ns) ? (r->interval_ns * 7 + interval) / 8 : interval;
+    }
+    r->newest_ns = (time_ns > r->newest_ns) ? time_ns : r->newest_ns;
+
+    uint32_t slot = r->head & (RESAMPLE_QUEUE_CAPACITY - 1);
+    r->reports[slot] = *report;
+    r->times[slot] = time_ns;
+    r->head++;
+    return true;
+}
+
+void PushResamplerBatch(Resampler *r, const ReportBatch *batch) {
+    for (uint32_t i = 0; i < batch->count; i++) {
+        TabletReport report = { batch->x[i], batch->y[i], batch->pressure[i], batch->flags[i] };
+        PushResampler(r, &report, batch->time_ns[i]);
+    }
+}
+
+bool IsResamplerIdle(const Resampler *r) {
+    return !r->playing && r->head == r->tail;
+}
+
+static void AppendResampled(ReportBatch *out, const TabletReport *report, uint64_t time_ns) {
+    if (out->count < REPORT_BATCH_CAPACITY) {
+        StoreReport(out, out->count, report);
+        out->time_ns[out->count++] = time_ns;
+    }
+}
+
+/* Appends what is due at `tick_ns` to `out`: reports with new flags in order, then the sample. */
+uint32_t ResampleReports(Resampler *r, uint64_t tick_ns, ReportBatch *out) {
+    uint32_t start = out->count;
+    uint64_t target = (tick_ns > r->interval_ns) ? tick_ns - r->interval_ns : 0;
+    while (r->tail != r->head) {
+        uint32_t slot = r->tail & (RESAMPLE_QUEUE_CAPACITY - 1);
+        if (r->playing && r->times[slot] > target)
+            break;
+
+        /* a new stroke starts right away instead of an interval late */
+        const TabletReport *report = &r->reports[slot];
+        if (!r->playing || report->flags != r->current.flags) {
+            AppendResampled(out, report, tick_ns);
+            r->edges++;
+        }
+        r->playing = true;
+        r->current = *report;
+        r->current_ns = (r->times[slot] > target) ? target : r->times[slot];
+        r->tail++;
+    }
+
+    if (!r->playing)
+        return out->count - start;
+    if (r->tail == r->head && tick_ns - r->newest_ns > FILTER_RESET_NS) {
+        r->playing = false;
+        return out->count - start;
+    }
+
+    TabletReport sample = r->current;
+    if (r->tail != r->head) {
+        uint32_t slot = r->tail & (RESAMPLE_QUEUE_CAPACITY - 1);
+        const TabletReport *next = &r->reports[slot];
+        int64_t num = target - r->current_ns, den = r->times[slot] - r->current_ns;
+        if (den > 0 && num > 0) {
+            sample.x += (int32_t)((next->x - sample.x) * num / den);
+            sample.y += (int32_t)((next->y - sample.y) * num / den);
+            sample.pressure += (int32_t)(((int64_t)next->pressure - sample.pressure) * num / den);
+        }
+    } else {
+        r->held++;
+    }
+    AppendResampled(out, &sample, tick_ns);
+    r->samples++;
+    return out->count - start;
+}
+
+#endif /* _TABD_RESAMPLE_H */
@@ -0,0 +1,93 @@
+#ifndef _TABD_RING_H
+#define _TABD_RING_H
+
+#include "base.h"
+#include "tablet.h"
+#include "batch.h"
+
+/* Lock-free single-producer/single-consumer ring of parsed reports between the reader thread and the
+output thread. `head` is only written by the producer and `tail` only by the consumer, each on its own
+cache line: the ring is cache line aligned, so heap copies need a 64-byte aligned allocation. A
+full ring drops the incoming report rather than blocking the reader, both that and the highest
+occupancy seen are counted by the producer.
+
+Every report is pushed with a tag, the device slot's generation, and popped by the tag the consumer
+expects: reports tagged before it are left over from an earlier tablet and dropped, a pop stops at
+one tagged after it until the consumer catches up. */
+#define REPORT_RING_CAPACITY 256 /* power of two */
+
+typedef struct CACHE_ALIGNED {
+    TabletReport items[REPORT_RING_CAPACITY];
+    uint64_t times[REPORT_RING_CAPACITY];
+    uint32_t tags[REPORT_RING_CAPACITY];
+    volatile uint32_t head;
+    uint32_t high_water;
+    uint64_t dropped;
+    uint8_t _pad0[64 - sizeof(uint32_t) * 2 - sizeof(uint64_t)];
+    volatile uint32_t tail;
+    uint8_t _pad1[64 - sizeof(uint32_t)];
+} ReportRing;
+
+STATIC_ASSERT(offsetof(ReportRing, head) % 64 == 0);
+STATIC_ASSERT(offsetof(ReportRing, tail) % 64 == 0);
+
+bool PushReport(ReportRing *ring, const TabletReport *report, uint64_t time_ns, uint32_t tag) {
+    uint32_t head = ring->head;
+    uint32_t used = head - AtomicLoad32(&ring->tail);
+    if (used == REPORT_RING_CAPACITY) {
+        ring->dropped++;
+        return false;
+    }
+
+    ring->items[head & (REPORT_RING_CAPACITY - 1)] = *report;
+    ring->times[head & (REPORT_RING_CAPACITY - 1)] = time_ns;
+    ring->tags[head & (REPORT_RING_CAPACITY - 1)] = tag;
+    AtomicStore32(&ring->head, head + 1);
+    ring->high_water = (used + 1 > ring->high_water) ? used + 1 : ring->high_water;
+    return true;
+}
+
+uint32_t PushReportBatch(ReportRing *ring, const ReportBatch *batch, uint32_t tag) {
+    uint32_t pushed = 0;
+    for (uint32_t i = 0; i < batch->count; i++) {
+        TabletReport report = {
+            .x = batch->x[i],
+            .y = batch->y[i],
+            .pressure = batch->pressure[i],
+            .flags = batch->flags[i],
+        };
+        pushed += PushReport(ring, &report, batch->time_ns[i], tag);
+    }
+    return pushed;
+}
+
+/* Moves everything queued with `tag` (up to the batch capacity) into `batch`, ready for
+MapReportBatch(). Older reports on the way are dropped without taking up any of the batch. */
+uint32_t PopReportBatch(ReportRing *ring, ReportBatch *batch, uint32_t tag) {
+    uint32_t tail = ring->tail;
+    uint32_t head = AtomicLoad32(&ring->head);
+    uint32_t count = 0;
+
+    for (; tail != head && count < REPORT_BATCH_CAPACITY; tail++) {
+        uint32_t slot = tail & (REPORT_RING_CAPACITY - 1);
+        int32_t age = (int32_t)(tag - ring->tags[slot]);
+        if (age > 0)
+            continue;
+        if (age < 0)
+            break;
+
+        const TabletReport *report = &ring->items[slot];
+        batch->x[count] = report->x;
+        batch->y[count] = report->y;
+        batch->pressure[count] = report->pressure;
+        batch->flags[count] = report->flags;
+        batch->time_ns[count] = ring->times[slot];
+        count++;
+    }
+
+    batch->count = count;
+    AtomicStore32(&ring->tail, tail);
+    return count;
+}
+
+#endif /* _TABD_RING_H */
@@ -1,6 +1,18 @@
 #include "util.h"
 #include "preset.h"
+#include "presetfile.h"
 #include "tablet.h"
+#include "output.h"
+#include "batch.h"
+#include "capture.h"
+#include "replay.h"
+#include "ring.h"
+#include "readqueue.h"
+#include "devicetable.h"
+#include "devicedb.h"
+#include "resample.h"
+#include "latency.h"
+#include "log.h"
 #include "resources.h"
 
 #define MAIN_WNDCLASSNAME       L"tabd"
@@ -8,13 +20,38 @@
 #define TRAY_WM_ICON_MESSAGE    (WM_USER+1)
 #define TRAY_WM_SHOW_MENU       (WM_USER+2)
 #define TRAY_WM_ACTIVATE_PRESET (WM_USER+3)
+#define TRAY_WM_LOG_LATENCY     (WM_USER+4)
 #define TRAY_MENU_EXIT_ITEM     1
+#define TRAY_MENU_LATENCY_ITEM  2
 #define TRAY_MENU_PRESET_ITEM_0 100
+#define CAPTURE_BUFFER_SIZE     (64 * 1024)
+#define CAPTURE_HANDOVER_NS     1000000000ull
+#define DEVICE_LIST_CAPACITY    1024
+#define TABLET_COMPLETION_BATCH 16
+#define TABLET_STOP_KEY         (~(ULONG_PTR)0)
+#define TABLET_KEY(_device, _generation) ((ULONG_PTR)(_generation) << 8 | (_device))
+#define LOG_THREAD_CAPACITY     16
+#define LOG_FLUSH_INTERVAL_MS   50
+#define LOG_FILE_BUFFER_SIZE    (64 * 1024)
 
 static void InitThreadMessageQueue(void);
-static void _Log(DWORD tid, PCWSTR file, int line, PCSTR func, PCWSTR message, ...);
-#define Log(_message, ...) \
-    _Log(GetCurrentThreadId(), __WFILE__, __LINE__, __func__, _message, ##__VA_ARGS__);
+static void _Log(LogSite *site, ...);
+#define Log(_message, ...) do { \
+    static LogSite _site = { __LINE__, __WFILE__, __func__, _message, 0 }; \
+    _Log(&_site, ##__VA_ARGS__); \
+} while (0)
+
+/* Log() only copies its arguments into the calling thread's LogRing (log.h) and a log thread writes
+them out every LOG_FLUSH_INTERVAL_MS, or sooner when a ring is half full: formatted to the console
+and, with --log, as binary entries to a file that --decode-log turns into text. A thread claims a ring
+on its first Log(), the log thread hands it back once the thread has exited and the ring is empty. */
+static LogRing *ClaimLogRing(void);
+static void StartLogging(PCWSTR path);
+static DWORD WINAPI LogThreadProc(LPVOID arg);
+static void FlushLogRings(void);
+static void WriteLogFile(void);
+static void StopLogging(void);
+static bool DecodeLogFile(PCWSTR path);
 
 static void WinEventHookCallback(
     HWINEVENTHOOK hWinEventHook,
@@ -26,6 +63,12 @@ static void WinEventHookCallback(
     DWORD dwmsEventTime
 );
 static LRESULT MainWindowEventHandler(HWND hwnd, UINT msg, WPARAM wp, LPARAM lp);
+static int GetDisplayRefreshRate(void);
+
+/* Presets are compiled for the monitor layout, at startup and again on WM_DISPLAYCHANGE (which the
+hidden main window gets like any top-level one) for every open tablet. */
+static void RefreshMonitorLayout(void);
+static BOOL CALLBACK AddMonitorCallback(HMONITOR monitor, HDC hdc, RECT *rect, LPARAM layout);
 
 /* A whole separate thread with a hidden window and its message queue are dedicated for tray menu 
 only because TrackPopupMenu() blocks the calling thread and sometimes fails if called from a thread 
@@ -35,9 +78,32 @@ static LRESULT TrayWindowEventHandler(HWND hwnd, UINT msg, WPARAM wp, LPARAM lp)
 
 static void SetTrayIconTabletActiveStatus(bool active);
 
+/* The device database is loaded once before enumeration, either a prebuilt one mapped in place or a
+text one compiled into s_device_database. Without --devices the built-in table is used. */
+static bool LoadDeviceDatabase(PCWSTR path);
+
+/* Presets start out as the built-in g_presets. With --presets every *.txt in the directory is one
+instead and a watcher thread reloads a file when it changes: it is parsed and compiled on the watcher
+thread and published to the output thread through its PresetSlot, never touching the packet path.
+Files that fail to parse are logged and the last good version stays active. */
+static void InitBuiltInPresets(void);
+static bool LoadPresetDirectory(PCWSTR path);
+static bool LoadPresetFile(PCWSTR file_name);
+static DWORD WINAPI PresetWatchThreadProc(LPVOID arg);
+static HMENU CreateTrayMenu(void);
+
+/* Every tablet found is opened into a slot of s_tablets, with its handle associated with a single I/O
+completion port under a key of its slot and the slot's generation. The reader thread starts a
+tablet's reads when the port hands it the key without a read, and services any tablet whose reads
+complete. A failed read cancels the tablet's other reads, the slot is released once all of them are
+back so no stale completion can reach the next tablet in it. */
 static bool TryInitTablet(PCWSTR path);
-static bool BeginReadingTablet(void);
-static void CleanUpTablet(void);
+static DeviceSlot *ClaimTablet(const TabletInfo *info);
+static bool SubmitTabletRead(void *context, uint32_t slot, uint8_t *buffer, uint32_t capacity);
+static bool WaitForTabletRead(void *context, uint32_t slot, uint32_t *size);
+static void ServiceTablet(DeviceSlot *tablet);
+static void CloseTablet(DeviceSlot *tablet);
+static void CleanUpTablets(void);
 static DWORD CALLBACK DeviceChangedCallback(
     HCMNOTIFICATION       notification,
     PVOID                 arg,
@@ -46,13 +112,65 @@ static DWORD CALLBACK DeviceChangedCallback(
     DWORD                 data_size
 );
 
-static void SynthesizeInput(const TabletReport *report);
+/* Packets are read and parsed on a time critical reader thread and handed to the output thread
+through each tablet's lock-free ring, neither of them ever waits on the message loop or on each
+other. Preset switches and the foreground window reach the output thread as plain atomic stores,
+s_tablet_lock only serializes opening and closing tablets. Each tablet injects ink through its own
+synthetic pen, mouse input goes to the one cursor. Frames that would change nothing aren't injected
+until --keep-alive (OUTPUT_KEEP_ALIVE_MS by default, 0 injects everything) has passed, see
+OutputSuppressor, the rest of a batch is injected in as few calls as it takes, see PlanOutputCalls(). */
+static DWORD WINAPI ReaderThreadProc(LPVOID arg);
+static DWORD WINAPI OutputThreadProc(LPVOID arg);
+static void QueuePackets(DeviceSlot *tablet, const BYTE *data, DWORD size, UINT64 time_ns);
+static void EmitOutputBatch(DeviceSlot *tablet, const CompiledPreset *preset, ReportBatch *batch);
+static void SynthesizeInput(
+    HSYNTHETICPOINTERDEVICE ink_device, const OutputFrame *frames, const UINT64 *times_ns, uint32_t count
+);
+static INPUT GetMouseInput(const OutputFrame *frame);
+static POINTER_TYPE_INFO GetPenInput(const OutputFrame *frame, UINT64 time_ns);
+static void CompileTabletPresets(DeviceSlot *tablet);
+static void ActivatePreset(uint32_t target, uint32_t preset_idx);
+static void LogRingCounters(const DeviceSlot *tablet);
+static UINT64 GetMonotonicNs(void);
+static UINT64 GetPerformanceCount(UINT64 time_ns);
+
+/* With --output-rate the output thread doesn't emit per report but feeds a Resampler and emits on the
+ticks of a high resolution waitable timer. The timer only runs while the resampler has something to
+play back. */
+static UINT64 TickOutput(bool fired, UINT64 next_tick);
+static bool AreResamplersIdle(void);
+
+/* Built with TABD_LATENCY every report is timed from its read's completion to each stage of the
+pipeline, see latency.h. The histograms are logged from the tray menu and at exit, without it the
+LATENCY_RECORD() calls compile to nothing. With --output-rate the later stages are timed from the
+tick instead, resampled reports are stamped with it. */
+#ifdef TABD_LATENCY
+#define LATENCY_RECORD(_stage, _since) RecordLatency(&s_latency[_stage], GetMonotonicNs() - (_since))
+#else
+#define LATENCY_RECORD(_stage, _since)
+#endif
+static void LogLatency(void);
+
+/* Recording is double buffered: the tablet loop appends records to the active buffer and hands full
+(or stale) buffers over to a flush thread. If the flush thread is still busy with the other buffer
+the record is dropped and counted rather than stalling the reader. */
+static bool StartRecording(PCWSTR path);
+static void RecordPacket(const TabletInfo *info, const BYTE *packet, DWORD size, UINT64 time_ns);
+static bool HandOverCaptureBuffer(void);
+static DWORD WINAPI CaptureThreadProc(LPVOID arg);
+static void StopRecording(void);
+
+/* Replay maps a capture and feeds it through QueuePackets() from its own thread instead of a real
+tablet, either with the original timing or as fast as possible. */
+static bool StartReplay(PCWSTR path, ReplayMode mode);
+static DWORD WINAPI ReplayThreadProc(LPVOID arg);
+static void StopReplay(void);
 
 static DWORD s_main_thread_id;
 static HINSTANCE s_hinstance;
 static HANDLE s_hconsole;
-static POINT s_screen_size;
 static HWINEVENTHOOK s_win_event_hook;
+static LARGE_INTEGER s_qpc_frequency;
 
 static CRITICAL_SECTION s_tray_lock;
 static HANDLE s_tray_thread;
@@ -60,15 +178,84 @@ static DWORD s_tray_thread_id;
 static NOTIFYICONDATAW s_tray_icon_data;
 
 static CRITICAL_SECTION s_tablet_lock;
-static OVERLAPPED s_tablet_overlapped;
+static DeviceTable s_tablets; /* slots claimed and released under s_tablet_lock */
+static MonitorLayout s_monitors; /* under s_tablet_lock */
+static HANDLE s_tablet_port;
+static HANDLE s_tablet_handles[DEVICE_TABLE_CAPACITY];
+static OVERLAPPED s_tablet_reads[DEVICE_TABLE_CAPACITY][READ_QUEUE_MAX_DEPTH];
+static uint32_t s_tablet_pending[DEVICE_TABLE_CAPACITY]; /* reads in flight, reader thread only */
 static HCMNOTIFICATION s_device_notification;
-static HANDLE s_tablet_handle = INVALID_HANDLE_VALUE;
-static TabletInfo s_tablet_info;
-static BYTE s_tablet_packet[1024];
-static int s_tablet_preset_idx;
-static TabletReport s_tablet_previous_report;
-static HSYNTHETICPOINTERDEVICE s_ink_device;
-static HWND s_ink_foreground_window;
+static uint32_t s_tablet_read_depth = READ_QUEUE_DEFAULT_DEPTH;
+static DeviceDatabase s_devices;
+static HANDLE s_devices_file = INVALID_HANDLE_VALUE;
+static HANDLE s_devices_mapping;
+static const BYTE *s_devices_view;
+static TabletInfo s_device_list[DEVICE_LIST_CAPACITY];
+static UINT64 s_device_database[DEVICE_DATABASE_MAX_SIZE(DEVICE_LIST_CAPACITY) / 8 + 1];
+static HSYNTHETICPOINTERDEVICE s_ink_devices[DEVICE_TABLE_CAPACITY]; /* created on a slot's first claim */
+static HWND volatile s_ink_foreground_window;
+
+static HANDLE s_reader_thread;
+static HANDLE s_output_thread;
+static HANDLE s_stop_event;
+static HANDLE s_ring_event;
+static ReportBatch s_output_batch;
+static OutputFrame s_output_frames[REPORT_BATCH_CAPACITY];
+static UINT64 s_output_times[REPORT_BATCH_CAPACITY];
+static OutputCall s_output_calls[2 * REPORT_BATCH_CAPACITY];
+static INPUT s_output_mouse[REPORT_BATCH_CAPACITY];
+static HANDLE s_output_timer;
+static UINT64 s_output_period_ns;
+static ReportBatch s_resampled_batch;
+static UINT64 s_output_missed_ticks;
+static bool s_output_coalesce;
+static UINT64 s_output_keep_alive_ns = OUTPUT_KEEP_ALIVE_MS * 1000000ull;
+#ifdef TABD_LATENCY
+static LatencyHistogram s_latency[LATENCY_STAGES]; /* LATENCY_PARSED written by the reader thread */
+#endif
+
+static Preset s_presets[PRESET_CAPACITY]; /* written under s_tablet_lock */
+static WCHAR s_preset_names[PRESET_CAPACITY][PRESET_NAME_CAPACITY];
+static volatile uint32_t s_preset_count;   /* only grows */
+static PCWSTR s_presets_path;
+static HANDLE s_presets_dir = INVALID_HANDLE_VALUE;
+static HANDLE s_presets_thread;
+static OVERLAPPED s_presets_watch;
+static DWORD s_presets_changes[1024];
+
+static HANDLE s_capture_file = INVALID_HANDLE_VALUE;
+static HANDLE s_capture_thread;
+static HANDLE s_capture_event;
+static BYTE s_capture_buffers[2][CAPTURE_BUFFER_SIZE];
+static DWORD s_capture_sizes[2];
+static int s_capture_active;
+static volatile long s_capture_pending = -1; /* index of the buffer owned by the flush thread */
+static volatile long s_capture_stopping;
+static UINT64 s_capture_handover_ns;
+static UINT64 s_capture_recorded;
+static UINT64 s_capture_dropped;
+
+static LogRing s_log_rings[LOG_THREAD_CAPACITY];
+static volatile long s_log_ring_owners[LOG_THREAD_CAPACITY]; /* thread ids, 0 while free */
+static HANDLE s_log_ring_threads[LOG_THREAD_CAPACITY];
+static DWORD s_log_tls = TLS_OUT_OF_INDEXES;
+static volatile long s_log_unclaimed; /* records of threads that found every ring taken */
+static HANDLE s_log_thread;
+static HANDLE s_log_event;
+static volatile long s_log_stopping;
+static HANDLE s_log_file = INVALID_HANDLE_VALUE;
+static LogEncoder s_log_encoder;
+static BYTE s_log_buffer[LOG_FILE_BUFFER_SIZE];
+static DWORD s_log_buffer_size;
+static LogDecoder s_log_decoder;
+
+static HANDLE s_replay_thread;
+static HANDLE s_replay_file = INVALID_HANDLE_VALUE;
+static HANDLE s_replay_mapping;
+static const BYTE *s_replay_view;
+static ReplaySource s_replay;
+static DeviceSlot *s_replay_tablet;
+static volatile long s_replay_stopping;
 
 void _start(void) {
     s_main_thread_id = GetCurrentThreadId();
@@ -76,12 +263,78 @@ void _start(void) {
     if (AttachConsole(ATTACH_PARENT_PROCESS)) {
         s_hconsole = GetStdHandle(STD_OUTPUT_HANDLE);
     }
-    s_screen_size = (POINT){ GetSystemMetrics(SM_CXSCREEN), GetSystemMetrics(SM_CYSCREEN) };
+    QueryPerformanceFrequency(&s_qpc_frequency);
+    s_log_tls = TlsAlloc();
+    s_log_event = CreateEventW(0, false, false, 0);
+    ASSERT(s_log_tls != TLS_OUT_OF_INDEXES && s_log_event);
+
+    PCWSTR log_path = 0;
+    PCWSTR replay_path = 0;
+    PCWSTR devices_path = 0;
+    PCWSTR presets_path = 0;
+    int output_rate = 0;
+    ReplayMode replay_mode = REPLAY_REALTIME;
+    int argc = 0;
+    LPWSTR *argv = CommandLineToArgvW(GetCommandLineW(), &argc);
+    for (int i = 1; i < argc; i++) {
+        if ((!wcscmp(argv[i], L"--replay") || !wcscmp(argv[i], L"--replay-fast")) && i + 1 < argc) {
+            replay_mode = wcscmp(argv[i], L"--replay") ? REPLAY_FAST : REPLAY_REALTIME;
+            replay_path = argv[++i];
+        } else if (!wcscmp(argv[i], L"--record") && i + 1 < argc) {
+            i++;
+            if (StartRecording(argv[i])) {
+                Log(L"Recording packets to \"%ls\"", argv[i]);
+            } else {
+                Log(L"Failed to open \"%ls\" for recording (%d)", argv[i], GetLastError());
+            }
+        } else if (!wcscmp(argv[i], L"--devices") && i + 1 < argc) {
+            devices_path = argv[++i];
+        } else if (!wcscmp(argv[i], L"--presets") && i + 1 < argc) {
+            presets_path = argv[++i];
+        } else if (!wcscmp(argv[i], L"--output-rate") && i + 1 < argc) {
+            i++;
+            output_rate = (!wcscmp(argv[i], L"display")) ? GetDisplayRefreshRate() : _wtoi(argv[i]);
+            output_rate = CLAMP(output_rate, 0, 1000);
+        } else if (!wcscmp(argv[i], L"--coalesce")) {
+            s_output_coalesce = true;
+        } else if (!wcscmp(argv[i], L"--keep-alive") && i + 1 < argc) {
+            s_output_keep_alive_ns = CLAMP(_wtoi(argv[++i]), 0, 60000) * 1000000ull;
+        } else if (!wcscmp(argv[i], L"--read-depth") && i + 1 < argc) {
+            s_tablet_read_depth = CLAMP(_wtoi(argv[++i]), 1, READ_QUEUE_MAX_DEPTH);
+        } else if (!wcscmp(argv[i], L"--log") && i + 1 < argc) {
+            log_path = argv[++i];
+        } else if (!wcscmp(argv[i], L"--decode-log") && i + 1 < argc) {
+            ExitProcess(DecodeLogFile(argv[++i]) ? 0 : 1);
+        } else {
+            Log(L"Unknown argument \"%ls\"", argv[i]);
+        }
+    }
+    StartLogging(log_path);
+    if (!LoadDeviceDatabase(devices_path)) {
+        Log(L"Failed to load devices from \"%ls\", using built-in ones", devices_path);
+        ASSERT(LoadDeviceDatabase(0));
+    }
+    InitializeCriticalSection(&s_tablet_lock);
+    RefreshMonitorLayout();
+    InitBuiltInPresets();
+    if (presets_path && !LoadPresetDirectory(presets_path)) {
+        Log(L"No presets loaded from \"%ls\", using built-in ones", presets_path);
+    }
+    if (output_rate) {
+        s_output_period_ns = 1000000000ull / output_rate;
+        s_output_timer = CreateWaitableTimerExW(
+            0, 0, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS
+        );
+        if (!s_output_timer) {
+            /* before Windows 10 1803, ticks get rounded to the system timer resolution */
+            s_output_timer = CreateWaitableTimerExW(0, 0, 0, TIMER_ALL_ACCESS);
+        }
+        ASSERT(s_output_timer);
+        Log(L"Resampling output at %d Hz", output_rate);
+    }
+    InitDeviceTable(&s_tablets, s_output_period_ns, s_output_keep_alive_ns);
     s_ink_foreground_window = GetForegroundWindow();
 
-    s_ink_device = CreateSyntheticPointerDevice(PT_PEN, 1, POINTER_FEEDBACK_DEFAULT);
-    ASSERT(s_ink_device);
-
     InitThreadMessageQueue();
 
     WNDCLASSEXW wndclass = {
@@ -110,8 +363,27 @@ void _start(void) {
     s_tray_thread = CreateThread(0, 0, TrayThreadProc, thread_ready, 0, &s_tray_thread_id);
     ASSERT(WaitForSingleObject(thread_ready, INFINITE) == WAIT_OBJECT_0);
 
-    InitializeCriticalSection(&s_tablet_lock);
-    s_tablet_overlapped.hEvent = CreateEventW(0, false, false, 0);
+    s_tablet_port = CreateIoCompletionPort(INVALID_HANDLE_VALUE, 0, 0, 1);
+    s_stop_event = CreateEventW(0, true, false, 0);
+    s_ring_event = CreateEventW(0, false, false, 0);
+    s_reader_thread = CreateThread(0, 0, ReaderThreadProc, 0, 0, 0);
+    s_output_thread = CreateThread(0, 0, OutputThreadProc, 0, 0, 0);
+    ASSERT(s_tablet_port && s_stop_event && s_ring_event && s_reader_thread && s_output_thread);
+    SetThreadPriority(s_reader_thread, THREAD_PRIORITY_TIME_CRITICAL);
+    SetThreadPriority(s_output_thread, THREAD_PRIORITY_HIGHEST);
+    if (s_presets_dir != INVALID_HANDLE_VALUE) {
+        s_presets_watch.hEvent = CreateEventW(0, false, false, 0);
+        s_presets_thread = CreateThread(0, 0, PresetWatchThreadProc, 0, 0, 0);
+        ASSERT(s_presets_watch.hEvent && s_presets_thread);
+    }
+
+    if (replay_path) {
+        if (!StartReplay(replay_path, replay_mode)) {
+            Log(L"Failed to replay \"%ls\" (%d)", replay_path, GetLastError());
+            PostThreadMessageW(s_main_thread_id, WM_QUIT, 0, 0);
+        }
+        goto Run;
+    }
 
     HDEVINFO devices = SetupDiGetClassDevsW(
         &GUID_DEVINTERFACE_HID, 0, 0, DIGCF_DEVICEINTERFACE | DIGCF_PRESENT
@@ -128,9 +400,7 @@ void _start(void) {
             devices, &iface, details, COUNTOF(details_buffer) - 1, 0, 0
         );
 
-        if (TryInitTablet(details->DevicePath)) {
-            break;
-        }
+        TryInitTablet(details->DevicePath);
     }
 
     CM_NOTIFY_FILTER filter = {
@@ -140,57 +410,41 @@ void _start(void) {
     };
     ASSERT(!CM_Register_Notification(&filter, 0, DeviceChangedCallback, &s_device_notification));
 
-    for (bool is_running = true; is_running; ) {
-        DWORD wait = MsgWaitForMultipleObjects(
-            1, &s_tablet_overlapped.hEvent, false, INFINITE, QS_ALLINPUT
-        );
-
-        if (wait == WAIT_OBJECT_0) {
-            DWORD packet_size = 0;
-            BOOL packet_ready = GetOverlappedResult(
-                s_tablet_handle, &s_tablet_overlapped, &packet_size,  false
-            );
-
-            if (!packet_ready || !BeginReadingTablet()) {
-                Log(L"Tablet lost");
-                CleanUpTablet();
-                SetTrayIconTabletActiveStatus(false);
-                continue;
-            }
-
-            EnterCriticalSection(&s_tablet_lock);
-            TabletReport report = {0};
-            if (s_tablet_info.Parse(s_tablet_packet, packet_size, &report)) {
-                SynthesizeInput(&report);
-            }
-            LeaveCriticalSection(&s_tablet_lock);
-        } else if (wait == WAIT_OBJECT_0 + 1) {
-            for (MSG msg; PeekMessageW(&msg, 0, 0, 0, PM_REMOVE); ) {
-                if (msg.hwnd) {
-                    TranslateMessage(&msg);
-                    DispatchMessageW(&msg);
-                    continue;
-                }
+    Run:
+    LocalFree(argv);
+    for (MSG msg; GetMessageW(&msg, 0, 0, 0) > 0; ) {
+        if (msg.hwnd) {
+            TranslateMessage(&msg);
+            DispatchMessageW(&msg);
+        } else if (msg.message == TRAY_WM_ACTIVATE_PRESET) {
+            ActivatePreset((uint32_t)msg.wParam, (uint32_t)msg.lParam);
+        } else if (msg.message == TRAY_WM_LOG_LATENCY) {
+            LogLatency();
+        }
+    }
 
-                if (msg.message == WM_QUIT) {
-                    is_running = false;
-                } else if (msg.message == TRAY_WM_ACTIVATE_PRESET) {
-                    EnterCriticalSection(&s_tablet_lock);
-                    s_tablet_preset_idx = msg.lParam;
-                    LeaveCriticalSection(&s_tablet_lock);
-                    Log(L"Activated \"%ls\" preset", g_presets[msg.lParam].name);
-                }
-            }
-        } else if (wait - WAIT_ABANDONED_0 == 0) {
-            Log(L"Wait abandoned? (%d)", GetLastError());
-            CleanUpTablet();
-        } else {
-            Log(L"MsgWaitForMultipleObjects() error %d", GetLastError());
-            TRAP();
+    StopReplay();
+    SetEvent(s_stop_event);
+    PostQueuedCompletionStatus(s_tablet_port, 0, TABLET_STOP_KEY, 0);
+    WaitForSingleObject(s_reader_thread, INFINITE);
+    WaitForSingleObject(s_output_thread, INFINITE);
+    CloseHandle(s_reader_thread);
+    CloseHandle(s_output_thread);
+    if (s_presets_thread) {
+        WaitForSingleObject(s_presets_thread, INFINITE);
+        CloseHandle(s_presets_thread);
+        CloseHandle(s_presets_dir);
+    }
+    for (uint32_t i = 0; i < DEVICE_TABLE_CAPACITY; i++) {
+        if (s_tablets.slots[i].state != DEVICE_FREE) {
+            LogRingCounters(&s_tablets.slots[i]);
         }
     }
+    LogLatency();
 
-    CleanUpTablet();
+    StopReplay();
+    CleanUpTablets();
+    StopRecording();
     DeleteCriticalSection(&s_tablet_lock);
 
     PostThreadMessageW(s_tray_thread_id, WM_QUIT, 0, 0);
@@ -198,7 +452,12 @@ void _start(void) {
     DeleteCriticalSection(&s_tray_lock);
 
     UnhookWinEvent(s_win_event_hook);
-    DestroySyntheticPointerDevice(s_ink_device);
+    for (uint32_t i = 0; i < DEVICE_TABLE_CAPACITY; i++) {
+        if (s_ink_devices[i]) {
+            DestroySyntheticPointerDevice(s_ink_devices[i]);
+        }
+    }
+    StopLogging();
 
     ExitProcess(0);
 }
@@ -206,6 +465,8 @@ void _start(void) {
 LRESULT MainWindowEventHandler(HWND hwnd, UINT msg, WPARAM wp, LPARAM lp) {
     if (msg == WM_QUIT) {
         PostThreadMessageW(s_main_thread_id, WM_QUIT, 0, 0);
+    } else if (msg == WM_DISPLAYCHANGE) {
+        RefreshMonitorLayout();
     }
     return DefWindowProcW(hwnd, msg, wp, lp);
 }
@@ -235,14 +496,6 @@ DWORD WINAPI TrayThreadProc(HANDLE thread_ready) {
     LeaveCriticalSection(&s_tray_lock);
     ASSERT(Shell_NotifyIconW(NIM_ADD, &s_tray_icon_data));
 
-    HMENU presets = CreateMenu();
-    for (int i = 0; i < COUNTOF(g_presets); i++) {
-        AppendMenuW(presets, MF_STRING, TRAY_MENU_PRESET_ITEM_0 + i, g_presets[i].name);
-    }
-    HMENU menu = CreatePopupMenu();
-    AppendMenuW(menu, MF_POPUP, (UINT_PTR)presets, L"Presets");
-    AppendMenuW(menu, MF_STRING, TRAY_MENU_EXIT_ITEM, L"Exit");
-
     SetEvent(thread_ready);
     thread_ready = 0;
 
@@ -255,16 +508,24 @@ DWORD WINAPI TrayThreadProc(HANDLE thread_ready) {
             GetCursorPos(&cursor);
             SetForegroundWindow(hwnd);
 
+            /* built every time, preset files may have been added since */
+            uint32_t preset_count = AtomicLoad32(&s_preset_count);
+            HMENU menu = CreateTrayMenu();
             int choice = TrackPopupMenuEx(
                 menu, TPM_RETURNCMD | TPM_NONOTIFY, cursor.x, cursor.y, hwnd, 0
             );
+            DestroyMenu(menu);
 
             if (choice == TRAY_MENU_EXIT_ITEM) {
                 PostThreadMessageW(s_main_thread_id, WM_QUIT, 0, 0);
+            } else if (choice == TRAY_MENU_LATENCY_ITEM) {
+                PostThreadMessageW(s_main_thread_id, TRAY_WM_LOG_LATENCY, 0, 0);
             } else if (choice >= TRAY_MENU_PRESET_ITEM_0) {
-                ASSERT(choice < TRAY_MENU_PRESET_ITEM_0 + COUNTOF(g_presets));
+                /* PRESET_CAPACITY items per tablet after the ones for all of them */
+                uint32_t item = choice - TRAY_MENU_PRESET_ITEM_0;
+                ASSERT(item % PRESET_CAPACITY < preset_count);
                 PostThreadMessageW(
-                    s_main_thread_id, TRAY_WM_ACTIVATE_PRESET, 0, choice - TRAY_MENU_PRESET_ITEM_0
+                    s_main_thread_id, TRAY_WM_ACTIVATE_PRESET, item / PRESET_CAPACITY, item % PRESET_CAPACITY
                 );
             } else {
                 Log(L"TrackPopupMenuEx() returned %d (%d)", choice, GetLastError());
@@ -272,14 +533,43 @@ DWORD WINAPI TrayThreadProc(HANDLE thread_ready) {
         }
     }
 
-    DestroyMenu(menu);
-    DestroyMenu(presets);
     Shell_NotifyIconW(NIM_DELETE, &s_tray_icon_data);
     DestroyWindow(hwnd);
     UnregisterClassW(TRAY_WNDCLASSNAME, s_hinstance);
     return 0;
 }
 
+/* "Presets" switches every tablet, with several tablets each one also gets a submenu of its own. */
+HMENU CreateTrayMenu(void) {
+    HMENU menu = CreatePopupMenu();
+    uint32_t count = AtomicLoad32(&s_preset_count);
+    EnterCriticalSection(&s_tablet_lock);
+    for (uint32_t target = 0; target <= DEVICE_TABLE_CAPACITY; target++) {
+        const DeviceSlot *tablet = (target) ? &s_tablets.slots[target - 1] : 0;
+        if (tablet && (s_tablets.count < 2 || tablet->state == DEVICE_FREE))
+            continue;
+
+        HMENU presets = CreateMenu();
+        for (uint32_t i = 0; i < count; i++) {
+            UINT_PTR item = TRAY_MENU_PRESET_ITEM_0 + target * PRESET_CAPACITY + i;
+            AppendMenuW(presets, MF_STRING, item, s_preset_names[i]);
+        }
+        WCHAR title[64];
+        if (tablet) {
+            swprintf_s(title, COUNTOF(title), L"Tablet %u (%hs)", target - 1, tablet->info.name);
+        } else {
+            swprintf_s(title, COUNTOF(title), L"Presets");
+        }
+        AppendMenuW(menu, MF_POPUP, (UINT_PTR)presets, title);
+    }
+    LeaveCriticalSection(&s_tablet_lock);
+#ifdef TABD_LATENCY
+    AppendMenuW(menu, MF_STRING, TRAY_MENU_LATENCY_ITEM, L"Log latency");
+#endif
+    AppendMenuW(menu, MF_STRING, TRAY_MENU_EXIT_ITEM, L"Exit");
+    return menu;
+}
+
 LRESULT TrayWindowEventHandler(HWND hwnd, UINT msg, WPARAM wp, LPARAM lp) {
     if (msg == TRAY_WM_ICON_MESSAGE && LOWORD(lp) == WM_RBUTTONDOWN) {
         PostThreadMessageW(s_tray_thread_id, TRAY_WM_SHOW_MENU, 0, 0);
@@ -296,50 +586,199 @@ void SetTrayIconTabletActiveStatus(bool active) {
     Shell_NotifyIconW(NIM_MODIFY, &s_tray_icon_data);
 }
 
+bool LoadDeviceDatabase(PCWSTR path) {
+    if (!path) {
+        size_t size = BuildDeviceDatabase(
+            s_tablet_infos, COUNTOF(s_tablet_infos), (BYTE*)s_device_database, sizeof(s_device_database)
+        );
+        return size && OpenDeviceDatabase((BYTE*)s_device_database, size, &s_devices);
+    }
+
+    s_devices_file = CreateFileW(
+        path, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0
+    );
+    if (s_devices_file == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER size = {0};
+    GetFileSizeEx(s_devices_file, &size);
+    s_devices_mapping = CreateFileMappingW(s_devices_file, 0, PAGE_READONLY, 0, 0, 0);
+    s_devices_view = (s_devices_mapping) ? MapViewOfFile(s_devices_mapping, FILE_MAP_READ, 0, 0, 0) : 0;
+    if (!s_devices_view)
+        return false;
+
+    /* a prebuilt database stays mapped for good */
+    if (OpenDeviceDatabase(s_devices_view, size.QuadPart, &s_devices)) {
+        Log(L"Mapped %u devices from \"%ls\"", s_devices.count, path);
+        return true;
+    }
+
+    uint32_t count = 0, error_line = 0;
+    bool valid = ParseDeviceList(
+        (const char*)s_devices_view,
+        size.QuadPart,
+        s_device_list,
+        COUNTOF(s_device_list),
+        &count,
+        &error_line
+    );
+    size_t built = (valid) ? BuildDeviceDatabase(
+        s_device_list, count, (BYTE*)s_device_database, sizeof(s_device_database)
+    ) : 0;
+    UnmapViewOfFile(s_devices_view);
+    CloseHandle(s_devices_mapping);
+    CloseHandle(s_devices_file);
+    s_devices_view = 0;
+    s_devices_mapping = 0;
+    s_devices_file = INVALID_HANDLE_VALUE;
+
+    if (!valid) {
+        Log(L"\"%ls\" line %u: invalid device", path, error_line);
+        return false;
+    }
+    Log(L"Loaded %u devices from \"%ls\"", count, path);
+    return built && OpenDeviceDatabase((BYTE*)s_device_database, built, &s_devices);
+}
+
 bool TryInitTablet(PCWSTR path) {
-    EnterCriticalSection(&s_tablet_lock);
-    s_tablet_handle = CreateFileW(path, GENERIC_READ, 0, 0, OPEN_EXISTING, FILE_FLAG_OVERLAPPED, 0);
-    if (s_tablet_handle == INVALID_HANDLE_VALUE) {
-        goto Failure;
+    HANDLE handle = CreateFileW(path, GENERIC_READ, 0, 0, OPEN_EXISTING, FILE_FLAG_OVERLAPPED, 0);
+    if (handle == INVALID_HANDLE_VALUE) {
+        Log(L"Failed to initialize \"%ls\"", path);
+        return false;
     }
 
+    /* only the collection that sends the reports, a tablet has others with the same VID/PID */
     HIDD_ATTRIBUTES attrs = { .Size = sizeof(attrs) };
-    bool valid = 
-        HidD_GetAttributes(s_tablet_handle, &attrs)
-        && FindTabletInfo(attrs.VendorID, attrs.ProductID, &s_tablet_info)
-        && HidD_SetFeature(s_tablet_handle, s_tablet_info.features, s_tablet_info.features_size)
-        && BeginReadingTablet();
+    PHIDP_PREPARSED_DATA preparsed = 0;
+    HIDP_CAPS caps = {0};
+    TabletInfo info;
+    bool valid =
+        HidD_GetAttributes(handle, &attrs)
+        && FindTabletInfo(&s_devices, attrs.VendorID, attrs.ProductID, &info)
+        && HidD_GetPreparsedData(handle, &preparsed)
+        && HidP_GetCaps(preparsed, &caps) == HIDP_STATUS_SUCCESS
+        && caps.InputReportByteLength == info.packet_size
+        && HidD_SetFeature(handle, info.features, info.features_size);
+    if (preparsed) {
+        HidD_FreePreparsedData(preparsed);
+    }
+
+    EnterCriticalSection(&s_tablet_lock);
+    DeviceSlot *tablet = (valid) ? ClaimTablet(&info) : 0;
+    uint32_t device = (tablet) ? GetDeviceIndex(&s_tablets, tablet) : 0;
+    ULONG_PTR key = (tablet) ? TABLET_KEY(device, tablet->generation) : 0;
+    valid = tablet && CreateIoCompletionPort(handle, s_tablet_port, key, 0);
     if (!valid) {
-        goto Failure;
+        if (tablet) {
+            ReleaseDeviceSlot(&s_tablets, tablet);
+        }
+        LeaveCriticalSection(&s_tablet_lock);
+        CloseHandle(handle);
+        Log(L"Failed to initialize \"%ls\"", path);
+        return false;
     }
 
-    Log(L"Initialized %ls at \"%ls\"", s_tablet_info.name, path);
+    s_tablet_handles[device] = handle;
+    CompileTabletPresets(tablet);
+    PostQueuedCompletionStatus(s_tablet_port, 0, key, 0);
     LeaveCriticalSection(&s_tablet_lock);
+    Log(L"Initialized %hs at \"%ls\" as tablet %u", info.name, path, device);
     SetTrayIconTabletActiveStatus(true);
     return true;
+}
 
-    Failure:
-    Log(L"Failed to initialize \"%ls\"", path);
-    CleanUpTablet();
-    LeaveCriticalSection(&s_tablet_lock);
-    return false;
+/* A slot for `info` with a synthetic pen of its own, 0 if there is none. Under s_tablet_lock. */
+DeviceSlot *ClaimTablet(const TabletInfo *info) {
+    DeviceSlot *tablet = ClaimDeviceSlot(&s_tablets, info);
+    if (!tablet)
+        return 0;
+
+    uint32_t device = GetDeviceIndex(&s_tablets, tablet);
+    if (!s_ink_devices[device]) {
+        s_ink_devices[device] = CreateSyntheticPointerDevice(PT_PEN, 1, POINTER_FEEDBACK_DEFAULT);
+    }
+    if (!s_ink_devices[device]) {
+        ReleaseDeviceSlot(&s_tablets, tablet);
+        return 0;
+    }
+    return tablet;
 }
 
-bool BeginReadingTablet(void) {
+bool SubmitTabletRead(void *context, uint32_t slot, uint8_t *buffer, uint32_t capacity) {
+    uint32_t device = (uint32_t)(ULONG_PTR)context;
+    bool submitted =
+        ReadFile(s_tablet_handles[device], buffer, capacity, 0, &s_tablet_reads[device][slot])
+        || GetLastError() == ERROR_IO_PENDING;
+    s_tablet_pending[device] += submitted;
+    return submitted;
+}
+
+/* Only called once the read is known to be done, its completion came through the port. */
+bool WaitForTabletRead(void *context, uint32_t slot, uint32_t *size) {
+    uint32_t device = (uint32_t)(ULONG_PTR)context;
+    DWORD transferred = 0;
+    bool read_ok = GetOverlappedResult(
+        s_tablet_handles[device], &s_tablet_reads[device][slot], &transferred, false
+    );
+    *size = transferred;
+    return read_ok;
+}
+
+/* Reads complete in order, so everything from the oldest read on that is done gets parsed and
+resubmitted, a completion that arrives for a read taken this way early finds nothing to do. */
+void ServiceTablet(DeviceSlot *tablet) {
+    uint32_t device = GetDeviceIndex(&s_tablets, tablet);
+    ReadQueue *queue = &tablet->queue;
+    while (
+        tablet->state == DEVICE_OPEN
+        && HasOverlappedIoCompleted(&s_tablet_reads[device][queue->next])
+    ) {
+        const uint8_t *packet;
+        uint32_t packet_size;
+        if (!WaitForRead(queue, &packet, &packet_size)) {
+            CloseTablet(tablet);
+            break;
+        }
+
+        /* parse before the buffer goes back to the driver */
+        UINT64 now = GetMonotonicNs();
+        RecordPacket(&tablet->info, packet, packet_size, now);
+        QueuePackets(tablet, packet, packet_size, now);
+        if (!ResubmitRead(queue)) {
+            CloseTablet(tablet);
+            break;
+        }
+    }
+    if (tablet->state != DEVICE_CLOSING || s_tablet_pending[device])
+        return;
+
+    Log(L"Tablet %u (%hs) lost after %llu reads", device, tablet->info.name, queue->completions);
+    LogRingCounters(tablet);
     EnterCriticalSection(&s_tablet_lock);
-    bool read_ok = ReadFile(
-        s_tablet_handle, s_tablet_packet, sizeof(s_tablet_packet), 0, &s_tablet_overlapped
-    ) || GetLastError() == ERROR_IO_PENDING;
+    CloseHandle(s_tablet_handles[device]);
+    s_tablet_handles[device] = INVALID_HANDLE_VALUE;
+    ReleaseDeviceSlot(&s_tablets, tablet);
+    bool active = s_tablets.count > 0;
     LeaveCriticalSection(&s_tablet_lock);
-    return read_ok;
+    SetTrayIconTabletActiveStatus(active);
+}
+
+/* Cancels the tablet's reads, ServiceTablet() releases it once all of them are back. */
+void CloseTablet(DeviceSlot *tablet) {
+    AtomicStore32(&tablet->state, DEVICE_CLOSING);
+    CancelIoEx(s_tablet_handles[GetDeviceIndex(&s_tablets, tablet)], 0);
 }
 
-void CleanUpTablet(void) {
+/* At exit, with the reader thread gone. */
+void CleanUpTablets(void) {
     EnterCriticalSection(&s_tablet_lock);
-    CloseHandle(s_tablet_handle);
-    s_tablet_handle = INVALID_HANDLE_VALUE;
-    s_tablet_info = (TabletInfo){0};
-    s_tablet_previous_report = (TabletReport){0};
+    for (uint32_t i = 0; i < DEVICE_TABLE_CAPACITY; i++) {
+        if (s_tablet_handles[i] && s_tablet_handles[i] != INVALID_HANDLE_VALUE) {
+            CloseHandle(s_tablet_handles[i]);
+        }
+        s_tablet_handles[i] = INVALID_HANDLE_VALUE;
+        ReleaseDeviceSlot(&s_tablets, &s_tablets.slots[i]);
+    }
     LeaveCriticalSection(&s_tablet_lock);
 }
 
@@ -350,77 +789,733 @@ DWORD CALLBACK DeviceChangedCallback(
     PCM_NOTIFY_EVENT_DATA data,
     DWORD                 data_size
 ) {
-    EnterCriticalSection(&s_tablet_lock);
-    if (s_tablet_handle == INVALID_HANDLE_VALUE && action == CM_NOTIFY_ACTION_DEVICEINTERFACEARRIVAL) {
+    /* removals show up as failed reads */
+    if (action == CM_NOTIFY_ACTION_DEVICEINTERFACEARRIVAL) {
         TryInitTablet(data->u.DeviceInterface.SymbolicLink);
     }
-    LeaveCriticalSection(&s_tablet_lock);
     return ERROR_SUCCESS;
 }
 
-void SynthesizeInput(const TabletReport *report) {
+DWORD WINAPI ReaderThreadProc(LPVOID arg) {
+    OVERLAPPED_ENTRY entries[TABLET_COMPLETION_BATCH];
+    for (bool is_running = true; is_running; ) {
+        ULONG count = 0;
+        if (!GetQueuedCompletionStatusEx(s_tablet_port, entries, COUNTOF(entries), &count, INFINITE, false))
+            break;
+
+        for (ULONG i = 0; i < count; i++) {
+            ULONG_PTR key = entries[i].lpCompletionKey;
+            if (key == TABLET_STOP_KEY) {
+                is_running = false;
+                continue;
+            }
+
+            DeviceSlot *tablet = &s_tablets.slots[key & 0xff];
+            if (tablet->generation != (uint32_t)(key >> 8))
+                continue;
+
+            if (!entries[i].lpOverlapped) {
+                /* a new tablet, its reads are started from here so only this thread submits them */
+                AsyncReadSource source = {
+                    (void*)(ULONG_PTR)(key & 0xff), SubmitTabletRead, WaitForTabletRead
+                };
+                if (!StartReadQueue(&tablet->queue, &source, s_tablet_read_depth)) {
+                    CloseTablet(tablet);
+                }
+            } else {
+                s_tablet_pending[key & 0xff]--;
+            }
+            ServiceTablet(tablet);
+        }
+    }
+    return 0;
+}
+
+/* Called from the reader or the replay thread, never both for one tablet: a replay has a slot of its
+own. Replays pass capture timestamps moved onto GetMonotonicNs() so filters see the original spacing
+in fast mode too. */
+void QueuePackets(DeviceSlot *tablet, const BYTE *data, DWORD size, UINT64 time_ns) {
+    ParseReportBatch(&tablet->info, data, size, time_ns, &tablet->batch);
+    LATENCY_RECORD(LATENCY_PARSED, time_ns);
+    if (PushReportBatch(&tablet->ring, &tablet->batch, tablet->generation)) {
+        SetEvent(s_ring_event);
+    }
+}
+
+/* Takes a batch off every tablet's ring in turn until all of them are empty, so a tablet sending a
+lot can't hold back the others for longer than a batch. */
+DWORD WINAPI OutputThreadProc(LPVOID arg) {
+    HANDLE events[] = { s_stop_event, s_ring_event, s_output_timer };
+    DWORD event_count = (s_output_timer) ? 3 : 2;
+    UINT64 next_tick = 0;
+    for (bool is_running = true; is_running; ) {
+        /* drain once more after the stop event, e.g. the tail of a replay */
+        DWORD wait = WaitForMultipleObjects(event_count, events, false, INFINITE);
+        is_running = wait == WAIT_OBJECT_0 + 1 || wait == WAIT_OBJECT_0 + 2;
+        for (bool popped = true; popped; ) {
+            popped = false;
+            for (uint32_t i = 0; i < DEVICE_TABLE_CAPACITY; i++) {
+                DeviceSlot *tablet = &s_tablets.slots[i];
+                if (!PopDeviceBatch(tablet, &s_output_batch))
+                    continue;
+
+                popped = true;
+                /* per batch, from its oldest report */
+                LATENCY_RECORD(LATENCY_POPPED, s_output_batch.time_ns[0]);
+                const CompiledPreset *preset = PrepareDeviceBatch(tablet, &s_output_batch);
+                if (s_output_timer) {
+                    PushResamplerBatch(&tablet->resampler, &s_output_batch);
+                    continue;
+                }
+                /* everything that piled up while the last batch was being injected */
+                if (s_output_coalesce) {
+                    uint32_t dropped = CoalesceReportBatch(&s_output_batch, tablet->previous.flags);
+                    tablet->coalesced += dropped;
+                    tablet->coalesced_batches += dropped != 0;
+                }
+                EmitOutputBatch(tablet, preset, &s_output_batch);
+            }
+        }
+        if (s_output_timer && is_running) {
+            next_tick = TickOutput(wait == WAIT_OBJECT_0 + 2, next_tick);
+        }
+    }
+    return 0;
+}
+
+void EmitOutputBatch(DeviceSlot *tablet, const CompiledPreset *preset, ReportBatch *batch) {
+    HSYNTHETICPOINTERDEVICE ink_device = s_ink_devices[GetDeviceIndex(&s_tablets, tablet)];
+    MapReportBatch(preset, batch);
+    if (batch->count) {
+        LATENCY_RECORD(LATENCY_MAPPED, batch->time_ns[0]);
+    }
+    uint32_t count = ComputeOutputFrames(preset, &tablet->previous, batch, s_output_frames);
+    uint32_t emitted = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        if (!ShouldEmitFrame(&tablet->suppressor, &s_output_frames[i], batch->time_ns[i]))
+            continue;
+        s_output_frames[emitted] = s_output_frames[i];
+        s_output_times[emitted++] = batch->time_ns[i];
+    }
+    SynthesizeInput(ink_device, s_output_frames, s_output_times, emitted);
+#ifdef TABD_LATENCY
+    for (uint32_t i = 0; i < emitted; i++) {
+        LATENCY_RECORD(LATENCY_INJECTED, s_output_times[i]);
+    }
+#endif
+}
+
+/* Returns the next tick, 0 while the timer is stopped. The first tick of a stroke is due right
+away, ticks that are already past when the previous one is done are skipped and counted. Every
+tablet with something to play back is sampled on the same ticks. */
+UINT64 TickOutput(bool fired, UINT64 next_tick) {
+    UINT64 now = GetMonotonicNs(), period = s_output_period_ns;
+    if (fired && next_tick) {
+        for (uint32_t i = 0; i < DEVICE_TABLE_CAPACITY; i++) {
+            DeviceSlot *tablet = &s_tablets.slots[i];
+            if (IsResamplerIdle(&tablet->resampler))
+                continue;
+            s_resampled_batch.count = 0;
+            ResampleReports(&tablet->resampler, now, &s_resampled_batch);
+            EmitOutputBatch(tablet, &tablet->preset.copies[tablet->preset.current], &s_resampled_batch);
+        }
+        if (AreResamplersIdle())
+            return 0;
+
+        next_tick += period;
+        if (next_tick <= now) {
+            UINT64 missed = (now - next_tick) / period + 1;
+            s_output_missed_ticks += missed;
+            next_tick += missed * period;
+        }
+    } else if (next_tick || AreResamplersIdle()) {
+        return next_tick;
+    } else {
+        next_tick = now;
+    }
+
+    /* relative due time in 100 ns units, 0 (the distant past) fires right away */
+    LARGE_INTEGER due = { .QuadPart = -(LONGLONG)((next_tick - now) / 100) };
+    SetWaitableTimer(s_output_timer, &due, 0, 0, 0, false);
+    return next_tick;
+}
+
+bool AreResamplersIdle(void) {
+    for (uint32_t i = 0; i < DEVICE_TABLE_CAPACITY; i++) {
+        if (!IsResamplerIdle(&s_tablets.slots[i].resampler))
+            return false;
+    }
+    return true;
+}
+
+/* Every preset is compiled up front so switching is a single index store. */
+void CompileTabletPresets(DeviceSlot *tablet) {
+    EnterCriticalSection(&s_tablet_lock);
+    for (uint32_t i = 0; i < s_preset_count; i++) {
+        CompiledPreset compiled = CompilePresetForLayout(&s_presets[i], &tablet->info, &s_monitors);
+        PublishPreset(&tablet->presets[i], &compiled);
+    }
+    LeaveCriticalSection(&s_tablet_lock);
+}
+
+/* `target` is a tablet's slot + 1, or 0 for every tablet and the ones still to come. */
+void ActivatePreset(uint32_t target, uint32_t preset_idx) {
+    EnterCriticalSection(&s_tablet_lock);
+    if (!target) {
+        AtomicStore32(&s_tablets.preset_idx, preset_idx);
+    }
+    for (uint32_t i = 0; i < DEVICE_TABLE_CAPACITY; i++) {
+        if (!target || i == target - 1) {
+            AtomicStore32(&s_tablets.slots[i].preset_idx, preset_idx);
+        }
+    }
+    LeaveCriticalSection(&s_tablet_lock);
+
+    if (target) {
+        Log(L"Activated \"%ls\" preset on tablet %u", s_preset_names[preset_idx], target - 1);
+    } else {
+        Log(L"Activated \"%ls\" preset", s_preset_names[preset_idx]);
+    }
+}
+
+void InitBuiltInPresets(void) {
+    for (uint32_t i = 0; i < COUNTOF(g_presets); i++) {
+        swprintf_s(s_preset_names[i], PRESET_NAME_CAPACITY, L"%ls", g_presets[i].name);
+        s_presets[i] = g_presets[i];
+        s_presets[i].name = s_preset_names[i];
+    }
+    AtomicStore32(&s_preset_count, COUNTOF(g_presets));
+}
+
+/* Loaded presets replace the built-in ones, which are only kept if there are none. */
+bool LoadPresetDirectory(PCWSTR path) {
+    WCHAR pattern[MAX_PATH];
+    WIN32_FIND_DATAW found;
+    swprintf_s(pattern, MAX_PATH, L"%ls\\*.txt", path);
+    HANDLE find = FindFirstFileW(pattern, &found);
+    if (find == INVALID_HANDLE_VALUE)
+        return false;
+
+    s_presets_path = path;
+    AtomicStore32(&s_preset_count, 0);
+    do {
+        LoadPresetFile(found.cFileName);
+    } while (FindNextFileW(find, &found));
+    FindClose(find);
+
+    if (!s_preset_count) {
+        InitBuiltInPresets();
+        return false;
+    }
+    s_presets_dir = CreateFileW(
+        path,
+        FILE_LIST_DIRECTORY,
+        FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+        0,
+        OPEN_EXISTING,
+        FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED,
+        0
+    );
+    if (s_presets_dir == INVALID_HANDLE_VALUE) {
+        Log(L"Failed to watch \"%ls\" (%d), presets won't reload", path, GetLastError());
+    }
+    return true;
+}
+
+/* Parses `file_name` in the preset directory over the first built-in preset and replaces the preset
+of the same name, or adds it. The new version is compiled and published right away if there is a
+tablet, otherwise it's compiled with the others once there is one. */
+bool LoadPresetFile(PCWSTR file_name) {
+    UINT64 start = GetMonotonicNs();
+    size_t length = wcslen(file_name);
+    if (length <= 4 || length - 4 >= PRESET_NAME_CAPACITY || wcscmp(file_name + length - 4, L".txt"))
+        return false;
+
+    WCHAR path[MAX_PATH];
+    swprintf_s(path, MAX_PATH, L"%ls\\%ls", s_presets_path, file_name);
+
+    /* editors may still have the file open right after the change notification */
+    HANDLE file = INVALID_HANDLE_VALUE;
+    for (int attempt = 0; attempt < 10 && file == INVALID_HANDLE_VALUE; attempt++) {
+        file = CreateFileW(
+            path,
+            GENERIC_READ,
+            FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+            0,
+            OPEN_EXISTING,
+            FILE_ATTRIBUTE_NORMAL,
+            0
+        );
+        if (file == INVALID_HANDLE_VALUE) {
+            Sleep(10);
+        }
+    }
+    if (file == INVALID_HANDLE_VALUE) {
+        Log(L"Failed to open preset \"%ls\" (%d)", path, GetLastError());
+        return false;
+    }
+
+    char text[PRESET_FILE_MAX_SIZE];
+    DWORD size = 0;
+    bool read = ReadFile(file, text, sizeof(text), &size, 0);
+    CloseHandle(file);
+    Preset preset = g_presets[0];
+    uint32_t error_line = 0;
+    if (!read || size == sizeof(text)) {
+        Log(L"Failed to read preset \"%ls\"", path);
+        return false;
+    }
+    if (!ParsePresetFile(text, size, &preset, &error_line)) {
+        Log(L"\"%ls\" line %u: invalid preset setting, keeping the last good one", path, error_line);
+        return false;
+    }
+
+    WCHAR name[PRESET_NAME_CAPACITY];
+    swprintf_s(name, PRESET_NAME_CAPACITY, L"%.*ls", (int)(length - 4), file_name);
     EnterCriticalSection(&s_tablet_lock);
+    uint32_t i = 0;
+    while (i < s_preset_count && wcscmp(s_preset_names[i], name)) {
+        i++;
+    }
+    bool is_new = i == s_preset_count;
+    if (is_new && i == PRESET_CAPACITY) {
+        LeaveCriticalSection(&s_tablet_lock);
+        Log(L"Too many presets, ignoring \"%ls\"", path);
+        return false;
+    }
+
+    swprintf_s(s_preset_names[i], PRESET_NAME_CAPACITY, L"%ls", name);
+    s_presets[i] = preset;
+    s_presets[i].name = s_preset_names[i];
+    for (uint32_t device = 0; device < DEVICE_TABLE_CAPACITY; device++) {
+        DeviceSlot *tablet = &s_tablets.slots[device];
+        if (tablet->state == DEVICE_FREE)
+            continue;
+        CompiledPreset compiled = CompilePresetForLayout(&preset, &tablet->info, &s_monitors);
+        PublishPreset(&tablet->presets[i], &compiled);
+    }
+    if (is_new) {
+        AtomicStore32(&s_preset_count, i + 1);
+    }
+    LeaveCriticalSection(&s_tablet_lock);
+
+    Log(
+        L"%ls \"%ls\" preset in %llu us",
+        (is_new) ? L"Loaded" : L"Reloaded",
+        name,
+        (GetMonotonicNs() - start) / 1000
+    );
+    return true;
+}
+
+DWORD WINAPI PresetWatchThreadProc(LPVOID arg) {
+    HANDLE events[] = { s_stop_event, s_presets_watch.hEvent };
+    for (;;) {
+        DWORD size = 0;
+        bool watching = ReadDirectoryChangesW(
+            s_presets_dir,
+            s_presets_changes,
+            sizeof(s_presets_changes),
+            false,
+            FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_LAST_WRITE,
+            0,
+            &s_presets_watch,
+            0
+        );
+        if (!watching) {
+            Log(L"Stopped watching presets (%d)", GetLastError());
+            break;
+        }
+        if (WaitForMultipleObjects(COUNTOF(events), events, false, INFINITE) != WAIT_OBJECT_0 + 1) {
+            CancelIoEx(s_presets_dir, &s_presets_watch);
+            GetOverlappedResult(s_presets_dir, &s_presets_watch, &size, true);
+            break;
+        }
+        if (!GetOverlappedResult(s_presets_dir, &s_presets_watch, &size, false))
+            continue;
+
+        /* an empty result means the changes didn't fit, only then is everything reparsed */
+        if (!size) {
+            WIN32_FIND_DATAW found;
+            WCHAR pattern[MAX_PATH];
+            swprintf_s(pattern, MAX_PATH, L"%ls\\*.txt", s_presets_path);
+            HANDLE find = FindFirstFileW(pattern, &found);
+            for (bool more = find != INVALID_HANDLE_VALUE; more; more = FindNextFileW(find, &found)) {
+                LoadPresetFile(found.cFileName);
+            }
+            if (find != INVALID_HANDLE_VALUE) {
+                FindClose(find);
+            }
+            continue;
+        }
+
+        /* saving usually shows up as several changes to the same file, it's parsed once */
+        WCHAR previous[MAX_PATH] = {0};
+        const BYTE *p = (const BYTE*)s_presets_changes;
+        for (const FILE_NOTIFY_INFORMATION *info; ; p += info->NextEntryOffset) {
+            info = (const FILE_NOTIFY_INFORMATION*)p;
+            WCHAR name[MAX_PATH];
+            int length = (int)(info->FileNameLength / sizeof(WCHAR));
+            swprintf_s(name, MAX_PATH, L"%.*ls", (length < MAX_PATH) ? length : MAX_PATH - 1, info->FileName);
+            bool gone = info->Action == FILE_ACTION_REMOVED || info->Action == FILE_ACTION_RENAMED_OLD_NAME;
+            if (!gone && wcscmp(name, previous)) {
+                LoadPresetFile(name);
+                swprintf_s(previous, MAX_PATH, L"%ls", name);
+            }
+            if (!info->NextEntryOffset)
+                break;
+        }
+    }
+    return 0;
+}
 
-    const Preset* preset = &g_presets[s_tablet_preset_idx];
-    Vec2 point = MapTabletPointToScreen(preset, &s_tablet_info, report->point);
+void LogRingCounters(const DeviceSlot *tablet) {
+    uint32_t device = GetDeviceIndex(&s_tablets, tablet);
+    Log(
+        L"Tablet %u report ring high-water mark %u/%u, dropped %llu",
+        device,
+        tablet->ring.high_water,
+        REPORT_RING_CAPACITY,
+        tablet->ring.dropped
+    );
+    if (s_output_keep_alive_ns) {
+        Log(
+            L"Tablet %u suppressed %llu repeated frames, %llu injection calls saved",
+            device,
+            tablet->suppressor.suppressed,
+            tablet->suppressor.calls_saved
+        );
+    }
+    if (s_output_coalesce) {
+        Log(
+            L"Tablet %u coalesced %llu reports in %llu batches",
+            device,
+            tablet->coalesced,
+            tablet->coalesced_batches
+        );
+    }
+    if (s_output_timer) {
+        Log(
+            L"Tablet %u resampled %llu samples, %llu edges, %llu held, %llu ticks missed, %llu reports dropped",
+            device,
+            tablet->resampler.samples,
+            tablet->resampler.edges,
+            tablet->resampler.held,
+            s_output_missed_ticks,
+            tablet->resampler.dropped
+        );
+    }
+}
 
-    // FIXME: all of this. its a костыль and should be refactored in the nearest future.
+void LogLatency(void) {
+#ifdef TABD_LATENCY
+    for (int i = 0; i < LATENCY_STAGES; i++) {
+        LatencySummary s = SummarizeLatency(&s_latency[i]);
+        Log(
+            L"Latency %hs: %llu reports, mean %llu us, p50 %llu us, p99 %llu us, p99.9 %llu us, max %llu us",
+            g_latency_stages[i],
+            s.count,
+            s.mean / 1000,
+            s.p50 / 1000,
+            s.p99 / 1000,
+            s.p999 / 1000,
+            s.max / 1000
+        );
+    }
+#endif
+}
 
-    bool b1_down = report->flags & TABLET_REPORT_BUTTON_DOWN(0);
-    bool was_b1_down = s_tablet_previous_report.flags & TABLET_REPORT_BUTTON_DOWN(0);
-    bool b2_down = report->flags & TABLET_REPORT_BUTTON_DOWN(1);
-    bool was_b2_down = s_tablet_previous_report.flags & TABLET_REPORT_BUTTON_DOWN(1);
-    bool pointer_down = report->flags & TABLET_REPORT_POINTER_DOWN;
-    bool was_pointer_down = s_tablet_previous_report.flags & TABLET_REPORT_POINTER_DOWN;
+/* Output thread only. */
+void SynthesizeInput(
+    HSYNTHETICPOINTERDEVICE ink_device, const OutputFrame *frames, const UINT64 *times_ns, uint32_t count
+) {
+    uint32_t calls = PlanOutputCalls(frames, count, s_output_calls);
+    for (uint32_t c = 0; c < calls; c++) {
+        const OutputCall *call = &s_output_calls[c];
+        if (call->kind == OUTPUT_PEN) {
+            POINTER_TYPE_INFO pen = GetPenInput(&frames[call->first], times_ns[call->first]);
+            InjectSyntheticPointerInput(ink_device, &pen, 1);
+            continue;
+        }
+        for (uint32_t i = 0; i < call->count; i++) {
+            s_output_mouse[i] = GetMouseInput(&frames[call->first + i]);
+        }
+        SendInput(call->count, s_output_mouse, sizeof(INPUT));
+    }
+}
 
+INPUT GetMouseInput(const OutputFrame *frame) {
     INPUT mouse = {
         .type = INPUT_MOUSE,
         .mi = (MOUSEINPUT){
-            .dx = point.x * 65535,
-            .dy = point.y * 65535,
-            .dwFlags = MOUSEEVENTF_ABSOLUTE,
+            .dx = frame->absolute.x,
+            .dy = frame->absolute.y,
+            .dwFlags = MOUSEEVENTF_ABSOLUTE | MOUSEEVENTF_VIRTUALDESK,
         },
     };
 
-    POINT pixel_location = { point.x * s_screen_size.x, point.y * s_screen_size.y };
-    POINTER_TYPE_INFO pen = {
+    if      (frame->flags & OUTPUT_LEFT_DOWN)  mouse.mi.dwFlags |= MOUSEEVENTF_LEFTDOWN;
+    else if (frame->flags & OUTPUT_LEFT_UP)    mouse.mi.dwFlags |= MOUSEEVENTF_LEFTUP;
+    if      (frame->flags & OUTPUT_RIGHT_DOWN) mouse.mi.dwFlags |= MOUSEEVENTF_RIGHTDOWN;
+    else if (frame->flags & OUTPUT_RIGHT_UP)   mouse.mi.dwFlags |= MOUSEEVENTF_RIGHTUP;
+    if      (frame->flags & OUTPUT_MOUSE_MOVE) mouse.mi.dwFlags |= MOUSEEVENTF_MOVE;
+    return mouse;
+}
+
+/* Stamped with the report's time rather than left for the system to stamp on injection. */
+POINTER_TYPE_INFO GetPenInput(const OutputFrame *frame, UINT64 time_ns) {
+    POINT pixel_location = { frame->pixel.x, frame->pixel.y };
+    return (POINTER_TYPE_INFO){
         .type = PT_PEN,
         .penInfo = {
             .pointerInfo = {
                 .pointerType = PT_PEN,
                 .hwndTarget = s_ink_foreground_window,
                 .pointerFlags = POINTER_FLAG_INRANGE | (
-                    (pointer_down)
+                    (frame->pointer_down)
                         ? (POINTER_FLAG_INCONTACT | POINTER_FLAG_DOWN)
                         : (POINTER_FLAG_UP)
                 ),
                 .ptPixelLocation = pixel_location,
                 .ptPixelLocationRaw = pixel_location,
+                .PerformanceCount = GetPerformanceCount(time_ns),
             },
             .penMask = PEN_MASK_PRESSURE,
-            .pressure = CLAMP(report->pressure * preset->pressure_sensitivity, 0, 1) * 1024,
+            .pressure = frame->pressure,
         }
     };
+}
+
+BOOL CALLBACK AddMonitorCallback(HMONITOR monitor, HDC hdc, RECT *rect, LPARAM layout) {
+    ScreenRect r = { rect->left, rect->top, rect->right - rect->left, rect->bottom - rect->top };
+    AddMonitor((MonitorLayout*)layout, r);
+    return true;
+}
+
+void RefreshMonitorLayout(void) {
+    MonitorLayout layout = {0};
+    EnumDisplayMonitors(0, 0, AddMonitorCallback, (LPARAM)&layout);
+    if (!layout.count) {
+        AddMonitor(&layout, (ScreenRect){ 0, 0, GetSystemMetrics(SM_CXSCREEN), GetSystemMetrics(SM_CYSCREEN) });
+    }
+    if (!layout.count) {
+        Log(L"No monitors found, keeping the last layout");
+        return;
+    }
+
+    EnterCriticalSection(&s_tablet_lock);
+    s_monitors = layout;
+    for (uint32_t i = 0; i < DEVICE_TABLE_CAPACITY; i++) {
+        if (s_tablets.slots[i].state != DEVICE_FREE) {
+            CompileTabletPresets(&s_tablets.slots[i]);
+        }
+    }
+    LeaveCriticalSection(&s_tablet_lock);
+
+    ScreenRect d = layout.desktop;
+    Log(L"%u monitors, desktop %dx%d at %d,%d", layout.count, d.width, d.height, d.left, d.top);
+}
 
-    if      (pointer_down && !was_pointer_down) mouse.mi.dwFlags |= MOUSEEVENTF_LEFTDOWN;
-    else if (!pointer_down && was_pointer_down) mouse.mi.dwFlags |= MOUSEEVENTF_LEFTUP;
+int GetDisplayRefreshRate(void) {
+    HDC hdc = GetDC(0);
+    int rate = GetDeviceCaps(hdc, VREFRESH);
+    ReleaseDC(0, hdc);
+    return (rate > 1) ? rate : 60; /* 0 and 1 stand for the hardware default */
+}
+
+UINT64 GetMonotonicNs(void) {
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    UINT64 ticks = now.QuadPart, frequency = s_qpc_frequency.QuadPart;
+    return ticks / frequency * 1000000000ull + ticks % frequency * 1000000000ull / frequency;
+}
+
+/* The QueryPerformanceCounter() value GetMonotonicNs() returned `time_ns` for. */
+UINT64 GetPerformanceCount(UINT64 time_ns) {
+    UINT64 frequency = s_qpc_frequency.QuadPart;
+    return time_ns / 1000000000ull * frequency + time_ns % 1000000000ull * frequency / 1000000000ull;
+}
+
+bool StartRecording(PCWSTR path) {
+    s_capture_file = CreateFileW(
+        path, FILE_APPEND_DATA, FILE_SHARE_READ, 0, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, 0
+    );
+    if (s_capture_file == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER size = {0};
+    GetFileSizeEx(s_capture_file, &size);
+    if (!size.QuadPart) {
+        CaptureHeader header;
+        InitCaptureHeader(&header);
+        DWORD written = 0;
+        WriteFile(s_capture_file, &header, sizeof(header), &written, 0);
+    }
+
+    s_capture_event = CreateEventW(0, false, false, 0);
+    s_capture_thread = CreateThread(0, 0, CaptureThreadProc, 0, 0, 0);
+    ASSERT(s_capture_event && s_capture_thread);
+    s_capture_handover_ns = GetMonotonicNs();
+    return true;
+}
 
-    if      (b1_down && !was_b1_down) mouse.mi.dwFlags |= MOUSEEVENTF_RIGHTDOWN;
-    else if (!b1_down && was_b1_down) mouse.mi.dwFlags |= MOUSEEVENTF_RIGHTUP;
+void RecordPacket(const TabletInfo *info, const BYTE *packet, DWORD size, UINT64 now) {
+    if (s_capture_file == INVALID_HANDLE_VALUE)
+        return;
+
+    DWORD record_size = CAPTURE_RECORD_SIZE(size);
+    DWORD *used = &s_capture_sizes[s_capture_active];
+    bool stale = *used && now - s_capture_handover_ns > CAPTURE_HANDOVER_NS;
+    if ((*used + record_size > CAPTURE_BUFFER_SIZE || stale) && HandOverCaptureBuffer()) {
+        s_capture_handover_ns = now;
+        used = &s_capture_sizes[s_capture_active];
+    }
 
-    if (preset->mode == MODE_INK || b2_down) {
-        InjectSyntheticPointerInput(s_ink_device, &pen, 1);
+    if (*used + record_size > CAPTURE_BUFFER_SIZE) {
+        s_capture_dropped++;
+        return;
+    }
 
-        if (b1_down != was_b1_down) {
-            SendInput(1, &mouse, sizeof(mouse));
+    *used += WriteCaptureRecord(
+        s_capture_buffers[s_capture_active] + *used,
+        now,
+        info->vid,
+        info->pid,
+        packet,
+        size
+    );
+    s_capture_recorded++;
+}
+
+bool HandOverCaptureBuffer(void) {
+    if (_InterlockedCompareExchange(&s_capture_pending, s_capture_active, -1) != -1)
+        return false;
+
+    s_capture_active ^= 1;
+    s_capture_sizes[s_capture_active] = 0;
+    SetEvent(s_capture_event);
+    return true;
+}
+
+DWORD WINAPI CaptureThreadProc(LPVOID arg) {
+    for (;;) {
+        WaitForSingleObject(s_capture_event, INFINITE);
+
+        long pending = s_capture_pending;
+        if (pending != -1) {
+            DWORD written = 0;
+            if (!WriteFile(
+                s_capture_file, s_capture_buffers[pending], s_capture_sizes[pending], &written, 0
+            )) {
+                Log(L"WriteFile() error %d", GetLastError());
+            }
+            _InterlockedExchange(&s_capture_pending, -1);
         }
-    } else {
-        mouse.mi.dwFlags |= MOUSEEVENTF_MOVE;
-        SendInput(1, &mouse, sizeof(mouse));
+
+        if (s_capture_stopping)
+            break;
+    }
+    return 0;
+}
+
+void StopRecording(void) {
+    if (s_capture_file == INVALID_HANDLE_VALUE)
+        return;
+
+    /* blocking is fine here, the tablet loop is gone */
+    while (s_capture_sizes[s_capture_active] && !HandOverCaptureBuffer()) {
+        Sleep(1);
     }
+    _InterlockedExchange(&s_capture_stopping, 1);
+    SetEvent(s_capture_event);
+    WaitForSingleObject(s_capture_thread, INFINITE);
+
+    Log(L"Recorded %llu packets, dropped %llu", s_capture_recorded, s_capture_dropped);
+    CloseHandle(s_capture_thread);
+    CloseHandle(s_capture_event);
+    CloseHandle(s_capture_file);
+    s_capture_file = INVALID_HANDLE_VALUE;
+}
+
+bool StartReplay(PCWSTR path, ReplayMode mode) {
+    s_replay_file = CreateFileW(
+        path, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, 0
+    );
+    if (s_replay_file == INVALID_HANDLE_VALUE)
+        return false;
 
-    s_tablet_previous_report = *report;
+    LARGE_INTEGER size = {0};
+    GetFileSizeEx(s_replay_file, &size);
+    s_replay_mapping = CreateFileMappingW(s_replay_file, 0, PAGE_READONLY, 0, 0, 0);
+    s_replay_view = (s_replay_mapping) ? MapViewOfFile(s_replay_mapping, FILE_MAP_READ, 0, 0, 0) : 0;
+
+    /* only the first tablet in the capture is replayed */
+    CaptureRecord first;
+    TabletInfo info;
+    EnterCriticalSection(&s_tablet_lock);
+    bool valid =
+        s_replay_view
+        && InitReplaySource(&s_replay, s_replay_view, size.QuadPart, mode)
+        && PeekReplayRecord(&s_replay, &first)
+        && FindTabletInfo(&s_devices, first.vid, first.pid, &info)
+        && (s_replay_tablet = ClaimTablet(&info));
+    if (valid) {
+        CompileTabletPresets(s_replay_tablet);
+    }
     LeaveCriticalSection(&s_tablet_lock);
+
+    if (!valid) {
+        StopReplay();
+        return false;
+    }
+
+    Log(L"Replaying %hs capture \"%ls\"", info.name, path);
+    SetTrayIconTabletActiveStatus(true);
+    s_replay_thread = CreateThread(0, 0, ReplayThreadProc, 0, 0, 0);
+    ASSERT(s_replay_thread);
+    return true;
+}
+
+DWORD WINAPI ReplayThreadProc(LPVOID arg) {
+    CaptureRecord record;
+    UINT64 due = 0;
+    while (!s_replay_stopping && NextReplayRecord(&s_replay, GetMonotonicNs(), &record, &due)) {
+        if (record.vid != s_replay_tablet->info.vid || record.pid != s_replay_tablet->info.pid)
+            continue;
+
+        /* Sleep() only has millisecond granularity, spin through the last couple of them */
+        for (UINT64 now = GetMonotonicNs(); now < due && !s_replay_stopping; now = GetMonotonicNs()) {
+            if (due - now > 2000000) {
+                Sleep((DWORD)((due - now) / 1000000) - 1);
+            }
+        }
+        QueuePackets(s_replay_tablet, record.packet, record.size, ReplayClockTime(&s_replay, &record));
+    }
+
+    Log(L"Replayed %llu packets (%llu bytes)", s_replay.packets, s_replay.bytes);
+    PostThreadMessageW(s_main_thread_id, WM_QUIT, 0, 0);
+    return 0;
+}
+
+void StopReplay(void) {
+    if (s_replay_thread) {
+        _InterlockedExchange(&s_replay_stopping, 1);
+        WaitForSingleObject(s_replay_thread, INFINITE);
+        CloseHandle(s_replay_thread);
+        s_replay_thread = 0;
+    }
+    if (s_replay_view) {
+        UnmapViewOfFile(s_replay_view);
+        s_replay_view = 0;
+    }
+    if (s_replay_mapping) {
+        CloseHandle(s_replay_mapping);
+        s_replay_mapping = 0;
+    }
+    if (s_replay_file != INVALID_HANDLE_VALUE) {
+        CloseHandle(s_replay_file);
+        s_replay_file = INVALID_HANDLE_VALUE;
+    }
 }
 
 void InitThreadMessageQueue(void) {
@@ -428,31 +1523,171 @@ void InitThreadMessageQueue(void) {
     PeekMessageA(&m, 0, WM_USER, WM_USER, PM_NOREMOVE); 
 }
 
-void _Log(DWORD tid, PCWSTR file, int line, PCSTR func, PCWSTR message, ...) {
-    if (s_hconsole == INVALID_HANDLE_VALUE)
+void _Log(LogSite *site, ...) {
+    LogRing *ring = TlsGetValue(s_log_tls);
+    if (!ring && !(ring = ClaimLogRing())) {
+        _InterlockedIncrement(&s_log_unclaimed);
         return;
-
-    WCHAR buffer[1024];
-    int length = 0;
-
-    length += swprintf_s(
-        buffer + length,
-        sizeof(buffer) - length,
-        L"%lu %ls:%d:%hs() ",
-        tid,
-        PathFindFileNameW(file),
-        line,
-        func
-    );
+    }
 
     va_list args;
-    va_start(args, message);
-    length += vswprintf_s(buffer + length, sizeof(buffer) - length, message, args);
+    va_start(args, site);
+    WriteLog(ring, site, GetCurrentThreadId(), GetMonotonicNs(), args);
     va_end(args);
+    if (GetLogBacklog(ring) == LOG_RING_CAPACITY / 2) {
+        SetEvent(s_log_event);
+    }
+}
 
-    length += swprintf_s(buffer + length, sizeof(buffer) - length, L"\n");
+LogRing *ClaimLogRing(void) {
+    DWORD tid = GetCurrentThreadId();
+    for (int i = 0; i < LOG_THREAD_CAPACITY; i++) {
+        if (!_InterlockedCompareExchange(&s_log_ring_owners[i], (long)tid, 0)) {
+            s_log_ring_threads[i] = OpenThread(SYNCHRONIZE, false, tid);
+            TlsSetValue(s_log_tls, &s_log_rings[i]);
+            return &s_log_rings[i];
+        }
+    }
+    return 0;
+}
 
-    WriteConsoleW(s_hconsole, buffer, length, 0, 0);
+/* Records logged before the log thread starts wait in their rings. */
+void StartLogging(PCWSTR path) {
+    if (path) {
+        s_log_file = CreateFileW(
+            path, FILE_APPEND_DATA, FILE_SHARE_READ, 0, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, 0
+        );
+        if (s_log_file != INVALID_HANDLE_VALUE) {
+            s_log_buffer_size = StartLogFile(
+                &s_log_encoder, GetMonotonicNs(), s_log_buffer, sizeof(s_log_buffer)
+            );
+        } else {
+            Log(L"Failed to open \"%ls\" for logging (%d)", path, GetLastError());
+        }
+    }
+    s_log_thread = CreateThread(0, 0, LogThreadProc, 0, 0, 0);
+    ASSERT(s_log_thread);
+}
+
+DWORD WINAPI LogThreadProc(LPVOID arg) {
+    while (!s_log_stopping) {
+        WaitForSingleObject(s_log_event, LOG_FLUSH_INTERVAL_MS);
+        FlushLogRings();
+    }
+
+    FlushLogRings();
+    UINT64 dropped = s_log_unclaimed;
+    for (int i = 0; i < LOG_THREAD_CAPACITY; i++) {
+        dropped += AtomicLoad32(&s_log_rings[i].dropped);
+    }
+    if (dropped) {
+        Log(L"Dropped %llu log records", dropped);
+        FlushLogRings();
+    }
+    return 0;
+}
+
+/* Writes out every ring's records oldest first, then gives back the rings of exited threads. */
+void FlushLogRings(void) {
+    WCHAR line[LOG_LINE_CAPACITY];
+    for (;;) {
+        LogRing *oldest = 0;
+        for (int i = 0; i < LOG_THREAD_CAPACITY; i++) {
+            const LogRecord *r = (s_log_ring_owners[i]) ? PeekLog(&s_log_rings[i]) : 0;
+            if (r && (!oldest || r->time_ns < PeekLog(oldest)->time_ns)) {
+                oldest = &s_log_rings[i];
+            }
+        }
+        if (!oldest)
+            break;
+
+        const LogRecord *r = PeekLog(oldest);
+        if (s_hconsole) {
+            WriteConsoleW(s_hconsole, line, FormatLogRecord(r, line, COUNTOF(line)), 0, 0);
+        }
+        if (s_log_file != INVALID_HANDLE_VALUE) {
+            DWORD size = EncodeLogRecord(
+                &s_log_encoder, r, s_log_buffer + s_log_buffer_size, sizeof(s_log_buffer) - s_log_buffer_size
+            );
+            if (!size) {
+                WriteLogFile();
+                size = EncodeLogRecord(&s_log_encoder, r, s_log_buffer, sizeof(s_log_buffer));
+            }
+            s_log_buffer_size += size;
+        }
+        ReleaseLog(oldest);
+    }
+    WriteLogFile();
+
+    for (int i = 0; i < LOG_THREAD_CAPACITY; i++) {
+        HANDLE thread = s_log_ring_threads[i];
+        if (
+            thread
+            && !PeekLog(&s_log_rings[i])
+            && WaitForSingleObject(thread, 0) == WAIT_OBJECT_0
+        ) {
+            CloseHandle(thread);
+            s_log_ring_threads[i] = 0;
+            _InterlockedExchange(&s_log_ring_owners[i], 0);
+        }
+    }
+}
+
+void WriteLogFile(void) {
+    if (s_log_file != INVALID_HANDLE_VALUE && s_log_buffer_size) {
+        DWORD written;
+        WriteFile(s_log_file, s_log_buffer, s_log_buffer_size, &written, 0);
+        s_log_buffer_size = 0;
+    }
+}
+
+void StopLogging(void) {
+    _InterlockedExchange(&s_log_stopping, 1);
+    SetEvent(s_log_event);
+    WaitForSingleObject(s_log_thread, INFINITE);
+    CloseHandle(s_log_thread);
+    if (s_log_file != INVALID_HANDLE_VALUE) {
+        CloseHandle(s_log_file);
+    }
+}
+
+/* Writes a --log file to the console as text, the log thread isn't running yet. */
+bool DecodeLogFile(PCWSTR path) {
+    HANDLE file = CreateFileW(
+        path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, 0, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, 0
+    );
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER size = {0};
+    GetFileSizeEx(file, &size);
+    HANDLE mapping = (size.QuadPart) ? CreateFileMappingW(file, 0, PAGE_READONLY, 0, 0, 0) : 0;
+    const BYTE *view = (mapping) ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : 0;
+
+    WCHAR line[LOG_LINE_CAPACITY];
+    size_t offset = 0;
+    while (view && offset < (size_t)size.QuadPart) {
+        uint32_t length;
+        uint32_t entry_size = DecodeLogEntry(
+            &s_log_decoder, view + offset, size.QuadPart - offset, line, COUNTOF(line), &length
+        );
+        if (!entry_size)
+            break;
+        if (length && s_hconsole) {
+            WriteConsoleW(s_hconsole, line, length, 0, 0);
+        }
+        offset += entry_size;
+    }
+    bool decoded = view && offset == (size_t)size.QuadPart;
+    if (view && !decoded && s_hconsole) {
+        int length = swprintf_s(line, COUNTOF(line), L"Malformed entry at byte %llu\n", (UINT64)offset);
+        WriteConsoleW(s_hconsole, line, length, 0, 0);
+    }
+
+    if (view) UnmapViewOfFile(view);
+    if (mapping) CloseHandle(mapping);
+    CloseHandle(file);
+    return decoded;
 }
 
 void WinEventHookCallback(
@@ -467,7 +1702,5 @@ void WinEventHookCallback(
     if (event != EVENT_SYSTEM_FOREGROUND)
         return;
 
-    EnterCriticalSection(&s_tablet_lock);
     s_ink_foreground_window = hwnd;
-    LeaveCriticalSection(&s_tablet_lock);
 }
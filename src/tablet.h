@@ -1,53 +1,303 @@
 #ifndef _TABD_TABLETS_H
 #define _TABD_TABLETS_H
 
-#include "util.h"
+#include "base.h"
 
 #define TABLET_REPORT_POINTER_DOWN 0x01
 #define TABLET_REPORT_BUTTON_DOWN(_n) (1 << (_n) + 1)
 
+/* Where REPORT_PLAN_WORDS reports keep their values, see ReportPlanKind. */
+#define WORD_REPORT_X        2
+#define WORD_REPORT_Y        4
+#define WORD_REPORT_PRESSURE 6
+
+/* Coordinates and pressure are raw sensor units, see TabletInfo's logical maximums. */
 typedef struct {
-    Vec2 point;
-    float pressure;
-    DWORD flags;
+    int32_t x, y;
+    uint32_t pressure;
+    uint32_t flags;
 } TabletReport;
 
+/* Where a report keeps a value. Fields are little-endian, LSB first like HID's, and at most 25 bits
+wide. A field of size 0 is absent and reads as 0. Only coordinates can be signed. */
+typedef struct {
+    uint16_t bit_offset;
+    uint8_t bit_size;
+    bool is_signed;
+} ReportField;
+
+/* Compact description of a tablet's report in place of a hand-written parser, usually read straight
+off its HID report descriptor or OpenTabletDriver's parser. A report is valid when its first byte is
+`report_id` (unless that is 0) and `status` is non-zero, e.g. pen in range. */
+typedef struct {
+    uint8_t report_id;
+    ReportField status;
+    ReportField x, y, pressure;
+    ReportField tip;
+    ReportField buttons; /* consecutive bits, the lowest one is TABLET_REPORT_BUTTON_DOWN(0) */
+} ReportLayout;
+
+/* A field compiled to a 32-bit load, a multiply, a mask and a sign fix-up, see
+ExtractReportField(). Shifting right by `shift` is done as multiplying by 2^(32 - shift) and keeping
+the upper half: a shift by a variable amount costs several micro-ops on x64 without BMI2. Validity
+tests don't need the value, they mask the field in place and compare it with `value`: a report must
+have the ID (`==`) and must not have a zero status (`!=`). An absent field always passes.
+
+Most layouts keep every value on a byte boundary and have a status in the first 4 bytes. Their
+plans are REPORT_PLAN_ALIGNED: one load for both tests and a load and a mask per value, no multiply
+or sign fix-up. Most tablets go further and share one layout, the CTL-672's: the ID in byte 0, the
+status and the flags in byte 1, then x, y and pressure as 16-bit words (WORD_REPORT_X and so on).
+Their plans are REPORT_PLAN_WORDS and parse the way a hand-written parser does, with loads at fixed
+offsets; only the ID and the status and flags masks come from the plan. */
+typedef enum {
+    REPORT_PLAN_SHIFTED,
+    REPORT_PLAN_ALIGNED,
+    REPORT_PLAN_WORDS,
+} ReportPlanKind;
+
+typedef struct {
+    uint64_t multiplier;
+    uint32_t byte;
+    uint32_t mask;
+    uint32_t sign;
+} FieldExtractor;
+
+typedef struct {
+    uint32_t byte;
+    uint32_t mask;
+    uint32_t value;
+} FieldTest;
+
+typedef struct {
+    uint32_t size;
+    ReportPlanKind kind;
+    FieldTest id, status;
+    FieldExtractor x, y, pressure;
+    FieldExtractor flags;   /* the tip, and the buttons right above it */
+    FieldExtractor buttons; /* buttons elsewhere in the report */
+} ReportPlan;
+
+/* Plain data without pointers so devicedb.h can store it as is. */
 typedef struct {
-    const WCHAR *name;
-    USHORT vid, pid;
+    char name[48]; /* UTF-8 */
+    uint16_t vid, pid;
     Vec2 measurements;
-    BYTE features[64];
-    DWORD features_size;
-    bool (*Parse)(BYTE *packet, DWORD size, TabletReport *report);
+    int32_t max_x, max_y, max_pressure;
+    uint32_t packet_size; /* a single read may return several reports back to back */
+    uint8_t features[64];
+    uint32_t features_size;
+    ReportLayout layout;
+    ReportPlan plan; /* compiled from `layout` when the device is looked up */
 } TabletInfo;
 
-static bool WacomCTL672PacketParser(BYTE *packet, DWORD size, TabletReport *report);
-
+/* Built-in devices, used when no device database is given. */
 static const TabletInfo s_tablet_infos[] = {
-    { L"Wacom CTL-672", 1386, 891, { 216, 135 }, { 0x02, 0x02 }, 2, WacomCTL672PacketParser },
+    {
+        "Wacom CTL-672", 1386, 891, { 216, 135 }, 0x5460, 0x34BC, 2047, 10,
+        { 0x02, 0x02 }, 2,
+        {
+            .report_id = 0x02,
+            .status = { 8, 7 },
+            .x = { 16, 16 },
+            .y = { 32, 16 },
+            .pressure = { 48, 16 },
+            .tip = { 8, 1 },
+            .buttons = { 9, 3 },
+        },
+        {0},
+    },
 };
 
-bool FindTabletInfo(USHORT vid, USHORT pid, TabletInfo *info) {
-    for (unsigned int i = 0; i < COUNTOF(s_tablet_infos); i++) {
-        if (s_tablet_infos[i].vid == vid && s_tablet_infos[i].pid == pid) {
-            *info = s_tablet_infos[i];
-            return true;
-        }
-    }
-    return false;
+/* The 32-bit window is moved back at the end of the packet so it never reads past it. */
+static bool LocateReportField(
+    const ReportField *field, uint32_t packet_size, uint32_t *byte, uint32_t *shift
+) {
+    *byte = field->bit_offset / 8;
+    *byte = (*byte + 4 > packet_size) ? packet_size - 4 : *byte;
+    *shift = field->bit_offset - *byte * 8;
+    return field->bit_size <= 25 && *shift + field->bit_size <= 32;
+}
+
+static bool CompileReportField(const ReportField *field, uint32_t packet_size, FieldExtractor *f) {
+    uint32_t byte, shift;
+    *f = (FieldExtractor){0};
+    if (!field->bit_size)
+        return true;
+    if (!LocateReportField(field, packet_size, &byte, &shift))
+        return false;
+
+    *f = (FieldExtractor){
+        .multiplier = 1ull << (32 - shift),
+        .byte = byte,
+        .mask = (uint32_t)((1ull << field->bit_size) - 1),
+        .sign = (field->is_signed) ? 1u << (field->bit_size - 1) : 0,
+    };
+    return true;
+}
+
+static bool CompileReportTest(
+    const ReportField *field, uint32_t packet_size, uint32_t value, uint32_t absent, FieldTest *t
+) {
+    uint32_t byte = 0, shift = field->bit_offset;
+    *t = (FieldTest){ .value = absent };
+    if (!field->bit_size)
+        return true;
+    /* the first 4 bytes whenever the field lies there, they are loaded for the ID anyway */
+    if (shift + field->bit_size > 32 && !LocateReportField(field, packet_size, &byte, &shift))
+        return false;
+
+    *t = (FieldTest){
+        .byte = byte,
+        .mask = (uint32_t)((1ull << field->bit_size) - 1) << shift,
+        .value = value << shift,
+    };
+    return true;
 }
 
-bool WacomCTL672PacketParser(BYTE *packet, DWORD size, TabletReport *report) {
-    if (size != 10 || packet[0] != 0x02 || (packet[1] == 0x00 || packet[1] == 0x80))
+bool CompileReportLayout(const ReportLayout *layout, uint32_t packet_size, ReportPlan *plan) {
+    if (packet_size < 4)
         return false;
 
+    ReportField id = { 0, (layout->report_id) ? 8 : 0, false };
+    ReportField x = layout->x, y = layout->y, pressure = layout->pressure;
+    ReportField flags = layout->tip, buttons = layout->buttons;
+    pressure.is_signed = flags.is_signed = buttons.is_signed = false;
+    if (flags.bit_size == 1 && buttons.bit_offset == flags.bit_offset + 1) {
+        flags.bit_size += buttons.bit_size;
+        buttons = (ReportField){0};
+    }
+
+    *plan = (ReportPlan){ .size = packet_size };
+    bool valid = CompileReportTest(&id, packet_size, layout->report_id, 0, &plan->id)
+        && CompileReportTest(&layout->status, packet_size, 0, 1, &plan->status)
+        && CompileReportField(&x, packet_size, &plan->x)
+        && CompileReportField(&y, packet_size, &plan->y)
+        && CompileReportField(&pressure, packet_size, &plan->pressure)
+        && CompileReportField(&flags, packet_size, &plan->flags)
+        && CompileReportField(&buttons, packet_size, &plan->buttons);
+
+    const FieldExtractor *values[] = { &plan->x, &plan->y, &plan->pressure, &plan->flags, &plan->buttons };
+    bool aligned = !plan->buttons.mask && plan->status.mask && !plan->status.byte;
+    for (unsigned int i = 0; i < COUNTOF(values); i++) {
+        /* absent fields have no mask and read as 0 either way */
+        aligned &= (values[i]->multiplier == 1ull << 32 || !values[i]->mask) && !values[i]->sign;
+    }
+    bool words = plan->id.mask == 0xFF
+        && plan->flags.byte == 1 && plan->flags.mask <= 0xFFFFFF
+        && plan->x.byte == WORD_REPORT_X && plan->x.mask == 0xFFFF
+        && plan->y.byte == WORD_REPORT_Y && plan->y.mask == 0xFFFF
+        && plan->pressure.byte == WORD_REPORT_PRESSURE && plan->pressure.mask == 0xFFFF;
+    plan->kind = (!aligned) ? REPORT_PLAN_SHIFTED : (words) ? REPORT_PLAN_WORDS : REPORT_PLAN_ALIGNED;
+    return valid;
+}
+
+static uint32_t LoadReportWindow(const uint8_t *packet, uint32_t byte) {
+    uint32_t window;
+    memcpy(&window, packet + byte, sizeof(window));
+    return window;
+}
+
+static uint32_t ExtractAlignedField(const FieldExtractor *f, const uint8_t *packet) {
+    return LoadReportWindow(packet, f->byte) & f->mask;
+}
+
+static uint32_t ExtractWord(const uint8_t *packet, uint32_t byte) {
+    uint16_t word;
+    memcpy(&word, packet + byte, sizeof(word));
+    return word;
+}
+
+static uint32_t ExtractUnsignedField(const FieldExtractor *f, const uint8_t *packet) {
+    return (uint32_t)(LoadReportWindow(packet, f->byte) * f->multiplier >> 32) & f->mask;
+}
+
+static int32_t ExtractReportField(const FieldExtractor *f, const uint8_t *packet) {
+    uint32_t value = ExtractUnsignedField(f, packet);
+    return (int32_t)((value ^ f->sign) - f->sign);
+}
+
+/* The ID always sits in the first 4 bytes and the status usually does, both are tested without
+branching in between. */
+static bool IsReportValid(const ReportPlan *plan, const uint8_t *packet) {
+    uint32_t head = LoadReportWindow(packet, 0);
+    uint32_t status = LoadReportWindow(packet, plan->status.byte);
+    return ((head & plan->id.mask) == plan->id.value)
+        & ((status & plan->status.mask) != plan->status.value);
+}
+
+/* Aligned plans have a status in the first 4 bytes: one load serves both tests, and the status only
+has to be non-zero, which leaves its `value` out of the loops' registers. */
+static bool IsAlignedReportValid(FieldTest id, uint32_t status_mask, const uint8_t *packet) {
+    uint32_t head = LoadReportWindow(packet, 0);
+    return (head & id.mask) == id.value && (head & status_mask);
+}
+
+/* A REPORT_PLAN_WORDS report's ID is all of byte 0 and its flags are in `head` as well. */
+static bool IsWordReportValid(uint8_t id, uint32_t status_mask, uint32_t head) {
+    return (uint8_t)head == id && (head & status_mask);
+}
+
+static void ExtractWordReport(
+    uint32_t flags_mask, uint32_t head, const uint8_t *packet, TabletReport *report
+) {
+    *report = (TabletReport){
+        .x = (int32_t)ExtractWord(packet, WORD_REPORT_X),
+        .y = (int32_t)ExtractWord(packet, WORD_REPORT_Y),
+        .pressure = ExtractWord(packet, WORD_REPORT_PRESSURE),
+        .flags = head >> 8 & flags_mask,
+    };
+}
+
+static void ExtractReport(const ReportPlan *plan, const uint8_t *packet, TabletReport *report) {
     *report = (TabletReport){
-        .point.x  = *(USHORT*)(packet + 2) / (float)0x5460,
-        .point.y  = *(USHORT*)(packet + 4) / (float)0x34BC,
-        .pressure = *(USHORT*)(packet + 6) / 2047.0f,
-        .flags = packet[1] & 0x0F,
+        .x = ExtractReportField(&plan->x, packet),
+        .y = ExtractReportField(&plan->y, packet),
+        .pressure = ExtractUnsignedField(&plan->pressure, packet),
+        .flags = ExtractUnsignedField(&plan->flags, packet)
+            | ExtractUnsignedField(&plan->buttons, packet) << 1,
     };
+}
+
+static bool ParseShiftedReport(const ReportPlan *plan, const uint8_t *packet, TabletReport *report) {
+    if (!IsReportValid(plan, packet))
+        return false;
+    ExtractReport(plan, packet, report);
+    return true;
+}
+
+/* Runs the tablet's compiled plan, the same few operations for every field of every report.
+ParseReportBatch() picks the kind of plan once per read instead. Inlined into loops over packets,
+where the plan is read before anything else so the compiler can keep it in registers like a
+hand-written parser's constants. */
+static INLINE bool ParseReport(
+    const TabletInfo *tablet, const uint8_t *packet, uint32_t size, TabletReport *report
+) {
+    const ReportPlan *plan = &tablet->plan;
+    const ReportPlanKind kind = plan->kind;
+    const uint32_t plan_size = plan->size;
+    const FieldTest id = plan->id;
+    const uint32_t status_mask = plan->status.mask;
+    const FieldExtractor x = plan->x, y = plan->y, pressure = plan->pressure, flags = plan->flags;
+    if (size != plan_size)
+        return false;
+    if (kind == REPORT_PLAN_WORDS) {
+        uint32_t head = LoadReportWindow(packet, 0);
+        if (!IsWordReportValid((uint8_t)id.value, status_mask, head))
+            return false;
+        ExtractWordReport(flags.mask, head, packet, report);
+        return true;
+    }
+    if (kind == REPORT_PLAN_SHIFTED)
+        return ParseShiftedReport(plan, packet, report);
+    if (!IsAlignedReportValid(id, status_mask, packet))
+        return false;
 
+    *report = (TabletReport){
+        .x = (int32_t)ExtractAlignedField(&x, packet),
+        .y = (int32_t)ExtractAlignedField(&y, packet),
+        .pressure = ExtractAlignedField(&pressure, packet),
+        .flags = ExtractAlignedField(&flags, packet),
+    };
     return true;
 }
 
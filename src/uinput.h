@@ -0,0 +1,261 @@
+#ifndef _TABD_UINPUT_H
+#define _TABD_UINPUT_H
+
+/* Linux output backend, the counterpart of tabd.c's SynthesizeInput(): OutputFrames are injected
+through two uinput devices, a pen tablet for OUTPUT_PEN frames and an absolute mouse for OUTPUT_MOUSE
+ones.
+
+    pen    ABS_X/ABS_Y in screen pixels, ABS_PRESSURE 0..1024, BTN_TOOL_PEN while the pen is in range,
+           BTN_TOUCH for the tip and BTN_STYLUS for the first barrel button (the right click
+           SynthesizeInput() sends as a mouse event next to pen frames)
+    mouse  ABS_X/ABS_Y in MOUSEINPUT absolute units (0..65535), BTN_LEFT and BTN_RIGHT
+
+All events of a frame go to one device in a single write() ending with its SYN_REPORT, so a report
+costs one syscall. The only exception is a mouse frame while the pen is in range (the second barrel
+button was let go) which first takes the pen out of range with a write of its own.
+
+SynthesizeUinputBatch() injects the frames pending at once in as few writes as there are runs of
+frames for the same device: uinput takes any number of events per write() and every SYN_REPORT still
+ends a frame of its own for readers, so strokes keep their full resolution. Each frame of a batch
+carries its report's time as MSC_TIMESTAMP (microseconds, wrapping) since evdev stamps all events of a
+write with the time of the write.
+
+The null and recording sinks take the same frames without /dev/uinput: the null one only counts
+writes and events, the recording one keeps the events for tabd-bench to check. */
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/uinput.h>
+#include <stdio.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#include "base.h"
+#include "output.h"
+
+#define UINPUT_FRAME_EVENTS 8   /* most events a frame encodes to per device, SYN_REPORT included */
+#define UINPUT_BATCH_EVENTS 512 /* most events per write() */
+#define UINPUT_PRESSURE_MAX 1024
+
+typedef enum {
+    UINPUT_DEVICE,
+    UINPUT_NULL,
+    UINPUT_RECORDING,
+} UinputSinkKind;
+
+typedef enum {
+    UINPUT_PEN,
+    UINPUT_MOUSE,
+    UINPUT_DEVICES,
+} UinputDevice;
+
+typedef struct {
+    uint16_t device; /* UinputDevice */
+    uint16_t type;
+    uint16_t code;
+    int32_t value;
+} UinputEvent;
+
+typedef struct {
+    UinputSinkKind kind;
+    int fds[UINPUT_DEVICES]; /* UINPUT_DEVICE only */
+    bool pen_in_range;
+    uint64_t frames;
+    uint64_t writes;
+    uint64_t events;
+    uint64_t failed; /* writes the device didn't take */
+
+    /* events not written yet, all for the same device */
+    struct input_event pending[UINPUT_BATCH_EVENTS];
+    uint32_t pending_count;
+    UinputDevice pending_device;
+
+    /* UINPUT_RECORDING only, events past the capacity are counted but not kept */
+    UinputEvent *recorded;
+    uint32_t recorded_capacity;
+    uint32_t recorded_count;
+} Uinput;
+
+static void InitUinputSink(Uinput *u, UinputSinkKind kind) {
+    *u = (Uinput){ .kind = kind, .fds = { -1, -1 } };
+}
+
+void InitUinputNull(Uinput *u) {
+    InitUinputSink(u, UINPUT_NULL);
+}
+
+void InitUinputRecording(Uinput *u, UinputEvent *buffer, uint32_t capacity) {
+    InitUinputSink(u, UINPUT_RECORDING);
+    u->recorded = buffer;
+    u->recorded_capacity = capacity;
+}
+
+static bool SetUinputAxis(int fd, uint16_t code, int32_t maximum) {
+    struct uinput_abs_setup abs = { .code = code, .absinfo = { .maximum = maximum } };
+    return !ioctl(fd, UI_SET_ABSBIT, code) && !ioctl(fd, UI_ABS_SETUP, &abs);
+}
+
+static int CreateUinputDevice(const char *name, const uint16_t *keys, uint32_t key_count, IVec2 range, bool pen) {
+    int fd = open("/dev/uinput", O_WRONLY | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0)
+        return -1;
+
+    struct uinput_setup setup = { .id = { .bustype = BUS_VIRTUAL, .vendor = 0x7464, .product = 1 + pen } };
+    snprintf(setup.name, sizeof(setup.name), "%s", name);
+    bool valid =
+        !ioctl(fd, UI_SET_EVBIT, EV_KEY)
+        && !ioctl(fd, UI_SET_EVBIT, EV_ABS)
+        && !ioctl(fd, UI_SET_EVBIT, EV_SYN)
+        && !ioctl(fd, UI_SET_EVBIT, EV_MSC)
+        && !ioctl(fd, UI_SET_MSCBIT, MSC_TIMESTAMP)
+        && SetUinputAxis(fd, ABS_X, range.x)
+        && SetUinputAxis(fd, ABS_Y, range.y)
+        && (!pen || SetUinputAxis(fd, ABS_PRESSURE, UINPUT_PRESSURE_MAX))
+        && (!pen || !ioctl(fd, UI_SET_PROPBIT, INPUT_PROP_DIRECT));
+    for (uint32_t i = 0; valid && i < key_count; i++) {
+        valid = !ioctl(fd, UI_SET_KEYBIT, keys[i]);
+    }
+    if (!valid || ioctl(fd, UI_DEV_SETUP, &setup) || ioctl(fd, UI_DEV_CREATE)) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/* Creates the pen and mouse devices, the pen's axes span a `screen` sized desktop. False with errno
+set if /dev/uinput can't be opened or doesn't take them. */
+bool OpenUinput(Uinput *u, IVec2 screen) {
+    static const uint16_t pen_keys[] = { BTN_TOOL_PEN, BTN_TOUCH, BTN_STYLUS };
+    static const uint16_t mouse_keys[] = { BTN_LEFT, BTN_RIGHT };
+
+    InitUinputSink(u, UINPUT_DEVICE);
+    u->fds[UINPUT_PEN] = CreateUinputDevice(
+        "tabd pen", pen_keys, COUNTOF(pen_keys), (IVec2){ screen.x - 1, screen.y - 1 }, true
+    );
+    u->fds[UINPUT_MOUSE] = CreateUinputDevice(
+        "tabd mouse", mouse_keys, COUNTOF(mouse_keys), (IVec2){ 65535, 65535 }, false
+    );
+    if (u->fds[UINPUT_PEN] < 0 || u->fds[UINPUT_MOUSE] < 0) {
+        int error = errno;
+        for (int i = 0; i < UINPUT_DEVICES; i++) {
+            if (u->fds[i] >= 0) close(u->fds[i]);
+        }
+        errno = error;
+        return false;
+    }
+    return true;
+}
+
+void CloseUinput(Uinput *u) {
+    for (int i = 0; i < UINPUT_DEVICES; i++) {
+        if (u->fds[i] >= 0) {
+            ioctl(u->fds[i], UI_DEV_DESTROY);
+            close(u->fds[i]);
+        }
+        u->fds[i] = -1;
+    }
+}
+
+static void FlushUinput(Uinput *u) {
+    if (!u->pending_count)
+        return;
+    uint32_t count = u->pending_count;
+    u->pending_count = 0;
+    u->writes++;
+    u->events += count;
+    switch (u->kind) {
+    case UINPUT_DEVICE: {
+        ssize_t size = count * sizeof(*u->pending);
+        u->failed += write(u->fds[u->pending_device], u->pending, size) != size;
+        break;
+    }
+    case UINPUT_NULL:
+        break;
+    case UINPUT_RECORDING:
+        for (uint32_t i = 0; i < count && u->recorded_count < u->recorded_capacity; i++) {
+            struct input_event *e = &u->pending[i];
+            u->recorded[u->recorded_count++] = (UinputEvent){ u->pending_device, e->type, e->code, e->value };
+        }
+        break;
+    }
+}
+
+static void PutUinputEvent(Uinput *u, UinputDevice device, uint16_t type, uint16_t code, int32_t value) {
+    if (u->pending_count && u->pending_device != device) {
+        FlushUinput(u);
+    }
+    u->pending_device = device;
+    u->pending[u->pending_count++] = (struct input_event){ .type = type, .code = code, .value = value };
+}
+
+/* Queues a frame's events, stamped with `*time_ns` if there is one. */
+static void PutUinputFrame(Uinput *u, const OutputFrame *frame, const uint64_t *time_ns) {
+    if (u->pending_count > UINPUT_BATCH_EVENTS - UINPUT_FRAME_EVENTS) {
+        FlushUinput(u);
+    }
+    int32_t timestamp = (time_ns) ? (int32_t)(uint32_t)(*time_ns / 1000) : 0;
+    u->frames++;
+
+    if (frame->flags & OUTPUT_PEN) {
+        /* coming into range mid-stroke (the second barrel button was pressed) also sets the tip */
+        bool entering = !u->pen_in_range;
+        if (entering) {
+            PutUinputEvent(u, UINPUT_PEN, EV_KEY, BTN_TOOL_PEN, 1);
+            u->pen_in_range = true;
+        }
+        PutUinputEvent(u, UINPUT_PEN, EV_ABS, ABS_X, frame->pixel.x);
+        PutUinputEvent(u, UINPUT_PEN, EV_ABS, ABS_Y, frame->pixel.y);
+        PutUinputEvent(u, UINPUT_PEN, EV_ABS, ABS_PRESSURE, (frame->pointer_down) ? frame->pressure : 0);
+        if (frame->flags & (OUTPUT_LEFT_DOWN | OUTPUT_LEFT_UP) || entering) {
+            PutUinputEvent(u, UINPUT_PEN, EV_KEY, BTN_TOUCH, frame->pointer_down);
+        }
+        if (frame->flags & (OUTPUT_RIGHT_DOWN | OUTPUT_RIGHT_UP)) {
+            PutUinputEvent(u, UINPUT_PEN, EV_KEY, BTN_STYLUS, !!(frame->flags & OUTPUT_RIGHT_DOWN));
+        }
+        if (time_ns) {
+            PutUinputEvent(u, UINPUT_PEN, EV_MSC, MSC_TIMESTAMP, timestamp);
+        }
+        PutUinputEvent(u, UINPUT_PEN, EV_SYN, SYN_REPORT, 0);
+        return;
+    }
+    if (!(frame->flags & OUTPUT_MOUSE))
+        return;
+
+    if (u->pen_in_range) {
+        PutUinputEvent(u, UINPUT_PEN, EV_ABS, ABS_PRESSURE, 0);
+        PutUinputEvent(u, UINPUT_PEN, EV_KEY, BTN_TOUCH, 0);
+        PutUinputEvent(u, UINPUT_PEN, EV_KEY, BTN_TOOL_PEN, 0);
+        PutUinputEvent(u, UINPUT_PEN, EV_SYN, SYN_REPORT, 0);
+        FlushUinput(u);
+        u->pen_in_range = false;
+    }
+    uint32_t count = u->pending_count;
+    if (frame->flags & OUTPUT_MOUSE_MOVE) {
+        PutUinputEvent(u, UINPUT_MOUSE, EV_ABS, ABS_X, frame->absolute.x);
+        PutUinputEvent(u, UINPUT_MOUSE, EV_ABS, ABS_Y, frame->absolute.y);
+    }
+    if      (frame->flags & OUTPUT_LEFT_DOWN)  PutUinputEvent(u, UINPUT_MOUSE, EV_KEY, BTN_LEFT, 1);
+    else if (frame->flags & OUTPUT_LEFT_UP)    PutUinputEvent(u, UINPUT_MOUSE, EV_KEY, BTN_LEFT, 0);
+    if      (frame->flags & OUTPUT_RIGHT_DOWN) PutUinputEvent(u, UINPUT_MOUSE, EV_KEY, BTN_RIGHT, 1);
+    else if (frame->flags & OUTPUT_RIGHT_UP)   PutUinputEvent(u, UINPUT_MOUSE, EV_KEY, BTN_RIGHT, 0);
+    if (u->pending_count != count) {
+        if (time_ns) {
+            PutUinputEvent(u, UINPUT_MOUSE, EV_MSC, MSC_TIMESTAMP, timestamp);
+        }
+        PutUinputEvent(u, UINPUT_MOUSE, EV_SYN, SYN_REPORT, 0);
+    }
+}
+
+void SynthesizeUinput(Uinput *u, const OutputFrame *frame) {
+    PutUinputFrame(u, frame, 0);
+    FlushUinput(u);
+}
+
+/* `count` frames with their reports' times, see above. */
+void SynthesizeUinputBatch(Uinput *u, const OutputFrame *frames, const uint64_t *times_ns, uint32_t count) {
+    for (uint32_t i = 0; i < count; i++) {
+        PutUinputFrame(u, &frames[i], &times_ns[i]);
+    }
+    FlushUinput(u);
+}
+
+#endif /* _TABD_UINPUT_H */
@@ -1,40 +1,17 @@
 #ifndef _TABD_UTIL_H
 #define _TABD_UTIL_H
 
-/* misc */
-typedef unsigned short wchar_t;
-typedef struct {
-    float x, y;
-} Vec2;
+#include "base.h"
 
+/* misc */
 #define _CHAR_LITERAL_TO_WCHAR_2(_x) L ## _x
 #define CHAR_LITERAL_TO_WCHAR(_x) _CHAR_LITERAL_TO_WCHAR_2(_x)
 #define __WFILE__ CHAR_LITERAL_TO_WCHAR(__FILE__)
-#define COUNTOF(_a) (sizeof(_a)/sizeof((_a)[0]))
-#define TRAP() __debugbreak()
-#define ASSERT(_e) do { if (!(_e)) TRAP(); } while(0)
-#define CLAMP(_v, _min, _max) ((_v) < (_min) ? (_min) : ((_v) > (_max) ? (_max) : (_v)))
 
 
 /* stdlib */
-#pragma comment(lib, "ucrt.lib")
-#pragma comment(lib, "vcruntime.lib")
-
-typedef unsigned __int64 size_t;
-typedef unsigned char bool;
-typedef char* va_list;
 typedef void *_locale_t;
 
-#define true 1
-#define false 0
-#define va_start(_list, _arg) ((void)__va_start(&(_list), (_arg)))
-#define va_end(_list) ((void)((_list) = (va_list)0))
-
-double __cdecl sin(double _X);
-double __cdecl cos(double _X);
-void __cdecl __va_start(va_list* , ...);
-void *memset(void *dest, int c, size_t count);
-void *memcpy(void *dest, const void *src, size_t count);
 int __cdecl __stdio_common_vsnwprintf_s(
     size_t         _Options,
     wchar_t*       _Buffer,
@@ -55,10 +32,15 @@ int vswprintf_s(wchar_t *buffer, size_t size, const wchar_t *format, va_list arg
     return __stdio_common_vsnwprintf_s(0, buffer, size, size-1, format, 0, args);
 }
 
+int wcscmp(const wchar_t *a, const wchar_t *b);
+size_t wcslen(const wchar_t *str);
+int _wtoi(const wchar_t *str);
+
 
 /* windows.h */
 #pragma comment(lib, "hid.lib")
 #pragma comment(lib, "user32.lib")
+#pragma comment(lib, "gdi32.lib")
 #pragma comment(lib, "shell32.lib")
 #pragma comment(lib, "kernel32.lib")
 
@@ -69,15 +51,23 @@ typedef unsigned char UCHAR, BYTE, BOOLEAN;
 typedef int BOOL, INT32;
 typedef long LONG;
 typedef unsigned long ULONG, *PULONG;
-typedef __int64 LONG_PTR, LPARAM, LRESULT;
+typedef __int64 LONG_PTR, LPARAM, LRESULT, LONGLONG;
 typedef unsigned int DWORD, *PDWORD, *LPDWORD, UINT, UINT32;
-typedef unsigned short USHORT, WCHAR, *PWSTR, WORD, ATOM;
+typedef unsigned short USHORT, WCHAR, *PWSTR, *LPWSTR, WORD, ATOM;
 typedef void VOID, *PVOID, *LPVOID;
+typedef const void *LPCVOID;
 typedef PVOID HANDLE, HWND, HMENU, HINSTANCE, HICON, HCURSOR, HBRUSH, HMODULE, 
-HSYNTHETICPOINTERDEVICE, HWINEVENTHOOK;
-typedef const PWSTR PCWSTR, LPCWSTR;
+HSYNTHETICPOINTERDEVICE, HWINEVENTHOOK, HDC, HMONITOR;
+typedef const WCHAR *PCWSTR, *LPCWSTR;
 typedef const char *PCSTR, *LPSTR, *LPCSTR;
 typedef unsigned __int64 ULONG_PTR, UINT_PTR, SIZE_T, DWORD_PTR, WPARAM, UINT64;
+typedef union _LARGE_INTEGER {
+  struct {
+    DWORD LowPart;
+    LONG  HighPart;
+  } DUMMYSTRUCTNAME;
+  LONGLONG QuadPart;
+} LARGE_INTEGER, *PLARGE_INTEGER;
 typedef struct _OVERLAPPED {
   ULONG_PTR Internal;
   ULONG_PTR InternalHigh;
@@ -199,6 +189,31 @@ typedef struct _HIDD_ATTRIBUTES {
   USHORT ProductID;
   USHORT VersionNumber;
 } HIDD_ATTRIBUTES, *PHIDD_ATTRIBUTES;
+typedef struct _HIDP_PREPARSED_DATA *PHIDP_PREPARSED_DATA;
+typedef struct _HIDP_CAPS {
+  USHORT Usage;
+  USHORT UsagePage;
+  USHORT InputReportByteLength;
+  USHORT OutputReportByteLength;
+  USHORT FeatureReportByteLength;
+  USHORT Reserved[17];
+  USHORT NumberLinkCollectionNodes;
+  USHORT NumberInputButtonCaps;
+  USHORT NumberInputValueCaps;
+  USHORT NumberInputDataIndices;
+  USHORT NumberOutputButtonCaps;
+  USHORT NumberOutputValueCaps;
+  USHORT NumberOutputDataIndices;
+  USHORT NumberFeatureButtonCaps;
+  USHORT NumberFeatureValueCaps;
+  USHORT NumberFeatureDataIndices;
+} HIDP_CAPS, *PHIDP_CAPS;
+typedef struct _OVERLAPPED_ENTRY {
+  ULONG_PTR    lpCompletionKey;
+  LPOVERLAPPED lpOverlapped;
+  ULONG_PTR    Internal;
+  DWORD        dwNumberOfBytesTransferred;
+} OVERLAPPED_ENTRY, *LPOVERLAPPED_ENTRY;
 enum {
     PT_POINTER = 1,
     PT_TOUCH   = 2,
@@ -272,6 +287,7 @@ typedef struct tagPOINTER_TYPE_INFO {
         POINTER_PEN_INFO   penInfo;
     };
 }POINTER_TYPE_INFO, *PPOINTER_TYPE_INFO;
+typedef BOOL (CALLBACK* MONITORENUMPROC)(HMONITOR hMonitor, HDC hdc, RECT *lprcMonitor, LPARAM dwData);
 typedef VOID (CALLBACK* WINEVENTPROC)(
     HWINEVENTHOOK hWinEventHook,
     DWORD         event,
@@ -290,9 +306,24 @@ typedef VOID (CALLBACK* WINEVENTPROC)(
 #define GENERIC_WRITE                      0x40000000L
 #define FILE_SHARE_READ                    0x00000001
 #define FILE_SHARE_WRITE                   0x00000002
+#define FILE_SHARE_DELETE                  0x00000004
+#define FILE_LIST_DIRECTORY                0x00000001
+#define FILE_FLAG_BACKUP_SEMANTICS         0x02000000
+#define FILE_NOTIFY_CHANGE_FILE_NAME       0x00000001
+#define FILE_NOTIFY_CHANGE_LAST_WRITE      0x00000010
+#define FILE_ACTION_REMOVED                0x00000002
+#define FILE_ACTION_RENAMED_OLD_NAME       0x00000004
+#define MAX_PATH                           260
 #define OPEN_EXISTING                      3
+#define OPEN_ALWAYS                        4
+#define FILE_APPEND_DATA                   0x00000004
+#define FILE_ATTRIBUTE_NORMAL              0x00000080
+#define FILE_FLAG_SEQUENTIAL_SCAN          0x08000000
+#define PAGE_READONLY                      0x02
+#define FILE_MAP_READ                      0x0004
 #define FILE_FLAG_OVERLAPPED               0x40000000
 #define WM_QUIT                            0x0012
+#define WM_DISPLAYCHANGE                   0x007E
 #define WM_RBUTTONDOWN                     0x0204
 #define WM_USER                            0x0400
 #define PM_NOREMOVE                        0x0000
@@ -303,9 +334,19 @@ typedef VOID (CALLBACK* WINEVENTPROC)(
 #define TPM_NONOTIFY                       0x0080L
 #define TPM_RETURNCMD                      0x0100L
 #define WAIT_OBJECT_0                      0x00000000L
+#define SYNCHRONIZE                        0x00100000L
+#define TLS_OUT_OF_INDEXES                 0xFFFFFFFF
 #define WAIT_ABANDONED_0                   0x00000080L
+#define THREAD_PRIORITY_HIGHEST            2
+#define THREAD_PRIORITY_TIME_CRITICAL      15
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002
+#define TIMER_ALL_ACCESS                   0x001F0003
+#define VREFRESH                           116
 #define QS_ALLINPUT                        0x047B
 #define ERROR_IO_PENDING                   997
+#define STATUS_PENDING                     0x00000103L
+#define HIDP_STATUS_SUCCESS                0x00110000L
+#define HasOverlappedIoCompleted(lpOverlapped) (((DWORD)(lpOverlapped)->Internal) != STATUS_PENDING)
 #define INPUT_MOUSE                        0
 #define INPUT_KEYBOARD                     1
 #define INPUT_HARDWARE                     2
@@ -314,6 +355,7 @@ typedef VOID (CALLBACK* WINEVENTPROC)(
 #define MOUSEEVENTF_LEFTUP                 0x0004
 #define MOUSEEVENTF_RIGHTDOWN              0x0008
 #define MOUSEEVENTF_RIGHTUP                0x0010
+#define MOUSEEVENTF_VIRTUALDESK            0x4000
 #define MOUSEEVENTF_ABSOLUTE               0x8000
 #define SM_CXSCREEN                        0
 #define SM_CYSCREEN                        1
@@ -366,13 +408,115 @@ HANDLE CreateFileW(
     DWORD                 dwFlagsAndAttributes,
     HANDLE                hTemplateFile
 );
+typedef struct _FILETIME {
+    DWORD dwLowDateTime;
+    DWORD dwHighDateTime;
+} FILETIME;
+
+typedef struct _WIN32_FIND_DATAW {
+    DWORD    dwFileAttributes;
+    FILETIME ftCreationTime;
+    FILETIME ftLastAccessTime;
+    FILETIME ftLastWriteTime;
+    DWORD    nFileSizeHigh;
+    DWORD    nFileSizeLow;
+    DWORD    dwReserved0;
+    DWORD    dwReserved1;
+    WCHAR    cFileName[MAX_PATH];
+    WCHAR    cAlternateFileName[14];
+} WIN32_FIND_DATAW;
+
+typedef struct _FILE_NOTIFY_INFORMATION {
+    DWORD NextEntryOffset;
+    DWORD Action;
+    DWORD FileNameLength; /* bytes, not terminated */
+    WCHAR FileName[1];
+} FILE_NOTIFY_INFORMATION;
+
+HANDLE FindFirstFileW(LPCWSTR lpFileName, WIN32_FIND_DATAW *lpFindFileData);
+BOOL FindNextFileW(HANDLE hFindFile, WIN32_FIND_DATAW *lpFindFileData);
+BOOL FindClose(HANDLE hFindFile);
+BOOL ReadDirectoryChangesW(
+    HANDLE       hDirectory,
+    LPVOID       lpBuffer,
+    DWORD        nBufferLength,
+    BOOL         bWatchSubtree,
+    DWORD        dwNotifyFilter,
+    LPDWORD      lpBytesReturned,
+    LPOVERLAPPED lpOverlapped,
+    PVOID        lpCompletionRoutine
+);
+BOOL CancelIoEx(HANDLE hFile, LPOVERLAPPED lpOverlapped);
+HANDLE CreateIoCompletionPort(
+    HANDLE    FileHandle,
+    HANDLE    ExistingCompletionPort,
+    ULONG_PTR CompletionKey,
+    DWORD     NumberOfConcurrentThreads
+);
+BOOL GetQueuedCompletionStatusEx(
+    HANDLE             CompletionPort,
+    LPOVERLAPPED_ENTRY lpCompletionPortEntries,
+    ULONG              ulCount,
+    PULONG             ulNumEntriesRemoved,
+    DWORD              dwMilliseconds,
+    BOOL               fAlertable
+);
+BOOL PostQueuedCompletionStatus(
+    HANDLE       CompletionPort,
+    DWORD        dwNumberOfBytesTransferred,
+    ULONG_PTR    dwCompletionKey,
+    LPOVERLAPPED lpOverlapped
+);
 BOOL ReadFile(HANDLE file, LPVOID buf, DWORD size, LPDWORD read, LPOVERLAPPED ol);
+BOOL WriteFile(HANDLE file, const void *buf, DWORD size, LPDWORD written, LPOVERLAPPED ol);
+BOOL GetFileSizeEx(HANDLE hFile, PLARGE_INTEGER lpFileSize);
+HANDLE CreateFileMappingW(
+    HANDLE                hFile,
+    LPSECURITY_ATTRIBUTES lpFileMappingAttributes,
+    DWORD                 flProtect,
+    DWORD                 dwMaximumSizeHigh,
+    DWORD                 dwMaximumSizeLow,
+    LPCWSTR               lpName
+);
+LPVOID MapViewOfFile(
+    HANDLE hFileMappingObject,
+    DWORD  dwDesiredAccess,
+    DWORD  dwFileOffsetHigh,
+    DWORD  dwFileOffsetLow,
+    SIZE_T dwNumberOfBytesToMap
+);
+BOOL UnmapViewOfFile(LPCVOID lpBaseAddress);
+BOOL SetEvent(HANDLE hEvent);
+void Sleep(DWORD dwMilliseconds);
+BOOL QueryPerformanceCounter(LARGE_INTEGER *lpPerformanceCount);
+BOOL QueryPerformanceFrequency(LARGE_INTEGER *lpFrequency);
+LPWSTR GetCommandLineW(void);
+PVOID LocalFree(PVOID hMem);
+long _InterlockedExchange(long volatile *Target, long Value);
+long _InterlockedCompareExchange(long volatile *Destination, long Exchange, long Comparand);
+long _InterlockedIncrement(long volatile *Addend);
+#pragma intrinsic(_InterlockedExchange, _InterlockedCompareExchange, _InterlockedIncrement)
 HANDLE CreateEventW(
     PVOID   lpEventAttributes,
     BOOL    bManualReset,
     BOOL    bInitialState,
     LPCWSTR lpName
 );
+HANDLE CreateWaitableTimerExW(
+    LPSECURITY_ATTRIBUTES lpTimerAttributes,
+    LPCWSTR               lpTimerName,
+    DWORD                 dwFlags,
+    DWORD                 dwDesiredAccess
+);
+BOOL SetWaitableTimer(
+    HANDLE              hTimer,
+    const LARGE_INTEGER *lpDueTime,
+    LONG                lPeriod,
+    PVOID               pfnCompletionRoutine,
+    LPVOID              lpArgToCompletionRoutine,
+    BOOL                fResume
+);
+BOOL CancelWaitableTimer(HANDLE hTimer);
 BOOL GetOverlappedResult(
     HANDLE       hFile,
     LPOVERLAPPED lpOverlapped,
@@ -395,6 +539,10 @@ VOID EnterCriticalSection(LPCRITICAL_SECTION lpCriticalSection);
 VOID LeaveCriticalSection(LPCRITICAL_SECTION lpCriticalSection);
 VOID DeleteCriticalSection(LPCRITICAL_SECTION lpCriticalSection);
 DWORD GetCurrentThreadId(void);
+HANDLE OpenThread(DWORD dwDesiredAccess, BOOL bInheritHandle, DWORD dwThreadId);
+DWORD TlsAlloc(void);
+LPVOID TlsGetValue(DWORD dwTlsIndex);
+BOOL TlsSetValue(DWORD dwTlsIndex, LPVOID lpTlsValue);
 HANDLE CreateThread(
     LPSECURITY_ATTRIBUTES   lpThreadAttributes,
     SIZE_T                  dwStackSize,
@@ -403,8 +551,12 @@ HANDLE CreateThread(
     DWORD                   dwCreationFlags,
     LPDWORD                 lpThreadId
 );
+BOOL SetThreadPriority(HANDLE hThread, int nPriority);
 HMODULE WINAPI GetModuleHandleW(LPCWSTR lpModuleName);
 UINT SendInput(UINT cInputs, LPINPUT pInputs, int cbSize);
+HDC GetDC(HWND hWnd);
+int ReleaseDC(HWND hWnd, HDC hDC);
+int GetDeviceCaps(HDC hdc, int index);
 ATOM WINAPI RegisterClassExW(const WNDCLASSEXW *cls);
 BOOL WINAPI UnregisterClassW(LPCWSTR lpClassName, HINSTANCE hInstance);
 HWND WINAPI CreateWindowExW(
@@ -434,6 +586,7 @@ DWORD MsgWaitForMultipleObjects(
     DWORD         dwWakeMask
 );
 int GetSystemMetrics(int nIndex);
+BOOL EnumDisplayMonitors(HDC hdc, const RECT *lprcClip, MONITORENUMPROC lpfnEnum, LPARAM dwData);
 BOOL PostThreadMessageW(DWORD idThread, UINT Msg, WPARAM wParam, LPARAM lParam);
 HICON WINAPI LoadIconW(HINSTANCE hInstance, LPCWSTR lpIconName);
 HMENU WINAPI CreateMenu(void);
@@ -445,6 +598,9 @@ BOOL GetCursorPos(LPPOINT lpPoint);
 BOOL SetForegroundWindow(HWND hWnd);
 BOOLEAN HidD_GetAttributes(HANDLE HidDeviceObject, PHIDD_ATTRIBUTES Attributes);
 BOOLEAN HidD_SetFeature(HANDLE HidDeviceObject, PVOID ReportBuffer, ULONG ReportBufferLength);
+BOOLEAN HidD_GetPreparsedData(HANDLE HidDeviceObject, PHIDP_PREPARSED_DATA *PreparsedData);
+BOOLEAN HidD_FreePreparsedData(PHIDP_PREPARSED_DATA PreparsedData);
+LONG HidP_GetCaps(PHIDP_PREPARSED_DATA PreparsedData, PHIDP_CAPS Capabilities);
 HWND GetForegroundWindow(void);
 HSYNTHETICPOINTERDEVICE WINAPI CreateSyntheticPointerDevice(
     POINTER_INPUT_TYPE pointerType, ULONG maxCount, POINTER_FEEDBACK_MODE mode
@@ -498,6 +654,7 @@ typedef struct _NOTIFYICONDATAW {
 } NOTIFYICONDATAW, *PNOTIFYICONDATAW;
 
 LPCWSTR PathFindFileNameW(LPCWSTR pszPath);
+LPWSTR *CommandLineToArgvW(LPCWSTR lpCmdLine, int *pNumArgs);
 BOOL Shell_NotifyIconW(DWORD dwMessage, PNOTIFYICONDATAW lpData);
 
 